@@ -15,6 +15,7 @@ autor: Тарасенко А.И.
 #include <QThread>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QReadWriteLock>
 #include <QMetaType>
 
 #include "databasecontroller.h"
@@ -153,6 +154,14 @@ Request::Request(
 {
 }
 
+//! Условие поиска запроса по номеру
+struct RequestNumber
+{
+    RequestNumber(uint n) : number(n) {}
+    bool operator()(const Request *r) const { return r->number == number; }
+    uint number;
+};
+
 /********************** PriorityQueue **************************/
 
 //! Класс - Очередь с приоритетом
@@ -222,6 +231,22 @@ public:
         throw 0;
     }
 
+    //---------------------------------------------------------------
+    //! Извлечь из очереди первый элемент, удовлетворяющий условию
+    //! \param pred условие
+    //! \param item извлечённый элемент
+    //! \returns истина, если элемент найден
+    template <typename Predicate>
+    inline bool take(Predicate pred, T &item) {
+        for (typename VectorQT::iterator it = _queues.begin(); it != _queues.end(); ++it)
+            for (int i = 0; i < it->size(); ++i)
+                if (pred(it->at(i))) {
+                    item = it->takeAt(i);
+                    return true;
+                }
+        return false;
+    }
+
     //---------------------------------------------------------------
     //! количество элементов в очереди
     inline int count() const {
@@ -307,12 +332,95 @@ bool DbTransactor::rollback()
 
 typedef QPair<QPointer<QObject>, QByteArray> DCHandler;
 
+//! Соединение с БД, используемое одним потоком
+class DCConnection
+{
+    public:
+        //! Подготовленный запрос в кэше
+        struct Statement
+        {
+            QSqlQuery *query;  //!< запрос
+            quint64    used;   //!< отметка последнего использования (LRU)
+            bool       active; //!< результат еще читается (execQueryEach), вытеснять нельзя
+        };
+
+        DCConnection() : inTransaction(false), tick(0) {}
+        //! Закрыть соединение и очистить кэш запросов
+        void close();
+        //! Очистить кэш запросов
+        void clearStatements();
+        //! Вытеснить давно не использованный запрос, кроме выполняемых
+        void evictStatement();
+
+        QSqlDatabase                db;            //!< дискриптор БД
+        bool                        inTransaction; //!< признак открытой транзакции
+        QHash<QString, Statement>   statements;    //!< кэш подготовленных запросов
+        quint64                     tick;          //!< счетчик обращений к кэшу
+};
+
+//---------------------------------------------------------------
+void DCConnection::close()
+{
+    clearStatements();
+    if (db.isOpen())
+        db.close();
+    inTransaction = false;
+}
+
+//---------------------------------------------------------------
+void DCConnection::clearStatements()
+{
+    foreach (const Statement &s, statements)
+        delete s.query;
+    statements.clear();
+}
+
+//---------------------------------------------------------------
+void DCConnection::evictStatement()
+{
+    QHash<QString, Statement>::iterator victim = statements.end();
+    for (QHash<QString, Statement>::iterator it = statements.begin(); it != statements.end(); ++it)
+        if (!it->active && (victim == statements.end() || it->used < victim->used))
+            victim = it;
+    // все запросы выполняются - кэш временно растет
+    if (victim == statements.end())
+        return;
+    delete victim->query;
+    statements.erase(victim);
+}
+
+class DatabaseControllerPrivate;
+
+//! Поток - читатель БД (режим пула)
+class DCReader : public QThread
+{
+    public:
+        DCReader(DatabaseControllerPrivate *data, const QString &driverName, const QVariantMap &connectionData, const QString &logicName)
+            : d(data), driver(driverName), connData(connectionData), name(logicName) { setObjectName("DC Reader-" + logicName); }
+
+    protected:
+        void run();
+
+    private:
+        DatabaseControllerPrivate *d;
+        QString     driver;   //!< драйвер СУБД
+        QVariantMap connData; //!< данные соединения с БД
+        QString     name;     //!< логическое имя соединения
+};
+
 //! Класс данных контроллера БД
 class DatabaseControllerPrivate
 {
     public:
     DatabaseControllerPrivate()
-        : requestQueue(5) {}
+        : requestQueue(5), readQueue(5) {}
+
+        //! Вызвать обработчик запроса и передать результат получателю
+        static void execute(Request *request, const DCHandler &handler);
+        //! Соединение текущего потока. NULL для постороннего потока
+        DCConnection *connection(QThread *mainThread);
+        //! Остановить и удалить потоки-читатели
+        void stopReaders();
 
         bool           beInited; //!< истина - если инициализация прошла успешно, иначе - ложь
         bool           needQuit; //!< признак необходимости выхода
@@ -320,14 +428,137 @@ class DatabaseControllerPrivate
         QWaitCondition wait;     //!< ожидание новых данных
         QThread        thread;   //!< поток работы БД
         int            number;   //!< номер текущего запроса БД
-        QSqlDatabase   db;       //!< дискриптор БД
+        DCConnection   mainConn; //!< соединение потока БД (единственный писатель)
 
-        bool                     inTransaction; //!< признак открытой транзакции
         QHash<uint, DCHandler>   handlers;      //!< список обработчиков
         QHash<uint, QString >    handlerNames;  //!< список имён обработчиков (отладочная информация)
+        QSet<uint>               readOnly;      //!< обработчики только для чтения
         PriorityQueue<Request *> requestQueue;  //!< очередь запросов
+
+        QWaitCondition           readWait;      //!< ожидание новых запросов на чтение
+        PriorityQueue<Request *> readQueue;     //!< очередь запросов на чтение (режим пула)
+        QList<DCReader *>        readers;       //!< потоки-читатели
+
+        QReadWriteLock                     readersLock; //!< защита списка соединений читателей
+        QHash<QThread *, DCConnection *>   readerConnections; //!< соединения потоков-читателей
 };
 
+//---------------------------------------------------------------
+void DatabaseControllerPrivate::execute(Request *request, const DCHandler &handler)
+{
+    if (handler.first.isNull()) {
+        qWarning() << "The handler has disconnected before his request was processed.";
+        return;
+    }
+
+    QVariant result;
+    QVariant errors;
+    if (!QMetaObject::invokeMethod(
+                handler.first,
+                handler.second,
+                Qt::DirectConnection,
+                Q_ARG(QVariant, request->parameters),
+                Q_ARG(QVariant&, result),
+                Q_ARG(QVariant&, errors)
+                ))
+        qWarning() << QString::fromUtf8("ERROR: no invoke slot %1 for %2").arg(handler.second.constData()).arg(handler.first->objectName());
+
+    if (request->sender.isNull() || request->callBack.isEmpty())
+        return;
+    if (!QMetaObject::invokeMethod(
+                request->sender.data(),
+                request->callBack,
+                Qt::QueuedConnection,
+                Q_ARG(uint, request->number),
+                Q_ARG(QVariant, result),
+                Q_ARG(QVariant, errors)
+                ))
+        qWarning() << QString::fromUtf8("ERROR: no invoke slot %1 for %2").arg(request->callBack.constData()).arg(request->sender.data()->objectName());
+}
+
+//---------------------------------------------------------------
+DCConnection *DatabaseControllerPrivate::connection(QThread *mainThread)
+{
+    QThread *current = QThread::currentThread();
+    if (current == mainThread)
+        return &mainConn;
+
+    QReadLocker locker(&readersLock);
+    return readerConnections.value(current);
+}
+
+//---------------------------------------------------------------
+void DatabaseControllerPrivate::stopReaders()
+{
+    QList<DCReader *> tmp;
+    {
+        QMutexLocker locker(&mutex);
+        tmp.swap(readers);
+        readWait.wakeAll();
+    }
+    foreach (DCReader *reader, tmp) {
+        reader->wait();
+        delete reader;
+    }
+}
+
+//---------------------------------------------------------------
+void DCReader::run()
+{
+    DCConnection conn;
+    conn.db = QSqlDatabase::addDatabase(driver, name);
+    conn.db.setDatabaseName(connData.value("name").toString());
+    conn.db.setUserName    (connData.value("user").toString());
+    conn.db.setPassword    (connData.value("pass").toString());
+    conn.db.setHostName    (connData.value("host").toString());
+    conn.db.setPort        (connData.value("port").toInt());
+
+    if (!conn.db.open())
+        qWarning() << "Unable to connect reader to database " << conn.db.lastError().text();
+    else {
+        QSqlQuery query(conn.db);
+        if (!query.exec("PRAGMA query_only=ON;"))
+            qWarning() << "Failed to set reader connection read only " << query.lastError();
+        query.finish();
+
+        {
+            QWriteLocker locker(&d->readersLock);
+            d->readerConnections.insert(this, &conn);
+        }
+
+        Request *request = NULL;
+        DCHandler handler;
+        forever {
+            if (request) {
+                delete request;
+                request = NULL;
+            }
+
+            { // считать запрос из очереди
+                QMutexLocker locker(&d->mutex);
+
+                while (d->readQueue.isEmpty() && !d->needQuit)
+                    d->readWait.wait(&d->mutex);
+                if (d->needQuit)
+                    break;
+                request = d->readQueue.dequeue();
+                handler = d->handlers.value(request->request);
+            } // end - считать запрос
+
+            DatabaseControllerPrivate::execute(request, handler);
+        } // forever
+
+        {
+            QWriteLocker locker(&d->readersLock);
+            d->readerConnections.remove(this);
+        }
+    }
+
+    conn.close();
+    conn.db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(name);
+}
+
 /********************** DatabaseController **************************/
 
 //---------------------------------------------------------------
@@ -340,7 +571,6 @@ DatabaseController::DatabaseController() :
     d->number        = 0;
     d->beInited      = false;
     d->needQuit      = false;
-    d->inTransaction = false;
     d->thread.setObjectName("DC Thread");
 
     // регистрация новых типов данных
@@ -360,6 +590,7 @@ DatabaseController::~DatabaseController()
     done();
     d->thread.quit();
     d->thread.wait();
+    d->mainConn.clearStatements();
     delete d_ptr;
 }
 
@@ -416,30 +647,30 @@ bool DatabaseController::init(
     }
 
     if (QSqlDatabase::contains(dbLogicName_p))
-        d->db = QSqlDatabase::database(dbLogicName_p);
+        d->mainConn.db = QSqlDatabase::database(dbLogicName_p);
     else {
-        d->db = QSqlDatabase::addDatabase(driver, dbLogicName_p);
-        d->db.setDatabaseName(connData.value("name").toString());
-        d->db.setUserName    (connData.value("user").toString());
-        d->db.setPassword    (connData.value("pass").toString());
-        d->db.setHostName    (connData.value("host").toString());
-        d->db.setPort        (connData.value("port").toInt());
-    }
-    if (!d->db.isOpen()) {
-        if (!d->db.open()) {
+        d->mainConn.db = QSqlDatabase::addDatabase(driver, dbLogicName_p);
+        d->mainConn.db.setDatabaseName(connData.value("name").toString());
+        d->mainConn.db.setUserName    (connData.value("user").toString());
+        d->mainConn.db.setPassword    (connData.value("pass").toString());
+        d->mainConn.db.setHostName    (connData.value("host").toString());
+        d->mainConn.db.setPort        (connData.value("port").toInt());
+    }
+    if (!d->mainConn.db.isOpen()) {
+        if (!d->mainConn.db.open()) {
             if (errorStringPtr)
-                *errorStringPtr = "Unable to connect to database " + d->db.lastError().text();
+                *errorStringPtr = "Unable to connect to database " + d->mainConn.db.lastError().text();
             return false;
         }
     }
 
 //    QString errorString;
-//    if (!sqliteMemoryFile(d->db, d->fileDb, false, &errorString)) {
+//    if (!sqliteMemoryFile(d->mainConn.db, d->fileDb, false, &errorString)) {
 //        qWarning() << errorString << "[" << d->fileDb << "]";
     //    }
 
     if (driver == "QSQLITE") {
-        QSqlQuery query(d->db);
+        QSqlQuery query(d->mainConn.db);
 
         #define ExecPragma(sql, err) \
             if (!query.exec(sql)) { \
@@ -471,9 +702,30 @@ bool DatabaseController::init(
 #endif
     }
 
+    // пул читателей: WAL позволяет читать параллельно с записью
+    QString fileName = connData.value("name").toString();
+    int readers = qBound(0, connData.value("readers").toInt(), int(MaxReaders));
+    if (driver != "QSQLITE" || fileName.isEmpty() || fileName == ":memory:")
+        readers = 0;
+    if (readers > 0) {
+        QSqlQuery query(d->mainConn.db);
+        if (!query.exec("PRAGMA journal_mode=WAL;") || !query.first() || query.value(0).toString().toLower() != "wal") {
+            qWarning() << "Failed to enable WAL journal, reader pool disabled";
+            readers = 0;
+        }
+        else if (!query.exec("PRAGMA synchronous=NORMAL;"))
+            qWarning() << "Failed to set synchronous mode " << query.lastError();
+    }
+
     d->needQuit = false;
     d->beInited = true;
 
+    for (int i = 0; i < readers; ++i) {
+        DCReader *reader = new DCReader(d, driver, connData, QString("%1-R%2").arg(dbLogicName_p).arg(i + 1));
+        d->readers.append(reader);
+        reader->start();
+    }
+
     if (!QMetaObject::invokeMethod(
                 this,
                 "mainProcessing",
@@ -503,15 +755,21 @@ bool DatabaseController::done()
 
         d->handlers.clear();
         d->handlerNames.clear();
+        d->readOnly.clear();
         try {
             for (int i = d->requestQueue.count(); i; --i)
                 delete d->requestQueue.dequeue();
+            for (int i = d->readQueue.count(); i; --i)
+                delete d->readQueue.dequeue();
         }
         catch (...) {}
 
         d->wait.wakeAll();
     }
 
+    // читатели завершают текущий запрос
+    d->stopReaders();
+
     d->beInited = false;
     return true;
 }
@@ -552,7 +810,8 @@ void DatabaseController::destroyedHandler(QObject *object)
 bool DatabaseController::registerHandler (
         const QString    &requestName,
         QPointer<QObject> implementerPtr,
-        const QByteArray &handlerName
+        const QByteArray &handlerName,
+        bool              readOnly
         )
 {
     Q_D(DatabaseController);
@@ -594,6 +853,8 @@ bool DatabaseController::registerHandler (
     }
     d->handlers[topic] = DCHandler(implementerPtr, handlerName);
     d->handlerNames[topic] = requestName;
+    if (readOnly)
+        d->readOnly.insert(topic);
     if (implementerPtr->thread() != thread())
         implementerPtr->moveToThread(thread()); // перенести обработчик в поток контроллера БД
     connect(implementerPtr.data(), SIGNAL(destroyed(QObject*)), this, SLOT(destroyedHandler(QObject*)), Qt::UniqueConnection);
@@ -620,6 +881,7 @@ void DatabaseController::unregisterHandlerPriv(
         it.next();
         if (it.value().first == implementerPtr) {
             d->handlerNames.remove(it.key());
+            d->readOnly.remove(it.key());
             it.remove();
         }
     }
@@ -652,6 +914,7 @@ void DatabaseController::unregisterHandler(
     }
     d->handlers.remove(topic);
     d->handlerNames.remove(topic);
+    d->readOnly.remove(topic);
 }
 
 //---------------------------------------------------------------
@@ -671,12 +934,12 @@ QStringList DatabaseController::registeredHandlers()
 //---------------------------------------------------------------
 QSqlDatabase const *DatabaseController::database() const
 {
-    Q_D(const DatabaseController);
-    if (QThread::currentThread() != thread()) {
+    DCConnection *conn = d_ptr->connection(thread());
+    if (!conn) {
         qWarning() << "Stream flow is different from the database";
         return NULL;
     }
-    return &d->db;
+    return &conn->db;
 }
 
 //---------------------------------------------------------------
@@ -686,28 +949,105 @@ bool DatabaseController::execQuery(
         QueryResult &result
         )
 {
-    Q_D(DatabaseController);
     result.clear();
-    if (QThread::currentThread() != thread()) {
-        qWarning() << "Stream flow is different from the database";
+    QSqlQuery *q = execPrepared(query, parameters);
+    if (!q)
+        return false;
+
+    result = convertQueryResult(*q);
+    finishPrepared(query);
+    return true;
+}
+
+//---------------------------------------------------------------
+bool DatabaseController::execQuery(
+        const QString &query,
+        const QVariantMap &parameters,
+        QueryRows &rows
+        )
+{
+    rows.clear();
+    QSqlQuery *q = execPrepared(query, parameters);
+    if (!q)
         return false;
+
+    if (q->isSelect()) {
+        int fields = q->record().count();
+        QueryRow row(fields);
+        while (q->next()) {
+            for (int f = 0; f < fields; ++f)
+                row[f] = q->value(f);
+            rows.append(row);
+        }
+    }
+    finishPrepared(query);
+    return true;
+}
+
+//---------------------------------------------------------------
+QSqlQuery *DatabaseController::execPrepared(
+        const QString &query,
+        const QVariantMap &parameters
+        )
+{
+    Q_D(DatabaseController);
+    DCConnection *conn = d->connection(thread());
+    if (!conn) {
+        qWarning() << "Stream flow is different from the database";
+        return NULL;
     }
 
 //    QMutexLocker lock(&d->mutex);
-    QSqlQuery q(d->db);
-    q.prepare(query);
+    QHash<QString, DCConnection::Statement>::iterator st = conn->statements.find(query);
+    if (st == conn->statements.end()) {
+        // запросы с подставленными в текст значениями быстро переполняют кэш
+        if (conn->statements.size() >= StatementCacheSize)
+            conn->evictStatement();
+        QSqlQuery *q = new QSqlQuery(conn->db);
+        q->setForwardOnly(true);
+        if (!q->prepare(query)) {
+            qWarning() << "ERROR prepare query " << query << q->lastError();
+            delete q;
+            return NULL;
+        }
+        DCConnection::Statement s;
+        s.query = q;
+        s.used = 0;
+        s.active = false;
+        st = conn->statements.insert(query, s);
+    }
+    st->used = ++conn->tick;
+
+    QSqlQuery *q = st->query;
     if (!parameters.isEmpty())
         for (QMapIterator<QString, QVariant > it(parameters); it.hasNext(); ) {
             it.next();
-            q.bindValue(it.key(), it.value());
+            q->bindValue(it.key(), it.value());
         }
-    if (!q.exec()) {
-        qWarning() << "ERROR execute query " << query << " with parameters " << parameters << q.lastError();
-        return false;
+    if (!q->exec()) {
+        qWarning() << "ERROR execute query " << query << " with parameters " << parameters << q->lastError();
+        q->finish();
+        return NULL;
     }
+    st->active = true;
+    return q;
+}
 
-    result = convertQueryResult(q);
-    return true;
+//---------------------------------------------------------------
+void DatabaseController::finishPrepared(
+        const QString &query
+        )
+{
+    Q_D(DatabaseController);
+    DCConnection *conn = d->connection(thread());
+    if (!conn)
+        return;
+
+    QHash<QString, DCConnection::Statement>::iterator st = conn->statements.find(query);
+    if (st == conn->statements.end())
+        return;
+    st->query->finish();
+    st->active = false;
 }
 
 //---------------------------------------------------------------
@@ -739,48 +1079,55 @@ QueryResult DatabaseController::convertQueryResult(
 bool DatabaseController::transaction()
 {
     Q_D(DatabaseController);
-    if (QThread::currentThread() != thread()) {
+    DCConnection *conn = d->connection(thread());
+    if (!conn) {
         qWarning() << "Stream flow is different from the database";
         return false;
     }
 //    QMutexLocker(&d->mutex);
 
-    if (d->inTransaction)
+    if (conn->inTransaction)
         rollback();
-    if (!d->db.transaction()) {
-        qWarning() << "Error start transaction " << d->db.lastError();
+    if (!conn->db.transaction()) {
+        qWarning() << "Error start transaction " << conn->db.lastError();
         return false;
     }
-    d->inTransaction = true;
+    conn->inTransaction = true;
     return true;
 }
 
 //---------------------------------------------------------------
-void DatabaseController::commit()
+bool DatabaseController::commit()
 {
     Q_D(DatabaseController);
-    if (QThread::currentThread() != thread()) {
+    DCConnection *conn = d->connection(thread());
+    if (!conn) {
         qWarning() << "Stream flow is different from the database";
-        return;
+        return false;
     }
 //    QMutexLocker(&d->mutex);
-    if (!d->db.commit())
-        qWarning() << "Error commit transaction " << d->db.lastError();
-    d->inTransaction = false;
+    bool result = conn->db.commit();
+    if (!result) {
+        qWarning() << "Error commit transaction " << conn->db.lastError();
+        conn->db.rollback();
+    }
+    conn->inTransaction = false;
+    return result;
 }
 
 //---------------------------------------------------------------
 void DatabaseController::rollback()
 {
     Q_D(DatabaseController);
-    if (QThread::currentThread() != thread()) {
+    DCConnection *conn = d->connection(thread());
+    if (!conn) {
         qWarning() << "Stream flow is different from the database";
         return;
     }
 //    QMutexLocker(&d->mutex);
-    if (!d->db.rollback())
-        qWarning() << "Error rollback transaction " << d->db.lastError();
-    d->inTransaction = false;
+    if (!conn->db.rollback())
+        qWarning() << "Error rollback transaction " << conn->db.lastError();
+    conn->inTransaction = false;
 }
 
 //---------------------------------------------------------------
@@ -821,23 +1168,50 @@ uint DatabaseController::postRequest(
             return 0;
         }
     uint npp;
+    bool read;
     {
         QMutexLocker locker(&d->mutex);
         npp = ++d->number;
         uint h = qHash(requestName);
         if (!d->handlers.contains(h))
             qWarning() << QString::fromUtf8("Handler \"%1\" not found. hope that soon will be.").arg(requestName);
-        d->requestQueue.enqueue(new Request(npp, h, requestParameters, senderPtr, callBackName), priority);
+        read = !d->readers.isEmpty() && d->readOnly.contains(h);
+        (read ? d->readQueue : d->requestQueue).enqueue(new Request(npp, h, requestParameters, senderPtr, callBackName), priority);
     }
-    d->wait.wakeAll();
+    if (read)
+        d->readWait.wakeOne();
+    else
+        d->wait.wakeAll();
     return npp;
 }
 
+//---------------------------------------------------------------
+bool DatabaseController::cancelRequest(uint number)
+{
+    Q_D(DatabaseController);
+    Request *request = NULL;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->requestQueue.take(RequestNumber(number), request) &&
+            !d->readQueue.take(RequestNumber(number), request))
+            return false;
+    }
+    delete request;
+    return true;
+}
+
 //---------------------------------------------------------------
 uint DatabaseController::requestCount() const
 {
     QMutexLocker locker(&d_ptr->mutex);
-    return d_ptr->requestQueue.count();
+    return d_ptr->requestQueue.count() + d_ptr->readQueue.count();
+}
+
+//---------------------------------------------------------------
+int DatabaseController::readerCount() const
+{
+    QReadLocker locker(&d_ptr->readersLock);
+    return d_ptr->readerConnections.size();
 }
 
 //---------------------------------------------------------------
@@ -845,9 +1219,7 @@ void DatabaseController::mainProcessing()
 {
     Q_D(DatabaseController);
     Request *request = NULL;
-    QPair<QPointer<QObject>, QByteArray> handler;
-    QVariant result;
-    QVariant errors;
+    DCHandler handler;
 
     forever {
         if (request) {
@@ -873,32 +1245,7 @@ void DatabaseController::mainProcessing()
             handler = d->handlers.value(request->request);
         } // end - считать запрос
 
-        if (handler.first.isNull()) {
-            qWarning() << "The handler has disconnected before his request was processed.";
-            continue;
-        }
-        if (!QMetaObject::invokeMethod(
-                    handler.first,
-                    handler.second,
-                    Qt::DirectConnection,
-                    Q_ARG(QVariant, request->parameters),
-                    Q_ARG(QVariant&, result),
-                    Q_ARG(QVariant&, errors)
-                    ))
-            qWarning() << QString::fromUtf8("ERROR: no invoke slot %1 for %2").arg(handler.second.constData()).arg(handler.first->objectName());
-
-        if (request->sender.isNull() || request->callBack.isEmpty())
-            continue;
-        if (!QMetaObject::invokeMethod(
-                    request->sender.data(),
-                    request->callBack,
-                    Qt::QueuedConnection,
-                    Q_ARG(uint, request->number),
-                    Q_ARG(QVariant, result),
-                    Q_ARG(QVariant, errors)
-                    ))
-            qWarning() << QString::fromUtf8("ERROR: no invoke slot %1 for %2").arg(request->callBack.constData()).arg(request->sender.data()->objectName());
-        result.clear();
+        DatabaseControllerPrivate::execute(request, handler);
     } // forever
 }
 
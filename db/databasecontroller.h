@@ -18,6 +18,13 @@ autor: Тарасенко А.И.
   * 3. если обработчик "общается" с другими объектами, и уж тем более с графическим интерфейсом,
   *    он должен делать это через slot/signal
   * 4. после регистрации в качестве обработчика, объект автоматически перемещается в поток базы данных
+  * 5. обработчики, зарегистрированные только для чтения, вызываются из потоков читателей
+  *    параллельно друг другу и основному потоку, поэтому должны быть реентерабельными
+  *
+  * Режим пула читателей (только SQLite, параметр соединения "readers" > 0):
+  * журнал БД переводится в WAL, запись выполняет один основной поток,
+  * запросы к обработчикам только для чтения разбирают N потоков-читателей
+  * со своими соединениями в порядке приоритета.
   */
 
 /****************************************************************************/
@@ -32,6 +39,7 @@ autor: Тарасенко А.И.
 #include <QSqlQuery>
 #include <QSharedPointer>
 #include <QStringList>
+#include <QVector>
 
 namespace dc {
 
@@ -49,6 +57,11 @@ enum {
 //! результат запроса
 typedef QList<QVariantMap> QueryResult;
 
+//! строка результата запроса, значения в порядке столбцов SELECT
+typedef QVector<QVariant> QueryRow;
+//! результат запроса без имен столбцов
+typedef QList<QueryRow> QueryRows;
+
 //! класс приватных данных
 class ExecutingRequestsPrivate;
 class DatabaseController;
@@ -125,6 +138,12 @@ public:
 
 public slots:
     //! Инициализация контроллера
+    /**
+        Параметры соединения: name, user, pass, host, port.
+        readers - количество соединений-читателей (0..MaxReaders, по умолчанию 0). Для SQLite
+        при readers > 0 журнал переводится в режим WAL, и запросы к обработчикам только для чтения
+        выполняются параллельно основному потоку. Для БД в памяти пул не создается.
+    */
     bool init(
             QString const     &driver         = QString("QSQLITE"), //!< драйвер СУБД
             QVariantMap const &connData       = QVariantMap(),      //!< данные соединения с БД
@@ -141,12 +160,15 @@ public slots:
     //! Регистрация обработчика
     /**
         Метод handlerName в обработчике implementerPtr будет вызываться из потока invokeMethod() с Qt::DirectConnection.
+        Обработчик только для чтения в режиме пула вызывается из потока читателя, соединение которого
+        открыто только на чтение (database(), execQuery() и транзакции работают с ним).
         Возвращает false, если в обработчике такой метод не существует.
     */
     bool registerHandler (
-            const QString    &requestName,    //!< логическое имя обработчика (функции)
-            QPointer<QObject> implementerPtr, //!< объект где реализован обработчик
-            const QByteArray &handlerName     //!< функция обработчик
+            const QString    &requestName,     //!< логическое имя обработчика (функции)
+            QPointer<QObject> implementerPtr,  //!< объект где реализован обработчик
+            const QByteArray &handlerName,     //!< функция обработчик
+            bool              readOnly = false //!< обработчик только читает БД и реентерабелен
             );
 
     //! Разрегистрация обработчиков объекта
@@ -164,7 +186,8 @@ public slots:
 
     //! БД контроллера БД
     /**
-        Доступ к БД контроллера напрямую. Доступ возможен только из потока БД.
+        Доступ к БД контроллера напрямую. Доступ возможен только из потока БД или потока читателя
+        (возвращается соединение читателя).
     */
     QSqlDatabase const *database() const;
 
@@ -188,6 +211,36 @@ public slots:
             QSqlQuery query //!< выполненный запрос
             );
 
+    //! Выполнить SQL запрос
+    /**
+        Этот метод будет вызываться напрямую в потоке контроллера для доступа к базе данных.
+        Каждая запись в списке результатов является QueryRow, значения доступны по номеру столбца
+    */
+    bool execQuery(
+            const QString &query,          //!< запрос
+            const QVariantMap &parameters, //!< параметры запроса
+            QueryRows &rows                //!< результат выполнения запроса - строки данных
+            );
+
+    //! Выполнить SQL запрос с потоковой обработкой строк
+    /**
+        Этот метод будет вызываться напрямую в потоке контроллера для доступа к базе данных.
+        Для каждой строки результата вызывается f(const QSqlQuery &), значения читаются по номеру
+        столбца. Промежуточный результат не создается. Внутри f нельзя выполнять тот же текст запроса,
+        другие запросы допустимы (выполняемый запрос не вытесняется из кэша).
+    */
+    template <typename RowFunc>
+    bool execQueryEach(
+            const QString &query,          //!< запрос
+            const QVariantMap &parameters, //!< параметры запроса
+            RowFunc f                      //!< обработчик строки
+            );
+
+    //! Размер кэша подготовленных запросов (на соединение)
+    static const int StatementCacheSize = 64;
+    //! Максимальное количество соединений-читателей
+    static const int MaxReaders = 8;
+
     //! Старт транзакции
     /**
         Этот метод должен вызываться напрямую в потоке контроллера для доступа к базе данных.
@@ -199,8 +252,9 @@ public slots:
     //! Подтвердить транзакцию
     /**
         Этот метод должен вызываться напрямую в потоке контроллера для доступа к базе данных.
+        \returns ложь, если подтвердить не удалось (транзакция при этом откатывается)
     */
-    void commit();
+    bool commit();
 
     //! Откатить транзакцию
     /**
@@ -235,6 +289,15 @@ public slots:
             const QByteArray  &callBackName = QByteArray()      //!< имя метода обратного вызова, вызываемого после завершения запроса. Если пусто, то обратный вызов не требуется
             );
 
+    //! Отменить запрос
+    /**
+        удалить из очереди запрос, ещё не переданный обработчику. Обратный вызов для него выполнен не будет.
+        \returns истина, если запрос был найден в очереди
+    */
+    bool cancelRequest(
+            uint number //!< регистрационный номер запроса
+            );
+
     //! Размер очереди запросов
     /**
         размер оставшейся очереди запросов к БД
@@ -242,6 +305,9 @@ public slots:
     */
     uint requestCount() const;
 
+    //! Количество работающих соединений-читателей
+    int readerCount() const;
+
 private slots:
     //! Уничтожение обработчика
     void destroyedHandler(
@@ -254,6 +320,12 @@ private slots:
 private:
     void unregisterHandlerPriv(QObject *implementerPtr);
     static QString nextLogicName();
+
+    //! Подготовленный (из кэша по тексту запроса) и выполненный запрос. NULL при ошибке
+    //! До finishPrepared() запрос считается выполняемым и не вытесняется из кэша
+    QSqlQuery *execPrepared(const QString &query, const QVariantMap &parameters);
+    //! Завершить чтение результата запроса
+    void finishPrepared(const QString &query);
 private:
     //! Приватные данные
     DatabaseControllerPrivate *d_ptr;
@@ -262,6 +334,24 @@ private:
     Q_DISABLE_COPY(DatabaseController)
 };
 
+//---------------------------------------------------------------
+template <typename RowFunc>
+bool DatabaseController::execQueryEach(
+        const QString &query,
+        const QVariantMap &parameters,
+        RowFunc f
+        )
+{
+    QSqlQuery *q = execPrepared(query, parameters);
+    if (!q)
+        return false;
+
+    while (q->next())
+        f(static_cast<const QSqlQuery &>(*q));
+    finishPrepared(query);
+    return true;
+}
+
 } // namespace dc
 
 #endif // DATABASECONTROLLER_H
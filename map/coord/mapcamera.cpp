@@ -31,6 +31,7 @@ MapCamera::MapCamera(QObject *parent)
     connect(d, SIGNAL(zoomChanged()), SIGNAL(zoomChanged()));
     connect(d, SIGNAL(posChanged()), SIGNAL(posChanged()));
     connect(d, SIGNAL(angleChanged()), SIGNAL(angleChanged()));
+    connect(d, SIGNAL(destinationChanged(QPointF,qreal)), SIGNAL(destinationChanged(QPointF,qreal)));
 }
 
 MapCamera::~MapCamera()
@@ -112,6 +113,14 @@ bool MapCamera::ensureVisible(QPointF pos, int duration, QEasingCurve curve)
     return false;
 }
 
+void MapCamera::expectDestination(QPointF pos, qreal scale)
+{
+    Q_D(MapCamera);
+    if (scale <= 0)
+        scale = d->scale;
+    emit destinationChanged(boundPos(pos, d->boundRect), qBound<double>(MaxScaleParam, scale, MinScaleParam));
+}
+
 QPointF MapCamera::position() const
 {
     Q_D(const MapCamera);
@@ -71,6 +71,13 @@ public:
      */
     Q_INVOKABLE bool ensureVisible(QPointF pos, int duration = 0, QEasingCurve curve = QEasingCurve::OutCubic);
 
+    /**
+     * @brief expectDestination сообщить предполагаемую точку назначения (например при инерционном перемещении)
+     * @param pos точка (в системе Меркатора)
+     * @param scale ожидаемый scale (0 - текущий)
+     */
+    Q_INVOKABLE void expectDestination(QPointF pos, qreal scale = 0);
+
     /**
      * @brief position получит позицию камеры
      * @return точка
@@ -297,6 +304,9 @@ Q_SIGNALS:
     void posChanged();
     void angleChanged();
 
+    //! запущена анимация или ожидается перемещение в точку pos с масштабом scale
+    void destinationChanged(QPointF pos, qreal scale);
+
 private:
     Q_DECLARE_PRIVATE(MapCamera)
     Q_DISABLE_COPY(MapCamera)
@@ -63,6 +63,8 @@ void MapCameraPrivate::moveAnimation(QPointF finish, int duration, QEasingCurve
     disconnect(&lMove, 0, this, 0);
     connect(&lMove, SIGNAL(valueChanged(qreal)), this, SLOT(updatePos(qreal)));
     lMove.start();
+
+    notifyDestination();
 }
 
 void MapCameraPrivate::rotateAnimation(qreal finish, int duration, QEasingCurve curve)
@@ -91,6 +93,15 @@ void MapCameraPrivate::scaleAnimation(qreal finish, int duration, QEasingCurve c
     disconnect(&lScale, 0, this, 0);
     connect(&lScale, SIGNAL(valueChanged(qreal)), this, SLOT(updateScale(qreal)));
     lScale.start();
+
+    notifyDestination();
+}
+
+void MapCameraPrivate::notifyDestination()
+{
+    QPointF pos = lMove.state() != QTimeLine::NotRunning ? -finishPos : -location;
+    qreal sc = lScale.state() != QTimeLine::NotRunning ? qBound<double>(MaxScaleParam, finishScale, MinScaleParam) : scale;
+    emit destinationChanged(pos, sc);
 }
 
 void MapCameraPrivate::updatePos(qreal dt)
@@ -42,6 +42,11 @@ public:
     void rotateAnimation(qreal finish, int duration, QEasingCurve curve = QEasingCurve::OutCubic);
     void scaleAnimation(qreal finish, int duration, QEasingCurve curve = QEasingCurve::OutCubic);
 
+    /**
+     * @brief notifyDestination сообщить конечное положение и масштаб запущенных анимаций
+     */
+    void notifyDestination();
+
 public slots:
     void updatePos(qreal);
     void updateAngle(qreal);
@@ -51,6 +56,7 @@ signals:
     void zoomChanged();
     void posChanged();
     void angleChanged();
+    void destinationChanged(QPointF pos, qreal scale);
 
 public:
     QPointF location; //! позиция
@@ -1,5 +1,10 @@
 
+#include <algorithm>
+
 #include <qnumeric.h>
+#include <QVector>
+#include <QPair>
+#include <QtConcurrentMap>
 
 #include "coord/mapcoords.h"
 
@@ -171,18 +176,12 @@ QString TileSystem::tileToQuadKey(const QPoint &tileXY, int levelOfDetail)
 
 QString TileSystem::tileToQuadKey(int tileX, int tileY, int levelOfDetail)
 {
-    QString quadKey = "";
-    for (int i = levelOfDetail; i > 0; --i) {
-        char digit = '0';
-        int mask = 1 << (i - 1);
-        if ((tileX & mask) != 0)
-            ++digit;
-        if ((tileY & mask) != 0) {
-            ++digit;
-            ++digit;
-        }
-        quadKey.append(digit);
-    }
+    // строка нужна только для шаблонов адресов {q}, цифры - из целочисленного quadkey
+    quint64 key = mortonEncode(tileX, tileY);
+    QString quadKey(levelOfDetail, QChar('0'));
+    QChar *digit = quadKey.data() + levelOfDetail;
+    for (int i = 0; i < levelOfDetail; ++i, key >>= 2)
+        *--digit = QChar(ushort('0' + (key & 3)));
     return quadKey;
 }
 
@@ -282,25 +281,105 @@ double TePZ9002toPZ90::m = 0.22 * 1e-6;
 // -------------------------------------------------------
 // -------------------------------------------------------
 
-Coord CoordinateSystem::geoToRect(Coord geo, double alpha, double a)
+// -------------------------------------------------------
+// Вычисления для одной точки - общие у поточечных и пакетных преобразований
+// (пакетные дают те же результаты, что и поточечные)
+
+// геодезические (рад) в прямоугольные, e - эксцентриситет в квадрате
+static inline void geoToRectPoint(double b, double l, double h, double e, double a, double &x, double &y, double &z)
 {
-    double x, y, z;
-    double e, n;
+    double sinx = qSin(b);
+    double cosx = qCos(b);
+
+    double n = a / sqrt(1 - e * sinx * sinx);
 
-    e = 2 * alpha - alpha * alpha;
+    x = (n + h) * cosx * qCos(l);
+    y = (n + h) * cosx * qSin(l);
+    z = ((1 - e) * n + h) * sinx;
+}
 
-    double sinx = qSin(geo.x);
-    double cosx = qCos(geo.x);
+// поправки Молоденского (ang в секундах), da, de2, a, e2 - разности и средние параметров эллипсоидов
+static inline void molodenskyPoint(double b, double l, double h, const Coord &dr, const Coord &ang, double m,
+                                   double da, double de2, double a, double e2,
+                                   double &dB, double &dL, double &dH)
+{
+    double sinx = qSin(b);
+    double cosx = qCos(b);
+    double siny = qSin(l);
+    double cosy = qCos(l);
 
-    n = a / sqrt(1 - e * sinx * sinx);
+    double W = sqrt(1 - e2 * sinx * sinx);
+    double M = a * (1 - e2) / (W * W * W);
+    double N = a / W;
+    double p = 206264.806;
 
-    x = (n + geo.z) * cosx * qCos(geo.y);
-    y = (n + geo.z) * cosx * qSin(geo.y);
-    z = ((1 - e) * n + geo.z) * sinx;
+    dB = p / (M + h) * (N / a * e2 * sinx * cosx * da
+                        + (N * N / (a * a) + 1) * N * sinx * cosx * de2 / 2
+                        - (dr.x * cosy + dr.y * siny) * sinx + dr.z * cosx)
+            - ang.x * siny * (1 + e2 * qCos(2 * b)) + ang.y * cosy * (1 + e2 * qCos(2 * b))
+            - p * m * e2 * sinx * cosx;
+
+    dL = p / ((N + h) * cosx) * (-dr.x * siny + dr.y * cosy)
+            + tan(b) * (1 - e2) * (ang.x * cosy + ang.y * siny) - ang.z;
+
+    dH = -a / N * da + N * sinx * sinx * de2 / 2 + (dr.x * cosy + dr.y * siny)
+            * cosx + dr.z * sinx
+            - N * e2 * sinx * cosx * (ang.x / p * siny - ang.y / p * cosy)
+            + (a * a / N + h) * m;
+}
+
+// параметры поправок Молоденского по параметрам эллипсоидов
+static inline void molodenskyParams(double aa, double alpha_a, double ab, double alpha_b,
+                                    double &da, double &de2, double &a, double &e2)
+{
+    double ea = 2 * alpha_a - alpha_a * alpha_a;
+    double eb = 2 * alpha_b - alpha_b * alpha_b;
 
+    da = ab - aa;
+    de2 = eb - ea;
+    a = (ab + aa) / 2;
+    e2 = (eb + ea) / 2;
+}
+
+// -------------------------------------------------------
+
+// большие пакеты делятся на части и считаются в пуле потоков
+static const int BatchChunk = 16384;          // точек в части
+static const int BatchParallelMin = 65536;    // минимум точек для многопоточного расчета
+
+template <typename F>
+static void forChunks(int n, F f)
+{
+    if (n < BatchParallelMin) {
+        f(0, n);
+        return;
+    }
+
+    QVector<QPair<int, int> > ranges;
+    for (int i = 0; i < n; i += BatchChunk)
+        ranges.append(qMakePair(i, qMin(n, i + BatchChunk)));
+    QtConcurrent::blockingMap(ranges, [&f](const QPair<int, int> &r) { f(r.first, r.second); });
+}
+
+// -------------------------------------------------------
+
+Coord CoordinateSystem::geoToRect(Coord geo, double alpha, double a)
+{
+    double x, y, z;
+    geoToRectPoint(geo.x, geo.y, geo.z, 2 * alpha - alpha * alpha, a, x, y, z);
     return Coord(x, y, z);
 }
 
+void CoordinateSystem::geoToRect(const double *b, const double *l, const double *h, double *x, double *y, double *z,
+                                 int n, double alpha, double a)
+{
+    double e = 2 * alpha - alpha * alpha;
+    forChunks(n, [=](int from, int to) {
+        for (int i = from; i < to; ++i)
+            geoToRectPoint(b[i], l[i], h[i], e, a, x[i], y[i], z[i]);
+    });
+}
+
 Coord CoordinateSystem::rectToGeo(Coord rect, double alpha, double a, double end)
 {
     double b, l, h;
@@ -367,6 +446,20 @@ Coord CoordinateSystem::rectToGeo(Coord rect, double alpha, double a, double end
     return Coord(b, l, h);
 }
 
+void CoordinateSystem::rectToGeo(const double *x, const double *y, const double *z, double *b, double *l, double *h,
+                                 int n, double alpha, double a, double end)
+{
+    // итерационный расчет широты - по точкам, пакет только распределяется по потокам
+    forChunks(n, [=](int from, int to) {
+        for (int i = from; i < to; ++i) {
+            Coord geo = rectToGeo(Coord(x[i], y[i], z[i]), alpha, a, end);
+            b[i] = geo.x;
+            l[i] = geo.y;
+            h[i] = geo.z;
+        }
+    });
+}
+
 Coord CoordinateSystem::transformRect(Coord rect, Coord dr, Coord ang, double m)
 {
     // ang в рад
@@ -398,6 +491,22 @@ Coord CoordinateSystem::backTransformRect(Coord rect, Coord dr, Coord ang, doubl
     return Coord(x, y, z);
 }
 
+void CoordinateSystem::transformRect(double *x, double *y, double *z, int n, Coord dr, Coord ang, double m)
+{
+    // ang в рад
+    const double k = 1 + m;
+    forChunks(n, [=](int from, int to) {
+        for (int i = from; i < to; ++i) {
+            double rx = x[i];
+            double ry = y[i];
+            double rz = z[i];
+            x[i] =       k * rx + ang.z * ry - ang.y * rz + dr.x;
+            y[i] =  -ang.z * rx +     k * ry + ang.x * rz + dr.y;
+            z[i] =   ang.y * rx - ang.x * ry +     k * rz + dr.z;
+        }
+    });
+}
+
 template <class T>
 Coord CoordinateSystem::transformRect(Coord rect)
 {
@@ -413,91 +522,46 @@ Coord CoordinateSystem::backTransformRect(Coord rect)
 Coord CoordinateSystem::transformGeo(Coord geo, Coord dr, Coord ang, double m, double aa, double alpha_a, double ab, double alpha_b)
 {
     // ang в секундах
-    double B, L, H, dB, dL, dH;
-    double p, da, de2, a, e2, N, M;
-
-    double ea = 2 * alpha_a - alpha_a * alpha_a;
-    double eb = 2 * alpha_b - alpha_b * alpha_b;
-
-    da = ab - aa;
-    de2 = eb - ea;
-    a = (ab + aa) / 2;
-    e2 = (eb + ea) / 2;
-
-    double sinx = qSin(geo.x);
-    double cosx = qCos(geo.x);
-    double siny = qSin(geo.y);
-    double cosy = qCos(geo.y);
-
-    double W = sqrt(1 - e2 * sinx * sinx);
-    M = a * (1 - e2) / (W * W * W);
-    N = a / W;
-    p = 206264.806;
-
-    dB = p / (M + geo.z) * (N / a * e2 * sinx * cosx * da
-                        + (N * N / (a * a) + 1) * N * sinx * cosx * de2 / 2
-                        - (dr.x * cosy + dr.y * siny) * sinx + dr.z * cosx)
-            - ang.x * siny * (1 + e2 * qCos(2 * geo.x)) + ang.y * cosy * (1 + e2 * qCos(2 * geo.x))
-            - p * m * e2 * sinx * cosx;
-
-    dL = p / ((N + geo.z) * cosx) * (-dr.x * siny + dr.y * cosy)
-            + tan(geo.x) * (1 - e2) * (ang.x * cosy + ang.y * siny) - ang.z;
+    double da, de2, a, e2, dB, dL, dH;
+    molodenskyParams(aa, alpha_a, ab, alpha_b, da, de2, a, e2);
+    molodenskyPoint(geo.x, geo.y, geo.z, dr, ang, m, da, de2, a, e2, dB, dL, dH);
 
-    dH = -a / N * da + N * sinx * sinx * de2 / 2 + (dr.x * cosy + dr.y * siny)
-            * cosx + dr.z * sinx
-            - N * e2 * sinx * cosx * (ang.x / p * siny - ang.y / p * cosy)
-            + (a * a / N + geo.z) * m;
-
-    B = geo.x + secToRad(dB);
-    L = geo.y + secToRad(dL);
-    H = geo.z + dH;
+    double B = geo.x + secToRad(dB);
+    double L = geo.y + secToRad(dL);
+    double H = geo.z + dH;
     return Coord(B, L, H);
 }
 
 Coord CoordinateSystem::backTransformGeo(Coord geo, Coord dr, Coord ang, double m, double aa, double alpha_a, double ab, double alpha_b)
 {
     // ang в секундах
-    double B, L, H, dB, dL, dH;
-    double p, da, de2, a, e2, N, M;
-
-    double ea = 2 * alpha_a - alpha_a * alpha_a;
-    double eb = 2 * alpha_b - alpha_b * alpha_b;
-
-    da = ab - aa;
-    de2 = eb - ea;
-    a = (ab + aa) / 2;
-    e2 = (eb + ea) / 2;
-
-    double sinx = qSin(geo.x);
-    double cosx = qCos(geo.x);
-    double siny = qSin(geo.y);
-    double cosy = qCos(geo.y);
-
-    double W = sqrt(1 - e2 * sinx * sinx);
-    M = a * (1 - e2) / (W * W * W);
-    N = a / W;
-    p = 206264.806;
-
-    dB = p / (M + geo.z) * (N / a * e2 * sinx * cosx * da
-                        + (N * N / (a * a) + 1) * N * sinx * cosx * de2 / 2
-                        - (dr.x * cosy + dr.y * siny) * sinx + dr.z * cosx)
-            - ang.x * siny * (1 + e2 * qCos(2 * geo.x)) + ang.y * cosy * (1 + e2 * qCos(2 * geo.x))
-            - p * m * e2 * sinx * cosx;
-
-    dL = p / ((N + geo.z) * cosx) * (-dr.x * siny + dr.y * cosy)
-            + tan(geo.x) * (1 - e2) * (ang.x * cosy + ang.y * siny) - ang.z;
-
-    dH = -a / N * da + N * sinx * sinx * de2 / 2 + (dr.x * cosy + dr.y * siny)
-            * cosx + dr.z * sinx
-            - N * e2 * sinx * cosx * (ang.x / p * siny - ang.y / p * cosy)
-            + (a * a / N + geo.z) * m;
+    double da, de2, a, e2, dB, dL, dH;
+    molodenskyParams(aa, alpha_a, ab, alpha_b, da, de2, a, e2);
+    molodenskyPoint(geo.x, geo.y, geo.z, dr, ang, m, da, de2, a, e2, dB, dL, dH);
 
-    B = geo.x - secToRad(dB);
-    L = geo.y - secToRad(dL);
-    H = geo.z - dH;
+    double B = geo.x - secToRad(dB);
+    double L = geo.y - secToRad(dL);
+    double H = geo.z - dH;
     return Coord(B, L, H);
 }
 
+void CoordinateSystem::transformGeo(double *b, double *l, double *h, int n, Coord dr, Coord ang, double m,
+                                    double aa, double alpha_a, double ab, double alpha_b)
+{
+    // ang в секундах, параметры эллипсоидов считаются один раз на пакет
+    double da, de2, a, e2;
+    molodenskyParams(aa, alpha_a, ab, alpha_b, da, de2, a, e2);
+    forChunks(n, [=](int from, int to) {
+        double dB, dL, dH;
+        for (int i = from; i < to; ++i) {
+            molodenskyPoint(b[i], l[i], h[i], dr, ang, m, da, de2, a, e2, dB, dL, dH);
+            b[i] += secToRad(dB);
+            l[i] += secToRad(dL);
+            h[i] += dH;
+        }
+    });
+}
+
 template <class T, class Pa, class Pb>
 Coord CoordinateSystem::transformGeo(Coord geo)
 {
@@ -510,64 +574,75 @@ Coord CoordinateSystem::backTransformGeo(Coord geo)
     return backTransformGeo(geo, T::dr, T::dAngSec, T::m, Pa::a, Pa::alpha, Pb::a, Pb::alpha);
 }
 
-QPointF CoordinateSystem::SKtoFlat(Coord geo)
+// -------------------------------------------------------
+
+GaussKruger::GaussKruger()
 {
-    return CoordinateSystem::SKtoFlat(geo, int((6 + radToDeg(geo.y)) / 6));
+    for (int n = ZoneMin; n <= ZoneMax; ++n)
+        table[n - ZoneMin] = gaussKrugerZone(n);
 }
 
-QPointF CoordinateSystem::SKfromFlat(QPointF flat)
+const GaussKruger &GaussKruger::inst()
 {
-    return CoordinateSystem::SKfromFlat(flat, int(flat.y() * 1e-6));
+    static const GaussKruger context;
+    return context;
 }
 
-QPointF CoordinateSystem::SKtoFlat(Coord geo, int zone)
+void GaussKruger::zonesFromGeo(const QPointF *latLon, int *zones, int n)
+{
+    for (int i = 0; i < n; ++i)
+        zones[i] = zoneFromGeo(latLon[i].y());
+}
+
+void GaussKruger::zonesFromFlat(const QPointF *flat, int *zones, int n)
 {
-    double Y = radToDeg(geo.y);
-    int n = zone;
-    double l = (Y - (3 + 6 * (n - 1))) / 57.29577951;
+    for (int i = 0; i < n; ++i)
+        zones[i] = zoneFromFlat(flat[i].y());
+}
 
-    double sinx  = qSin(geo.x);
+// формулы ГОСТ Р 51794-2008 для эллипсоида Красовского
+void GaussKruger::toFlat(double b, double l, const GaussKrugerZone &z, double &x, double &y)
+{
+    double dl = (radToDeg(l) - z.meridianDeg) / 57.29577951;
+
+    double sinx  = qSin(b);
     double sinx2 = sinx  * sinx;
     double sinx4 = sinx2 * sinx2;
     double sinx6 = sinx2 * sinx4;
 
-    double x = 6367558.4968 * geo.x - qSin(2 * geo.x) *
+    x = 6367558.4968 * b - qSin(2 * b) *
         (16002.89   + 66.9607    * sinx2 + 0.3515   * sinx4
-         - l * l *
+         - dl * dl *
         (1594561.25 + 5336.535   * sinx2 + 26.790   * sinx4 + 0.149  * sinx6
-         + l * l *
+         + dl * dl *
         (672483.4   - 811219.9   * sinx2 + 5420.0   * sinx4 - 10.6   * sinx6
-         + l * l *
+         + dl * dl *
         (278194     - 830174     * sinx2 + 572434   * sinx4 - 16010  * sinx6
-         + l * l *
+         + dl * dl *
         (109500     - 574700     * sinx2 + 863700   * sinx4 - 398600 * sinx6)))));
 
-    double y = (5 + 10 * n) * 1e+5 + l * qCos(geo.x) *
+    y = z.falseEasting + dl * qCos(b) *
         (6378245    + 21346.1415 * sinx2 + 107.1590 * sinx4 + 0.5977 * sinx6
-         + l * l *
+         + dl * dl *
         (1070204.16 - 2136826.66 * sinx2 + 17.98    * sinx4 - 11.99  * sinx6
-         + l * l *
+         + dl * dl *
         (270806     - 1523417    * sinx2 + 1327645  * sinx4 - 21701  * sinx6
-         + l * l *
+         + dl * dl *
         (79690      - 866190     * sinx2 + 1730360  * sinx4 - 945460 * sinx6))));
-
-    return QPointF(x, y);
 }
 
-QPointF CoordinateSystem::SKfromFlat(QPointF flat, int zone)
+void GaussKruger::fromFlat(double fx, double fy, const GaussKrugerZone &zn, double &B, double &L)
 {
-    double B, L;
     double b0, dB;
-    double l, n, beta, z;
-    n = zone;
-    beta = double(flat.x()) / 6367558.4968;
+    double l, beta, z;
+    beta = fx / 6367558.4968;
 
     double sinBeta  = qSin(beta);
     double sinBeta2 = sinBeta * sinBeta;
 
     b0 = beta + qSin(2 * beta) * (0.00252588685 - 0.0000149186 * sinBeta2 + 0.00000011904 * sinBeta2 * sinBeta2);
 
-    z = (double(flat.y()) - (10 * n + 5) * 1e+5) / (6378245 * qCos(b0));
+    z = (fy - zn.falseEasting) / (6378245 * qCos(b0));
     double z2 = z * z;
 
     double sinb  = qSin(b0);
@@ -596,10 +671,53 @@ QPointF CoordinateSystem::SKfromFlat(QPointF flat, int zone)
          (0.0038     + 0.0524       * sinb2 + 0.0482       * sinb4 + 0.0032       * sinb6)))));
 
     B = b0 + dB;
-    L = 6 * (n - 0.5) / 57.29577951 + l;
+    L = zn.meridianRad + l;
+}
+
+QPointF CoordinateSystem::SKtoFlat(Coord geo)
+{
+    return CoordinateSystem::SKtoFlat(geo, GaussKruger::zoneFromGeo(radToDeg(geo.y)));
+}
+
+QPointF CoordinateSystem::SKfromFlat(QPointF flat)
+{
+    return CoordinateSystem::SKfromFlat(flat, GaussKruger::zoneFromFlat(flat.y()));
+}
+
+QPointF CoordinateSystem::SKtoFlat(Coord geo, int zone)
+{
+    double x, y;
+    GaussKruger::toFlat(geo.x, geo.y, GaussKruger::inst().zone(zone), x, y);
+    return QPointF(x, y);
+}
+
+QPointF CoordinateSystem::SKfromFlat(QPointF flat, int zone)
+{
+    double B, L;
+    GaussKruger::fromFlat(flat.x(), flat.y(), GaussKruger::inst().zone(zone), B, L);
     return QPointF(B, L);
 }
 
+void CoordinateSystem::SKtoFlat(const double *b, const double *l, double *x, double *y, int n, int zone)
+{
+    const GaussKruger &gk = GaussKruger::inst();
+    const GaussKrugerZone fixed = gk.zone(zone);
+    forChunks(n, [=, &gk](int from, int to) {
+        for (int i = from; i < to; ++i)
+            GaussKruger::toFlat(b[i], l[i], zone > 0 ? fixed : gk.zone(GaussKruger::zoneFromGeo(radToDeg(l[i]))), x[i], y[i]);
+    });
+}
+
+void CoordinateSystem::SKfromFlat(const double *x, const double *y, double *b, double *l, int n, int zone)
+{
+    const GaussKruger &gk = GaussKruger::inst();
+    const GaussKrugerZone fixed = gk.zone(zone);
+    forChunks(n, [=, &gk](int from, int to) {
+        for (int i = from; i < to; ++i)
+            GaussKruger::fromFlat(x[i], y[i], zone > 0 ? fixed : gk.zone(GaussKruger::zoneFromFlat(y[i])), b[i], l[i]);
+    });
+}
+
 QString CoordinateSystem::debugSec(double X)
 {
     X = radToSec(degToRad(X));
@@ -894,12 +1012,12 @@ QPointF CoordTranform::sk42ToGeo(const QPointF &sk42)
 
 int CoordTranform::zoneSK42FromSK42(const QPointF &sk42)
 {
-    return int(sk42.y() * 1e-6);
+    return GaussKruger::zoneFromFlat(sk42.y());
 }
 
 int CoordTranform::zoneSK42FromGeo(const QPointF &latLon)
 {
-    return int((6 + latLon.y()) / 6);
+    return GaussKruger::zoneFromGeo(latLon.y());
 }
 
 int CoordTranform::zoneSK42FromWorld(const QPointF &xy)
@@ -907,6 +1025,36 @@ int CoordTranform::zoneSK42FromWorld(const QPointF &xy)
     return int((6 + xy.y() / OriginDeg) / 6);
 }
 
+void CoordTranform::worldToGeo(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::World, CoordTransformer::Geo).map(src, dst, n);
+}
+
+void CoordTranform::geoToWorld(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::Geo, CoordTransformer::World).map(src, dst, n);
+}
+
+void CoordTranform::geoToSK42(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::Geo, CoordTransformer::SK42).map(src, dst, n);
+}
+
+void CoordTranform::sk42ToGeo(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::SK42, CoordTransformer::Geo).map(src, dst, n);
+}
+
+void CoordTranform::worldToSK42(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::World, CoordTransformer::SK42).map(src, dst, n);
+}
+
+void CoordTranform::sk42ToWorld(const QPointF *src, QPointF *dst, int n)
+{
+    CoordTransformer(CoordTransformer::SK42, CoordTransformer::World).map(src, dst, n);
+}
+
 QPointF CoordTranform::worldToSK42(const QPointF &xy, int zone)
 {
     return geoToSK42(worldToGeo(xy), zone);
@@ -936,6 +1084,88 @@ QPointF CoordTranform::sk42ToGeo(const QPointF &sk42, int zone)
     return radToDeg(wgs.toPoint());
 }
 
+// -------------------------------------------------------
+
+CoordTransformer::CoordTransformer(System from, System to, int zone)
+    : _from(from), _to(to), _zone(qMax(0, zone)), _gk(GaussKruger::inst().zone(_zone))
+{
+}
+
+CoordTransformer::System CoordTransformer::source() const
+{
+    return _from;
+}
+
+CoordTransformer::System CoordTransformer::target() const
+{
+    return _to;
+}
+
+int CoordTransformer::zone() const
+{
+    return _zone;
+}
+
+bool CoordTransformer::isIdentity() const
+{
+    return _from == _to;
+}
+
+void CoordTransformer::map(const QPointF *src, QPointF *dst, int n) const
+{
+    if (isIdentity()) {
+        if (src != dst)
+            std::copy(src, src + n, dst);
+        return;
+    }
+
+    forChunks(n, [=](int from, int to) {
+        if (_to == SK42)
+            toSK42(src, dst, from, to);
+        else if (_from == SK42)
+            fromSK42(src, dst, from, to);
+        else if (_from == World) {
+            for (int i = from; i < to; ++i)
+                dst[i] = TileSystem::metersToLatLon(src[i]);
+        }
+        else {
+            for (int i = from; i < to; ++i)
+                dst[i] = TileSystem::latLonToMeters(src[i]);
+        }
+    });
+}
+
+QPointF CoordTransformer::map(const QPointF &p) const
+{
+    QPointF result;
+    map(&p, &result, 1);
+    return result;
+}
+
+void CoordTransformer::toSK42(const QPointF *src, QPointF *dst, int from, int to) const
+{
+    const GaussKruger &gk = GaussKruger::inst();
+    double x, y;
+    for (int i = from; i < to; ++i) {
+        QPointF geo = _from == World ? TileSystem::metersToLatLon(src[i]) : src[i];
+        double b = degToRad(geo.x());
+        double l = degToRad(geo.y());
+        GaussKruger::toFlat(b, l, _zone ? _gk : gk.zone(GaussKruger::zoneFromGeo(radToDeg(l))), x, y);
+        dst[i] = QPointF(x, y);
+    }
+}
+
+void CoordTransformer::fromSK42(const QPointF *src, QPointF *dst, int from, int to) const
+{
+    const GaussKruger &gk = GaussKruger::inst();
+    double b, l;
+    for (int i = from; i < to; ++i) {
+        GaussKruger::fromFlat(src[i].x(), src[i].y(), _zone ? _gk : gk.zone(GaussKruger::zoneFromFlat(src[i].y())), b, l);
+        QPointF geo = radToDeg(QPointF(b, l));
+        dst[i] = _to == World ? TileSystem::latLonToMeters(geo) : geo;
+    }
+}
+
 // -------------------------------------------------------
 // -------------------------------------------------------
 // -------------------------------------------------------
@@ -189,6 +189,20 @@ QPointF SKfromFlat(QPointF flat);
 QPointF SKtoFlat(Coord geo, int zone);
 QPointF SKfromFlat(QPointF flat, int zone);
 
+// пакетные преобразования n точек, координаты - отдельными массивами
+// (результат может записываться в исходные массивы; большие пакеты считаются в нескольких потоках,
+// результаты совпадают с поточечными преобразованиями)
+void geoToRect(const double *b, const double *l, const double *h, double *x, double *y, double *z,
+               int n, double alpha, double a);
+void rectToGeo(const double *x, const double *y, const double *z, double *b, double *l, double *h,
+               int n, double alpha, double a, double end = 0.0001);
+void transformRect(double *x, double *y, double *z, int n, Coord dr, Coord ang, double m);
+void transformGeo(double *b, double *l, double *h, int n, Coord dr, Coord ang, double m,
+                  double aa, double alpha_a, double ab, double alpha_b);
+// zone <= 0 - зона по координатам каждой точки
+void SKtoFlat(const double *b, const double *l, double *x, double *y, int n, int zone = 0);
+void SKfromFlat(const double *x, const double *y, double *b, double *l, int n, int zone = 0);
+
 // сформировать строку вывода из градусов в градусы, минуты и сикунды
 QString debugSec(double X);
 }
@@ -261,8 +275,95 @@ QPointF sk42ToWorld(const QPointF &sk42, int zone);
 QPointF geoToSK42(const QPointF &latLon, int zone);
 QPointF sk42ToGeo(const QPointF &sk42, int zone);
 
+// пакетные преобразования n точек (dst может совпадать с src)
+void worldToGeo(const QPointF *src, QPointF *dst, int n);
+void geoToWorld(const QPointF *src, QPointF *dst, int n);
+void worldToSK42(const QPointF *src, QPointF *dst, int n);
+void sk42ToWorld(const QPointF *src, QPointF *dst, int n);
+void geoToSK42(const QPointF *src, QPointF *dst, int n);
+void sk42ToGeo(const QPointF *src, QPointF *dst, int n);
+
+}
+
+// -------------------------------------------------------
+// Проекция Гаусса-Крюгера (СК-42, эллипсоид Красовского)
+// постоянные шестиградусных зон вычисляются один раз
+
+// постоянные одной зоны
+struct GaussKrugerZone
+{
+    double meridianDeg;     // долгота осевого меридиана, град
+    double meridianRad;     // долгота осевого меридиана, рад
+    double falseEasting;    // ордината осевого меридиана с номером зоны, м
+};
+
+constexpr GaussKrugerZone gaussKrugerZone(int n)
+{
+    return GaussKrugerZone{3. + 6 * (n - 1), 6 * (n - 0.5) / 57.29577951, (5 + 10 * n) * 1e+5};
+}
+
+class GaussKruger
+{
+public:
+    // зоны в таблице (с запасом на западное полушарие), остальные считаются при обращении
+    static const int ZoneMin = -32;
+    static const int ZoneMax = 64;
+
+    static const GaussKruger &inst();
+
+    GaussKrugerZone zone(int n) const;
+
+    // номер зоны по долготе (град) и по плоской ординате
+    static constexpr int zoneFromGeo(double lon) { return int((6 + lon) / 6); }
+    static constexpr int zoneFromFlat(double y) { return int(y * 1e-6); }
+    // номера зон n точек
+    static void zonesFromGeo(const QPointF *latLon, int *zones, int n);
+    static void zonesFromFlat(const QPointF *flat, int *zones, int n);
+
+    // геодезические (рад) в плоские и обратно для одной точки
+    static void toFlat(double b, double l, const GaussKrugerZone &z, double &x, double &y);
+    static void fromFlat(double x, double y, const GaussKrugerZone &z, double &b, double &l);
+
+private:
+    GaussKruger();
+    GaussKrugerZone table[ZoneMax - ZoneMin + 1];
+};
+
+inline GaussKrugerZone GaussKruger::zone(int n) const
+{
+    return n >= ZoneMin && n <= ZoneMax ? table[n - ZoneMin] : gaussKrugerZone(n);
 }
 
+// -------------------------------------------------------
+// Преобразование между "мировыми", геодезическими WGS-84 и плоскими SK-42 координатами
+// (выбирается один раз и применяется к любому количеству пакетов точек)
+class CoordTransformer
+{
+public:
+    enum System { World, Geo, SK42 };
+
+    // zone <= 0 - зона по координатам каждой точки
+    CoordTransformer(System from = World, System to = World, int zone = 0);
+
+    System source() const;
+    System target() const;
+    int zone() const;
+    bool isIdentity() const;
+
+    // пакетное преобразование n точек (dst может совпадать с src)
+    void map(const QPointF *src, QPointF *dst, int n) const;
+    QPointF map(const QPointF &p) const;
+
+private:
+    void toSK42(const QPointF *src, QPointF *dst, int from, int to) const;
+    void fromSK42(const QPointF *src, QPointF *dst, int from, int to) const;
+
+    System _from;
+    System _to;
+    int _zone;
+    GaussKrugerZone _gk;
+};
+
 // -------------------------------------------------------
 // -------------------------------------------------------
 // -------------------------------------------------------
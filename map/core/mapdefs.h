@@ -7,6 +7,12 @@
 #include <QColor>
 #include <qmath.h>
 
+// чередование битов инструкциями BMI2 - только при сборке под них
+#if defined(__GNUC__) && defined(__BMI2__) && defined(__x86_64__)
+#  define MAP_QUADKEY_BMI2
+#  include <immintrin.h>
+#endif
+
 // -------------------------------------------------------
 
 namespace minigis {
@@ -15,6 +21,7 @@ namespace minigis {
 
 //#define TILEANIMATION     // включить анимацию тайлов
 #define TILEUPLOADLEVEL 5   // уровень подмены верхних тайлов при отсутствии искомых
+#define TILECACHEBUDGET 128 // бюджет памяти кэша подложки по умолчанию (Мб)
 
 static const int TileAnimationTime = 250;                // время появления тайлов
 static const qreal GenerlizationDissolveRange   = 0.4;   // процент плавной генерализации область
@@ -81,6 +88,47 @@ static const int PointSemantic       = 34;         // QPointF
 
 // -------------------------------------------------------
 
+//! максимальный уровень целочисленных quadkey (x и y - до 24 бит)
+static const int QuadKeyMaxZoom = 24;
+
+//! целочисленный quadkey: биты x и y чередуются (код Мортона), цифра quadkey = бит x + 2 * бит y
+inline quint64 mortonEncode(quint32 x, quint32 y)
+{
+#ifdef MAP_QUADKEY_BMI2
+    return _pdep_u64(x, Q_UINT64_C(0x5555555555555555)) | _pdep_u64(y, Q_UINT64_C(0xaaaaaaaaaaaaaaaa));
+#else
+    quint64 v[2] = { x, y };
+    for (int i = 0; i < 2; ++i) {
+        v[i] = (v[i] | (v[i] << 16)) & Q_UINT64_C(0x0000ffff0000ffff);
+        v[i] = (v[i] | (v[i] << 8))  & Q_UINT64_C(0x00ff00ff00ff00ff);
+        v[i] = (v[i] | (v[i] << 4))  & Q_UINT64_C(0x0f0f0f0f0f0f0f0f);
+        v[i] = (v[i] | (v[i] << 2))  & Q_UINT64_C(0x3333333333333333);
+        v[i] = (v[i] | (v[i] << 1))  & Q_UINT64_C(0x5555555555555555);
+    }
+    return v[0] | (v[1] << 1);
+#endif
+}
+
+//! обратное преобразование целочисленного quadkey
+inline void mortonDecode(quint64 code, quint32 &x, quint32 &y)
+{
+#ifdef MAP_QUADKEY_BMI2
+    x = quint32(_pext_u64(code, Q_UINT64_C(0x5555555555555555)));
+    y = quint32(_pext_u64(code, Q_UINT64_C(0xaaaaaaaaaaaaaaaa)));
+#else
+    quint64 v[2] = { code & Q_UINT64_C(0x5555555555555555), (code >> 1) & Q_UINT64_C(0x5555555555555555) };
+    for (int i = 0; i < 2; ++i) {
+        v[i] = (v[i] | (v[i] >> 1))  & Q_UINT64_C(0x3333333333333333);
+        v[i] = (v[i] | (v[i] >> 2))  & Q_UINT64_C(0x0f0f0f0f0f0f0f0f);
+        v[i] = (v[i] | (v[i] >> 4))  & Q_UINT64_C(0x00ff00ff00ff00ff);
+        v[i] = (v[i] | (v[i] >> 8))  & Q_UINT64_C(0x0000ffff0000ffff);
+        v[i] = (v[i] | (v[i] >> 16)) & Q_UINT64_C(0x00000000ffffffff);
+    }
+    x = quint32(v[0]);
+    y = quint32(v[1]);
+#endif
+}
+
 //! Ключ подложки
 struct TileKey {
 public:
@@ -93,9 +141,45 @@ public:
     int z;
     int type;
 
+    //! тайл существует на своем уровне: z до QuadKeyMaxZoom, x и y в [0, 2^z)
+    //! (иначе сдвиг в quadOrder не определен, а лишние биты x, y дают совпадающие ключи)
+    inline bool isValid() const
+    {
+        return z >= 0 && z <= QuadKeyMaxZoom && quint32(x) < (1u << z) && quint32(y) < (1u << z);
+    }
+
+    //! целочисленный quadkey тайла
+    inline quint64 quadKey() const
+    {
+        Q_ASSERT(isValid());
+        return mortonEncode(x, y);
+    }
+
+    //! ключ в порядке обхода дерева quadkey (уровень - в младших 5 битах):
+    //! тайл и все его потомки занимают непрерывный диапазон [quadOrder(), quadOrderLast()]
+    inline quint64 quadOrder() const
+    {
+        return (quadKey() << (2 * (QuadKeyMaxZoom - z) + 5)) | quint64(z);
+    }
+
+    inline quint64 quadOrderLast() const
+    {
+        return ((quadKey() + 1) << (2 * (QuadKeyMaxZoom - z) + 5)) - 1;
+    }
+
+    static inline TileKey fromQuadOrder(quint64 order, int type = 0)
+    {
+        int z = int(order & 0x1f);
+        Q_ASSERT(z <= QuadKeyMaxZoom);
+        quint32 x, y;
+        mortonDecode(order >> (2 * (QuadKeyMaxZoom - z) + 5), x, y);
+        return TileKey(int(x), int(y), z, type);
+    }
+
+    //! ключ с типом (тип - в младших 8 битах)
     inline quint64 hash() const
     {
-        return (quint64(y) << 40) | (quint64(x) << 16) | (quint64(z) << 8) | quint64(type);
+        return (quadOrder() << 8) | quint64(type);
     }
 };
 
@@ -232,7 +316,8 @@ enum MapOption {
     optIgnoreGen          = 0x01,
     optDissolveGen        = 0x02,
     optAntialiasing       = 0x04,
-    optSubstrateSmoothing = 0x08
+    optSubstrateSmoothing = 0x08,
+    optSubstrateAffine    = 0x10     // поворот подложки при отрисовке (без повернутых копий тайлов)
 };
 Q_DECLARE_FLAGS(MapOptions, MapOption)
 
@@ -246,6 +331,7 @@ inline QDebug operator<<(QDebug dbg, MapOption e)
     case optDissolveGen:        d << "optDissolveGen"; break;
     case optAntialiasing:       d << "optAntialiasing"; break;
     case optSubstrateSmoothing: d << "optSubstrateSmoothing"; break;
+    case optSubstrateAffine:    d << "optSubstrateAffine"; break;
     default: d << "Unknown MapOption!";
     }
     return dbg.space();
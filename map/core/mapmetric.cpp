@@ -1,5 +1,9 @@
 
+#include <QMutex>
+#include <QMutexLocker>
+
 #include "coord/mapcoords.h"
+#include "core/mapmath.h"
 #include "core/mapmetric.h"
 
 // -------------------------------------------------------
@@ -8,6 +12,11 @@ namespace minigis {
 
 // -------------------------------------------------------
 
+static const int LodMinPoints = 64;  // линии короче не упрощаются
+static const int LodMaxLevel  = 20;  // на уровнях крупнее - исходная метрика
+
+// -------------------------------------------------------
+
 Metric::Metric(MetricType mt)
     : QObject(), d_ptr(new MetricShareData)
 {
@@ -42,11 +51,13 @@ Metric::~Metric()
 void Metric::clear()
 {
     d_ptr->metric.clear();
+    d_ptr->lod.clear();
 }
 
 void Metric::setMetric(MetricData m, MetricType t)
 {
     d_ptr->metric.clear();
+    d_ptr->lod.clear();
     d_ptr->baseType = t;
     d_ptr->metric[d_ptr->baseType] = m;
 }
@@ -58,12 +69,22 @@ void Metric::setMetric(MetricItem m, MetricType t)
 
 void Metric::setMetric(MetricItem m, int ind, MetricType t)
 {
-    MetricData data = d_ptr->metric[d_ptr->baseType];
-    d_ptr->metric.clear();
+    MetricType base = d_ptr->baseType;
+    MetricData &data = d_ptr->metric[base];
     if (ind >= data.size())
         data.resize(ind + 1);
-    data[ind] = convertToType(m, findConvertFunction(t, d_ptr->baseType));
-    d_ptr->metric[d_ptr->baseType] = data;
+    data[ind] = convertToType(m, findConvertFunction(t, base));
+    d_ptr->lod.clear();
+
+    // в вычисленных системах координат пересчитывается только измененная часть
+    for (int i = 0; i < MetricStore::TypeCount; ++i) {
+        MetricType type = MetricStore::typeAt(i);
+        if (type == base || !d_ptr->metric.contains(type))
+            continue;
+        MetricData &view = d_ptr->metric[type];
+        view.resize(data.size());
+        view[ind] = convertToType(data.at(ind), findConvertFunction(base, type));
+    }
 }
 
 void Metric::setMetric(Metric m, int ind)
@@ -87,12 +108,42 @@ void Metric::setMetric(QPointF m, int ind, MetricType t)
 
 MetricData Metric::toType(MetricType t) const
 {
-    if (!d_ptr->metric.contains(t)) {
-        MetricData data;
-        d_ptr->metric[t] = data = convertToType(d_ptr->metric.value(d_ptr->baseType), findConvertFunction(d_ptr->baseType, t));
+    if (d_ptr->metric.contains(t))
+        return d_ptr->metric.value(t);
+
+    // один объект может рисоваться в нескольких тайлах одновременно
+    QMutexLocker locker(&d_ptr->mutex);
+    if (!d_ptr->metric.contains(t))
+        d_ptr->metric.publish(t, convertToType(d_ptr->metric.value(d_ptr->baseType), findConvertFunction(d_ptr->baseType, t)));
+    return d_ptr->metric.value(t);
+}
+
+MetricData Metric::toMercatorLod(int zoomLevel) const
+{
+    MetricData data = toMercator();
+    if (zoomLevel < 0 || zoomLevel > LodMaxLevel)
         return data;
+
+    {
+        QMutexLocker locker(&d_ptr->mutex);
+        QHash<int, MetricData>::const_iterator it = d_ptr->lod.constFind(zoomLevel);
+        if (it != d_ptr->lod.constEnd())
+            return it.value();
     }
-    return d_ptr->metric.value(t);
+
+    // упрощение - без блокировки, уровни разных объектов строятся параллельно
+    qreal epsilon = TileSystem::groundResolution(zoomLevel) / 2;
+    for (int i = 0; i < data.size(); ++i)
+        if (data.at(i).size() >= LodMinPoints)
+            data[i] = polygonSmoothing(data.at(i), epsilon);
+
+    // уровень мог построить другой поток - остается первый
+    QMutexLocker locker(&d_ptr->mutex);
+    QHash<int, MetricData>::const_iterator it = d_ptr->lod.constFind(zoomLevel);
+    if (it != d_ptr->lod.constEnd())
+        return it.value();
+    d_ptr->lod.insert(zoomLevel, data);
+    return data;
 }
 
 MetricItem Metric::toType(int ind, MetricType t) const
@@ -137,62 +188,47 @@ bool Metric::operator!=(Metric const &other) const
     return !(*this == other);
 }
 
-Metric::PointToPoint Metric::findConvertFunction(MetricType from, MetricType to) const
+// тип метрики в систему координат преобразования
+static bool transformerSystem(MetricType type, CoordTransformer::System &system)
 {
-    switch (from) {
-    case Mercator: {
-        switch (to) {
-        case SK42_flat:
-            return &CoordTranform::worldToSK42; break;
-        case WGS84_geo:
-            return &CoordTranform::worldToGeo; break;
-        default:
-            break;
-        }
-        break;
-    }
-    case SK42_flat: {
-        switch (to) {
-        case Mercator:
-            return &CoordTranform::sk42ToWorld; break;
-        case WGS84_geo:
-            return &CoordTranform::sk42ToGeo; break;
-        default:
-            break;
-        }
-        break;
-    }
-    case WGS84_geo: {
-        switch (to) {
-        case SK42_flat:
-            return &CoordTranform::geoToSK42; break;
-        case Mercator:
-            return &CoordTranform::geoToWorld; break;
-        default:
-            break;
-        }
-        break;
-    }
+    switch (type) {
+    case Mercator:
+        system = CoordTransformer::World; return true;
+    case WGS84_geo:
+        system = CoordTransformer::Geo; return true;
+    case SK42_flat:
+        system = CoordTransformer::SK42; return true;
     default:
         break;
     }
+    return false;
+}
 
-    return &noopTransform;
+CoordTransformer Metric::findConvertFunction(MetricType from, MetricType to) const
+{
+    CoordTransformer::System a, b;
+    if (!transformerSystem(from, a) || !transformerSystem(to, b))
+        return CoordTransformer();
+    return CoordTransformer(a, b);
 }
 
-MetricItem Metric::convertToType(const MetricItem &m, Metric::PointToPoint f) const
+MetricItem Metric::convertToType(const MetricItem &m, const CoordTransformer &f) const
 {
-    MetricItem result;
-    foreach (QPointF const point, m)
-        result.append(f(point));
+    // без преобразования - общие данные без копирования
+    if (f.isIdentity())
+        return m;
+
+    // результат выделяется один раз, преобразование - пакетом по непрерывному массиву
+    MetricItem result(m.size());
+    f.map(m.constData(), result.data(), m.size());
     return result;
 }
 
-MetricData Metric::convertToType(const MetricData &m, Metric::PointToPoint f) const
+MetricData Metric::convertToType(const MetricData &m, const CoordTransformer &f) const
 {
-    MetricData result;
-    foreach (MetricItem const &p, m)
-        result.append(convertToType(p, f));
+    MetricData result(m.size());
+    for (int i = 0; i < m.size(); ++i)
+        result[i] = convertToType(m.at(i), f);
     return result;
 }
 
@@ -2,6 +2,8 @@
 #define MAPOBJECTMETRIC_H
 
 #include <QObject>
+#include <QAtomicInt>
+#include <QMutex>
 #include <QPolygonF>
 #include <QMap>
 #include <QVariant>
@@ -25,6 +27,35 @@ enum MetricType {
 typedef QPolygonF MetricItem;
 typedef QVector<MetricItem> MetricData;
 class MetricShareData;
+class CoordTransformer;
+
+// -------------------------------------------------------
+// Метрика в базовой и вычисленных системах координат
+// (массив по типам вместо QHash: без выделения памяти под узлы хэша у каждого объекта)
+// Изменение - только из потока владельца объекта; вычисленные системы дописываются через publish
+// (под MetricShareData::mutex), признак наличия выставляется после записи данных
+class MetricStore
+{
+public:
+    MetricStore() : present(0) {}
+
+    static const int TypeCount = 3;
+    static inline MetricType typeAt(int i) { return MetricType((i + 1) * 10); }
+
+    inline bool contains(MetricType t) const { return present.loadAcquire() & bit(t); }
+    inline MetricData value(MetricType t) const { return contains(t) ? data[index(t)] : MetricData(); }
+    inline MetricData &operator[](MetricType t) { present.fetchAndOrRelaxed(bit(t)); return data[index(t)]; }
+    inline void publish(MetricType t, const MetricData &d) { data[index(t)] = d; present.fetchAndOrRelease(bit(t)); }
+    inline void remove(MetricType t) { present.fetchAndAndRelaxed(~bit(t)); data[index(t)] = MetricData(); }
+    inline void clear() { for (int i = 0; i < TypeCount; ++i) data[i] = MetricData(); present.storeRelease(0); }
+
+private:
+    static inline int index(MetricType t) { Q_ASSERT(t == Mercator || t == WGS84_geo || t == SK42_flat); return t / 10 - 1; }
+    static inline int bit(MetricType t) { return 1 << index(t); }
+
+    MetricData data[TypeCount];
+    QAtomicInt present;
+};
 
 // -------------------------------------------------------
 // Данные метрики
@@ -35,11 +66,18 @@ public:
     MetricShareData(const MetricShareData &other) : QSharedData(other) {
         metric   = other.metric;
         baseType = other.baseType;
+        lod      = other.lod;
     }
     ~MetricShareData() {}
 
-    mutable QHash<MetricType, MetricData > metric;
+    mutable MetricStore metric;
     MetricType baseType;
+
+    // упрощенные (Дуглас-Пекер) метрики Mercator по уровням масштаба, строятся при запросе
+    mutable QHash<int, MetricData > lod;
+
+    // дописывание вычисленных систем координат и уровней lod (отрисовка идет из нескольких потоков), не копируется
+    mutable QMutex mutex;
 };
 
 // TODO: перевести на использование coord::Metric_ с добавлением типа СК
@@ -87,6 +125,10 @@ public:
     Q_INVOKABLE inline MetricData toBaseType() const { return d_ptr->metric.value(d_ptr->baseType); }
     template<typename P> inline P toMetric(MetricType t = SK42_flat) const;
 
+    // вернуть метрику Mercator, упрощенную для уровня масштаба TileSystem (допуск - полпикселя уровня)
+    // короткие линии и крупные уровни не упрощаются; уровни считаются один раз и хранятся с метрикой
+    Q_INVOKABLE MetricData toMercatorLod(int zoomLevel) const;
+
     // вернуть часть метрики в нужной системе координат
     Q_INVOKABLE MetricItem toType(int ind, MetricType t) const;
     Q_INVOKABLE inline MetricItem toMercator(int ind) const { return toType(ind, Mercator);  }
@@ -155,12 +197,9 @@ public:
 
 private:
 
-    typedef QPointF(*PointToPoint)(const QPointF&);
-    static QPointF noopTransform(const QPointF &p) { return p; }
-
-    PointToPoint findConvertFunction(MetricType from, MetricType to) const;
-    MetricItem convertToType(const MetricItem &m, PointToPoint f) const;
-    MetricData convertToType(const MetricData &m, PointToPoint f) const;
+    CoordTransformer findConvertFunction(MetricType from, MetricType to) const;
+    MetricItem convertToType(const MetricItem &m, const CoordTransformer &f) const;
+    MetricData convertToType(const MetricData &m, const CoordTransformer &f) const;
 
     QSharedDataPointer<MetricShareData> d_ptr;
 };
@@ -176,6 +215,7 @@ template<typename P> Metric::Metric(coord::Metric_<P> m, MetricType t)
 template<typename P> void Metric::setMetric(coord::Metric_<P> m, MetricType t) {
     typedef coord::Metric_<P> MMT;
     d_ptr->metric.clear();
+    d_ptr->lod.clear();
     d_ptr->baseType = t;
     MetricData &md = d_ptr->metric[d_ptr->baseType];
 
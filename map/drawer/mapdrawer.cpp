@@ -7,6 +7,7 @@
 #include <QSvgGenerator>
 #include <QByteArray>
 #include <QBuffer>
+#include <qmath.h>
 
 // -------------------------------------------------------
 
@@ -90,6 +91,19 @@ QImage MapDrawer::grayScaled(const QImage &source)
     return result;
 }
 
+qreal MapDrawer::distance(const MapObject *object, const QPointF &pos)
+{
+    QRectF r = boundRect(object);
+    qreal dx = qMax(qMax(r.left() - pos.x(), pos.x() - r.right()), qreal(0));
+    qreal dy = qMax(qMax(r.top() - pos.y(), pos.y() - r.bottom()), qreal(0));
+    return qSqrt(dx * dx + dy * dy);
+}
+
+bool MapDrawer::isThreadSafe() const
+{
+    return false;
+}
+
 QVector<QLineF> MapDrawer::lines(const MapObject *object)
 {
     Q_UNUSED(object);
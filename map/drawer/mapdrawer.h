@@ -237,6 +237,23 @@ public:
      */
     virtual QRectF localBound(MapObject const *object, MapCamera const *camera) = 0;
 
+    /**
+     * @brief distance расстояние от точки до объекта
+     * По умолчанию - до описывающего прямоугольника (boundRect), 0 внутри него.
+     * Результат не меньше расстояния до boundRect, на этом строится поиск ближайших в MapRTree.
+     * @param object объект
+     * @param pos точка (мировые координаты, как у boundRect)
+     * @return расстояние
+     */
+    virtual qreal distance(MapObject const *object, QPointF const &pos);
+
+    /**
+     * @brief isThreadSafe можно ли вызывать paint одновременно из нескольких потоков
+     * (каждый поток со своим QPainter). Нужно для многопоточной отрисовки слоя объектов.
+     * @return по умолчанию нельзя
+     */
+    virtual bool isThreadSafe() const;
+
     /**
      * @brief isValid проверка объекта на валидность
      * @return
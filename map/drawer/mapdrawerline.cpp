@@ -4,6 +4,10 @@
 
 #include <QSvgRenderer>
 #include <QPainter>
+#include <QPicture>
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
 
 // -------------------------------------------------------
 
@@ -102,6 +106,43 @@ struct LineDrawerSettings
 
 // =======================================================
 
+// ключ отрисованной стрелки
+struct ArrowGlyphKey
+{
+    uint type;      //!< тип окончания (ArrowType)
+    QRgb color;     //!< цвет
+    qreal width;    //!< толщина линии стрелки
+    qreal scale;    //!< ширина стрелки на экране
+
+    bool operator==(const ArrowGlyphKey &other) const
+    {
+        return type == other.type && color == other.color && width == other.width && scale == other.scale;
+    }
+};
+
+inline uint qHash(const ArrowGlyphKey &key, uint seed = 0)
+{
+    return qHash(key.type, seed) ^ qHash(key.color, seed) * 31 ^ qHash(key.width, seed) ^ qHash(key.scale, seed) * 17;
+}
+
+// стрелка, записанная из svg (вершина в начале координат, направление вдоль оси Y)
+struct ArrowGlyph
+{
+    QByteArray picture; //!< команды отрисовки (QPicture::data)
+    qreal depth;        //!< длина стрелки вдоль линии (на сколько укорачивается линия)
+
+    // QPicture::play перемещает позицию буфера, общего для всех копий QPicture,
+    // поэтому каждая отрисовка воспроизводит свою копию команд
+    void draw(QPainter *painter) const
+    {
+        QPicture pic;
+        pic.setData(picture.constData(), picture.size());
+        painter->drawPicture(0, 0, pic);
+    }
+};
+
+// =======================================================
+
 class MapDrawerLinePrivate : public MapDrawerPrivate
 {
 public:
@@ -110,6 +151,15 @@ public:
 
     QMap<QString, LineDrawerSettings*> settings;
     virtual void init();
+
+    static const int arrowCacheMax = 1024;   // максимум стрелок в кэше
+    QCache<ArrowGlyphKey, ArrowGlyph> arrows; // разобранные svg стрелок, общие для всех объектов (LRU)
+    QMutex arrowMutex;                       // paint может вызываться из нескольких потоков
+
+    /**
+     * @brief arrow стрелка из кэша, при отсутствии - загрузка svg и запись
+     */
+    ArrowGlyph arrow(const ArrowGlyphKey &key);
 };
 
 // =======================================================
@@ -208,68 +258,51 @@ void MapDrawerLine::paint(MapObject const *object, QPainter *painter, QRectF con
         endMetric =  ArrowType::metric(endArrow);
     }
 
+    // стрелки зависят только от типа, цвета и толщины - берутся из кэша
+    ArrowGlyphKey arrowKey;
+    arrowKey.color = painter->pen().color().rgb();
+    arrowKey.width = set->arrowWidth ? set->lineWidth : 0;
+//    arrowKey.scale = qMax(wid * 2, wid + 20);
+    arrowKey.scale = (painter->pen().widthF() + 3) * 2;
+
     QPainterPath oddPath;
     oddPath.setFillRule(set->fillRule);
 
-    QVector<QPolygonF> metric = object->metric().toMercator();
+    // на мелких масштабах - упрощенная метрика (вершины ближе полупикселя не видны)
+    QVector<QPolygonF> metric = pix ? object->metric().toMercator() : object->metric().toMercatorLod(camera->zoomLevel());
     for (int l = 0; l < metric.size(); ++l) {
         if (metric.at(l).size() < 2)
             continue;
         QPolygonF path = pix ? tr.map(metric.at(l)) : camera->toScreen().map(metric.at(l));
 
-        QSvgRenderer arrowLeft;
-        QSvgRenderer arrowRight;
+        ArrowGlyph arrowLeft;
+        ArrowGlyph arrowRight;
 
-        QRectF rStart;
-        QRectF rEnd;
         QPointF midStart;
         QPointF midEnd;
-        QString cls = "object";
         // --------------------- расчет линии в зависимости от стрелок
         if (!startMetric.isEmpty()) {
-            QByteArray copy = ArrowType::templateSVG();
-            copy.replace("%color%", painter->pen().color().name().toUtf8());
-            copy.replace("%metric%", startMetric);
-            copy.replace("%width%", QString::number(set->arrowWidth ? set->lineWidth : 0).toUtf8());
-
-            arrowLeft.load(copy);
-            QRectF rtmp = ArrowType::bound(startArrow);
-            rStart = arrowLeft.boundsOnElement(cls);
-
             qreal wid = painter->pen().widthF();
-//            qreal s = qMax(wid * 2, wid + 20);
-            qreal s = (wid + 3) * 2;
-            rStart.setSize(rStart.size() * s / rStart.width());
-            rtmp.setSize(rtmp.size() * s / rtmp.width());
+            arrowKey.type = startArrow;
+            arrowLeft = d->arrow(arrowKey);
 
             midStart = path.first();
 
             QLineF l(path.first(), path.at(1));
             qreal len = lengthR2(l.p2() - l.p1());
-            path.replace(0, len < rtmp.height() ? l.p2() + (l.p1() - l.p2()) / len : l.pointAt((rtmp.height() - wid) / len));
+            path.replace(0, len < arrowLeft.depth ? l.p2() + (l.p1() - l.p2()) / len : l.pointAt((arrowLeft.depth - wid) / len));
         }
         if (!endMetric.isEmpty()) {
-            QByteArray copy = ArrowType::templateSVG();
-            copy.replace("%color%", painter->pen().color().name().toUtf8());
-            copy.replace("%metric%", endMetric);
-            copy.replace("%width%", QString::number(set->arrowWidth ? set->lineWidth : 0).toUtf8());
-
-            arrowRight.load(copy);
-            QRectF rtmp = ArrowType::bound(endArrow);
-            rEnd = arrowRight.boundsOnElement(cls);
-
             qreal wid = painter->pen().widthF();
-//            qreal s = qMax(wid * 2, wid + 20);
-            qreal s = (wid + 3) * 2;
-            rEnd.setSize(rEnd.size() * s / rEnd.width());
-            rtmp.setSize(rtmp.size() * s / rtmp.width());
+            arrowKey.type = endArrow;
+            arrowRight = d->arrow(arrowKey);
 
             midEnd = path.last();
 
             int n = path.size();
             QLineF l(path.last(), path.at(n - 2));
             qreal len = lengthR2(l.p2() - l.p1());
-            path.replace(n - 1, len < rtmp.height() ? l.p2() + (l.p1() - l.p2()) / len : l.pointAt((rtmp.height() - wid) / len));
+            path.replace(n - 1, len < arrowRight.depth ? l.p2() + (l.p1() - l.p2()) / len : l.pointAt((arrowRight.depth - wid) / len));
         }
 
         // --------------------- отрисовка линии
@@ -304,27 +337,21 @@ void MapDrawerLine::paint(MapObject const *object, QPainter *painter, QRectF con
 
         // --------------------- отрисовка стрелок
         if (!startMetric.isEmpty()) {
-            rStart.moveTopLeft(midStart - QPointF(rStart.center().x(), rStart.top()) + rStart.topLeft());
-
             painter->save();
 
             painter->translate(midStart);
             painter->rotate(angleStart - 90);
-            painter->translate(-midStart);
 
-            arrowLeft.render(painter, cls, rStart);
+            arrowLeft.draw(painter);
             painter->restore();
         }
         if (!endMetric.isEmpty()) {
-            rEnd.moveTopLeft(midEnd - QPointF(rEnd.center().x(), rEnd.top()) + rEnd.topLeft());
-
             painter->save();
 
             painter->translate(midEnd);
             painter->rotate(angleEnd - 90);
-            painter->translate(-midEnd);
 
-            arrowRight.render(painter, cls, rEnd);
+            arrowRight.draw(painter);
             painter->restore();
         }
     }
@@ -460,6 +487,44 @@ QRectF MapDrawerLine::localBound(const MapObject *object, const MapCamera *camer
     return rect.adjusted(-dt, -dt, dt, dt);
 }
 
+qreal MapDrawerLine::distance(MapObject const *object, const QPointF &pos)
+{
+    Q_D(MapDrawerLine);
+
+    LineDrawerSettings *set = d->settings.value(object->classCode());
+    if (!set || object->parentObject() || isEmpty(object))
+        return MapDrawer::distance(object, pos);
+
+    QVariant var = object->attribute(attrBrushStyle);
+    bool isFilled = set->isClosed && (var.isNull() ? set->brushStyle != Qt::NoBrush : Qt::BrushStyle(var.toInt()) != Qt::NoBrush);
+
+    // сглаженная линия считается по опорным точкам
+    qreal dist = -1;
+    QVector<QPolygonF> metric = object->metric().toMercator();
+    for (int l = 0; l < metric.size(); ++l) {
+        const QPolygonF &poly = metric.at(l);
+        if (poly.isEmpty())
+            continue;
+        if (isFilled && poly.containsPoint(pos, set->fillRule))
+            return 0;
+
+        qreal len = lengthR2(poly.first() - pos);
+        for (int i = 1; i < poly.size(); ++i)
+            len = qMin(len, qreal(distToSegment(pos, QLineF(poly.at(i - 1), poly.at(i)))));
+        if (set->isClosed && poly.size() > 2)
+            len = qMin(len, qreal(distToSegment(pos, QLineF(poly.last(), poly.first()))));
+
+        if (dist < 0 || len < dist)
+            dist = len;
+    }
+    return dist < 0 ? MapDrawer::distance(object, pos) : dist;
+}
+
+bool MapDrawerLine::isThreadSafe() const
+{
+    return true;
+}
+
 bool MapDrawerLine::isValid(MapObject const *object)
 {
     Q_D(MapDrawerLine);
@@ -714,11 +779,46 @@ void MapDrawerLine::renderImg(QPainter &painter, const QString &cls, QRectF rgn,
 // -------------------------------------------------------
 
 MapDrawerLinePrivate::MapDrawerLinePrivate()
-    :MapDrawerPrivate()
+    :MapDrawerPrivate(), arrows(arrowCacheMax)
 {
     init();
 }
 
+ArrowGlyph MapDrawerLinePrivate::arrow(const ArrowGlyphKey &key)
+{
+    {
+        QMutexLocker locker(&arrowMutex);
+        if (ArrowGlyph *glyph = arrows.object(key))
+            return *glyph;
+    }
+
+    QByteArray copy = ArrowType::templateSVG();
+    copy.replace("%color%", QColor(key.color).name().toUtf8());
+    copy.replace("%metric%", ArrowType::metric(key.type));
+    copy.replace("%width%", QString::number(key.width).toUtf8());
+
+    QString cls = "object";
+    QSvgRenderer svg(copy);
+    QRectF r = svg.boundsOnElement(cls);
+    r.setSize(r.size() * key.scale / r.width());
+    r.moveTopLeft(QPointF(-r.width() / 2, 0));
+
+    QPicture picture;
+    QPainter p(&picture);
+    svg.render(&p, cls, r);
+    p.end();
+
+    ArrowGlyph glyph;
+    glyph.picture = QByteArray(picture.data(), picture.size());
+    QRectF rtmp = ArrowType::bound(key.type);
+    glyph.depth = rtmp.height() * key.scale / rtmp.width();
+
+    // давно не использованные стрелки вытесняются
+    QMutexLocker locker(&arrowMutex);
+    arrows.insert(key, new ArrowGlyph(glyph));
+    return glyph;
+}
+
 void MapDrawerLinePrivate::init()
 {
     static const int MAXGEN = 10000000;
@@ -68,6 +68,20 @@ public:
      */
     virtual QRectF localBound(MapObject const *object, const MapCamera *camera);
 
+    /**
+     * @brief distance расстояние от точки до линии (до контура, 0 внутри закрашенной площади)
+     * @param object объект
+     * @param pos точка (в меркаторе)
+     * @return расстояние
+     */
+    virtual qreal distance(MapObject const *object, QPointF const &pos);
+
+    /**
+     * @brief isThreadSafe отрисовка использует локальные объекты, неизменяемые настройки, кэш стрелок под мьютексом
+     * и метрику, вычисляемую под блокировкой Metric
+     */
+    virtual bool isThreadSafe() const;
+
     /**
      * @brief isValid проверка объекта на валидность
      * @return
@@ -6,6 +6,8 @@
 #include <QFileInfo>
 #include <QBuffer>
 
+#include <algorithm>
+
 // -------------------------------------------------------
 
 #include <common/Runtime.h>
@@ -109,6 +111,8 @@ void MapFrame::initDrawersAndLayers()
     registerLayer(lTile);
 
     d_ptr->layerTile = lTile;
+    // упреждающая загрузка подложки при анимации камеры и инерционном перемещении
+    connect(d_ptr->camera.data(), SIGNAL(destinationChanged(QPointF,qreal)), lTile, SLOT(prefetch(QPointF,qreal)));
     lTile->changeColorizedTiles(ConvertColor::hsvColor);
 
     // FIXME: Сильно подозреваю что лоадеры нигде не удаляются (как и драверы). придумать механизм чистки при завершении ПО
@@ -314,6 +318,31 @@ const QList<MapObject *> MapFrame::selectObjects(const QPointF &pos, const MapCa
 
 // -------------------------------------------------------
 
+QList<MapObject *> MapFrame::nearestObjects(const QPointF &pos, const MapCamera *camera, int k, qreal radius,
+                                            const MapObjectFilter &filter) const
+{
+    // ближайшие каждого слоя, затем общий порядок по расстоянию
+    QList<QPair<qreal, MapObject *> > all;
+    foreach (MapLayer *l, layers()) {
+        MapLayerObjects* lobj = qobject_cast<MapLayerObjects*>(l);
+        if (!lobj)
+            continue;
+        QList<qreal> dist;
+        QList<MapObject *> list = lobj->nearestObjects(pos, camera, k, radius, filter, &dist);
+        for (int i = 0; i < list.size(); ++i)
+            all.append(qMakePair(dist.at(i), list.at(i)));
+    }
+    std::stable_sort(all.begin(), all.end(),
+                     [](const QPair<qreal, MapObject *> &a, const QPair<qreal, MapObject *> &b) { return a.first < b.first; });
+
+    QList<MapObject *> list;
+    for (int i = 0; i < all.size() && (k < 1 || i < k); ++i)
+        list.append(all.at(i).second);
+    return list;
+}
+
+// -------------------------------------------------------
+
 void MapFrame::updateScene(QRect r)
 {
     r.isEmpty() ? update() : update(r);
@@ -340,7 +369,7 @@ void MapFrame::paint(QPainter *painter)
 
     foreach (MapLayer *l, layers())
         if (l->visible())
-            l->update(painter, contentsBoundingRect().toRect());
+            l->update(painter, contentsBoundingRect().toRect(), settings()->mapOptions());
 }
 
 // -------------------------------------------------------
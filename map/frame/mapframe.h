@@ -8,6 +8,8 @@
 
 #include <QEvent>
 
+#include "layers/maprtree.h"
+
 // -------------------------------------------------------
 
 namespace minigis {
@@ -65,6 +67,8 @@ public:
 
     QList<MapObject *> const selectObjects(QRectF const &rgn, MapCamera const *camera) const;
     QList<MapObject *> const selectObjects(QPointF const &pos, MapCamera const *camera) const;
+    QList<MapObject *> nearestObjects(QPointF const &pos, MapCamera const *camera, int k, qreal radius,
+                                      MapObjectFilter const &filter = MapObjectFilter()) const;
 
 public Q_SLOTS:
     void updateScene(QRect = QRect());
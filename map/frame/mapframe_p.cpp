@@ -46,6 +46,7 @@ void MapFramePrivate::connectSettingsToData()
     connect(settings.data(), SIGNAL(currentSearchTypeChanged()), SLOT(setSearcher()));
     connect(settings.data(), SIGNAL(nightModeChanged()), SLOT(clearTileCache()));
     connect(settings.data(), SIGNAL(mapOptionsChanged()), SLOT(mapOptionsChanged()));
+    connect(settings.data(), SIGNAL(tileCacheBudgetChanged()), SLOT(tileCacheBudgetChanged()));
 }
 
 // -------------------------------------------------------
@@ -186,6 +187,16 @@ void MapFramePrivate::mapOptionsChanged()
 
 // -------------------------------------------------------
 
+void MapFramePrivate::tileCacheBudgetChanged()
+{
+    if (layerTile.isNull())
+        return;
+
+    layerTile->setCacheBudget(qint64(settings->tileCacheBudget()) << 20);
+}
+
+// -------------------------------------------------------
+
 } // namespace minigis
 
 // -------------------------------------------------------
@@ -55,6 +55,7 @@ private Q_SLOTS:
     void setSearcher();
     void clearTileCache();
     void mapOptionsChanged();
+    void tileCacheBudgetChanged();
 
 public:
     Q_DECLARE_PUBLIC(MapFrame)
@@ -34,6 +34,10 @@ struct MapSettingsPrivate
     bool searchHelper;
 
     bool useGrid;
+
+    int tileCacheBudget;         // бюджет памяти кэша подложки (Мб)
+    QVariantMap tileCacheStats;  // статистика кэша подложки
+    QVariantMap tilePrefetchStats; // статистика упреждающей загрузки подложки
 };
 
 // ----------------------------------------------
@@ -52,6 +56,8 @@ MapSettings::MapSettings(QObject *parent)
     d->searchHelper = true;
 
     d->useGrid = true;
+
+    d->tileCacheBudget = TILECACHEBUDGET;
 }
 
 MapSettings::~MapSettings()
@@ -146,6 +152,24 @@ bool MapSettings::isGridEnabled() const
     return d->useGrid;
 }
 
+int MapSettings::tileCacheBudget() const
+{
+    Q_D(const MapSettings);
+    return d->tileCacheBudget;
+}
+
+QVariantMap MapSettings::tileCacheStats() const
+{
+    Q_D(const MapSettings);
+    return d->tileCacheStats;
+}
+
+QVariantMap MapSettings::tilePrefetchStats() const
+{
+    Q_D(const MapSettings);
+    return d->tilePrefetchStats;
+}
+
 void MapSettings::setSaturation(qreal sat)
 {
     Q_D(MapSettings);
@@ -283,6 +307,34 @@ void MapSettings::enableGrid(bool flag)
     }
 }
 
+void MapSettings::setTileCacheBudget(int mb)
+{
+    Q_D(MapSettings);
+    mb = qMax(mb, 0);
+    if (d->tileCacheBudget != mb) {
+        d->tileCacheBudget = mb;
+        emit tileCacheBudgetChanged();
+    }
+}
+
+void MapSettings::setTileCacheStats(const QVariantMap &stats)
+{
+    Q_D(MapSettings);
+    if (d->tileCacheStats != stats) {
+        d->tileCacheStats = stats;
+        emit tileCacheStatsChanged();
+    }
+}
+
+void MapSettings::setTilePrefetchStats(const QVariantMap &stats)
+{
+    Q_D(MapSettings);
+    if (d->tilePrefetchStats != stats) {
+        d->tilePrefetchStats = stats;
+        emit tilePrefetchStatsChanged();
+    }
+}
+
 void MapSettings::timerEvent(QTimerEvent */*e*/)
 {
 #if 0
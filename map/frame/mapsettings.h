@@ -2,6 +2,7 @@
 #define MAPSETTINGS_H
 
 #include <QObject>
+#include <QVariantMap>
 #include "map/core/mapdefs.h"
 
 // -------------------------------------------------------
@@ -27,6 +28,9 @@ class MapSettings : public QObject
     Q_PROPERTY(int minSunHour READ minSunHour WRITE setMinSunHour NOTIFY minSunHourChanged)
     Q_PROPERTY(int maxSunHour READ maxSunHour WRITE setMaxSunHour NOTIFY maxSunHourChanged)
     Q_PROPERTY(bool grid READ isGridEnabled WRITE enableGrid NOTIFY gridChanged)
+    Q_PROPERTY(int tileCacheBudget READ tileCacheBudget WRITE setTileCacheBudget NOTIFY tileCacheBudgetChanged)
+    Q_PROPERTY(QVariantMap tileCacheStats READ tileCacheStats NOTIFY tileCacheStatsChanged)
+    Q_PROPERTY(QVariantMap tilePrefetchStats READ tilePrefetchStats NOTIFY tilePrefetchStatsChanged)
 
 public:
     explicit MapSettings(QObject *parent = 0);
@@ -47,6 +51,9 @@ public slots:
     int currentSearchType() const;
     bool isSearchHelper() const;
     bool isGridEnabled() const;
+    int tileCacheBudget() const;
+    QVariantMap tileCacheStats() const;
+    QVariantMap tilePrefetchStats() const;
 
     void setSaturation(qreal sat);
     void setValue(qreal val);
@@ -62,6 +69,9 @@ public slots:
     void setCurrentSearchType(int type);
     void enableSearchHelper(bool flag);
     void enableGrid(bool flag);
+    void setTileCacheBudget(int mb);
+    void setTileCacheStats(const QVariantMap &stats);
+    void setTilePrefetchStats(const QVariantMap &stats);
 
 signals:
     void saturationChanged();
@@ -78,6 +88,9 @@ signals:
     void currentSearchTypeChanged();
     void searchHelperChanged();
     void gridChanged();
+    void tileCacheBudgetChanged();
+    void tileCacheStatsChanged();
+    void tilePrefetchStatsChanged();
 
 protected:
     virtual void timerEvent(QTimerEvent *);
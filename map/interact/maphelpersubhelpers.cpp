@@ -197,13 +197,10 @@ bool MapSubHelperMove::finish(QPointF pos)
         QRectF rgn(pos, QSizeF());
         int sizeR = 20;
         rgn.adjust(-sizeR, -sizeR, sizeR, sizeR);
-        QList<MapObject*> lo(map->selectObjects(rgn, cam));
-        QList<MapObject*> reslo;
-        reslo.reserve(lo.size());
-        foreach (MapObject *mo, lo) {
-            if (mo->drawer()->hit(mo, rgn, cam, opt))
-                reslo.append(mo);
-        }
+        // объекты под пальцем, ближайшие первыми
+        QList<MapObject*> reslo(map->nearestObjects(pos, cam, -1, sizeR, [&](MapObject *mo) {
+            return mo->drawer()->hit(mo, rgn, cam, opt);
+        }));
 
         MHETap mhtap(reslo, pos);
         emit handler(&mhtap);
@@ -443,11 +443,13 @@ bool MapHelperTouch::startFlick(int dx, int dy, int timeMs)
     QPointF aniStart = map->camera()->position();
     if (pan.animation->state() == QPropertyAnimation::Running)
         pan.animation->stop();
-    QPointF aniEnd = map->camera()->toWorld(map->camera()->toScreen(aniStart) + QPointF(dx, dy));
+    QPointF aniEnd = flickDestination(QPointF(dx, dy));
     pan.animation->setDuration(timeMs);
     pan.animation->setStartValue(QVariant::fromValue(aniStart));
     pan.animation->setEndValue(QVariant::fromValue(aniEnd));
     pan.animation->start();
+    // анимация идет через свойство pos, поэтому сообщаем камере точку назначения явно
+    map->camera()->expectDestination(aniEnd);
     emit flickStarted();
     return true;
 }
@@ -509,9 +511,23 @@ void MapHelperTouch::updateVelocityList(const QPointF &pos)
         qreal velY = qreal(dyFromLastPos) / elapsed;
         velocityX = qBound<qreal>(-pan.maxVelocity, velX, pan.maxVelocity);
         velocityY = qBound<qreal>(-pan.maxVelocity, velY, pan.maxVelocity);
+
+        // быстрое перемещение пальцем: заранее сообщаем камере, куда докатится карта
+        qreal deceleration = qAbs(pan.deceleration);
+        if (panState == panActive && deceleration > 0 &&
+                qMax(qAbs(velocityX), qAbs(velocityY)) > MinimumFlickVelocity) {
+            QPointF offset(-velocityX * qAbs(velocityX), -velocityY * qAbs(velocityY));
+            map->camera()->expectDestination(flickDestination(offset / (2 * deceleration)));
+        }
     }
 }
 
+QPointF MapHelperTouch::flickDestination(const QPointF &offset) const
+{
+    MapCamera *camera = map->camera();
+    return camera->toWorld(camera->toScreen(camera->position()) + offset);
+}
+
 //----------------------------------------------------------
 
 } // namespace minigis
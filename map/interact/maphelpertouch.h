@@ -133,6 +133,7 @@ private:
     void updatePan();
     bool tryStartFlick();
     bool startFlick(int dx, int dy, int timeMs = 0);
+    QPointF flickDestination(const QPointF &offset) const;
 
     bool isPinchActive() const;
     void setPinchActive(bool active);
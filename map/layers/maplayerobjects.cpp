@@ -1,5 +1,11 @@
 #include <QDebug>
 #include <QStack>
+#include <QVector>
+#include <QImage>
+#include <QtConcurrentMap>
+#include <qmath.h>
+
+#include <algorithm>
 
 #include "coord/mapcamera.h"
 #include "object/mapobject.h"
@@ -22,11 +28,40 @@ struct CompareObjectsByNpp
     bool operator ()(MapObject *a, MapObject *b) { return npp->value(a) < npp->value(b); }
 };
 
+// запас выборки объектов вокруг области (пикселей)
+// TODO: избавиться от FictiveSize
+static const int FictiveSize = 30;
+
+// тайл многопоточной отрисовки
+struct RenderTile
+{
+    QRect rect;
+    QVector<MapObject const *> objects;
+    QImage image;
+};
+
+// отрисовка объекта вместе с дочерними
+static void paintObject(MapObject const *object, QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options)
+{
+    QStack<MapObject const *> stack;
+    stack.push(object);
+    while (!stack.empty()) {
+        MapObject const *o = stack.pop();
+        if (o->drawer())
+            o->drawer()->paint(o, painter, rgn, camera, options);
+
+        foreach (MapObject const *child, o->childrenObjects())
+            stack.push(child);
+    }
+}
+
 // -------------------------------------------------------
 
 MapLayerObjectsPrivate::MapLayerObjectsPrivate(QObject *parent)
-    : MapLayerWithObjectsPrivate(parent), tree(new MapRTree), nppMin(0), nppMax(0)
+    : MapLayerWithObjectsPrivate(parent), tree(new MapRTree), parallelRender(false), nppMin(0), nppMax(0),
+      rasterCache(false), raster(RasterBudget), rasterDpr(0)
 {
+    connect(tree.data(), SIGNAL(regionChanged(QRectF,bool)), SLOT(treeRegionChanged(QRectF,bool)));
 }
 
 // -------------------------------------------------------
@@ -40,18 +75,290 @@ MapLayerObjectsPrivate::~MapLayerObjectsPrivate()
 void MapLayerObjectsPrivate::render(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options)
 {
     Q_Q(MapLayerObjects);
-    foreach (MapObject const *object, q->selectObjects(rgn, camera)) {
+    if (rasterCache && renderCached(painter, rgn, camera, options)) {
+        // объекты с пиксельной привязкой поверх кэша
+        foreach (MapObject const *object, localObjects)
+            if (object->drawer())
+                paintObject(object, painter, rgn, camera, options);
+        return;
+    }
+
+    QList<MapObject *> objects = q->selectObjects(rgn, camera);
+    if (parallelRender && objects.size() >= ParallelMin && renderTiled(painter, rgn, camera, options, objects))
+        return;
+
+    foreach (MapObject const *object, objects)
+        paintObject(object, painter, rgn, camera, options);
+}
+
+// -------------------------------------------------------
+
+bool MapLayerObjectsPrivate::renderTiled(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options, QList<MapObject *> objects)
+{
+    if (!painter->device() || !painter->transform().isIdentity())
+        return false;
+
+    QRect area = rgn.toAlignedRect();
+    if (area.isEmpty())
+        return false;
+
+    // границы объектов на экране (вместе с дочерними), неизвестные - весь экран
+    QVector<QRect> bounds(objects.size());
+    for (int i = 0; i < objects.size(); ++i) {
+        QRectF b;
+        bool unknown = false;
         QStack<MapObject const *> stack;
-        stack.push(object);
+        stack.push(objects.at(i));
         while (!stack.empty()) {
             MapObject const *o = stack.pop();
-            if (o->drawer())
-                o->drawer()->paint(o, painter, rgn, camera, options);
-
+            // метрика Mercator заполняется здесь, чтобы потоки отрисовки только читали ее
+            // (дочерние объекты с пиксельной привязкой в дерево не попадают и сами ее не вычисляют)
+            o->metric().toMercator();
+            if (o->drawer()) {
+                if (!o->drawer()->isThreadSafe())
+                    return false;
+                QRectF lb = o->drawer()->localBound(o, camera);
+                if (lb.isNull())
+                    unknown = true;
+                else
+                    b = b.isNull() ? lb : b.united(lb);
+            }
             foreach (MapObject const *child, o->childrenObjects())
                 stack.push(child);
         }
+        bounds[i] = unknown ? area : b.toAlignedRect().adjusted(-1, -1, 1, 1) & area;
+    }
+
+    // распределение объектов по тайлам (порядок отрисовки как при обычной отрисовке)
+    int cols = (area.width() + RenderTileSize - 1) / RenderTileSize;
+    int rows = (area.height() + RenderTileSize - 1) / RenderTileSize;
+    QVector<RenderTile> tiles(cols * rows);
+    for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c)
+            tiles[r * cols + c].rect = QRect(area.left() + c * RenderTileSize, area.top() + r * RenderTileSize,
+                                             RenderTileSize, RenderTileSize) & area;
+
+    for (int i = 0; i < objects.size(); ++i) {
+        const QRect &b = bounds.at(i);
+        if (b.isEmpty())
+            continue;
+        int c0 = (b.left() - area.left()) / RenderTileSize;
+        int c1 = (b.right() - area.left()) / RenderTileSize;
+        int r0 = (b.top() - area.top()) / RenderTileSize;
+        int r1 = (b.bottom() - area.top()) / RenderTileSize;
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                tiles[r * cols + c].objects.append(objects.at(i));
+    }
+
+    int dpr = painter->device()->devicePixelRatio();
+    QPainter::RenderHints hints = painter->renderHints();
+    QtConcurrent::blockingMap(tiles, [=](RenderTile &tile) {
+        if (tile.objects.isEmpty())
+            return;
+
+        tile.image = QImage(tile.rect.size() * dpr, QImage::Format_ARGB32_Premultiplied);
+        tile.image.setDevicePixelRatio(dpr);
+        tile.image.fill(Qt::transparent);
+
+        QPainter p(&tile.image);
+        p.setRenderHints(hints);
+        p.translate(-tile.rect.topLeft());
+        p.setClipRect(tile.rect);
+        foreach (MapObject const *object, tile.objects)
+            paintObject(object, &p, QRectF(tile.rect), camera, options);
+    });
+
+    foreach (const RenderTile &tile, tiles)
+        if (!tile.image.isNull())
+            painter->drawImage(tile.rect.topLeft(), tile.image);
+    return true;
+}
+
+// -------------------------------------------------------
+
+bool MapLayerObjectsPrivate::renderCached(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options)
+{
+    if (!painter->device() || !painter->transform().isIdentity())
+        return false;
+
+    // масштаб или поворот меняются (анимация камеры) - кэш не заполняется
+    const QTransform &ts = camera->toScreen();
+    QTransform linear(ts.m11(), ts.m12(), ts.m21(), ts.m22(), 0, 0);
+    if (linear != rasterLinear) {
+        rasterLinear = linear;
+        return false;
+    }
+
+    int dpr = painter->device()->devicePixelRatio();
+    if (options != rasterOptions || dpr != rasterDpr) {
+        raster.clear();
+        rasterDirty.clear();
+        rasterOptions = options;
+        rasterDpr = dpr;
+    }
+    applyRasterDirty();
+
+    // тайлы в экранных координатах без сдвига камеры
+    QPointF shift(ts.dx(), ts.dy());
+    QRectF area = rgn.translated(-shift);
+    int x0 = qFloor(area.left() / RenderTileSize);
+    int x1 = qCeil(area.right() / RenderTileSize);
+    int y0 = qFloor(area.top() / RenderTileSize);
+    int y1 = qCeil(area.bottom() / RenderTileSize);
+
+    RasterTileKey key;
+    key.m11 = linear.m11();
+    key.m12 = linear.m12();
+    key.m21 = linear.m21();
+    key.m22 = linear.m22();
+    for (key.y = y0; key.y < y1; ++key.y) {
+        for (key.x = x0; key.x < x1; ++key.x) {
+            QPointF pos = QPointF(key.x * RenderTileSize, key.y * RenderTileSize) + shift;
+            QImage image;
+            if (QImage *cached = raster.object(key))
+                image = *cached;
+            else {
+                image = renderRasterTile(QRectF(pos, QSizeF(RenderTileSize, RenderTileSize)), painter->renderHints(), camera, options);
+                raster.insert(key, new QImage(image), qMax(1, image.byteCount() / 1024));
+            }
+            painter->drawImage(pos, image);
+        }
+    }
+    return true;
+}
+
+// -------------------------------------------------------
+
+QImage MapLayerObjectsPrivate::renderRasterTile(const QRectF &rect, QPainter::RenderHints hints, const MapCamera *camera, MapOptions options)
+{
+    QImage image(QSize(RenderTileSize, RenderTileSize) * rasterDpr, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(rasterDpr);
+    image.fill(Qt::transparent);
+
+    QRectF tmp = rect.adjusted(-RasterMargin, -RasterMargin, RasterMargin, RasterMargin);
+    QList<MapObject *> objects = tree->find(QPolygonF(camera->toWorld().map(tmp)));
+    if (objects.isEmpty())
+        return image;
+
+    QPainter p(&image);
+    p.setRenderHints(hints);
+    p.translate(-rect.topLeft());
+    p.setClipRect(rect);
+    foreach (MapObject const *object, objects)
+        paintObject(object, &p, rect, camera, options);
+    return image;
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::applyRasterDirty()
+{
+    if (rasterDirty.isEmpty())
+        return;
+
+    foreach (const RasterTileKey &key, raster.keys()) {
+        QTransform linear = key.linear();
+        QRectF tile(key.x * RenderTileSize, key.y * RenderTileSize, RenderTileSize, RenderTileSize);
+        foreach (const QRectF &r, rasterDirty) {
+            QRectF area = linear.mapRect(r).adjusted(-RasterMargin, -RasterMargin, RasterMargin, RasterMargin);
+            if (area.intersects(tile)) {
+                raster.remove(key);
+                break;
+            }
+        }
+    }
+    rasterDirty.clear();
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::invalidateRaster(MapObject *mo)
+{
+    if (!rasterCache || raster.isEmpty())
+        return;
+
+    // объект с пиксельной привязкой рисуется вместе с корневым объектом
+    while (mo->parentObject())
+        mo = mo->parentObject();
+
+    markRasterDirty(tree->objectRect(mo));
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::markRasterDirty(const QRectF &r)
+{
+    // слой давно не отрисовывался - области объединяются
+    if (rasterDirty.size() >= RasterDirtyMax) {
+        QRectF &u = rasterDirty.last();
+        u = QRectF(QPointF(qMin(u.left(), r.left()), qMin(u.top(), r.top())),
+                   QPointF(qMax(u.right(), r.right()), qMax(u.bottom(), r.bottom())));
+    }
+    else
+        rasterDirty.append(r);
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::treeRegionChanged(QRectF rect, bool whole)
+{
+    if (!rasterCache)
+        return;
+
+    if (whole) {
+        raster.clear();
+        rasterDirty.clear();
     }
+    else
+        markRasterDirty(rect);
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::objectMetricChanged()
+{
+    if (!rasterCache)
+        return;
+
+    MapObject *mo = static_cast<MapObject *>(sender());
+    invalidateRaster(mo);
+
+    // новые границы сообщит дерево
+    if (!mo->parentObject())
+        tree->movedObj(mo);
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::objectAppearanceChanged()
+{
+    invalidateRaster(static_cast<MapObject *>(sender()));
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::connectAppearance(MapObject *mo)
+{
+    // все, что рисует drawer кроме метрики: атрибуты, подписи, семантика, выделение и подсветка
+    connect(mo, SIGNAL(attributeChanged(int,QVariant)), SLOT(objectAppearanceChanged()));
+    connect(mo, SIGNAL(textChanged(QString,int)), SLOT(objectAppearanceChanged()));
+    connect(mo, SIGNAL(semanticChanged(QString,QVariant)), SLOT(objectAppearanceChanged()));
+    connect(mo, SIGNAL(semanticsChanged(QVariantMap)), SLOT(objectAppearanceChanged()));
+    connect(mo, SIGNAL(selectedChanged(bool)), SLOT(objectAppearanceChanged()));
+    connect(mo, SIGNAL(highlightedChanged(Highlighting)), SLOT(objectAppearanceChanged()));
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjectsPrivate::disconnectAppearance(MapObject *mo)
+{
+    disconnect(mo, SIGNAL(attributeChanged(int,QVariant)), this, SLOT(objectAppearanceChanged()));
+    disconnect(mo, SIGNAL(textChanged(QString,int)), this, SLOT(objectAppearanceChanged()));
+    disconnect(mo, SIGNAL(semanticChanged(QString,QVariant)), this, SLOT(objectAppearanceChanged()));
+    disconnect(mo, SIGNAL(semanticsChanged(QVariantMap)), this, SLOT(objectAppearanceChanged()));
+    disconnect(mo, SIGNAL(selectedChanged(bool)), this, SLOT(objectAppearanceChanged()));
+    disconnect(mo, SIGNAL(highlightedChanged(Highlighting)), this, SLOT(objectAppearanceChanged()));
 }
 
 // -------------------------------------------------------
@@ -117,6 +424,22 @@ void MapLayerObjects::addObject(MapObject *mo)
     d->mObjects.insert(mo->uid(), mo);
     connect(mo, SIGNAL(uidChanged(QString,QString)), d, SLOT(objectUidChanged(QString,QString)));
     connect(mo, SIGNAL(aniNotify(MapObject*)), SLOT(updateObj(MapObject*)));
+    connect(mo, SIGNAL(metricChanged()), d, SLOT(objectMetricChanged()));
+    d->connectAppearance(mo);
+}
+
+// -------------------------------------------------------
+
+void MapLayerObjects::addObjects(const QList<MapObject *> &objList)
+{
+    Q_D(MapLayerObjects);
+    // пачка объектов попадет в дерево пакетным построением
+    bool locked = d->tree->isLocked();
+    d->tree->lock();
+    foreach (MapObject *mo, objList)
+        addObject(mo);
+    if (!locked)
+        d->tree->unlock();
 }
 
 // -------------------------------------------------------
@@ -126,6 +449,9 @@ void MapLayerObjects::remObject(MapObject *mo)
     Q_D(MapLayerObjects);
     disconnect(mo, SIGNAL(uidChanged(QString,QString)), d, SLOT(objectUidChanged(QString,QString)));
     disconnect(mo, SIGNAL(aniNotify(MapObject*)), this, SLOT(updateObj(MapObject*)));
+    disconnect(mo, SIGNAL(metricChanged()), d, SLOT(objectMetricChanged()));
+    d->disconnectAppearance(mo);
+    d->invalidateRaster(mo);
 
     d->tree->deleteObj(mo);
     d->lObjects.removeAll(mo);
@@ -141,6 +467,9 @@ void MapLayerObjects::removeObjects(const QList<MapObject *> &objList)
     Q_D(MapLayerObjects);
     foreach (MapObject *mo, objList) {
         disconnect(mo, SIGNAL(uidChanged(QString,QString)), d, SLOT(objectUidChanged(QString,QString)));
+        disconnect(mo, SIGNAL(metricChanged()), d, SLOT(objectMetricChanged()));
+        d->disconnectAppearance(mo);
+        d->invalidateRaster(mo);
 
         d->lObjects.removeAll(mo);
         d->mObjects.remove(d->mObjects.key(mo));
@@ -298,12 +627,16 @@ void MapLayerObjects::clearLayer()
     foreach (MapObject *mo, d->lObjects) {
         disconnect(mo, SIGNAL(uidChanged(QString,QString)), d, SLOT(objectUidChanged(QString,QString)));
         disconnect(mo, SIGNAL(aniNotify(MapObject*)), this, SLOT(updateObj(MapObject*)));
+        disconnect(mo, SIGNAL(metricChanged()), d, SLOT(objectMetricChanged()));
+        d->disconnectAppearance(mo);
         mo->setLayer(NULL);
     }
     d->lObjects.clear();
     foreach (MapObject *mo, d->localObjects) {
         disconnect(mo, SIGNAL(uidChanged(QString,QString)), d, SLOT(objectUidChanged(QString,QString)));
         disconnect(mo, SIGNAL(aniNotify(MapObject*)), this, SLOT(updateObj(MapObject*)));
+        disconnect(mo, SIGNAL(metricChanged()), d, SLOT(objectMetricChanged()));
+        d->disconnectAppearance(mo);
         mo->setLayer(NULL);
     }
     d->localObjects.clear();
@@ -315,9 +648,6 @@ const QList<MapObject *> MapLayerObjects::selectObjects(QRectF const &rgn, MapCa
 {
     Q_D(const MapLayerObjects);
 
-// TODO: избавиться от FictiveSize
-    int FictiveSize = 30;
-
     QRectF tmp = rgn.adjusted(-FictiveSize, -FictiveSize, +FictiveSize, +FictiveSize);
 
     if (!cam)
@@ -343,6 +673,47 @@ const QList<MapObject *> MapLayerObjects::selectObjects(QPointF const &pos, MapC
 
 // -------------------------------------------------------
 
+QList<MapObject *> MapLayerObjects::nearestObjects(const QPointF &pos, const MapCamera *cam, int k, qreal radius,
+                                                   const MapObjectFilter &filter, QList<qreal> *distances) const
+{
+    Q_D(const MapLayerObjects);
+
+    if (!cam)
+        cam = camera();
+    QPointF worldPos = cam->toWorld().map(pos);
+    qreal worldRadius = QLineF(worldPos, cam->toWorld().map(pos + QPointF(radius + FictiveSize, 0))).length();
+
+    QList<qreal> dist;
+    QList<MapObject *> res = d->tree->nearest(worldPos, k, worldRadius, filter, &dist);
+
+    // объекты с пиксельной привязкой: расстояние до описывающего прямоугольника на экране,
+    // переведенного в мировые координаты; вставка среди объектов дерева по расстоянию
+    foreach (MapObject *mo, d->localObjects) {
+        if (!mo->drawer() || (filter && !filter(mo)))
+            continue;
+        QRectF r = cam->toWorld().mapRect(mo->drawer()->localBound(mo, cam));
+        qreal dx = qMax(qMax(r.left() - worldPos.x(), worldPos.x() - r.right()), qreal(0));
+        qreal dy = qMax(qMax(r.top() - worldPos.y(), worldPos.y() - r.bottom()), qreal(0));
+        qreal dd = qSqrt(dx * dx + dy * dy);
+        if (dd > worldRadius)
+            continue;
+        int i = std::upper_bound(dist.begin(), dist.end(), dd) - dist.begin();
+        if (k > 0 && i >= k)
+            continue;
+        res.insert(i, mo);
+        dist.insert(i, dd);
+        if (k > 0 && res.size() > k) {
+            res.removeLast();
+            dist.removeLast();
+        }
+    }
+    if (distances)
+        *distances = dist;
+    return res;
+}
+
+// -------------------------------------------------------
+
 const QList<MapObject *> &MapLayerObjects::objectsFree() const
 {
     Q_D(const MapLayerObjects);
@@ -409,6 +780,7 @@ void MapLayerObjects::raiseObject(MapObject *object)
         d->npp[object] = ++d->nppMax;
         d->validateMinMax();
     }
+    d->invalidateRaster(object);
 }
 
 // -------------------------------------------------------
@@ -433,6 +805,7 @@ void MapLayerObjects::lowerObject(MapObject *object)
         d->npp[object] = --d->nppMin;
         d->validateMinMax();
     }
+    d->invalidateRaster(object);
 }
 
 // -------------------------------------------------------
@@ -454,6 +827,7 @@ void MapLayerObjects::stackUnderObject(MapObject *object, MapObject *parentObjec
     }
     else
         d->npp[object] = d->npp[parentObject] + 1;
+    d->invalidateRaster(object);
 }
 
 // -------------------------------------------------------
@@ -470,6 +844,48 @@ void MapLayerObjects::unlockLayer()
     d->tree->unlock();
 }
 
+void MapLayerObjects::setParallelRender(bool on)
+{
+    Q_D(MapLayerObjects);
+    if (d->parallelRender == on)
+        return;
+
+    d->parallelRender = on;
+    if (d->map)
+        d->map->update();
+}
+
+bool MapLayerObjects::isParallelRender() const
+{
+    Q_D(const MapLayerObjects);
+    return d->parallelRender;
+}
+
+void MapLayerObjects::setRasterCache(bool on)
+{
+    Q_D(MapLayerObjects);
+    if (d->rasterCache == on)
+        return;
+
+    d->rasterCache = on;
+    clearRasterCache();
+}
+
+bool MapLayerObjects::isRasterCache() const
+{
+    Q_D(const MapLayerObjects);
+    return d->rasterCache;
+}
+
+void MapLayerObjects::clearRasterCache()
+{
+    Q_D(MapLayerObjects);
+    d->raster.clear();
+    d->rasterDirty.clear();
+    if (d->map)
+        d->map->update();
+}
+
 // -------------------------------------------------------
 
 } // namespace minigis
@@ -2,6 +2,8 @@
 #define MAPLAYEROBJECTS_H
 
 #include <QScopedPointer>
+#include <QCache>
+#include <QImage>
 #include "layers/maprtree.h"
 
 #include "layers/maplayer.h"
@@ -13,6 +15,31 @@ namespace minigis {
 
 // -------------------------------------------------------
 
+/**
+ * @brief The RasterTileKey struct ключ тайла растрового кэша слоя
+ * Масштаб и поворот - линейная часть преобразования камеры, тайл - номер в экранных
+ * координатах без сдвига камеры (при перемещении карты ключи не меняются).
+ */
+struct RasterTileKey
+{
+    qreal m11, m12, m21, m22;
+    int x, y;
+
+    inline QTransform linear() const { return QTransform(m11, m12, m21, m22, 0, 0); }
+    inline bool operator==(const RasterTileKey &other) const
+    {
+        return x == other.x && y == other.y
+                && m11 == other.m11 && m12 == other.m12 && m21 == other.m21 && m22 == other.m22;
+    }
+};
+
+inline uint qHash(const RasterTileKey &key, uint seed = 0)
+{
+    return qHash(key.x, seed) ^ qHash(key.y, seed) * 31 ^ qHash(key.m11, seed) ^ qHash(key.m12, seed) * 17;
+}
+
+// -------------------------------------------------------
+
 class MapLayerObjects;
 class MapLayerObjectsPrivate : public MapLayerWithObjectsPrivate
 {
@@ -25,16 +52,56 @@ public:
 public Q_SLOTS:
     virtual void render(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options = optNone);
 
+    void treeRegionChanged(QRectF rect, bool whole); // изменились границы объектов в дереве
+    void objectMetricChanged();                      // изменилась метрика объекта
+    void objectAppearanceChanged();                  // изменились атрибуты, текст, семантика или выделение объекта
+
 public:
     QScopedPointer<MapRTree> tree;      // дерево объектов
     QList<MapObject*> localObjects;     // объекты с пиксельной привязкой
 
+    bool parallelRender;                // многопоточная отрисовка по тайлам экрана
+    static const int RenderTileSize = 256; // размер тайла многопоточной отрисовки
+    static const int ParallelMin = 1000;   // минимум объектов для многопоточной отрисовки
+
     int nppMin;
     int nppMax;
     QHash<MapObject *, int> npp;
 
     void validateMinMax();
 
+    /**
+     * @brief renderTiled многопоточная отрисовка: каждый тайл экрана в свое изображение,
+     * объекты в тайле в порядке selectObjects
+     * @return false, если отрисовка невозможна (не все отрисовщики потокобезопасны)
+     */
+    bool renderTiled(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options, QList<MapObject *> objects);
+
+    // растровый кэш
+    bool rasterCache;                   // отрисовка объектов дерева из кэша тайлов
+    static const int RasterBudget = 64 * 1024; // размер кэша, Кб
+    static const int RasterMargin = 30;        // запас на отрисовку за границами объектов, пикс.
+    static const int RasterDirtyMax = 256;     // максимум отдельных измененных областей
+    QCache<RasterTileKey, QImage> raster; // отрисованные тайлы
+    QVector<QRectF> rasterDirty;        // измененные области (мировые координаты) до следующей отрисовки
+    QTransform rasterLinear;            // масштаб и поворот предыдущего кадра
+    MapOptions rasterOptions;           // настройки отрисовки тайлов кэша
+    int rasterDpr;                      // плотность пикселей тайлов кэша
+
+    void invalidateRaster(MapObject *mo); // сбросить тайлы под объектом
+    void connectAppearance(MapObject *mo);    // сигналы изменения вида объекта (сброс кэша тайлов)
+    void disconnectAppearance(MapObject *mo);
+    void markRasterDirty(const QRectF &r);
+    void applyRasterDirty();            // удалить из кэша тайлы измененных областей
+
+    /**
+     * @brief renderCached отрисовка объектов дерева из растрового кэша, недостающие тайлы
+     * отрисовываются и сохраняются
+     * @return false, если кэш не используется (масштаб или поворот изменились с предыдущего кадра)
+     */
+    bool renderCached(QPainter *painter, const QRectF &rgn, const MapCamera *camera, MapOptions options);
+    QImage renderRasterTile(const QRectF &rect, QPainter::RenderHints hints, const MapCamera *camera, MapOptions options);
+
 public:
     Q_DECLARE_PUBLIC(MapLayerObjects)
     Q_DISABLE_COPY(MapLayerObjectsPrivate)
@@ -54,6 +121,7 @@ public:
 
     virtual void addObject(MapObject *mo);
     virtual void remObject(MapObject *mo);
+    void addObjects(QList<MapObject *> const &objList);
     void removeObjects(QList<MapObject *> const &objList);
 
     virtual MapObject *findObject(QString const &uid) const;
@@ -70,6 +138,18 @@ public:
 
     virtual QList<MapObject*> const selectObjects(QRectF const &rgn, MapCamera const *cam = NULL) const;
     virtual QList<MapObject*> const selectObjects(QPointF const &pos, MapCamera const *cam = NULL) const;
+    /**
+     * @brief nearestObjects ближайшие к точке экрана объекты
+     * @param pos точка (экранные координаты)
+     * @param cam камера
+     * @param k количество объектов (меньше 1 - все в пределах radius)
+     * @param radius радиус поиска в пикселях
+     * @param filter отбор объектов
+     * @param distances расстояния до объектов (мировые координаты)
+     * @return объекты по возрастанию расстояния (с пиксельной привязкой - до описывающего прямоугольника на экране)
+     */
+    QList<MapObject*> nearestObjects(QPointF const &pos, MapCamera const *cam, int k, qreal radius,
+                                     MapObjectFilter const &filter = MapObjectFilter(), QList<qreal> *distances = NULL) const;
 
     virtual QList<MapObject*> const &objectsFree() const;
     virtual QList<MapObject*> const &objectsChilds() const;
@@ -87,6 +167,26 @@ public Q_SLOTS:
     void lockLayer();
     void unlockLayer();
 
+    /**
+     * @brief setParallelRender отрисовка слоя по тайлам экрана в нескольких потоках
+     * Используется, только если все отрисовщики видимых объектов потокобезопасны (MapDrawer::isThreadSafe).
+     */
+    void setParallelRender(bool on);
+    bool isParallelRender() const;
+
+    /**
+     * @brief setRasterCache хранить отрисованные тайлы экрана между кадрами
+     * При перемещении карты тайлы только переносятся, после изменения объектов
+     * (границы в дереве, метрика, атрибуты) перерисовываются только тайлы под ними.
+     * Объекты с пиксельной привязкой рисуются поверх кэша каждый кадр.
+     */
+    void setRasterCache(bool on);
+    bool isRasterCache() const;
+    /**
+     * @brief clearRasterCache сбросить растровый кэш (например, после смены отрисовщиков)
+     */
+    void clearRasterCache();
+
 protected:
     explicit MapLayerObjects(MapLayerObjectsPrivate &dd, QObject *parent = 0);
 
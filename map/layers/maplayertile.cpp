@@ -94,6 +94,8 @@ bool MapLayerTile::registerLoader(MapTileLoader *loader)
     d->loaders.insert(loader->type(), loader);
     connect(loader, SIGNAL(imageReady(QImage,int,int,int,int,int)), this, SLOT(addNewImage(QImage,int,int,int,int,int)));
     connect(loader, SIGNAL(errorKey(int,int,int,int)), d, SLOT(loaderError(int,int,int,int)));
+    connect(loader, SIGNAL(tileValidators(int,int,int,int,QByteArray,QByteArray)), d, SLOT(loaderValidators(int,int,int,int,QByteArray,QByteArray)));
+    connect(loader, SIGNAL(tileNotModified(int,int,int,int,int)), this, SLOT(tileNotModified(int,int,int,int,int)));
     connect(loader, SIGNAL(destroyed(QObject*)), SLOT(loaderDestroid(QObject*)));
     return true;    
 }
@@ -104,6 +106,7 @@ void MapLayerTile::unregisterLoader(MapTileLoader *loader)
     QMutexLocker locker(&d->mutex);
 
     d->loaders.take(d->loaders.key(loader));
+    d->scheduler.cancelType(loader->type());
     loader->done();
     loader->setParent(NULL);
 }
@@ -135,8 +138,9 @@ dc::DatabaseController *MapLayerTile::dc() const
 void MapLayerTile::clearTileTypes(int type)
 {
     Q_D(MapLayerTile);
-    foreach (Tile *t, d->tiles.values())
-        t->source.remove(type);
+    d->tiles.forEach([type](Tile *t) {
+        delete t->source.take(type);
+    });
     emit imageReady();
 }
 
@@ -151,12 +155,7 @@ void MapLayerTile::changeColorizedTiles(ConvertColor::ColorFilterFunc f)
 void MapLayerTile::clearCache()
 {
     Q_D(MapLayerTile);
-    for (QMutableHashIterator<quint64, Tile*> it(d->tiles); it.hasNext();) {
-        it.next();
-        Tile *t = it.value();
-        if (t)
-            t->clear(Tile::Colorized);
-    }
+    d->tiles.forEach(std::bind2nd(std::mem_fun(&Tile::clear), Tile::Colorized));
     d->map->update();
 }
 
@@ -173,18 +172,19 @@ void MapLayerTile::changeTileTypesL(QList<int> types)
     Q_D(MapLayerTile);
     if (d->types == types)
         return;
-    d->types = types;
 
-    // очистка кэша    
-    d->dbCache.clear();
-    d->askCache.clear();
+    // отмена запросов к отключенным загрузчикам
+    foreach (int type, d->types)
+        if (!types.contains(type))
+            d->scheduler.cancelType(type);
+    d->types = types;
 
-    foreach (Tile *t, d->tiles.values()) {
+    d->tiles.forEach([&types](Tile *t) {
         delete t->prevTmp;
         t->prevTmp = NULL;
 
         t->setSource(types);
-    }
+    });
 
     emit imageReady();
 }
@@ -200,8 +200,9 @@ void MapLayerTile::changeWatchType(int)
     if (!d->types.contains(MapTileLoaderCheckFillDataBase::Type))
         return;
 
-    foreach (Tile *t, d->tiles.values())
+    d->tiles.forEach([](Tile *t) {
         delete t->source.take(MapTileLoaderCheckFillDataBase::Type);
+    });
 }
 
 void MapLayerTile::addNewImage(QImage img, int x, int y, int z, int type, int expires)
@@ -211,13 +212,15 @@ void MapLayerTile::addNewImage(QImage img, int x, int y, int z, int type, int ex
     TileKey tmpKey(x, y, z, type);
     emit tileIncome(tmpKey, img.isNull());
 
-    quint64 keyHash = tmpKey.hash();
-    d->askCache.remove(keyHash);
+    bool prefetch = d->scheduler.loaderFinished(tmpKey);
 
     if (img.isNull())
         return;
+    if (prefetch)
+        d->scheduler.markPrefetched(tmpKey);
 
     TileKey key(x, y, z);
+    QPair<QByteArray, QByteArray> validators = d->validators.take(tmpKey.hash());
     // img в очередь на сохранение в бд
     MapTileLoader *loader = d->loaders.value(type);
     if (loader) {
@@ -239,6 +242,8 @@ void MapLayerTile::addNewImage(QImage img, int x, int y, int z, int type, int ex
             v["type"] = type;
             v["tile"] = ba;
             v["expires"] = expires;
+            v["etag"] = validators.first;
+            v["modified"] = validators.second;
 
             d->queueTiles->append(v);
             // если очередь слишком большая то сохраняем в бд
@@ -248,7 +253,29 @@ void MapLayerTile::addNewImage(QImage img, int x, int y, int z, int type, int ex
             }
         }
     }
-    d->saveTileInCache(key, type, img, d->zoom == z);
+    d->saveTileInCache(key, type, img, !prefetch && d->zoom == z);
+}
+
+void MapLayerTile::tileNotModified(int x, int y, int z, int type, int expires)
+{
+    Q_D(MapLayerTile);
+
+    TileKey key(x, y, z, type);
+    emit tileIncome(key, false);
+    d->scheduler.loaderFinished(key);
+
+    // изображение уже в бд и в кэше - обновляется только срок годности
+    QVariantMap v;
+    v["x"] = x;
+    v["y"] = y;
+    v["z"] = z;
+    v["type"] = type;
+    v["expires"] = expires;
+    v["notModified"] = true;
+
+    d->queueTiles->append(v);
+    if (d->queueTiles->size() >= d->maxQueueSize)
+        d->flushTiles();
 }
 
 void MapLayerTile::getdbImage(const TileKey &key, bool ignoreDb)
@@ -258,13 +285,8 @@ void MapLayerTile::getdbImage(const TileKey &key, bool ignoreDb)
     if (d->loadersErrorsCache.contains(hash))
         emit tileIncome(key, true);
     else {
-        quint64 hash = key.hash();
-        if (!d->dbEmptyCache.contains(hash) && !ignoreDb) {
-            if (!d->dbCache.contains(hash)) {
-                d->dbCache.insert(hash);
-                if (d->dbCache.size() > d->MaxUIntCacheSize)
-                    d->dbCache.clear();
-
+        if (!d->dbEmptyCache.contains(hash) && !ignoreDb && !d->isPackType(key.type)) {
+            if (!d->scheduler.isDbPending(key)) {
                 QVariantMap v;
                 QStringList types;
                 types.append(QString::number(key.type));
@@ -273,26 +295,12 @@ void MapLayerTile::getdbImage(const TileKey &key, bool ignoreDb)
                 v["z"] = key.z;
                 v["type"] = types;
                 v["level"] = d->levelUp;
-                d->dc->postRequest("selTiles", v, dc::AboveNormalPriority, d, "onDb_TileIncome");
-            }
-        }
-        else {
-            MapTileLoader *loader = d->loaders.value(key.type);
-            if (!loader)
-                return;
-            bool ignore = !loader->isEnabled();
-            MapTileLoaderHttp *httploader = qobject_cast<MapTileLoaderHttp*>(loader);
-            if (httploader && httploader->isProxyEnabled())
-                ignore = false;
-            if (ignore)
-                return;
-            if (!d->askCache.contains(hash)) {
-                d->askCache.insert(hash);
-                if (d->askCache.size() >= d->MaxUIntCacheSize)
-                    d->askCache.clear();
-                loader->getTile(key.x, key.y, key.z);
+                // явный запрос не отменяется при смене области видимости
+                d->scheduler.requestDb(QList<TileKey>() << key, "selTiles", v, dc::AboveNormalPriority, d, "onDb_TileIncome", false);
             }
         }
+        else
+            d->requestLoader(key, false);
     }
 }
 
@@ -319,6 +327,47 @@ void MapLayerTile::setUploadLevel(int level)
     d->map->update();
 }
 
+qint64 MapLayerTile::cacheBudget() const
+{
+    Q_D(const MapLayerTile);
+    return d->tiles.budget();
+}
+
+void MapLayerTile::setCacheBudget(qint64 bytes)
+{
+    Q_D(MapLayerTile);
+    if (d->tiles.budget() == bytes)
+        return;
+
+    d->tiles.setBudget(bytes);
+    d->tiles.trim();
+}
+
+QVariantMap MapLayerTile::cacheStats() const
+{
+    Q_D(const MapLayerTile);
+    return d->tiles.stats().toVariant();
+}
+
+void MapLayerTile::prefetch(QPointF pos, qreal scale)
+{
+    Q_D(MapLayerTile);
+    d->prefetch(pos, scale);
+}
+
+void MapLayerTile::cancelPrefetch()
+{
+    Q_D(MapLayerTile);
+    d->scheduler.cancelPrefetch();
+    d->prefetchZoom = -1;
+}
+
+QVariantMap MapLayerTile::prefetchStats() const
+{
+    Q_D(const MapLayerTile);
+    return d->scheduler.prefetchStats().toVariant();
+}
+
 void MapLayerTile::loaderDestroid(QObject *loader)
 {
     Q_D(MapLayerTile);
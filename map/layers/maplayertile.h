@@ -56,11 +56,18 @@ public Q_SLOTS:
 
     // addNewImage добавляем полученную картинку в кэш
     void addNewImage(QImage, int, int, int, int, int);
+    // tileNotModified сохраненный тайл актуален (ответ 304), продлеваем срок годности в бд
+    void tileNotModified(int, int, int, int, int);
 
     // реагируем на изменение типа подложки
     void changeTileTypesL(QList<int>);
     void changeTileTypesI(int);
 
+    // prefetch упреждающая загрузка тайлов для точки назначения камеры
+    void prefetch(QPointF pos, qreal scale = 0);
+    // cancelPrefetch отменить упреждающую загрузку
+    void cancelPrefetch();
+
 public:
     // changeColorizedTiles реагируем на изменение гаммы
     void changeColorizedTiles(ConvertColor::ColorFilterFunc);
@@ -82,6 +89,15 @@ public:
     // setUploadLevel установить уровень подгрузки тайлов
     void setUploadLevel(int level);
 
+    // cacheBudget возвращает бюджет памяти кэша подложки в байтах
+    qint64 cacheBudget() const;
+    // setCacheBudget установить бюджет памяти кэша подложки в байтах
+    void setCacheBudget(qint64 bytes);
+    // cacheStats статистика кэша подложки (попадания, промахи, вытеснения, память по стадиям)
+    QVariantMap cacheStats() const;
+    // prefetchStats статистика упреждающей загрузки (получено, показано, доля попаданий)
+    QVariantMap prefetchStats() const;
+
 Q_SIGNALS:
     void tileIncome(const TileKey &key, bool empty, bool frombd = false);
 
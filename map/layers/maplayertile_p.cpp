@@ -33,9 +33,11 @@ namespace minigis {
 
 MapLayerTilePrivate::MapLayerTilePrivate(QObject *parent)
     : MapLayerPrivate(parent), func(ConvertColor::emptyColor), zoom(0), base(1),
-      cameraScale(0.), scaleChanged(true), cameraAngle(0.), angleChanged(true), levelUp(0), smoothing(true)
+      cameraScale(0.), scaleChanged(true), cameraAngle(0.), angleChanged(true), levelUp(0), smoothing(true), affine(false), prefetchZoom(-1)
 {
     dc = new dc::DatabaseController;
+    scheduler.setDatabase(dc);
+    decodePool.setMaxThreadCount(DecodeThreads);
     QString error;
 
 //    Settings& set = Settings::inst("map");
@@ -50,6 +52,7 @@ MapLayerTilePrivate::MapLayerTilePrivate(QObject *parent)
 
     QString path = Runtime::getSharePath();
     connData["name"] = path + "tiles.sqlite";
+    connData["readers"] = DbReaders;
 
     if (!dc->init("QSQLITE", connData, &error))
         return;
@@ -59,6 +62,7 @@ MapLayerTilePrivate::MapLayerTilePrivate(QObject *parent)
     dc->postRequest("create", QVariant(), dc::RealTimePriority);
     queueTimer.start(FlushInterval, this);
     cacheTimer.start(errorClearTime, this);
+    statsTimer.start(statsInterval, this);
 
     queueTiles = new dc::QueryResult;
 }
@@ -66,6 +70,9 @@ MapLayerTilePrivate::MapLayerTilePrivate(QObject *parent)
 MapLayerTilePrivate::~MapLayerTilePrivate()
 {
     flushTiles(false);
+    scheduler.clear();
+    decodePool.waitForDone();
+    decodeBatches.clear();
 
     QMutexLocker lockerKey(&keyMutex);
     QList<MapTileLoader *> tmp(loaders.values());
@@ -83,22 +90,10 @@ QList<int> MapLayerTilePrivate::missedTypes(const TileKey &key)
 {
     QList<int> tmpKeys = types;
 
-    quint64 hash = key.hash();
-    Tile *t = tiles.value(hash);
-    if (t && !t->source.isEmpty()) {
+    Tile *t = tiles.value(key.hash());
+    if (t) {
         foreach (int sourceKey, t->source.keys())
             tmpKeys.removeOne(sourceKey);
-
-        // обновляем кэш тайлов
-        int ind = tileHistory.indexOf(hash);
-        if (ind != -1)
-            tileHistory.move(ind, 0);
-        else
-            tileHistory.prepend(hash);
-
-        // чистим кэш тайлов
-        while (tileHistory.size() > MaxCacheTile)
-            delete tiles.take(tileHistory.takeLast());
     }
     return tmpKeys;
 }
@@ -106,11 +101,11 @@ QList<int> MapLayerTilePrivate::missedTypes(const TileKey &key)
 Tile *MapLayerTilePrivate::generateTile(const TileKey &key)
 {
     quint64 hash = key.hash();
-    Tile *t = tiles.value(hash);
+    Tile *t = tiles.touch(hash);
     // создаем новый тайл
     if (!t) {
         t = new Tile(key);
-        tiles[hash] = t;
+        tiles.insert(hash, t);
     }
 
 //    if (!t->origin) {
@@ -161,13 +156,16 @@ TileKey MapLayerTilePrivate::createImages(Tile *t)
         t->colorized = new QImage(createColorizedTileThread(t));
     if (!t->scaled)
         t->scaled = new QImage(createScaledTileThread(t->colorized));
-    if (!t->rotated)
-        t->rotated = new QImage(createRotatedTileThread(key, t->scaled));
 
+    bool aff = false;
     {
         QMutexLocker locker(&keyMutex);
-        tiles.insert(key.hash(), t);
+        aff = affine;
     }
+    if (!t->rotated && !aff)
+        t->rotated = new QImage(createRotatedTileThread(key, t->scaled));
+
+    tiles.updateCost(key.hash());
 
     return key;
 }
@@ -193,12 +191,8 @@ QImage MapLayerTilePrivate::createUploadTileThread(const TileKey &key)
         while (shift <= upBound) {
             TileKey prevKey(key.x >> shift, key.y >> shift, key.z - shift);
 
-            QImage *origin = NULL;
-            {
-                QMutexLocker locker(&keyMutex);
-                Tile *prevTile = tiles.value(prevKey.hash());
-                origin = prevTile ? prevTile->source.value(activeType) : NULL;
-            }
+            Tile *prevTile = tiles.value(prevKey.hash());
+            QImage *origin = prevTile ? prevTile->source.value(activeType) : NULL;
             if (origin) {
                 ++num;
                 int rectSize = TileSize >> shift;
@@ -234,12 +228,9 @@ QImage MapLayerTilePrivate::createTmpTileThread(const TileKey &key)
         TileKey prevKey(key.x >> shift, key.y >> shift, key.z - shift);
 
         QImage *origin = NULL;
-        {
-            QMutexLocker locker(&keyMutex);
-            Tile *prevTile = tiles.value(prevKey.hash());
-            if (prevTile && prevTile->origin && !prevTile->source.isEmpty())
-                origin = prevTile->origin;
-        }
+        Tile *prevTile = tiles.value(prevKey.hash());
+        if (prevTile && prevTile->origin && !prevTile->source.isEmpty())
+            origin = prevTile->origin;
 
         if (origin) {
             int rectSize = TileSize >> shift;
@@ -269,12 +260,9 @@ QImage MapLayerTilePrivate::createTmpTileThread(const TileKey &key)
             dest.moveTopLeft(rectSize * QPoint(i % side, i / side));
 
             QImage *origin = NULL;
-            {
-                QMutexLocker locker(&keyMutex);
-                Tile *prevTile = tiles.value(tmpKey.hash());
-                if (prevTile && prevTile->origin && !prevTile->source.isEmpty())
-                    origin = prevTile->origin;
-            }
+            Tile *prevTile = tiles.value(tmpKey.hash());
+            if (prevTile && prevTile->origin && !prevTile->source.isEmpty())
+                origin = prevTile->origin;
 
             if (origin) {
                 paint.drawImage(dest, *origin);
@@ -386,10 +374,10 @@ QList<int> MapLayerTilePrivate::getCacheImage(QPainter *painter, const TileKey &
 
         // ищем нужный тайл
         quint64 hash = key.hash();
-        Tile *t = tiles.value(hash);
+        Tile *t = tiles.touch(hash);
         // создаем новый тайл
         if (!t)
-            tiles[hash] = t = new Tile(key);
+            tiles.insert(hash, t = new Tile(key));
 
         // если нету оригинала
         if (!t->origin) {
@@ -403,8 +391,7 @@ QList<int> MapLayerTilePrivate::getCacheImage(QPainter *painter, const TileKey &
             if (t->origin)
                 t->clear(Tile::Colorized);
             else { // удаляем тайл, так как нету оригинала
-                tiles.remove(t->key.hash()/*tiles.key(t)*/);
-                delete t;
+                tiles.remove(hash);
                 t = NULL;
             }
         }
@@ -417,89 +404,93 @@ QList<int> MapLayerTilePrivate::getCacheImage(QPainter *painter, const TileKey &
                     createColorizedTile(t);
                 if (!t->scaled)
                     createScaledTileDirect(t);
-                if (!t->rotated)
+                if (!t->rotated && !affine)
                     createTransformTileDirect(t);
 
-                if (t->rotated)
+                if (t->target(affine))
                     localDraw(painter, t);
             }
 
-            if (!t->source.isEmpty()) {
-                // оставляем только нужные ключи
-                foreach (int sourceKey, t->source.keys())
-                    tmpKeys.removeOne(sourceKey);
+            // оставляем только нужные ключи
+            foreach (int sourceKey, t->source.keys())
+                tmpKeys.removeOne(sourceKey);
 
-                // обновляем кэш тайлов
-                int ind = tileHistory.indexOf(hash);
-                if (ind != -1)
-                    tileHistory.move(ind, 0);
-                else
-                    tileHistory.prepend(hash);
-
-                // чистим кэш тайлов
-                while (tileHistory.size() > MaxCacheTile)
-                    delete tiles.take(tileHistory.takeLast());
-            }
+            tiles.updateCost(hash);
         }
     }
+    tiles.trim();
     return tmpKeys;
 }
 
 void MapLayerTilePrivate::getdbImage(const QList<int> types, const TileKey &key)
 {
-    // создаем список типов для запросов
-    QStringList needTypes;
     QList<TileKey> loaderList;
     foreach (int activeType, types) {
         TileKey keyTmp(key.x, key.y, key.z, activeType);
-        quint64 hash = keyTmp.hash();
-        // добавляем в кэш запросов в бд
-        if (!dbEmptyCache.contains(hash)) {
-            if (!dbCache.contains(hash)) {
-                dbCache.insert(hash);
-                if (dbCache.size() > MaxUIntCacheSize)
-                    dbCache.clear();
-                needTypes.append(QString::number(activeType));
-            }
+        // тайлы, которых нет в бд, сразу запрашиваем у загрузчика
+        if (!dbEmptyCache.contains(keyTmp.hash()) && !isPackType(activeType)) {
+            // запрос в бд уйдет одной пачкой после обхода всех тайлов
+            if (!scheduler.isDbPending(keyTmp))
+                dbBatch.append(keyTmp);
         }
         else
             loaderList.append(keyTmp);
     }
 
-    // запрос в бд
-    if (!needTypes.isEmpty()) {
-        QVariantMap v;
-        v["x"] = key.x;
-        v["y"] = key.y;
-        v["z"] = key.z;
-        v["type"] = needTypes;
-        v["level"] = levelUp;
-        dc->postRequest("selTiles", v, dc::AboveNormalPriority, this, "onDb_TileIncome");
-    }
-
     // запрос на сервер
-    foreach (TileKey key, loaderList) {
-        MapTileLoader *loader = loaders.value(key.type);
-        if (!loader)
-            continue;
-        // если лоадер выключен то игнориреум его
-        bool ignore = !loader->isEnabled();
-        MapTileLoaderHttp *httploader = qobject_cast<MapTileLoaderHttp*>(loader);
-        if (httploader && httploader->isProxyEnabled())
-            ignore = false;
-        if (ignore)
-            continue;
-        // добавляем в кэш лоадеров
-        quint64 keyHash = key.hash();
-        if (!askCache.contains(keyHash) && !loadersErrorsCache.contains(keyHash)) {
-            askCache.insert(keyHash);
-            if (askCache.size() >= MaxUIntCacheSize)
-                askCache.clear();
+    foreach (TileKey key, loaderList)
+        requestLoader(key);
+}
 
-            // заправшиваем тайл
-            loader->getTile(key.x, key.y, key.z);
-        }
+uint MapLayerTilePrivate::requestDbBatch(const QList<TileKey> &keys, int level, int priority, bool prefetch)
+{
+    if (keys.isEmpty())
+        return 0;
+
+    QVariantList list;
+    foreach (const TileKey &key, keys) {
+        QVariantMap k;
+        k["x"] = key.x;
+        k["y"] = key.y;
+        k["z"] = key.z;
+        k["type"] = key.type;
+        list.append(k);
     }
+
+    QVariantMap v;
+    v["keys"] = list;
+    v["level"] = level;
+    return scheduler.requestDb(keys, "selTilesBatch", v, priority, this, "onDb_TileIncome", true, prefetch);
+}
+
+MapTileLoader *MapLayerTilePrivate::activeLoader(int type) const
+{
+    MapTileLoader *loader = loaders.value(type);
+    if (!loader)
+        return NULL;
+
+    // если лоадер выключен то игнориреум его
+    bool ignore = !loader->isEnabled();
+    MapTileLoaderHttp *httploader = qobject_cast<MapTileLoaderHttp*>(loader);
+    if (httploader && httploader->isProxyEnabled())
+        ignore = false;
+    return ignore ? NULL : loader;
+}
+
+bool MapLayerTilePrivate::isPackType(int type) const
+{
+    return qobject_cast<MapTileLoaderPack*>(loaders.value(type)) != NULL;
+}
+
+void MapLayerTilePrivate::requestLoader(const TileKey &key, bool cancelable, bool prefetch)
+{
+    // повторный обычный запрос поднимает упреждающий, поэтому в планировщик уходит всегда
+    if (loadersErrorsCache.contains(key.hash()) || (prefetch && scheduler.isLoaderPending(key)))
+        return;
+
+    MapTileLoader *loader = activeLoader(key.type);
+    if (loader)
+        scheduler.enqueue(loader, key, cancelable, prefetch);
 }
 
 void MapLayerTilePrivate::createColorizedTile(Tile *t)
@@ -589,11 +580,17 @@ void MapLayerTilePrivate::localUpdate(int x, int y, int z)
 void MapLayerTilePrivate::loaderError(int x, int y, int z, int type)
 {
     TileKey key(x, y, z, type);
+    scheduler.loaderFinished(key);
     emit tileIncome(TileKey(x, y, z, type), true);
 //    qDebug() << "----------------------------" << x << y << z << type << loadersErrorsCache.contains(key.hash());
     loadersErrorsCache.insert(key.hash());
 }
 
+void MapLayerTilePrivate::loaderValidators(int x, int y, int z, int type, QByteArray etag, QByteArray lastModified)
+{
+    validators.insert(TileKey(x, y, z, type).hash(), qMakePair(etag, lastModified));
+}
+
 void MapLayerTilePrivate::localDraw(QPainter *painter, Tile *t)
 {
     TileKey const &key = t->key;
@@ -617,7 +614,15 @@ void MapLayerTilePrivate::localDraw(QPainter *painter, Tile *t)
     painter->setOpacity(t->opacity);
 #endif
 
-    painter->drawImage(rect.topLeft(), *t->rotated);
+    if (affine) {
+        // поворачиваем отмасштабированный тайл вокруг его центра
+        painter->setRenderHint(QPainter::SmoothPixmapTransform, smoothing);
+        painter->translate(rect.center());
+        painter->rotate(camera->angle());
+        painter->drawImage(QPointF(-t->scaled->width(), -t->scaled->height()) * .5, *t->scaled);
+    }
+    else
+        painter->drawImage(rect.topLeft(), *t->rotated);
     // отрисовка стык в стык
 //    painter->drawImage(rect, *t->rotated);
     painter->restore();
@@ -737,16 +742,18 @@ void MapLayerTilePrivate::saveTileInCache(const TileKey &key, int type, const QI
             return;
 
         quint64 hash = key.hash();
-        Tile *t = tiles[hash];
+        Tile *t = tiles.value(hash);
         if (!t) {
             t = new Tile(key);
-            tiles[hash] = t;
+            tiles.insert(hash, t);
         }
 
         if (t->source.isEmpty()) {
             t->opacity = flag ? 0 : 1;
             if (t->rotated)
                 t->prevTmp = new QImage(*t->rotated);
+            else if (affine && t->scaled)
+                t->prevTmp = new QImage(*t->scaled);
         }
 
         if (!t->source.contains(type))
@@ -760,14 +767,8 @@ void MapLayerTilePrivate::saveTileInCache(const TileKey &key, int type, const QI
             t->clear(Tile::Colorized);
         }
 
-        int ind = tileHistory.indexOf(hash);
-        if (ind != -1)
-            tileHistory.move(ind, 0);
-        else
-            tileHistory.prepend(hash);
-
-        while (tileHistory.size() > MaxCacheTile)
-            delete tiles.take(tileHistory.takeLast());
+        // обновляем историю и объем тайла
+        tiles.insert(hash, t);
 
         // создаем анимацию появления тайла
 #ifdef TILEANIMATION
@@ -789,6 +790,7 @@ void MapLayerTilePrivate::saveTileInCache(const TileKey &key, int type, const QI
         t->opacity = 1.;
 #endif
     }
+    tiles.trim();
 
     if (flag)
         localUpdate(key.x, key.y, key.z);
@@ -889,30 +891,118 @@ QList<TileKey> sortedKeys(int startX, int endX, int startY, int endY, int zoom)
 void MapLayerTilePrivate::calcVisualRect()
 {
     QRectF worldRect = camera->toWorld().mapRect(QRectF(QPoint(0, 0), camera->screenSize())); // экран в мировых координатах
+    QRect rect = tileRect(worldRect, zoom);
+
+    QMutexLocker locker(&keyMutex);
+    visionTileRect = rect;
+}
+
+QRect MapLayerTilePrivate::tileRect(const QRectF &worldRect, int z) const
+{
+    int side = 1 << z;
 
     QPolygon tilePoints; // список индесков подложки QPoint(column, row)
 #ifndef YANDEXMAP
-    tilePoints << TileSystem::metersToTile(worldRect.topLeft(), zoom)
-               << TileSystem::metersToTile(worldRect.bottomRight(), zoom);
+    tilePoints << TileSystem::metersToTile(worldRect.topLeft(), z)
+               << TileSystem::metersToTile(worldRect.bottomRight(), z);
 #else
-    tilePoints << MyUtils::metersToEllipticTile(worldRect.topLeft(), zoom)
-               << MyUtils::metersToEllipticTile(worldRect.bottomRight(), zoom);
+    tilePoints << MyUtils::metersToEllipticTile(worldRect.topLeft(), z)
+               << MyUtils::metersToEllipticTile(worldRect.bottomRight(), z);
 #endif
 
 #ifndef YANDEXMAP
     int startX = qMax(tilePoints.at(0).y(), 0);
-    int endX   = qMin(tilePoints.at(1).y(), base - 1);
+    int endX   = qMin(tilePoints.at(1).y(), side - 1);
 #else
-    int startX = base - 1 - qMin(tilePoints.at(0).y(), base - 1);
-    int endX   = base - 1 - qMax(tilePoints.at(1).y(), 0);
+    int startX = side - 1 - qMin(tilePoints.at(0).y(), side - 1);
+    int endX   = side - 1 - qMax(tilePoints.at(1).y(), 0);
 #endif
 
-    int startY = base - 1 - qMin(tilePoints.at(1).x(), base - 1);
-    int endY   = base - 1 - qMax(tilePoints.at(0).x(), 0);
+    int startY = side - 1 - qMin(tilePoints.at(1).x(), side - 1);
+    int endY   = side - 1 - qMax(tilePoints.at(0).x(), 0);
 
-    QMutexLocker locker(&keyMutex);
-    visionTileRect = QRect(QPoint(startX, startY),
-                           QPoint(endX  , endY));
+    return QRect(QPoint(startX, startY),
+                 QPoint(endX  , endY));
+}
+
+static QList<TileKey> rectKeys(const QRect &rect, int z)
+{
+    if (!rect.isValid())
+        return QList<TileKey>();
+    return sortedKeys(rect.left(), rect.right(), rect.top(), rect.bottom(), z);
+}
+
+void MapLayerTilePrivate::prefetch(const QPointF &pos, qreal scale)
+{
+    if (!camera || types.isEmpty())
+        return;
+
+    if (scale <= 0)
+        scale = camera->scale();
+    int destZoom = TileSystem::zoomForPixelSize(1. / scale);
+
+    // область назначения: квадрат со стороной в диагональ экрана (с запасом на поворот)
+    QSize screen = camera->screenSize();
+    qreal side = qSqrt(qreal(screen.width()) * screen.width() + qreal(screen.height()) * screen.height()) / scale;
+    QRect destRect = tileRect(QRectF(pos - QPointF(side, side) * 0.5, QSizeF(side, side)), destZoom);
+
+    QRect view;
+    {
+        QMutexLocker locker(&keyMutex);
+        view = visionTileRect;
+    }
+
+    // цель не изменилась, запросы уже в очередях
+    if (destRect == prefetchRect && destZoom == prefetchZoom && view == prefetchView)
+        return;
+    prefetchRect = destRect;
+    prefetchZoom = destZoom;
+    prefetchView = view;
+
+    scheduler.cancelPrefetch();
+
+    // порядок определяет приоритет: назначение, кольцо вокруг экрана, соседние уровни
+    QList<TileKey> keys = rectKeys(destRect, destZoom);
+    if (view.isValid()) {
+        QRect ring = view.adjusted(-1, -1, 1, 1) & QRect(0, 0, base, base);
+        foreach (const TileKey &key, rectKeys(ring, zoom))
+            if (!view.contains(key.x, key.y))
+                keys.append(key);
+    }
+
+    QRectF worldRect = camera->toWorld().mapRect(QRectF(QPoint(0, 0), screen));
+    if (zoom > 0)
+        keys += rectKeys(tileRect(worldRect, zoom - 1), zoom - 1);
+    if (zoom < TileSystem::zoomForPixelSize(1. / MinScaleParam))
+        keys += rectKeys(tileRect(worldRect, zoom + 1), zoom + 1);
+
+    int budget = PrefetchBudget;
+    QList<TileKey> dbList;
+    QSet<quint64> used;
+    foreach (const TileKey &key, keys) {
+        if (budget <= 0)
+            break;
+        if (used.contains(key.hash()))
+            continue;
+        used.insert(key.hash());
+
+        foreach (int type, missedTypes(key)) {
+            TileKey keyTmp(key.x, key.y, key.z, type);
+            quint64 hash = keyTmp.hash();
+            if (loadersErrorsCache.contains(hash) || scheduler.isLoaderPending(keyTmp) || scheduler.isDbPending(keyTmp, true))
+                continue;
+
+            if (!dbEmptyCache.contains(hash) && !isPackType(type)) {
+                dbList.append(keyTmp);
+                --budget;
+            }
+            else if (activeLoader(type)) {
+                requestLoader(keyTmp, true, true);
+                --budget;
+            }
+        }
+    }
+    requestDbBatch(dbList, 0, dc::LowestPriority, true);
 }
 
 void MapLayerTilePrivate::updateLowerTiles(Tile *t)
@@ -943,7 +1033,16 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
     Q_ASSERT(painter);
     QRectF worldRect = camera->toWorld().mapRect(rgn); // экран в мировых координатах
 
+    tiles.beginFrame();
+
     bool newSmoothing = options.testFlag(optSubstrateSmoothing);
+    bool newAffine = options.testFlag(optSubstrateAffine);
+    if (newAffine != affine) { // сменился режим поворота, повернутые копии больше не нужны
+        QMutexLocker locker(&keyMutex);
+        affine = newAffine;
+        tiles.forEach(std::bind2nd(std::mem_fun(&Tile::clear), Tile::Rotated));
+    }
+
     if (!qFuzzyCompare(cameraScale, camera->scale()) || newSmoothing != smoothing) { // изменился scale
         smoothing = newSmoothing;
 
@@ -952,14 +1051,17 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
         scaleChanged = true;
 
         QMutexLocker locker(&keyMutex);
-        std::for_each(tiles.begin(), tiles.end(), std::bind2nd(std::mem_fun(&Tile::clear), Tile::Scaled));
+        tiles.forEach(std::bind2nd(std::mem_fun(&Tile::clear), Tile::Scaled));
     }
     else if (!qFuzzyCompare(cameraAngle, camera->angle())) { // изменился угол поворота
         cameraAngle = camera->angle();
         angleChanged = true;
 
-        QMutexLocker locker(&keyMutex);
-        std::for_each(tiles.begin(), tiles.end(), std::bind2nd(std::mem_fun(&Tile::clear), Tile::Rotated));
+        // в режиме affine поворот выполняется при отрисовке, тайлы не перестраиваются
+        if (!affine) {
+            QMutexLocker locker(&keyMutex);
+            tiles.forEach(std::bind2nd(std::mem_fun(&Tile::clear), Tile::Rotated));
+        }
     }
 
     // список индесков подложки QPoint(column, row)
@@ -980,14 +1082,13 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
     int endY   = base - 1 - qMax(tilePoints.at(0).x(), 0);
 
     calcVisualRect();
+    // отменяем запросы тайлов, ушедших из области видимости
+    scheduler.setView(visionTileRect, zoom);
 
-    // tileKeys
+    // tileKeys (от центра к краям, в этом же порядке уходят запросы)
     QList<TileKey> keyList;
-    for (int x = startX ; x <= endX; ++x)
-        for (int y = startY; y <= endY; ++y)
-            keyList.append(TileKey(x, y, zoom));
-
-    //    keyList = sortedKeys(startX, endX, startY, endY, zoom);
+    if (startX <= endX && startY <= endY)
+        keyList = sortedKeys(startX, endX, startY, endY, zoom);
 
     // размер подложки в мировых координатах
 #ifdef YANDEXMAP
@@ -1020,9 +1121,10 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
     foreach (const TileKey &key, keyList) {
         QList<int> tmp = missedTypes(key);
         Tile *t = generateTile(key);
+        scheduler.touchPrefetched(key);
 
         if (t) {
-            if (!t->rotated) {
+            if (!t->target(affine)) {
 //                QFutureWatcher<TileKey> *watcher = new QFutureWatcher<TileKey>(this);
 //                watcher->setFuture(QtConcurrent::run(this, &MapLayerTilePrivate::createImages, t));
 //                connect(watcher, SIGNAL(finished()), SLOT(incomeFuture()));
@@ -1041,6 +1143,10 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
         getdbImage(tmp, key);
     }
 
+    // все недостающие тайлы экрана - одним запросом в бд
+    requestDbBatch(dbBatch, levelUp, dc::AboveNormalPriority);
+    dbBatch.clear();
+
 //    if (futureCount > 0)
 //        wait.wait(&mutex);
 
@@ -1059,13 +1165,11 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
             quint64 hash = res.hash();
             Tile *t = tiles.value(hash);
             if (t) {
-                if (t->rotated) {
+                if (t->target(affine)) {
                     localDraw(painter, t);
                 }
                 else if (!t->origin && t->source.isEmpty()) {
-                    QMutexLocker locker(&keyMutex);
                     tiles.remove(hash);
-                    delete t;
                     t = NULL;
                 }
             }
@@ -1073,78 +1177,112 @@ void MapLayerTilePrivate::render(QPainter *painter, const QRectF &rgn, const Map
     }
 #endif
 
+    // все потоки завершены, можно вытеснять тайлы
+    tiles.trim();
+
     scaleChanged = false;
     angleChanged = false;
 }
 
 //! =======================================================================
 
-void MapLayerTilePrivate::onDb_TileIncome(uint /*query*/, QVariant result, QVariant /*error*/)
+void MapLayerTilePrivate::onDb_TileIncome(uint query, QVariant result, QVariant /*error*/)
 {
-    if (result.isNull() || !result.canConvert<dc::QueryResult>())
+    if (result.isNull() || !result.canConvert<dc::QueryResult>()) {
+        scheduler.dbFinished(query);
         return;
+    }
 
-    int time = QDateTime::currentDateTime().toTime_t();
-    QStringList expiresTiles;
+    dc::QueryResult rows = result.value<dc::QueryResult>();
+    if (rows.isEmpty()) {
+        tilesDecoded(query, QList<DecodedTile>());
+        return;
+    }
 
-    dc::QueryResult query = result.value<dc::QueryResult>();
+    // запрос остается в планировщике до конца декодирования, чтобы тайлы не запросили повторно
+    DecodeBatch &batch = decodeBatches[query];
+    batch.left = (rows.size() + DecodeChunk - 1) / DecodeChunk;
+    for (int i = 0; i < rows.size(); i += DecodeChunk) {
+        QFutureWatcher<QList<DecodedTile> > *watcher = new QFutureWatcher<QList<DecodedTile> >(this);
+        connect(watcher, &QFutureWatcher<QList<DecodedTile> >::finished, this, [this, watcher, query]() {
+            watcher->deleteLater();
+            QHash<uint, DecodeBatch>::iterator it = decodeBatches.find(query);
+            if (it == decodeBatches.end())
+                return;
+            it.value().tiles.append(watcher->result());
+            if (--it.value().left > 0)
+                return;
+
+            QList<DecodedTile> decoded = it.value().tiles;
+            decodeBatches.erase(it);
+            tilesDecoded(query, decoded);
+        });
+        watcher->setFuture(QtConcurrent::run(&decodePool, &MapLayerTilePrivate::decodeTiles, rows.mid(i, DecodeChunk)));
+    }
+}
 
-    QVariantMap f = query.first();
-    TileKey basicTile(f.value("x").toInt(), f.value("y").toInt(), f.value("z").toInt());
-    foreach (QVariantMap vm, query) {
-        TileKey key(
-                    vm.value("x").toInt(),
-                    vm.value("y").toInt(),
-                    vm.value("z").toInt()
-                    );
+QList<MapLayerTilePrivate::DecodedTile> MapLayerTilePrivate::decodeTiles(const dc::QueryResult &rows)
+{
+    QList<DecodedTile> decoded;
+    foreach (const QVariantMap &vm, rows) {
+        DecodedTile d;
+        d.key = TileKey(vm.value("x").toInt(), vm.value("y").toInt(), vm.value("z").toInt(), vm.value("type").toInt());
+        d.expires = vm.value("expires").toInt();
+        d.shift = vm.value("shift").toInt();
+        d.id = vm.value("id").toString();
+        d.etag = vm.value("etag").toByteArray();
+        d.lastModified = vm.value("modified").toByteArray();
 
-        int type = vm.value("type").toInt();
+        QByteArray imgData = vm.value("tile").toByteArray();
+        if (!imgData.isEmpty() && d.img.loadFromData(imgData))
+            // формат отрисовки, чтобы в потоке слоя не было конвертаций
+            d.img = d.img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        decoded.append(d);
+    }
+    return decoded;
+}
 
-        quint64 keyHash = TileKey(key.x, key.y, key.z, type).hash();
+void MapLayerTilePrivate::tilesDecoded(uint query, const QList<DecodedTile> &decoded)
+{
+    bool prefetch = scheduler.dbFinished(query);
 
-        QByteArray imgData = vm.value("tile").toByteArray();
-        QImage img;
-        img.loadFromData(imgData);
+    int time = QDateTime::currentDateTime().toTime_t();
+    QStringList expiresTiles;
 
-        int expires = vm.value("expires").toInt();
-        bool tileExpired = (expires != 0) && (expires < time);
+    foreach (const DecodedTile &d, decoded) {
+        TileKey key(d.key.x, d.key.y, d.key.z);
+        int type = d.key.type;
+        quint64 keyHash = d.key.hash();
 
-        if (!img.isNull() && !tileExpired)
-            emit tileIncome(TileKey(key.x, key.y, key.z, type), false, true);
+        bool tileExpired = (d.expires != 0) && (d.expires < time);
 
-        // если img не пуст то сохраняем его в кэш
-        dbCache.remove(keyHash);
-        if (!img.isNull())
-            saveTileInCache(key, type, img, key == basicTile);
+        if (!d.img.isNull() && !tileExpired)
+            emit tileIncome(d.key, false, true);
+
+        // если img не пуст то сохраняем его в кэш (упреждающие тайлы - даже вне экрана)
+        if (!d.img.isNull()) {
+            if (prefetch)
+                scheduler.markPrefetched(key);
+            // shift - на сколько уровней поднялись от запрошенного тайла
+            saveTileInCache(key, type, d.img, d.shift == 0 && !prefetch);
+        }
         else
             dbEmptyCache.insert(keyHash);
 
         // если нету img в базе или он устарел запрашиваем новый тайл в инете
-        if (img.isNull() || tileExpired) {
-            MapTileLoader *loader = loaders.value(type);
+        if (d.img.isNull() || tileExpired) {
+            MapTileLoader *loader = activeLoader(type);
             if (!loader)
                 continue;
 
-            // если лоадер выключен то игнориреум его
-            bool ignore = !loader->isEnabled();
-            MapTileLoaderHttp *httploader = qobject_cast<MapTileLoaderHttp*>(loader);
-            if (httploader && httploader->isProxyEnabled())
-                ignore = false;
-            if (ignore)
-                continue;
-
             if (tileExpired && loader->isTemporaryTiles())
-                expiresTiles.append(vm.value("id").toString());
+                expiresTiles.append(d.id);
+            else if (tileExpired && !d.img.isNull())
+                // сохраненный тайл проверяется условным запросом
+                loader->setTileValidators(d.key.x, d.key.y, d.key.z, d.etag, d.lastModified);
 
-            // добавляем в кэш лоадеров
-            if (!askCache.contains(keyHash) && !loadersErrorsCache.contains(keyHash)) {
-                askCache.insert(keyHash);
-                if (askCache.size() >= MaxUIntCacheSize)
-                    askCache.clear();
-
-                // заправшиваем тайл
-                loader->getTile(key.x, key.y, key.z);
-            }
+            // заправшиваем тайл
+            requestLoader(d.key, true, prefetch);
         }
     }
 
@@ -1181,19 +1319,13 @@ void MapLayerTilePrivate::incomeFuture()
     TileKey key = w->future().result();
 
     quint64 hash = key.hash();
-    Tile *t = NULL;
-    {
-        QMutexLocker locker(&keyMutex);
-        t = tiles.value(hash);
-    }
+    Tile *t = tiles.value(hash);
     if (t) {
         if (t->rotated) {
 //            localDraw(painter, t);
         }
         else if (!t->origin && t->source.isEmpty()) {
-            QMutexLocker locker(&keyMutex);
             tiles.remove(hash);
-            delete t;
             t = NULL;
         }
     }
@@ -1211,6 +1343,12 @@ void MapLayerTilePrivate::timerEvent(QTimerEvent *e)
         flushTiles();
     else if (e->timerId() == cacheTimer.timerId())
         loadersErrorsCache.clear();
+    else if (e->timerId() == statsTimer.timerId()) {
+        if (map) {
+            map->settings()->setTileCacheStats(tiles.stats().toVariant());
+            map->settings()->setTilePrefetchStats(scheduler.prefetchStats().toVariant());
+        }
+    }
 }
 
 // -----------------------------------------------------------------------------
@@ -6,6 +6,7 @@
 #include <QWaitCondition>
 #include <QPropertyAnimation>
 #include <QBasicTimer>
+#include <QThreadPool>
 
 #include "loaders/maptileloader.h"
 
@@ -15,6 +16,8 @@
 #include "coord/mapcamera.h"
 #include "sql/mapsql.h"
 #include "layers/maplayertile.h"
+#include "layers/maptilecache.h"
+#include "layers/maptilescheduler.h"
 
 namespace dc {
     class DatabaseController;
@@ -69,6 +72,12 @@ public:
     };
     Q_DECLARE_FLAGS(ClearBits, ClearBit)
 
+    /**
+     * @brief target изображение, готовое к отрисовке
+     * @param affine поворот выполняется при отрисовке
+     */
+    QImage *target(bool affine) const { return affine ? scaled : rotated; }
+
     void clear(ClearBits flag = All) {
         if (origin && flag.testFlag(OriginBit)) {
             delete origin;
@@ -144,6 +153,34 @@ public:
      */
     void saveTileInCache(const TileKey &key, int type, const QImage &img, bool flag = true);
 
+    /**
+     * @brief activeLoader загрузчик, которому можно отправлять запросы
+     * @param type тип загрузчика
+     * @return загрузчик или NULL, если он отсутствует или выключен
+     */
+    MapTileLoader *activeLoader(int type) const;
+
+    /**
+     * @brief isPackType тайлы типа лежат в локальном пакете (TilePack), бд не спрашиваем
+     * @param type тип тайла
+     */
+    bool isPackType(int type) const;
+
+    /**
+     * @brief requestLoader поставить тайл в очередь загрузчика
+     * @param key ключ тайла с типом
+     * @param cancelable запрос можно отменить при уходе тайла из области видимости
+     * @param prefetch упреждающий запрос
+     */
+    void requestLoader(const TileKey &key, bool cancelable = true, bool prefetch = false);
+
+    /**
+     * @brief prefetch упреждающая загрузка: область назначения, кольцо вокруг экрана и соседние уровни
+     * @param pos точка назначения камеры (в системе Меркатора)
+     * @param scale ожидаемый scale камеры
+     */
+    void prefetch(const QPointF &pos, qreal scale);
+
 private:
 
     QList<int> missedTypes(const TileKey &key);
@@ -167,12 +204,22 @@ private:
     QList<int> getCacheImage(QPainter *painter, const TileKey &key);
 
     /**
-     * @brief getdbImage создать запрос недостающих тайлов
+     * @brief getdbImage создать запрос недостающих тайлов (запросы в бд копятся в dbBatch)
      * @param types типы тайлов
      * @param key ключ
      */
     void getdbImage(const QList<int> types, const TileKey &key);
 
+    /**
+     * @brief requestDbBatch запросить тайлы в бд одним запросом
+     * @param keys ключи тайлов с типами
+     * @param level на сколько уровней подниматься для отсутствующих тайлов
+     * @param priority приоритет запроса
+     * @param prefetch упреждающий запрос
+     * @return регистрационный номер запроса
+     */
+    uint requestDbBatch(const QList<TileKey> &keys, int level, int priority, bool prefetch = false);
+
     /**
      * @brief createColorizedTile создать перекрашенный тайл
      * @param t
@@ -213,6 +260,14 @@ private:
      */
     void calcVisualRect();
 
+    /**
+     * @brief tileRect индексы тайлов, покрывающих прямоугольник
+     * @param worldRect прямоугольник в мировых координатах
+     * @param z масштаб подложки
+     * @return прямоугольник индексов (может быть пустым)
+     */
+    QRect tileRect(const QRectF &worldRect, int z) const;
+
     /**
      * @brief updateLowerTiles
      * @param t
@@ -248,6 +303,11 @@ public Q_SLOTS:
      */
     void loaderError(int, int, int, int);
 
+    /**
+     * @brief loaderValidators валидаторы полученного тайла (сохраняются в бд вместе с ним)
+     */
+    void loaderValidators(int, int, int, int, QByteArray, QByteArray);
+
 Q_SIGNALS:
     void tileIncome(const TileKey &key, bool empty, bool fromdb = false);
 
@@ -281,8 +341,36 @@ protected:
     void timerEvent(QTimerEvent *);
 
 public:
-    static const int MaxCacheTile     = 100;     // максимальный размер кэша тайлов
-    static const int MaxUIntCacheSize = 128;     // максимальный размер кэша тайлов
+    //! тайл из ответа бд, декодированный в пуле потоков
+    struct DecodedTile {
+        TileKey key;                             // ключ тайла с типом
+        QImage img;                              // изображение (пустое, если тайла нет)
+        int expires;                             // срок годности
+        int shift;                               // подъем к родителю (0 - запрошенный тайл)
+        QString id;                              // ид записи в бд
+        QByteArray etag;                         // валидаторы HTTP для условного запроса
+        QByteArray lastModified;
+    };
+
+    //! ответ бд в процессе декодирования
+    struct DecodeBatch {
+        DecodeBatch() : left(0) {}
+        int left;                                // не завершенных частей
+        QList<DecodedTile> tiles;
+    };
+
+    /**
+     * @brief decodeTiles декодировать часть ответа бд (выполняется в пуле потоков)
+     * @param rows строки ответа
+     */
+    static QList<DecodedTile> decodeTiles(const dc::QueryResult &rows);
+
+    /**
+     * @brief tilesDecoded ответ бд декодирован: раскладка тайлов в кэш и запросы промахов
+     * @param query номер запроса в бд
+     * @param decoded тайлы
+     */
+    void tilesDecoded(uint query, const QList<DecodedTile> &decoded);
 
     ConvertColor::ColorFilterFunc func;          // функция изменения гаммы подложки
     QVariantMap graphOpt;                        // опции изменения гаммы
@@ -294,19 +382,27 @@ public:
     bool scaleChanged;                           // scale изменился
     qreal cameraAngle;                           // предыдущее значение поворота камеры
     bool angleChanged;                           // камеру повернули
-    QHash<quint64, Tile*> tiles;                 // кэш подложки
-    QList<quint64> tileHistory;                  // история использования тайлов
+    TileCache tiles;                             // кэш подложки
     QList<int> types;                            // активные типы загрузчиков
 
-    QSet<quint64> askCache;                      // кэш отправленных запросов на сервер
-    QSet<quint64> dbCache;                       // кэш отправленных запросов в базу данных
+    TileScheduler scheduler;                     // планировщик запросов в бд и к загрузчикам
+    QList<TileKey> dbBatch;                      // тайлы кадра для запроса в бд
 
     QSet<quint64> dbEmptyCache;                  // кэш отсутсвующий тайлов в базе
+
+    QThreadPool decodePool;                      // пул декодирования тайлов из бд
+    QHash<uint, DecodeBatch> decodeBatches;      // номер запроса в бд - декодируемый ответ
+    static const int DecodeChunk = 16;           // тайлов в одной задаче декодирования
+    static const int DecodeThreads = 2;          // потоков декодирования
     QSet<quint64> loadersErrorsCache;            // кэш ошибок на сервере
+    QHash<quint64, QPair<QByteArray, QByteArray> > validators; // валидаторы полученных тайлов до постановки в очередь бд
 
     QBasicTimer cacheTimer;                      // таймер для очистки кэша ошибок
     static const int errorClearTime = 60000;     // время очистки кэша ошибок
 
+    QBasicTimer statsTimer;                      // таймер для публикации статистики кэша
+    static const int statsInterval = 1000;       // интервал публикации статистики кэша
+
     QHash<quint8, MapTileLoader*> loaders;       // полные перечень доступных загрузчиков
 
     int levelUp;                                 // уровень тайлов
@@ -318,6 +414,7 @@ public:
     dc::QueryResult *queueTiles;                 // очередь тайлов на сохранение в бд
     QBasicTimer queueTimer;                      // таймер для сохранение в бд
     static const int FlushInterval = 30000;      // инетрвал сохранений
+    static const int DbReaders = 2;              // соединений-читателей бд (чтение параллельно записи)
 
     QMutex keyMutex;
     QMutex mutex;
@@ -332,9 +429,15 @@ public:
 
     QRect visionTileRect;
 
+    static const int PrefetchBudget = 48;        // упреждающих запросов за один проход
+    QRect prefetchRect;                          // область назначения последнего прохода
+    QRect prefetchView;                          // область видимости последнего прохода
+    int prefetchZoom;                            // масштаб области назначения
+
     //-----------------------------------------------
 
     bool smoothing;
+    bool affine;                                 // поворот подложки при отрисовке
 
     //-----------------------------------------------
 };
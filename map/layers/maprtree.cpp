@@ -1,13 +1,20 @@
-
-#include <QStack>
 #include <QDebug>
-#include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QVarLengthArray>
+#include <QSharedDataPointer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <qmath.h>
+
+#include <algorithm>
 
 #include "object/mapobject.h"
 #include "drawer/mapdrawer.h"
 #include "drawer/mapdrawercommon.h"
 
 #include "layers/maprtree.h"
+#include "layers/maprtreekernel.h"
 
 // -------------------------------------------------------
 
@@ -15,42 +22,229 @@ namespace minigis {
 
 // -------------------------------------------------------
 
-class MapRTreePrivate
+// элемент узла вне дерева: границы и номер узла/объекта
+struct PackItem
+{
+    QRectF rect;
+    int child;
+};
+
+static bool packLessX(const PackItem &a, const PackItem &b)
+{
+    return a.rect.center().x() < b.rect.center().x();
+}
+
+static bool packLessY(const PackItem &a, const PackItem &b)
+{
+    return a.rect.center().y() < b.rect.center().y();
+}
+
+// объединение границ (QRectF::united пропускает вырожденные границы точечных объектов)
+static QRectF united(const QRectF &a, const QRectF &b)
+{
+    return QRectF(QPointF(qMin(a.left(), b.left()), qMin(a.top(), b.top())),
+                  QPointF(qMax(a.right(), b.right()), qMax(a.bottom(), b.bottom())));
+}
+
+// на сколько увеличится площадь границ a при добавлении b
+static qreal enlargement(const QRectF &a, const QRectF &b)
+{
+    QRectF u = united(a, b);
+    return u.width() * u.height() - a.width() * a.height();
+}
+
+// элемент очереди поиска ближайших
+struct NearItem
+{
+    enum Kind {
+        NearNode,       // узел
+        NearBox,        // объект, расстояние до границ
+        NearObject      // объект, точное расстояние
+    };
+
+    qreal dist;
+    int index;          // номер узла или объекта
+    Kind kind;
+
+    // обратный порядок - в вершине кучи ближайший
+    bool operator<(const NearItem &other) const { return dist > other.dist; }
+};
+
+// стек обхода дерева
+typedef QVarLengthArray<int, 64> NodeStack;
+
+// -------------------------------------------------------
+
+// массив из страниц с неявным разделением: копия (снимок) разделяет страницы,
+// при изменении копируется только измененная страница
+template <typename T, int PageSize>
+class PagedVector
 {
 public:
-    explicit MapRTreePrivate();
+    PagedVector() : n(0) { }
+
+    inline int size() const { return n; }
+    inline bool isEmpty() const { return n == 0; }
+
+    inline const T &at(int i) const { return pages.at(i / PageSize)->data[i % PageSize]; }
+    inline T &operator[](int i) { return pages[i / PageSize]->data[i % PageSize]; }
+    // элементы с i-го до конца страницы лежат подряд
+    inline const T *constData(int i) const { return pages.at(i / PageSize)->data + i % PageSize; }
+
+    void resize(int size)
+    {
+        int count = (size + PageSize - 1) / PageSize;
+        int old = pages.size();
+        pages.resize(count);
+        for (int i = old; i < count; ++i)
+            pages[i] = new Page;
+        n = size;
+    }
+    void append(const T &v)
+    {
+        resize(n + 1);
+        (*this)[n - 1] = v;
+    }
+    void clear()
+    {
+        pages.clear();
+        n = 0;
+    }
 
-    Node* findObj(MapObject *obj);                // поиск в дереве
+private:
+    struct Page : public QSharedData
+    {
+        T data[PageSize];
+    };
 
-    Node* chooseLeaf(const QRectF &r);            // выбор листа + изменение размеров листа и всех его родителей
+    QVector<QSharedDataPointer<Page> > pages;
+    int n;
+};
 
-    void adjustBounds(Node *n, const QRectF &r);  // изменяет размер листа
-    qreal adjustValue(const Node *n, const QRectF &r);  // на сколько изменится размер листа
-    void resizeBoundsObj(Node *n);
-    void resizeBoundsNodes(Node *n);
+// -------------------------------------------------------
 
-    void splitNode(Node *n);                      // разделение листа
-    void splitDownLevel(Node *n);                 // создание нового уровня дерева
-    void splitSameLevel(Node *n);                 // разделение текущего уровня дерева
-    void split(MapObjectList objects, Node *right, Node *left); // алгоритм создания новых узлов
+// хранилище узлов: общее у дерева и его снимков
+// (страничные массивы: снимок копирует только указатели на страницы,
+// первое изменение после публикации копирует одну страницу, а не весь массив)
+class MapRTreeStorage
+{
+public:
+    MapRTreeStorage();
 
-    // поиск листьев в дереве
-    QList<Node *> findPoint(const QPointF &p) const;
-    QList<Node *> findRect(const QRectF &r) const;
-    QList<Node *> findPoly(const QPolygonF &p) const;
-
-    Node *root;                                   // корень
-    QMap<MapObject*, Node*> cache;                // объект - лист
-    QList<Node*> allNodes;                        // список все узлов дерева
-    static const int minNodes = 2;                // не явно используется в функции split
     static const int maxNodes = 25;               // максимальное количество элементов в узле
+    static const int cap = maxNodes + 1;          // размер блока элементов узла (с учетом переполнения)
+
+    static const int pageNodes = 16;              // узлов на странице (блок элементов узла не разрывается)
+    typedef PagedVector<qreal, pageNodes * cap> SlotReals;
+    typedef PagedVector<int, pageNodes * cap> SlotInts;
+
+    inline int slot(int node, int i) const { return node * cap + i; }
+
+    // элементы узлов
+    QRectF entryRect(int s) const;
+    bool entryContains(int s, const QRectF &r) const;
+    qreal entryDistance(int s, const QPointF &p) const; // расстояние до границ элемента (MINDIST)
+    QRectF nodeRect(int node) const;              // границы всех элементов узла
+
+    // поиск листьев в дереве
+    void findPoint(const QPointF &p, QVector<int> &leafs) const;
+    void findRect(const QRectF &r, QVector<int> &leafs) const;
+
+    // поиск объектов по сохраненным границам
+    QList<MapObject *> findBoxes(const QRectF &r) const;
+    // поиск ближайших (exact - точное расстояние MapDrawer::distance, иначе до границ)
+    QList<MapObject *> nearest(const QPointF &p, int k, qreal maxDist, const MapObjectFilter &filter,
+                               QList<qreal> *distances, bool exact) const;
+
+    // узлы
+    PagedVector<int, 256> count;                  // количество элементов (-1 - свободный узел)
+    PagedVector<bool, 256> leaf;                  // признак листа
+    int root;                                     // корень (-1 - пустое дерево)
+
+    // элементы узлов, блоки по cap элементов
+    SlotReals minx;
+    SlotReals miny;
+    SlotReals maxx;
+    SlotReals maxy;
+    SlotInts child;                               // номер узла или объекта (в листе)
+
+    PagedVector<MapObject*, 1024> objects;        // номер - объект
+};
+
+// -------------------------------------------------------
+
+class MapRTreePrivate : public MapRTreeStorage
+{
+public:
+    explicit MapRTreePrivate();
+
+    static const int minNodes = 2;                // минимальное количество объектов в листе
+    static const int bulkMin = maxNodes;          // минимум вставляемых объектов для пакетного построения
+
+    // узлы
+    int allocNode(bool isLeaf);
+    void freeNode(int node);
+    inline bool isFree(int node) const { return count.at(node) < 0; }
+
+    // элементы узлов
+    void setEntry(int s, const QRectF &r, int c);
+    void copyEntry(int from, int to);
+    int slotInParent(int node) const;             // элемент узла в родителе (-1 для корня)
+    void linkChild(int node, int s);              // связь элемента с узлом (родитель узла/лист объекта)
+
+    // объекты
+    int acquireId(MapObject *mo);
+    void releaseId(int id);
+    inline int objectNode(int id) const { return objectSlot.at(id) / cap; }
+    bool updateInPlace(int id, const QRectF &r);  // обновить границы объекта, если он остается в листе
+
+    // изменение дерева
+    int chooseLeaf(const QRectF &r) const;        // выбор листа с минимальным расширением
+    void insertEntry(int node, const QRectF &r, int c); // вставка элемента, разделение переполненного узла
+    void enlargeParents(int node, const QRectF &r); // расширение границ родителей
+    void shrinkParents(int node);                 // пересчет границ родителей
+    void splitNode(int node);                     // разделение переполненного узла
+    void putEntry(int node, const PackItem &item);
+    void removeEntry(int node, int i);            // удаление элемента без перестроения
+    void condense(int node);                      // перестроение ветки после удаления
+    bool insertObject(MapObject *mo);             // вставка объекта
+    bool removeObject(MapObject *mo, bool rebuild); // удаление объекта
+
+    void bulkLoad(QVector<PackItem> &items);      // пакетное построение дерева
+    QVector<PackItem> packLevel(QVector<PackItem> &items, bool leafs); // упаковка одного уровня
+
+    void reset();                                 // очистка хранилища
+
+    void findPoly(const QPolygonF &p, QVector<int> &leafs) const;
+
+    void markDirty(const QRectF &r);              // границы объекта изменились
+    void changed();                               // сообщить об изменениях, запланировать публикацию снимка
+
+    QVector<int> parent;                          // родитель (-1 - корень)
+    QVector<int> freeNodes;                       // свободные узлы
+
+    QVector<int> objectSlot;                      // номер - элемент листа
+    QVector<int> freeIds;                         // свободные номера
+    QHash<MapObject*, int> ids;                   // объект - номер
 
     QSet<MapObject *> insertList;                 // набор вставляемых объектов
     QSet<MapObject *> moveList;                   // набор перемещаемых объектов
-    QSet<Node*> deleteList;                       // набор измененных узлов при удалении
+    QSet<int> deleteList;                         // набор измененных листов при удалении
 
     bool locked;                                  // блокирует перстроение дерева
 
+    // измененная область
+    bool dirty;                                   // были изменения границ объектов
+    bool dirtyAll;                                // изменилось все дерево
+    QRectF dirtyRect;                             // объединение старых и новых границ измененных объектов
+
+    // снимки
+    bool concurrent;                              // публиковать снимки
+    bool publishPending;                          // публикация запланирована
+    quint64 epoch;                                // номер последнего снимка
+    mutable QMutex snapshotMutex;
+    MapRTreeSnapshotPtr snapshot;                 // последний опубликованный снимок
+
     MapRTree *q_ptr;
 
 private:
@@ -60,205 +254,233 @@ private:
 
 // -------------------------------------------------------
 
-MapRTreePrivate::MapRTreePrivate() :
-    root(NULL), cache(QMap<MapObject*, Node*>()), allNodes(QList<Node*>()), locked(false)
-{    
+class MapRTreeSnapshotPrivate : public MapRTreeStorage
+{
+public:
+    MapRTreeSnapshotPrivate(const MapRTreeStorage &storage, quint64 epoch, int objectCount)
+        : MapRTreeStorage(storage), epoch(epoch), objectCount(objectCount) { }
+
+    quint64 epoch;
+    int objectCount;
+};
+
+// -------------------------------------------------------
+
+MapRTreeStorage::MapRTreeStorage() :
+    root(-1)
+{
 }
 
-Node *MapRTreePrivate::findObj(MapObject *obj)
+MapRTreePrivate::MapRTreePrivate() :
+    locked(false), dirty(false), dirtyAll(false), concurrent(false), publishPending(false), epoch(0)
 {
-    foreach (Node *n, findRect(obj->drawer()->boundRect(obj))) {
-        if (n->objects.contains(obj))
-            return n;
-    }
-    return NULL;
 }
 
-Node *MapRTreePrivate::chooseLeaf(const QRectF &r)
+int MapRTreePrivate::allocNode(bool isLeaf)
 {
-    adjustBounds(root, r);
-    QStack<Node*> stack;
-    stack.append(root);
-    while (!stack.isEmpty()) {
-        Node* leaf = stack.pop();
-        if (leaf->nodes.isEmpty())
-            return leaf;
-
-        Node *node = leaf->nodes.first();
-        qreal min = adjustValue(node, r);
-        for (QListIterator<Node*> it(leaf->nodes); it.hasNext();) {
-            Node *n = it.next();
-            qreal sq = adjustValue(n, r);
-            if (sq < min) {
-                min = sq;
-                node = n;
-                if (qFuzzyIsNull(min))
-                    break;
-            }
-        }
-        adjustBounds(node, r);
-        stack.append(node);
+    int node;
+    if (!freeNodes.isEmpty()) {
+        node = freeNodes.last();
+        freeNodes.removeLast();
+    }
+    else {
+        node = count.size();
+        count.append(0);
+        parent.append(-1);
+        leaf.append(isLeaf);
+
+        int size = (node + 1) * cap;
+        minx.resize(size);
+        miny.resize(size);
+        maxx.resize(size);
+        maxy.resize(size);
+        child.resize(size);
     }
-    return NULL;
+    count[node] = 0;
+    parent[node] = -1;
+    leaf[node] = isLeaf;
+    return node;
 }
 
-void MapRTreePrivate::adjustBounds(Node *n, const QRectF &r)
+void MapRTreePrivate::freeNode(int node)
 {
-    if (!n->rect.contains(r))
-        n->rect = QRectF(QPointF(
-                             qMin(n->rect.left(), r.left()),
-                             qMin(n->rect.top(), r.top())
-                             ),
-                         QPointF(
-                             qMax(n->rect.right(), r.right()),
-                             qMax(n->rect.bottom(), r.bottom()))
-                         );
+    count[node] = -1;
+    parent[node] = -1;
+    freeNodes.append(node);
 }
 
-qreal MapRTreePrivate::adjustValue(Node const *n, const QRectF &r)
+QRectF MapRTreeStorage::entryRect(int s) const
 {
-    if (n->rect.contains(r))
-        return 0;
-
-    QRectF rAd(QPointF(
-                   qMin(n->rect.left(), r.left()),
-                       qMin(n->rect.top(), r.top())
-                   ),
-               QPointF(
-                   qMax(n->rect.right(), r.right()),
-                   qMax(n->rect.bottom(), r.bottom()))
-               );
-    return qAbs(rAd.width() * rAd.height() - r.width() * r.height());
+    return QRectF(QPointF(minx.at(s), miny.at(s)), QPointF(maxx.at(s), maxy.at(s)));
 }
 
-void MapRTreePrivate::resizeBoundsObj(Node *n)
+void MapRTreePrivate::setEntry(int s, const QRectF &r, int c)
 {
-    if (n->objects.isEmpty())
-        return;
-
-    MapObjectPtr mo = n->objects.first();
-    QRectF rect(mo->drawer()->boundRect(mo));
-    qreal l = rect.left();
-    qreal t = rect.top();
-    qreal r = rect.right();
-    qreal b = rect.bottom();
-    foreach (MapObjectPtr p, n->objects) {
-        rect = p->drawer()->boundRect(p.data());
-        l = qMin(l, rect.left());
-        t = qMin(t, rect.top());
-        r = qMax(r, rect.right());
-        b = qMax(b, rect.bottom());
-    }
-    n->rect = QRectF(QPointF(l, t), QPointF(r, b));
+    minx[s] = r.left();
+    miny[s] = r.top();
+    maxx[s] = r.right();
+    maxy[s] = r.bottom();
+    child[s] = c;
 }
 
-void MapRTreePrivate::resizeBoundsNodes(Node *n)
+void MapRTreePrivate::copyEntry(int from, int to)
 {
-    if (n->nodes.isEmpty())
-        return;
+    minx[to] = minx.at(from);
+    miny[to] = miny.at(from);
+    maxx[to] = maxx.at(from);
+    maxy[to] = maxy.at(from);
+    child[to] = child.at(from);
+}
 
-    QRectF rect(n->nodes.first()->rect);
-    qreal l = rect.left();
-    qreal t = rect.top();
-    qreal r = rect.right();
-    qreal b = rect.bottom();
+bool MapRTreeStorage::entryContains(int s, const QRectF &r) const
+{
+    return minx.at(s) <= r.left() && miny.at(s) <= r.top() &&
+            maxx.at(s) >= r.right() && maxy.at(s) >= r.bottom();
+}
 
-    foreach (Node *p, n->nodes) {
-        l = qMin(l, p->rect.left());
-        t = qMin(t, p->rect.top());
-        r = qMax(r, p->rect.right());
-        b = qMax(b, p->rect.bottom());
-    }
-    n->rect = QRectF(QPointF(l, t), QPointF(r, b));
+qreal MapRTreeStorage::entryDistance(int s, const QPointF &p) const
+{
+    qreal dx = qMax(qMax(minx.at(s) - p.x(), p.x() - maxx.at(s)), qreal(0));
+    qreal dy = qMax(qMax(miny.at(s) - p.y(), p.y() - maxy.at(s)), qreal(0));
+    return qSqrt(dx * dx + dy * dy);
 }
 
-void MapRTreePrivate::splitNode(Node *n)
+QRectF MapRTreeStorage::nodeRect(int node) const
 {
-    if (n->nodes.size() > maxNodes || (n->objects.size() > maxNodes && n == root))
-        splitDownLevel(n);
-    else if (n->objects.size() > maxNodes && n != root) {
-        if (n->parent->nodes.size() + 1 > maxNodes)
-            splitDownLevel(n);
-        else
-            splitSameLevel(n);
+    int s = slot(node, 0);
+    int end = s + count.at(node);
+    qreal l = minx.at(s);
+    qreal t = miny.at(s);
+    qreal r = maxx.at(s);
+    qreal b = maxy.at(s);
+    for (++s; s < end; ++s) {
+        l = qMin(l, minx.at(s));
+        t = qMin(t, miny.at(s));
+        r = qMax(r, maxx.at(s));
+        b = qMax(b, maxy.at(s));
     }
+    return QRectF(QPointF(l, t), QPointF(r, b));
 }
 
-void MapRTreePrivate::splitDownLevel(Node *n)
+int MapRTreePrivate::slotInParent(int node) const
 {
-    Node *left = new Node();
-    Node *right= new Node();
-
-    left->parent  = n;
-    right->parent = n;
-
-    left->level  = n->level + 1;
-    right->level = n->level + 1;
-
-    split(n->objects, right, left);
-
-    n->nodes.append(left);
-    n->nodes.append(right);
-
-    n->objects.clear();
-
-    allNodes.append(left);
-    allNodes.append(right);
+    int p = parent.at(node);
+    if (p < 0)
+        return -1;
+
+    int s = slot(p, 0);
+    int end = s + count.at(p);
+    for (; s < end; ++s)
+        if (child.at(s) == node)
+            return s;
+    return -1;
 }
 
-void MapRTreePrivate::splitSameLevel(Node *n)
+void MapRTreePrivate::linkChild(int node, int s)
 {
-    Node *parent = n->parent;
-
-    Node *left  = new Node();
-    Node *right = new Node();
-
-    left->parent  = parent;
-    right->parent = parent;
-
-    left->level  = n->level;
-    right->level = n->level;
-
-    split(n->objects, right, left);
+    if (leaf.at(node))
+        objectSlot[child.at(s)] = s;
+    else
+        parent[child.at(s)] = node;
+}
 
-    parent->nodes.removeOne(n);
+int MapRTreePrivate::acquireId(MapObject *mo)
+{
+    int id;
+    if (!freeIds.isEmpty()) {
+        id = freeIds.last();
+        freeIds.removeLast();
+        objects[id] = mo;
+        objectSlot[id] = -1;
+    }
+    else {
+        id = objects.size();
+        objects.append(mo);
+        objectSlot.append(-1);
+    }
+    ids.insert(mo, id);
+    return id;
+}
 
-    parent->nodes.append(left);
-    parent->nodes.append(right);
+void MapRTreePrivate::releaseId(int id)
+{
+    ids.remove(objects.at(id));
+    objects[id] = NULL;
+    objectSlot[id] = -1;
+    freeIds.append(id);
+}
 
-    allNodes.removeOne(n);
-    n->objects.clear();
-    n->nodes.clear();
-    n->parent = NULL;
-    delete n;
-    n = NULL;
+int MapRTreePrivate::chooseLeaf(const QRectF &r) const
+{
+    int node = root;
+    while (!leaf.at(node)) {
+        int s = slot(node, 0);
+        int best = boxChoose(minx.constData(s), miny.constData(s), maxx.constData(s), maxy.constData(s),
+                             count.at(node), r.left(), r.top(), r.right(), r.bottom());
+        node = child.at(s + best);
+    }
+    return node;
+}
 
-    allNodes.append(left);
-    allNodes.append(right);
+void MapRTreePrivate::insertEntry(int node, const QRectF &r, int c)
+{
+    int s = slot(node, count.at(node));
+    ++count[node];
+    setEntry(s, r, c);
+    linkChild(node, s);
+
+    enlargeParents(node, r);
+    if (count.at(node) > maxNodes)
+        splitNode(node);
 }
 
-void MapRTreePrivate::split(MapObjectList objects, Node *right, Node *left)
+void MapRTreePrivate::enlargeParents(int node, const QRectF &r)
 {
-    if (objects.size() <= maxNodes)
-        return;
+    for (int s = slotInParent(node); s >= 0; s = slotInParent(node)) {
+        // если элемент содержит область, то и все выше тоже
+        if (entryContains(s, r))
+            break;
+        minx[s] = qMin(minx.at(s), r.left());
+        miny[s] = qMin(miny.at(s), r.top());
+        maxx[s] = qMax(maxx.at(s), r.right());
+        maxy[s] = qMax(maxy.at(s), r.bottom());
+        node = parent.at(node);
+    }
+}
 
-    // выбираем начальные точки для новых листов
-    qreal maxdist = 0.;
-    int lNum = -1;
-    int rNum = -1;
-    for (int i = 0; i < objects.size() - 1; ++i) {
-        MapObjectPtr oOne(objects.at(i));
-        QRectF rectOne(oOne->drawer()->boundRect(oOne));
+void MapRTreePrivate::shrinkParents(int node)
+{
+    for (int s = slotInParent(node); s >= 0 && count.at(node) > 0; s = slotInParent(node)) {
+        QRectF r = nodeRect(node);
+        if (entryRect(s) == r)
+            break;
+        setEntry(s, r, node);
+        node = parent.at(node);
+    }
+}
 
-        for (int j = i; j < objects.size(); ++j) {
-            MapObjectPtr oTwo(objects.at(j));
-            QRectF rectTwo(oTwo->drawer()->boundRect(oTwo));
+void MapRTreePrivate::splitNode(int node)
+{
+    int n = count.at(node);
+    QVector<PackItem> items(n);
+    for (int i = 0; i < n; ++i) {
+        int s = slot(node, i);
+        items[i].rect = entryRect(s);
+        items[i].child = child.at(s);
+    }
 
+    // выбираем начальные элементы для новых узлов
+    qreal maxdist = -1;
+    int lNum = 0;
+    int rNum = 1;
+    for (int i = 0; i < n - 1; ++i) {
+        const QRectF &rectOne = items.at(i).rect;
+        for (int j = i + 1; j < n; ++j) {
+            const QRectF &rectTwo = items.at(j).rect;
             qreal len = qMax(
                         QLineF(rectOne.topLeft(), rectTwo.bottomRight()).length(),
                         QLineF(rectOne.bottomLeft(), rectTwo.topRight()).length()
                         );
-
             if (len > maxdist) {
                 maxdist = len;
                 lNum = i;
@@ -266,173 +488,468 @@ void MapRTreePrivate::split(MapObjectList objects, Node *right, Node *left)
             }
         }
     }
-    if (lNum != -1 && rNum != -1) {
-        if (lNum > rNum) {
-            MapObjectPtr p = objects.takeAt(lNum);
-            left->objects.append(p);
-            left->rect = p->drawer()->boundRect(p);
-            cache[p] = left;
-
-            p = objects.takeAt(rNum);
-            right->objects.append(p);            
-            right->rect = p->drawer()->boundRect(p);
-            cache[p] = right;
+
+    int sibling = allocNode(leaf.at(node));
+    count[node] = 0;
+    putEntry(node, items.at(lNum));
+    putEntry(sibling, items.at(rNum));
+    QRectF lRect = items.at(lNum).rect;
+    QRectF rRect = items.at(rNum).rect;
+
+    // распределение по наименьшему расширению с учетом минимального заполнения
+    int rest = n - 2;
+    for (int i = 0; i < n; ++i) {
+        if (i == lNum || i == rNum)
+            continue;
+        const PackItem &item = items.at(i);
+
+        bool toLeft;
+        if (count.at(node) + rest <= minNodes)
+            toLeft = true;
+        else if (count.at(sibling) + rest <= minNodes)
+            toLeft = false;
+        else {
+            qreal lSize = enlargement(lRect, item.rect);
+            qreal rSize = enlargement(rRect, item.rect);
+            if (qFuzzyCompare(lSize + 1, rSize + 1))
+                toLeft = count.at(node) <= count.at(sibling);
+            else
+                toLeft = lSize < rSize;
+        }
+        --rest;
+
+        if (toLeft) {
+            putEntry(node, item);
+            lRect = united(lRect, item.rect);
         }
         else {
-            MapObjectPtr p = objects.takeAt(rNum);
-            right->objects.append(p);
-            right->rect = p->drawer()->boundRect(p);
-            cache[p] = right;
-
-            p = objects.takeAt(lNum);
-            left->objects.append(p);
-            left->rect = p->drawer()->boundRect(p);
-            cache[p] = left;
+            putEntry(sibling, item);
+            rRect = united(rRect, item.rect);
         }
     }
 
-    // ---------
-    while (!objects.isEmpty()) {
-        MapObjectPtr p = objects.takeFirst();
-        if (objects.size() == 1) {
-            if (right->objects.size() == 0) {
-                right->objects.append(p);
-                adjustBounds(right, p->drawer()->boundRect(p));
-                cache[p] = right;
-                continue;
-            }
-            if (left->objects.size() == 0) {
-                left->objects.append(p);
-                adjustBounds(left, p->drawer()->boundRect(p));
-                cache[p] = left;
-                continue;
-            }
-        }
+    int p = parent.at(node);
+    if (p < 0) {
+        // новый корень
+        root = allocNode(false);
+        putEntry(root, PackItem{lRect, node});
+        putEntry(root, PackItem{rRect, sibling});
+    }
+    else {
+        setEntry(slotInParent(node), lRect, node);
+        insertEntry(p, rRect, sibling);
+    }
+}
 
-        if (objects.isEmpty()) {
-            if (right->objects.size() == 1) {
-                right->objects.append(p);
-                adjustBounds(right, p->drawer()->boundRect(p));
-                cache[p] = right;
-                continue;
-            }
-            if (left->objects.size() == 1) {
-                left->objects.append(p);
-                adjustBounds(left, p->drawer()->boundRect(p));
-                cache[p] = left;
-                continue;
-            }
-        }
+void MapRTreePrivate::putEntry(int node, const PackItem &item)
+{
+    int s = slot(node, count.at(node));
+    ++count[node];
+    setEntry(s, item.rect, item.child);
+    linkChild(node, s);
+}
 
-        qreal lSize = adjustValue(left, p->drawer()->boundRect(p));
-        qreal rSize = adjustValue(right, p->drawer()->boundRect(p));
-        if (lSize < rSize) {
-            if (left->objects.size() < maxNodes) {
-                left->objects.append(p);
-                adjustBounds(left, p->drawer()->boundRect(p));
-                cache[p] = left;
-            }
-            else {
-                right->objects.append(p);
-                adjustBounds(right, p->drawer()->boundRect(p));
-                cache[p] = right;
-            }
+void MapRTreePrivate::removeEntry(int node, int i)
+{
+    int last = count.at(node) - 1;
+    if (i != last) {
+        copyEntry(slot(node, last), slot(node, i));
+        linkChild(node, slot(node, i));
+    }
+    --count[node];
+}
+
+void MapRTreePrivate::condense(int node)
+{
+    // листья с недостаточным заполнением и пустые узлы удаляются,
+    // оставшиеся объекты вставляются заново (как в R*-дереве)
+    QVector<PackItem> orphans;
+    while (parent.at(node) >= 0) {
+        int p = parent.at(node);
+        if (count.at(node) >= (leaf.at(node) ? minNodes : 1)) {
+            shrinkParents(node);
+            break;
         }
-        else {
-            if (right->objects.size() < maxNodes) {
-                right->objects.append(p);
-                adjustBounds(right, p->drawer()->boundRect(p));
-                cache[p] = right;
-            }
-            else {
-                left->objects.append(p);
-                adjustBounds(left, p->drawer()->boundRect(p));
-                cache[p] = left;
+
+        if (leaf.at(node))
+            for (int i = 0; i < count.at(node); ++i) {
+                int s = slot(node, i);
+                orphans.append(PackItem{entryRect(s), child.at(s)});
             }
+        removeEntry(p, slotInParent(node) - slot(p, 0));
+        freeNode(node);
+        node = p;
+    }
+
+    // корень с единственным потомком
+    while (root >= 0 && !leaf.at(root) && count.at(root) == 1) {
+        int c = child.at(slot(root, 0));
+        freeNode(root);
+        parent[c] = -1;
+        root = c;
+    }
+    if (root >= 0 && count.at(root) == 0) {
+        freeNode(root);
+        root = -1;
+    }
+
+    // сначала ближайшие к центру удаленного листа - меньше перекрытие листов
+    if (orphans.size() > 1) {
+        QRectF r = orphans.first().rect;
+        foreach (const PackItem &item, orphans)
+            r = united(r, item.rect);
+        QPointF c = r.center();
+        std::sort(orphans.begin(), orphans.end(), [&c](const PackItem &a, const PackItem &b) {
+            QPointF da = a.rect.center() - c;
+            QPointF db = b.rect.center() - c;
+            return QPointF::dotProduct(da, da) < QPointF::dotProduct(db, db);
+        });
+    }
+    foreach (const PackItem &item, orphans) {
+        if (root < 0)
+            root = allocNode(true);
+        insertEntry(chooseLeaf(item.rect), item.rect, item.child);
+    }
+}
+
+bool MapRTreePrivate::insertObject(MapObject *mo)
+{
+    if (!mo->drawer())
+        return true;
+
+    if (ids.contains(mo))
+        removeObject(mo, true);
+
+    QRectF r = mo->drawer()->boundRect(mo);
+    int id = acquireId(mo);
+    if (root < 0)
+        root = allocNode(true);
+    insertEntry(chooseLeaf(r), r, id);
+    markDirty(r);
+    return true;
+}
+
+bool MapRTreePrivate::updateInPlace(int id, const QRectF &r)
+{
+    int ps = slotInParent(objectNode(id));
+    if (ps >= 0 && !entryContains(ps, r))
+        return false;
+
+    markDirty(entryRect(objectSlot.at(id)));
+    markDirty(r);
+    setEntry(objectSlot.at(id), r, id);
+    return true;
+}
+
+bool MapRTreePrivate::removeObject(MapObject *mo, bool rebuild)
+{
+    int id = ids.value(mo, -1);
+    if (id < 0)
+        return false;
+
+    int node = objectNode(id);
+    markDirty(entryRect(objectSlot.at(id)));
+    removeEntry(node, objectSlot.at(id) - slot(node, 0));
+    releaseId(id);
+
+    if (rebuild)
+        condense(node);
+    else
+        deleteList.insert(node);
+    return true;
+}
+
+void MapRTreePrivate::bulkLoad(QVector<PackItem> &items)
+{
+    if (items.isEmpty())
+        return;
+
+    // упаковка снизу вверх, пока не останется корень
+    QVector<PackItem> level = packLevel(items, true);
+    while (level.size() > 1)
+        level = packLevel(level, false);
+
+    root = level.first().child;
+    parent[root] = -1;
+}
+
+QVector<PackItem> MapRTreePrivate::packLevel(QVector<PackItem> &items, bool leafs)
+{
+    // Sort-Tile-Recursive: полосы по X, в полосе - узлы по Y
+    int size = items.size();
+    int nodes = (size + maxNodes - 1) / maxNodes;
+    int slices = qCeil(qSqrt(qreal(nodes)));
+    int sliceSize = slices * maxNodes;
+
+    std::sort(items.begin(), items.end(), packLessX);
+
+    QVector<PackItem> result;
+    result.reserve(nodes);
+    for (int s = 0; s < size; s += sliceSize) {
+        int sliceEnd = qMin(s + sliceSize, size);
+        std::sort(items.begin() + s, items.begin() + sliceEnd, packLessY);
+
+        for (int i = s; i < sliceEnd; i += maxNodes) {
+            int end = qMin(i + maxNodes, sliceEnd);
+            int n = allocNode(leafs);
+            for (int j = i; j < end; ++j)
+                putEntry(n, items.at(j));
+
+            PackItem packed;
+            packed.rect = nodeRect(n);
+            packed.child = n;
+            result.append(packed);
         }
     }
+    return result;
 }
 
+void MapRTreePrivate::reset()
+{
+    count.clear();
+    parent.clear();
+    leaf.clear();
+    freeNodes.clear();
+    root = -1;
+
+    minx.clear();
+    miny.clear();
+    maxx.clear();
+    maxy.clear();
+    child.clear();
+
+    objects.clear();
+    objectSlot.clear();
+    freeIds.clear();
+    ids.clear();
+
+    insertList.clear();
+    moveList.clear();
+    deleteList.clear();
+
+    dirtyAll = true;
+}
 
-QList<Node *> MapRTreePrivate::findPoint(const QPointF &p) const
+void MapRTreeStorage::findPoint(const QPointF &p, QVector<int> &leafs) const
 {
-    QList<Node*> endList;
+    if (root < 0)
+        return;
+
+    qreal x = p.x();
+    qreal y = p.y();
 
-    QStack<Node*> stack;
+    int hits[cap];
+    NodeStack stack;
     stack.append(root);
     while (!stack.isEmpty()) {
-        Node* leaf = stack.pop();
-        if (leaf->nodes.isEmpty()) {
-            endList.append(leaf);
+        int node = stack.last();
+        stack.removeLast();
+        if (leaf.at(node)) {
+            leafs.append(node);
             continue;
         }
 
-        for (int i = 0; i < leaf->nodes.size(); ++i)
-            if (leaf->nodes.at(i)->rect.contains(p))
-                stack.append(leaf->nodes.at(i));
+        int s = slot(node, 0);
+        int found = boxOverlap(minx.constData(s), miny.constData(s), maxx.constData(s), maxy.constData(s),
+                               count.at(node), x, y, x, y, hits);
+        for (int i = 0; i < found; ++i)
+            stack.append(child.at(s + hits[i]));
     }
-    return endList;
 }
 
-QList<Node *> MapRTreePrivate::findRect(const QRectF &r) const
+void MapRTreeStorage::findRect(const QRectF &r, QVector<int> &leafs) const
 {
-    if (allNodes.isEmpty())
-        return QList<Node *>();
+    if (root < 0)
+        return;
 
-    if (r.size().isEmpty())
-        return findPoint(r.topLeft());
+    if (r.size().isEmpty()) {
+        findPoint(r.topLeft(), leafs);
+        return;
+    }
 
-    QList<Node*> endList;
+    qreal l = r.left();
+    qreal t = r.top();
+    qreal rt = r.right();
+    qreal b = r.bottom();
 
-    QStack<Node*> stack;
+    int hits[cap];
+    NodeStack stack;
     stack.append(root);
     while (!stack.isEmpty()) {
-        Node* leaf = stack.pop();
-        if (leaf->nodes.isEmpty()) {
-            endList.append(leaf);
+        int node = stack.last();
+        stack.removeLast();
+        if (leaf.at(node)) {
+            leafs.append(node);
             continue;
         }
 
-        for (int i = 0; i < leaf->nodes.size(); ++i) {
-            if (leaf->nodes.at(i)->rect.intersects(r))
-                stack.append(leaf->nodes.at(i));
-        }
+        int s = slot(node, 0);
+        int found = boxOverlap(minx.constData(s), miny.constData(s), maxx.constData(s), maxy.constData(s),
+                               count.at(node), l, t, rt, b, hits);
+        for (int i = 0; i < found; ++i)
+            stack.append(child.at(s + hits[i]));
     }
+}
 
-    return endList;
+QList<MapObject *> MapRTreeStorage::findBoxes(const QRectF &r) const
+{
+    QList<MapObject *> list;
+    QVector<int> leafs;
+    findRect(r, leafs);
+
+    int hits[cap];
+    foreach (int node, leafs) {
+        int s = slot(node, 0);
+        int found = boxOverlap(minx.constData(s), miny.constData(s), maxx.constData(s), maxy.constData(s),
+                               count.at(node), r.left(), r.top(), r.right(), r.bottom(), hits);
+        for (int i = 0; i < found; ++i)
+            list.append(objects.at(child.at(s + hits[i])));
+    }
+    return list;
 }
 
-QList<Node *> MapRTreePrivate::findPoly(const QPolygonF &p) const
+QList<MapObject *> MapRTreeStorage::nearest(const QPointF &p, int k, qreal maxDist, const MapObjectFilter &filter,
+                                           QList<qreal> *distances, bool exact) const
 {
-    if (allNodes.isEmpty())
-        return QList<Node *>();
+    QList<MapObject *> list;
+    if (distances)
+        distances->clear();
+    if (root < 0)
+        return list;
+
+    // точное расстояние до объекта не меньше расстояния до его границ,
+    // поэтому объект из вершины кучи ближе всех оставшихся
+    // (для снимка точное расстояние не считается - объекты могут меняться в другом потоке)
+    QVector<NearItem> queue;
+    queue.append(NearItem{0, root, NearItem::NearNode});
+    while (!queue.isEmpty()) {
+        std::pop_heap(queue.begin(), queue.end());
+        NearItem item = queue.last();
+        queue.removeLast();
+
+        if (item.kind == NearItem::NearObject) {
+            list.append(objects.at(item.index));
+            if (distances)
+                distances->append(item.dist);
+            if (k > 0 && list.size() >= k)
+                break;
+            continue;
+        }
 
-    if (p.isEmpty())
-        return QList<Node *>();
-    if (p.size() == 1)
-        return findPoint(p.first());
+        if (item.kind == NearItem::NearBox) {
+            MapObject *obj = objects.at(item.index);
+            if (filter && !filter(obj))
+                continue;
+            qreal dist = exact ? obj->drawer()->distance(obj, p) : item.dist;
+            if (maxDist < 0 || dist <= maxDist) {
+                queue.append(NearItem{dist, item.index, NearItem::NearObject});
+                std::push_heap(queue.begin(), queue.end());
+            }
+            continue;
+        }
 
-    QList<Node*> endList;
+        NearItem::Kind kind = leaf.at(item.index) ? NearItem::NearBox : NearItem::NearNode;
+        int s = slot(item.index, 0);
+        int end = s + count.at(item.index);
+        for (; s < end; ++s) {
+            qreal dist = entryDistance(s, p);
+            if (maxDist >= 0 && dist > maxDist)
+                continue;
+            queue.append(NearItem{dist, child.at(s), kind});
+            std::push_heap(queue.begin(), queue.end());
+        }
+    }
+    return list;
+}
 
-    QStack<Node*> stack;
+void MapRTreePrivate::findPoly(const QPolygonF &p, QVector<int> &leafs) const
+{
+    if (root < 0 || p.isEmpty())
+        return;
+    if (p.size() == 1) {
+        findPoint(p.first(), leafs);
+        return;
+    }
+
+    NodeStack stack;
     stack.append(root);
     while (!stack.isEmpty()) {
-        Node* leaf = stack.pop();
-        if (leaf->nodes.isEmpty())
-            endList.append(leaf);
-        else
-            for (int i = 0; i < leaf->nodes.size(); ++i)
-                if (rectIntersectPolyFull(leaf->nodes.at(i)->rect, p))
-                    stack.append(leaf->nodes.at(i));
-                else {
-                    MapObjectList moList = leaf->nodes.at(i)->objects;
-                    for (int i = 0; i < moList.size(); ++i) {
-                        MapObject *obj = moList.at(i).data();
-                        obj->drawer()->hide(obj);
-                    }
+        int node = stack.last();
+        stack.removeLast();
+        if (leaf.at(node)) {
+            leafs.append(node);
+            continue;
+        }
+
+        int s = slot(node, 0);
+        int end = s + count.at(node);
+        for (; s < end; ++s) {
+            int c = child.at(s);
+            if (rectIntersectPolyFull(entryRect(s), p))
+                stack.append(c);
+            else if (leaf.at(c))
+                for (int i = 0; i < count.at(c); ++i) {
+                    MapObject *obj = objects.at(child.at(slot(c, i)));
+                    obj->drawer()->hide(obj);
                 }
+        }
     }
-    return endList;
+}
+
+void MapRTreePrivate::markDirty(const QRectF &r)
+{
+    dirtyRect = dirty ? united(dirtyRect, r) : r;
+    dirty = true;
+}
+
+void MapRTreePrivate::changed()
+{
+    if (dirty || dirtyAll) {
+        Q_Q(MapRTree);
+        QRectF r = dirtyRect;
+        bool whole = dirtyAll;
+        dirty = dirtyAll = false;
+        dirtyRect = QRectF();
+        emit q->regionChanged(r, whole);
+    }
+
+    // изменения одного прохода цикла событий - один снимок
+    if (!concurrent || publishPending || locked)
+        return;
+    publishPending = true;
+    QMetaObject::invokeMethod(q_ptr, "publish", Qt::QueuedConnection);
+}
+
+// -------------------------------------------------------
+
+MapRTreeSnapshot::MapRTreeSnapshot(MapRTreeSnapshotPrivate *dd) :
+    d_ptr(dd)
+{
+}
+
+MapRTreeSnapshot::~MapRTreeSnapshot()
+{
+}
+
+QList<MapObject *> MapRTreeSnapshot::find(const QRectF &r) const
+{
+    return d_ptr->findBoxes(r);
+}
+
+QList<MapObject *> MapRTreeSnapshot::nearest(const QPointF &p, int k, qreal maxDist,
+                                            const MapObjectFilter &filter, QList<qreal> *distances) const
+{
+    return d_ptr->nearest(p, k, maxDist, filter, distances, false);
+}
+
+int MapRTreeSnapshot::count() const
+{
+    return d_ptr->objectCount;
+}
+
+quint64 MapRTreeSnapshot::epoch() const
+{
+    return d_ptr->epoch;
 }
 
 // -------------------------------------------------------
@@ -447,6 +964,7 @@ MapRTree::MapRTree(QObject *parent) :
 
 MapRTree::~MapRTree()
 {
+    delete d_ptr;
 }
 
 void MapRTree::clear()
@@ -457,25 +975,60 @@ void MapRTree::clear()
         disconnect(mo, SIGNAL(destroyed(QObject*)), this, SLOT(deleteObj(QObject*)));
         disconnect(mo, SIGNAL(classCodeChanged(QString)), this, SLOT(movedObj()));
     }
-    d->insertList.clear();
-    d->moveList.clear();
-
-    for (QMapIterator<MapObject*, Node*> it(d->cache); it.hasNext(); ) {
+    for (QHashIterator<MapObject*, int> it(d->ids); it.hasNext(); ) {
         MapObject *mo = it.next().key();
         disconnect(mo, SIGNAL(destroyed(QObject*)), this, SLOT(deleteObj(QObject*)));
         disconnect(mo, SIGNAL(classCodeChanged(QString)), this, SLOT(movedObj()));
     }
-    d->cache.clear();
-    d->root = NULL;
-
-    qDeleteAll(d->allNodes);
-    d->allNodes.clear();
+    d->reset();
+    d->changed();
 }
 
 bool MapRTree::insert(MapObject *mo)
 {
     Q_D(MapRTree);
-    return d->locked ? blockingInsertObject(mo) : nonblockingInsertObject(mo);
+    bool res = d->locked ? blockingInsertObject(mo) : nonblockingInsertObject(mo);
+    d->changed();
+    return res;
+}
+
+void MapRTree::build(const QList<MapObject *> &objects)
+{
+    Q_D(MapRTree);
+
+    // объекты дерева, ожидающие вставки и новые
+    QSet<MapObject *> all = d->insertList;
+    for (QHashIterator<MapObject*, int> it(d->ids); it.hasNext(); )
+        all.insert(it.next().key());
+    foreach (MapObject *mo, objects) {
+        if (!mo || all.contains(mo))
+            continue;
+        connect(mo, SIGNAL(destroyed(QObject*)), SLOT(deleteObj(QObject*)), Qt::UniqueConnection);
+        connect(mo, SIGNAL(classCodeChanged(QString)), SLOT(movedObj()), Qt::UniqueConnection);
+        all.insert(mo);
+    }
+
+    // границы пересчитываются заново, отложенные перемещения и удаления не нужны
+    d->reset();
+
+    QVector<PackItem> items;
+    items.reserve(all.size());
+    foreach (MapObject *mo, all) {
+        if (!mo->drawer())
+            continue;
+        PackItem item;
+        item.rect = mo->drawer()->boundRect(mo);
+        item.child = d->acquireId(mo);
+        items.append(item);
+    }
+    d->bulkLoad(items);
+    d->changed();
+}
+
+bool MapRTree::isLocked() const
+{
+    Q_D(const MapRTree);
+    return d->locked;
 }
 
 void MapRTree::deleteObj(QObject *obj)
@@ -483,7 +1036,9 @@ void MapRTree::deleteObj(QObject *obj)
     if (!obj)
         return;
 
-    MapObject *mo = qobject_cast<MapObject *>(obj);
+    // сигнал destroyed приходит из деструктора QObject, qobject_cast уже не сработает;
+    // объект только ищется по адресу и не разыменовывается
+    MapObject *mo = static_cast<MapObject *>(obj);
     deleteObj(mo);
 }
 
@@ -491,6 +1046,7 @@ void MapRTree::deleteObj(MapObject *mo)
 {
    Q_D(MapRTree);
    d->locked ? blockingDeleteObject(mo) : nonblockingDeleteObject(mo);
+   d->changed();
 }
 
 void MapRTree::deleteObj(const QList<MapObject *> &obj)
@@ -499,6 +1055,7 @@ void MapRTree::deleteObj(const QList<MapObject *> &obj)
     blockingDeleteObject(obj);
     if (!d->locked)
         unblockDelete();
+    d->changed();
 }
 
 void MapRTree::blockingMoveObject(MapObject *mo)
@@ -511,9 +1068,17 @@ void MapRTree::blockingMoveObject(MapObject *mo)
 
 void MapRTree::nonblockingMoveObject(MapObject *mo)
 {
+    Q_D(MapRTree);
     if (!mo)
         return;
 
+    // объект остался в границах листа - обновляем элемент на месте
+    int id = d->ids.value(mo, -1);
+    if (id >= 0 && mo->drawer() && d->updateInPlace(id, mo->drawer()->boundRect(mo))) {
+        d->shrinkParents(d->objectNode(id));
+        return;
+    }
+
     nonblockingDeleteObject(mo);
     nonblockingInsertObject(mo);
 }
@@ -524,29 +1089,31 @@ void MapRTree::unblockMove()
     if (d->moveList.isEmpty())
         return;
 
-    QSet<Node*> resizeNodes;
+    QSet<int> resizeNodes;
     QList<MapObject*> list;
     foreach (MapObject *mo, d->moveList) {
         if (!mo || !mo->drawer())
             continue;
 
-        Node *par = d->cache.value(mo, NULL);
-        if (!par)
-            return;
+        int id = d->ids.value(mo, -1);
+        if (id < 0)
+            continue;
 
-        if (!par->rect.contains(mo->drawer()->boundRect(mo)))
-            list.append(mo);
+        // объект остался в границах листа - обновляем элемент на месте
+        if (d->updateInPlace(id, mo->drawer()->boundRect(mo)))
+            resizeNodes.insert(d->objectNode(id));
         else
-            resizeNodes.insert(par);
+            list.append(mo);
     }
     d->moveList.clear();
 
-    foreach (Node *n, resizeNodes)
-        d->resizeBoundsObj(n);
+    foreach (int node, resizeNodes)
+        d->shrinkParents(node);
 
-    blockingDeleteObject(list);
-    for (QListIterator<MapObject*> it(list); it.hasNext(); )
-        blockingInsertObject(it.next());
+    foreach (MapObject *mo, list) {
+        d->removeObject(mo, false);
+        d->insertList.insert(mo);
+    }
 }
 
 bool MapRTree::blockingInsertObject(MapObject *mo)
@@ -572,29 +1139,7 @@ bool MapRTree::nonblockingInsertObject(MapObject *mo)
     connect(mo, SIGNAL(destroyed(QObject*)), SLOT(deleteObj(QObject*)), Qt::UniqueConnection);
     connect(mo, SIGNAL(classCodeChanged(QString)), SLOT(movedObj()), Qt::UniqueConnection);
 
-    if (!mo->drawer())
-        return true;
-
-    if (d->allNodes.isEmpty()) {
-        d->root = new Node(mo->drawer()->boundRect(mo));
-        d->root->level = 0;
-        d->cache[mo] = d->root;
-        d->allNodes.append(d->root);
-    }
-
-    Node *n = d->chooseLeaf(mo->drawer()->boundRect(mo));
-    if (!n) {
-        qDebug() << "Error choose Leaf";
-        return false;
-    }
-
-    n->objects.append(mo);
-    d->cache[mo] = n;
-
-    if (n->objects.size() > d->maxNodes)
-        d->splitNode(n);
-
-    return true;
+    return d->insertObject(mo);
 }
 
 void MapRTree::unblockInsert()
@@ -603,36 +1148,16 @@ void MapRTree::unblockInsert()
     if (d->insertList.isEmpty())
         return;
 
-    bool empty = d->allNodes.isEmpty();
+    // крупная пачка - пакетное перестроение всего дерева
+    if (d->insertList.size() >= d->bulkMin && d->insertList.size() * 4 >= d->ids.size()) {
+        build();
+        return;
+    }
+
     for (QSetIterator<MapObject*> it(d->insertList); it.hasNext(); ) {
         MapObject *mo = it.next();
         Q_ASSERT(mo);
-
-        if (!mo->drawer())
-            continue;
-
-        if (empty) {
-            d->root = new Node(mo->drawer()->boundRect(mo));
-            d->root->level = 0;
-
-            d->cache[mo] = d->root;
-
-            d->allNodes.append(d->root);
-            empty = false;
-        }
-
-        Node *n = d->chooseLeaf(mo->drawer()->boundRect(mo));
-
-        if (!n) {
-            qDebug() << "Error choose Leaf; " << " object" << mo;
-            continue;
-        }
-
-        n->objects.append(mo);
-        d->cache[mo] = n;
-
-        if (n->objects.size() > d->maxNodes)
-            d->splitNode(n);
+        d->insertObject(mo);
     }
     d->insertList.clear();
 }
@@ -655,90 +1180,19 @@ void MapRTree::blockingDeleteObject(MapObject *mo)
     disconnect(mo, SIGNAL(destroyed(QObject*)), this, SLOT(deleteObj(QObject*)));
     disconnect(mo, SIGNAL(classCodeChanged(QString)), this, SLOT(movedObj()));
 
-    Node *n = d->cache.take(mo);
-    if (!n)
-        return;
-    n->objects.removeOne(mo);
-    d->deleteList.insert(n);
+    d->removeObject(mo, false);
 }
 
 void MapRTree::nonblockingDeleteObject(MapObject *mo)
 {
     Q_D(MapRTree);
-    Node *n = d->cache.take(mo);
-    if (!n)
+    if (!d->ids.contains(mo))
         return;
 
     disconnect(mo, SIGNAL(destroyed(QObject*)), this, SLOT(deleteObj(QObject*)));
     disconnect(mo, SIGNAL(classCodeChanged(QString)), this, SLOT(movedObj()));
 
-    // удаление объекта и изменение размера листа
-    n->objects.removeOne(mo);
-    d->resizeBoundsObj(n);
-
-    // изменение размеров родителей
-    Node *par = n->parent;
-    while (par) {
-        d->resizeBoundsNodes(par);
-        par = par->parent;
-    }
-
-    // перестроение дерева
-    if (n->objects.size() < 2) {
-        MapObjectList obj = n->objects;
-        foreach (MapObjectPtr mobj, obj)
-            d->cache.remove(mobj.data());
-        n->objects.clear();
-
-        Node *par = NULL;
-        if (n->parent) {
-            par = n->parent;
-            n->parent->nodes.removeOne(n);
-            n->parent = NULL;
-        }
-
-        d->allNodes.removeOne(n);
-        delete n;
-
-        if (par && par->nodes.size() == 1) {
-            Node *child = par->nodes.first();
-            while (child) {
-                if (!child->objects.isEmpty()) {
-                    par->objects = child->objects;
-                    foreach (MapObject *mobj, par->objects)
-                        d->cache[mobj] = par;
-
-                    d->allNodes.removeOne(child);
-
-                    par->nodes.clear();
-                    child->parent = NULL;
-
-                    child->objects.clear();
-                    delete child;
-                    child = NULL;
-                }
-                else if (!child->nodes.isEmpty()) {
-                    par->nodes = child->nodes;
-                    foreach (Node *nod, par->nodes) {
-                        if (nod)
-                            nod->parent = par;
-                    }
-
-                    child->nodes.clear();
-                    d->allNodes.removeOne(child);
-                    child->parent = NULL;
-                    delete child;
-                    child = NULL;
-
-                    if (par->nodes.size() == 1)
-                        child = par->nodes.first();
-                }
-            }
-        }
-
-        if (obj.size() == 1)
-            insert(obj.first());
-    }
+    d->removeObject(mo, true);
 }
 
 void MapRTree::unblockDelete()
@@ -747,102 +1201,12 @@ void MapRTree::unblockDelete()
     if (d->deleteList.isEmpty())
         return;
 
-    MapObjectList objList;
-
-    QSet<Node*>::iterator itNode;
-    while (!d->deleteList.isEmpty()) {
-        itNode = d->deleteList.begin();
-        Node *n = *itNode;
-        d->deleteList.erase(itNode);
-
-        if (n->objects.isEmpty()) { // если список объектов пуст
-            // удаляем пустой нод
-            Node *par = NULL;
-            if (n->parent) {
-                par = n->parent;
-                par->nodes.removeOne(n);
-                n->parent = NULL;
-            }
-
-            if (!par)
-                continue;
-
-            d->allNodes.removeOne(n);
-            delete n;
-
-            if (par->nodes.size() == 1) { // если остался один нод
-                Node *parpar = par->parent;
-                if (parpar) { // перемещаем лист на уровень выше
-                    parpar->nodes.removeOne(par);
-                    foreach (Node *child, par->nodes)
-                        child->parent = parpar;
-                    parpar->nodes.append(par->nodes);
-
-                    d->allNodes.removeOne(par);
-                    delete par;
-
-                    // изменяем размер ветки
-                    d->resizeBoundsObj(parpar);
-                    Node *up = parpar->parent;
-                    while (up) {
-                        d->resizeBoundsObj(up);
-                        up = up->parent;
-                    }
-                }
-                else { // перемещаем список объектов/нодов
-                    Node *child = par->nodes.first();
-                    if (!child->nodes.isEmpty()) {
-                        par->nodes = child->nodes;
-                        foreach (Node *tmp, child->nodes)
-                            tmp->parent = par;
-                        child->nodes.clear();
-                    }
-                    else {
-                        par->objects.append(child->objects);
-                        foreach (MapObjectPtr mobj, child->objects)
-                            d->cache[mobj.data()] = par;
-                        par->nodes.clear();
-                        child->objects.clear();
-                    }
-                    child->parent = NULL;
-
-                    d->deleteList.remove(par);
-                    d->allNodes.removeOne(child);
-                    delete child;
-                }
-            }
-            else {
-                // изменяем размер ветки
-                d->resizeBoundsObj(par);
-                for (Node *up = par->parent; up; up = up->parent)
-                    d->resizeBoundsObj(up);
-            }
-        }
-        else if (n->objects.size() >= 1) { // если список объектов не пуст
-            // изменяем размер всей ветки
-            d->resizeBoundsObj(n);
-            Node *par = n->parent;
-            while (par) {
-                d->resizeBoundsNodes(par);
-                par = par->parent;
-            }
-
-            if (n->objects.size() == 1) {
-                // если остался только один объект, перемещаем его в отдельный список
-                // ноду возвращаем в список измененных нодов
-                MapObjectList obj = n->objects;
-                foreach (MapObjectPtr mobj, obj)
-                    d->cache.remove(mobj.data());
-                n->objects.clear();
-
-                objList.append(obj);
-                d->deleteList.insert(n);
-            }
-        }
-    }
-
-    foreach (MapObjectPtr mo, objList)
-        nonblockingInsertObject(mo);
+    // узлы могли освободиться при перестроении предыдущих
+    QSet<int> nodes = d->deleteList;
+    d->deleteList.clear();
+    foreach (int node, nodes)
+        if (!d->isFree(node))
+            d->condense(node);
 }
 
 void MapRTree::movedObj(MapObject *mo)
@@ -854,18 +1218,22 @@ void MapRTree::movedObj(MapObject *mo)
             return;
     }
     d->locked ? blockingMoveObject(mo) : nonblockingMoveObject(mo);
+    d->changed();
 }
 
 QList<MapObject *> MapRTree::find(const QRectF &r) const
 {
     Q_D(const MapRTree);
     QList<MapObject*> list;
-    QList<Node *> nodes = d->findRect(r);
-    list.reserve(nodes.size() * qSqrt(d->maxNodes));
-
-    foreach (Node *n, nodes) {
-        for (int i = 0; i < n->objects.size(); ++i) {
-            MapObject *obj = n->objects.at(i).data();
+    QVector<int> leafs;
+    d->findRect(r, leafs);
+    list.reserve(leafs.size() * qSqrt(d->maxNodes));
+
+    foreach (int node, leafs) {
+        int s = d->slot(node, 0);
+        int end = s + d->count.at(node);
+        for (; s < end; ++s) {
+            MapObject *obj = d->objects.at(d->child.at(s));
             if (r.intersects(obj->drawer()->boundRect(obj)))
                 list.append(obj);
         }
@@ -877,12 +1245,15 @@ QList<MapObject *> MapRTree::find(const QPolygonF &p) const
 {
     Q_D(const MapRTree);
     QList<MapObject *> list;
-    QList<Node *> nodes = d->findPoly(p);
-    list.reserve(nodes.size() * qSqrt(d->maxNodes));
-
-    foreach (Node *n, nodes) {
-        for (int i = 0; i < n->objects.size(); ++i) {
-            MapObject *obj = n->objects.at(i).data();
+    QVector<int> leafs;
+    d->findPoly(p, leafs);
+    list.reserve(leafs.size() * qSqrt(d->maxNodes));
+
+    foreach (int node, leafs) {
+        int s = d->slot(node, 0);
+        int end = s + d->count.at(node);
+        for (; s < end; ++s) {
+            MapObject *obj = d->objects.at(d->child.at(s));
             if (rectIntersectPolyFull(obj->drawer()->boundRect(obj), p))
                 list.append(obj);
             else
@@ -892,36 +1263,37 @@ QList<MapObject *> MapRTree::find(const QPolygonF &p) const
     return list;
 }
 
+QList<MapObject *> MapRTree::nearest(const QPointF &p, int k, qreal maxDist,
+                                    const MapObjectFilter &filter, QList<qreal> *distances) const
+{
+    Q_D(const MapRTree);
+    return d->nearest(p, k, maxDist, filter, distances, true);
+}
+
 void MapRTree::numFeature()
 {
     Q_D(MapRTree);
 
-    QList<Node*> leafs;
-    foreach (Node *n, allLeafs()) {
-        if (n->nodes.isEmpty())
-            leafs.append(n);
-        else if (!n->objects.isEmpty())
-            qDebug() << "Objects error";
-    }
-    if (leafs.isEmpty()) {
-        qDebug() << "empty tree";
-        return;
-    }
-
+    int leafs = 0;
     int maxLevel = 0;
     qreal midLevel = 0;
 
     int minObj = 1000;
     int maxObj = -1;
     int sumObj = 0;
-    foreach (Node *n, leafs) {
-        int level = n->level;
+    for (int node = 0; node < d->count.size(); ++node) {
+        if (d->isFree(node) || !d->leaf.at(node))
+            continue;
+        ++leafs;
+
+        int level = 0;
+        for (int p = d->parent.at(node); p >= 0; p = d->parent.at(p))
+            ++level;
         if (level > maxLevel)
             maxLevel = level;
         midLevel += level;
 
-        int objSize = n->objects.size();
-
+        int objSize = d->count.at(node);
         if (objSize > maxObj)
             maxObj = objSize;
         if (objSize < minObj)
@@ -929,26 +1301,54 @@ void MapRTree::numFeature()
 
         sumObj += objSize;
     }
-    midLevel /= leafs.size();
-    qreal midObj = qreal(sumObj) / qreal(leafs.size());
+    if (!leafs) {
+        qDebug() << "empty tree";
+        return;
+    }
+    midLevel /= leafs;
+    qreal midObj = qreal(sumObj) / qreal(leafs);
 
     qDebug() << "max level: " << maxLevel << "; mid level: " << midLevel
              << "; min objects: " << minObj << "; max objects: " << maxObj << "; mid objects: " << midObj
-             << "; objects: " << sumObj << "; leafs count: " << leafs.size();
+             << "; objects: " << sumObj << "; leafs count: " << leafs;
 
-    qDebug() << "in cache: " << d->cache.uniqueKeys().size() << d->cache.keys().size();
+    // перекрытие соседних элементов узлов: сумма площадей попарных пересечений к сумме площадей элементов
+    qreal overlap = 0;
+    qreal area = 0;
+    for (int node = 0; node < d->count.size(); ++node) {
+        if (d->isFree(node))
+            continue;
+        int n = d->count.at(node);
+        for (int i = 0; i < n; ++i) {
+            int si = d->slot(node, i);
+            area += (d->maxx.at(si) - d->minx.at(si)) * (d->maxy.at(si) - d->miny.at(si));
+            for (int j = i + 1; j < n; ++j) {
+                int sj = d->slot(node, j);
+                qreal w = qMin(d->maxx.at(si), d->maxx.at(sj)) - qMax(d->minx.at(si), d->minx.at(sj));
+                qreal h = qMin(d->maxy.at(si), d->maxy.at(sj)) - qMax(d->miny.at(si), d->miny.at(sj));
+                if (w > 0 && h > 0)
+                    overlap += w * h;
+            }
+        }
+    }
+
+    qDebug() << "in cache: " << d->ids.size() << "; nodes: " << d->count.size() - d->freeNodes.size()
+             << "; overlap: " << (area > 0 ? overlap / area : 0);
 }
 
-QList<Node *> MapRTree::allLeafs() const
+int MapRTree::count() const
 {
     Q_D(const MapRTree);
-    return d->allNodes;
+    return d->ids.size();
 }
 
-Node *MapRTree::treeRoot() const
+QRectF MapRTree::objectRect(MapObject *mo) const
 {
     Q_D(const MapRTree);
-    return d->root;
+    int id = d->ids.value(mo, -1);
+    if (id < 0)
+        return QRectF();
+    return d->entryRect(d->objectSlot.at(id));
 }
 
 void MapRTree::lock()
@@ -964,6 +1364,49 @@ void MapRTree::unlock()
     unblockMove();
     unblockDelete();
     unblockInsert();
+    d->changed();
+}
+
+void MapRTree::setConcurrent(bool on)
+{
+    Q_D(MapRTree);
+    if (d->concurrent == on)
+        return;
+
+    d->concurrent = on;
+    if (on)
+        publish();
+    else {
+        QMutexLocker locker(&d->snapshotMutex);
+        d->snapshot.clear();
+    }
+}
+
+bool MapRTree::isConcurrent() const
+{
+    Q_D(const MapRTree);
+    return d->concurrent;
+}
+
+MapRTreeSnapshotPtr MapRTree::snapshot() const
+{
+    Q_D(const MapRTree);
+    QMutexLocker locker(&d->snapshotMutex);
+    return d->snapshot;
+}
+
+void MapRTree::publish()
+{
+    Q_D(MapRTree);
+    d->publishPending = false;
+    if (!d->concurrent)
+        return;
+
+    // страницы массивов разделяются со снимком, дерево скопирует измененные страницы
+    // (публикация - O(количество страниц), без копирования элементов)
+    MapRTreeSnapshotPtr snap(new MapRTreeSnapshot(new MapRTreeSnapshotPrivate(*d, ++d->epoch, d->ids.size())));
+    QMutexLocker locker(&d->snapshotMutex);
+    d->snapshot.swap(snap);
 }
 
 // -------------------------------------------------------
@@ -5,6 +5,10 @@
 #include <QRectF>
 #include <QPolygonF>
 #include <QPointer>
+#include <QSharedPointer>
+#include <QScopedPointer>
+
+#include <functional>
 
 // -------------------------------------------------------
 
@@ -15,19 +19,61 @@ namespace minigis {
 class MapObject;
 typedef QPointer<MapObject> MapObjectPtr;
 typedef QList<MapObjectPtr> MapObjectList;
+typedef std::function<bool(MapObject *)> MapObjectFilter;
+
+class MapRTreeSnapshotPrivate;
+/**
+ * @brief The MapRTreeSnapshot class неизменяемый снимок R-дерева
+ * Снимок публикуется деревом в режиме setConcurrent и читается из любого потока без блокировок.
+ * Поиск идет по границам объектов на момент публикации, объекты не разыменовываются.
+ * Время жизни объектов снимок не продлевает: удалять объекты, пока их могут читать
+ * другие потоки, нельзя (например, удалять через deleteLater после смены снимка).
+ */
+class MapRTreeSnapshot
+{
+public:
+    ~MapRTreeSnapshot();
+
+    /**
+     * @brief find объекты, границы которых пересекаются с областью (включая касание)
+     */
+    QList<MapObject *> find(const QRectF &r) const;
+
+    /**
+     * @brief nearest ближайшие объекты по расстоянию до границ
+     * @see MapRTree::nearest
+     */
+    QList<MapObject *> nearest(const QPointF &p, int k = 1, qreal maxDist = -1,
+                               const MapObjectFilter &filter = MapObjectFilter(), QList<qreal> *distances = NULL) const;
+
+    /**
+     * @brief count количество объектов
+     */
+    int count() const;
+
+    /**
+     * @brief epoch номер снимка (растет с каждой публикацией)
+     */
+    quint64 epoch() const;
 
-struct Node {
-    Node(QRectF r = QRectF(), Node *_parent = NULL, QList<Node*>list = QList<Node*>()) : rect(r), parent(_parent), nodes(list) {}
-    int level;
-    QRectF rect;
+private:
+    friend class MapRTree;
+    explicit MapRTreeSnapshot(MapRTreeSnapshotPrivate *dd);
 
-    Node *parent;
-    QList<Node*> nodes;
+    QScopedPointer<MapRTreeSnapshotPrivate> d_ptr;
 
-    MapObjectList objects;
+    Q_DISABLE_COPY(MapRTreeSnapshot)
 };
 
+typedef QSharedPointer<const MapRTreeSnapshot> MapRTreeSnapshotPtr;
+
 class MapRTreePrivate;
+/**
+ * @brief The MapRTree class R-дерево объектов слоя
+ * Узлы хранятся в плоских массивах: у каждого узла непрерывный блок элементов,
+ * границы элементов - отдельные массивы minx/miny/maxx/maxy, в листьях - номера объектов
+ * (таблица номер - объект отдельно). Указателей между узлами нет.
+ */
 class MapRTree : public QObject
 {
     Q_OBJECT
@@ -47,6 +93,19 @@ public:
      */
     bool insert(MapObject *mo);
 
+    /**
+     * @brief build пакетное построение дерева (Sort-Tile-Recursive)
+     * Дерево перестраивается целиком из уже вставленных объектов и объектов списка.
+     * Листья заполняются полностью и почти не перекрываются.
+     * @param objects добавляемые объекты
+     */
+    void build(const QList<MapObject *> &objects = QList<MapObject *>());
+
+    /**
+     * @brief isLocked заблокировано ли перестроение дерева
+     */
+    bool isLocked() const;
+
     /**
      * @brief objectsInLeaf поиск объектов попавших в область
      * @param r область
@@ -61,25 +120,61 @@ public:
      */
     QList<MapObject *> find(const QPolygonF &p) const;
 
+    /**
+     * @brief nearest поиск ближайших к точке объектов
+     * Обход по возрастанию расстояния до границ узлов (MINDIST), точное расстояние
+     * (MapDrawer::distance) считается только для объектов, до границ которых ближе найденных.
+     * @param p точка (мировые координаты)
+     * @param k количество объектов (меньше 1 - все в пределах maxDist)
+     * @param maxDist максимальное расстояние (меньше 0 - без ограничения)
+     * @param filter отбор объектов (проверяется до расчета расстояния)
+     * @param distances расстояния до найденных объектов
+     * @return объекты по возрастанию расстояния
+     */
+    QList<MapObject *> nearest(const QPointF &p, int k = 1, qreal maxDist = -1,
+                               const MapObjectFilter &filter = MapObjectFilter(), QList<qreal> *distances = NULL) const;
+
     /**
      * @brief numFeature вывод основных характеристик дерева
+     * (заполнение листьев, глубина, перекрытие элементов узлов)
      */
     void numFeature();
 
-    // ============================
+    /**
+     * @brief count количество объектов в дереве
+     */
+    int count() const;
+
+    /**
+     * @brief objectRect границы объекта, сохраненные в дереве
+     * @return пустой прямоугольник, если объекта нет в дереве
+     */
+    QRectF objectRect(MapObject *mo) const;
 
     /**
-     * @brief allLeafs список всех узлов дерева
-     * @return
+     * @brief setConcurrent режим публикации снимков для чтения из других потоков
+     * Изменения дерева накапливаются и публикуются одним снимком при возврате
+     * в цикл событий потока дерева (и при разблокировке).
+     * Сами изменения по-прежнему только из потока дерева.
+     * Снимок разделяет с деревом страницы узлов (по 16 узлов): публикация не копирует элементы,
+     * первое изменение страницы после публикации копирует только ее.
      */
-    QList<Node *> allLeafs() const;
+    void setConcurrent(bool on);
+    bool isConcurrent() const;
+
     /**
-     * @brief treeRoot корень дерева
-     * @return
+     * @brief snapshot последний опубликованный снимок (можно вызывать из любого потока)
+     * @return снимок, пустой указатель вне режима setConcurrent
      */
-    Node *treeRoot() const;
-    
+    MapRTreeSnapshotPtr snapshot() const;
+
 signals:
+    /**
+     * @brief regionChanged изменились границы объектов дерева (вставка, перемещение, удаление)
+     * @param rect объединение старых и новых границ (мировые координаты)
+     * @param whole изменилось все дерево (очистка, пакетное построение), rect не используется
+     */
+    void regionChanged(QRectF rect, bool whole);
 
 public slots:
     /**
@@ -107,6 +202,12 @@ public slots:
     void deleteObj(MapObject *obj);
     void deleteObj(QList<MapObject*> const &obj);
 
+private slots:
+    /**
+     * @brief publish опубликовать снимок текущего состояния дерева
+     */
+    void publish();
+
 private:
     /**
      * @brief blockingMoveObject перемещение объектов в дереве без перестроения дерева
@@ -0,0 +1,236 @@
+
+#include <QVarLengthArray>
+
+#include "layers/maprtreekernel.h"
+
+// векторные реализации - только для x86 с double в качестве qreal
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(QT_COORD_TYPE) && (defined(__x86_64__) || defined(__i386__))
+#  define MAP_RTREE_SIMD
+#  include <immintrin.h>
+#endif
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+namespace {
+
+typedef int (*OverlapFunc)(const qreal *, const qreal *, const qreal *, const qreal *, int,
+                           qreal, qreal, qreal, qreal, int *);
+typedef void (*EnlargeFunc)(const qreal *, const qreal *, const qreal *, const qreal *, int,
+                            qreal, qreal, qreal, qreal, qreal *);
+
+struct BoxKernel
+{
+    OverlapFunc overlap;
+    EnlargeFunc enlarge;
+    const char *name;
+};
+
+// -------------------------------------------------------
+
+// скалярная проверка элементов [from, n)
+inline int overlapRange(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int from, int n,
+                        qreal l, qreal t, qreal r, qreal b, int *result, int found)
+{
+    for (int i = from; i < n; ++i)
+        if (minx[i] <= r && maxx[i] >= l && miny[i] <= b && maxy[i] >= t)
+            result[found++] = i;
+    return found;
+}
+
+// скалярное увеличение площади элементов [from, n)
+inline void enlargeRange(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int from, int n,
+                         qreal l, qreal t, qreal r, qreal b, qreal *result)
+{
+    // если элемент содержит область, объединение совпадает с ним и результат ровно 0
+    for (int i = from; i < n; ++i) {
+        qreal w = qMax(maxx[i], r) - qMin(minx[i], l);
+        qreal h = qMax(maxy[i], b) - qMin(miny[i], t);
+        result[i] = w * h - (maxx[i] - minx[i]) * (maxy[i] - miny[i]);
+    }
+}
+
+int overlapScalar(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                  qreal l, qreal t, qreal r, qreal b, int *result)
+{
+    return overlapRange(minx, miny, maxx, maxy, 0, n, l, t, r, b, result, 0);
+}
+
+void enlargeScalar(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                   qreal l, qreal t, qreal r, qreal b, qreal *result)
+{
+    enlargeRange(minx, miny, maxx, maxy, 0, n, l, t, r, b, result);
+}
+
+// -------------------------------------------------------
+
+#ifdef MAP_RTREE_SIMD
+
+// запись номеров элементов по битовой маске сравнения
+inline int appendMask(int mask, int base, int *result, int found)
+{
+    while (mask) {
+        result[found++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+    }
+    return found;
+}
+
+// SSE2 - по 2 элемента
+int overlapSse2(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                qreal l, qreal t, qreal r, qreal b, int *result)
+{
+    const __m128d vl = _mm_set1_pd(l);
+    const __m128d vt = _mm_set1_pd(t);
+    const __m128d vr = _mm_set1_pd(r);
+    const __m128d vb = _mm_set1_pd(b);
+
+    int found = 0;
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d m = _mm_and_pd(_mm_cmple_pd(_mm_loadu_pd(minx + i), vr),
+                               _mm_cmpge_pd(_mm_loadu_pd(maxx + i), vl));
+        m = _mm_and_pd(m, _mm_cmple_pd(_mm_loadu_pd(miny + i), vb));
+        m = _mm_and_pd(m, _mm_cmpge_pd(_mm_loadu_pd(maxy + i), vt));
+        found = appendMask(_mm_movemask_pd(m), i, result, found);
+    }
+    return overlapRange(minx, miny, maxx, maxy, i, n, l, t, r, b, result, found);
+}
+
+void enlargeSse2(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                 qreal l, qreal t, qreal r, qreal b, qreal *result)
+{
+    const __m128d vl = _mm_set1_pd(l);
+    const __m128d vt = _mm_set1_pd(t);
+    const __m128d vr = _mm_set1_pd(r);
+    const __m128d vb = _mm_set1_pd(b);
+
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x0 = _mm_loadu_pd(minx + i);
+        __m128d y0 = _mm_loadu_pd(miny + i);
+        __m128d x1 = _mm_loadu_pd(maxx + i);
+        __m128d y1 = _mm_loadu_pd(maxy + i);
+        __m128d w = _mm_sub_pd(_mm_max_pd(x1, vr), _mm_min_pd(x0, vl));
+        __m128d h = _mm_sub_pd(_mm_max_pd(y1, vb), _mm_min_pd(y0, vt));
+        __m128d area = _mm_mul_pd(_mm_sub_pd(x1, x0), _mm_sub_pd(y1, y0));
+        _mm_storeu_pd(result + i, _mm_sub_pd(_mm_mul_pd(w, h), area));
+    }
+    enlargeRange(minx, miny, maxx, maxy, i, n, l, t, r, b, result);
+}
+
+// AVX - по 4 элемента
+__attribute__((target("avx")))
+int overlapAvx(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+               qreal l, qreal t, qreal r, qreal b, int *result)
+{
+    const __m256d vl = _mm256_set1_pd(l);
+    const __m256d vt = _mm256_set1_pd(t);
+    const __m256d vr = _mm256_set1_pd(r);
+    const __m256d vb = _mm256_set1_pd(b);
+
+    int found = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d m = _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(minx + i), vr, _CMP_LE_OQ),
+                                  _mm256_cmp_pd(_mm256_loadu_pd(maxx + i), vl, _CMP_GE_OQ));
+        m = _mm256_and_pd(m, _mm256_cmp_pd(_mm256_loadu_pd(miny + i), vb, _CMP_LE_OQ));
+        m = _mm256_and_pd(m, _mm256_cmp_pd(_mm256_loadu_pd(maxy + i), vt, _CMP_GE_OQ));
+        found = appendMask(_mm256_movemask_pd(m), i, result, found);
+    }
+    return overlapRange(minx, miny, maxx, maxy, i, n, l, t, r, b, result, found);
+}
+
+__attribute__((target("avx")))
+void enlargeAvx(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                qreal l, qreal t, qreal r, qreal b, qreal *result)
+{
+    const __m256d vl = _mm256_set1_pd(l);
+    const __m256d vt = _mm256_set1_pd(t);
+    const __m256d vr = _mm256_set1_pd(r);
+    const __m256d vb = _mm256_set1_pd(b);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x0 = _mm256_loadu_pd(minx + i);
+        __m256d y0 = _mm256_loadu_pd(miny + i);
+        __m256d x1 = _mm256_loadu_pd(maxx + i);
+        __m256d y1 = _mm256_loadu_pd(maxy + i);
+        __m256d w = _mm256_sub_pd(_mm256_max_pd(x1, vr), _mm256_min_pd(x0, vl));
+        __m256d h = _mm256_sub_pd(_mm256_max_pd(y1, vb), _mm256_min_pd(y0, vt));
+        __m256d area = _mm256_mul_pd(_mm256_sub_pd(x1, x0), _mm256_sub_pd(y1, y0));
+        _mm256_storeu_pd(result + i, _mm256_sub_pd(_mm256_mul_pd(w, h), area));
+    }
+    enlargeRange(minx, miny, maxx, maxy, i, n, l, t, r, b, result);
+}
+
+#endif // MAP_RTREE_SIMD
+
+// -------------------------------------------------------
+
+BoxKernel selectKernel()
+{
+    BoxKernel k;
+#ifdef MAP_RTREE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        k.overlap = overlapAvx;
+        k.enlarge = enlargeAvx;
+        k.name = "avx";
+        return k;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        k.overlap = overlapSse2;
+        k.enlarge = enlargeSse2;
+        k.name = "sse2";
+        return k;
+    }
+#endif
+    k.overlap = overlapScalar;
+    k.enlarge = enlargeScalar;
+    k.name = "scalar";
+    return k;
+}
+
+const BoxKernel &kernel()
+{
+    static const BoxKernel k = selectKernel();
+    return k;
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+int boxOverlap(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+               qreal l, qreal t, qreal r, qreal b, int *result)
+{
+    return kernel().overlap(minx, miny, maxx, maxy, n, l, t, r, b, result);
+}
+
+int boxChoose(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+              qreal l, qreal t, qreal r, qreal b)
+{
+    QVarLengthArray<qreal, 32> values(n);
+    kernel().enlarge(minx, miny, maxx, maxy, n, l, t, r, b, values.data());
+
+    int best = 0;
+    for (int i = 1; i < n && values[best] > 0; ++i)
+        if (values[i] < values[best])
+            best = i;
+    return best;
+}
+
+const char *boxKernelName()
+{
+    return kernel().name;
+}
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
@@ -0,0 +1,46 @@
+#ifndef MAPRTREEKERNEL_H
+#define MAPRTREEKERNEL_H
+
+#include <QtGlobal>
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+/**
+ * Проверки границ элементов узла R-дерева.
+ * Границы элементов - массивы minx/miny/maxx/maxy, область - l, t, r, b.
+ * Реализация (AVX, SSE2 или скалярная) выбирается при первом вызове по возможностям процессора.
+ */
+
+/**
+ * @brief boxOverlap поиск элементов, пересекающихся с областью (включая касание)
+ * @param n количество элементов
+ * @param result номера найденных элементов (не меньше n)
+ * @return количество найденных элементов
+ */
+int boxOverlap(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+               qreal l, qreal t, qreal r, qreal b, int *result);
+
+/**
+ * @brief boxChoose выбор элемента с минимальным увеличением площади при добавлении области
+ * @param n количество элементов (больше 0)
+ * @return номер элемента (при равенстве - первый)
+ */
+int boxChoose(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+              qreal l, qreal t, qreal r, qreal b);
+
+/**
+ * @brief boxKernelName название выбранной реализации
+ */
+const char *boxKernelName();
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
+
+#endif // MAPRTREEKERNEL_H
@@ -0,0 +1,262 @@
+
+#include <QImage>
+
+#include "layers/maptilecache.h"
+#include "layers/maplayertile_p.h"
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+namespace {
+
+// объем изображения (неявно разделяемые копии считаются один раз)
+inline qint64 imageBytes(const QImage *img, const QImage *shared = NULL)
+{
+    if (!img || img->isNull())
+        return 0;
+    if (shared && img->cacheKey() == shared->cacheKey())
+        return 0;
+    return img->byteCount();
+}
+
+inline uint shardIndex(quint64 hash)
+{
+    // перемешиваем биты, так как соседние тайлы отличаются в немногих разрядах quadkey
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    return uint(hash % TileCache::ShardCount);
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+QVariantMap TileCache::Stats::toVariant() const
+{
+    QVariantMap v;
+    v["hits"]      = hits;
+    v["misses"]    = misses;
+    v["evictions"] = evictions;
+    v["count"]     = count;
+    v["bytes"]     = bytes;
+    v["source"]    = stageBytes[SourceStage];
+    v["origin"]    = stageBytes[OriginStage];
+    v["colorized"] = stageBytes[ColorizedStage];
+    v["scaled"]    = stageBytes[ScaledStage];
+    v["rotated"]   = stageBytes[RotatedStage];
+    return v;
+}
+
+// -------------------------------------------------------
+
+TileCache::TileCache(qint64 budget)
+    : limit(budget), frame(0), hits(0), misses(0), evictions(0)
+{
+}
+
+TileCache::~TileCache()
+{
+    clear();
+}
+
+Tile *TileCache::value(quint64 hash) const
+{
+    Shard &s = shard(hash);
+    QMutexLocker locker(&s.mutex);
+    Entry *e = s.entries.value(hash);
+    return e ? e->tile : NULL;
+}
+
+Tile *TileCache::touch(quint64 hash)
+{
+    Shard &s = shard(hash);
+    QMutexLocker locker(&s.mutex);
+    Entry *e = s.entries.value(hash);
+    if (!e) {
+        misses.ref();
+        return NULL;
+    }
+    hits.ref();
+
+    e->frame = frame.load();
+    if (s.head != e) {
+        unlink(s, e);
+        pushFront(s, e);
+    }
+    return e->tile;
+}
+
+void TileCache::insert(quint64 hash, Tile *t)
+{
+    Shard &s = shard(hash);
+    QMutexLocker locker(&s.mutex);
+    Entry *e = s.entries.value(hash);
+    if (e) {
+        if (e->tile != t)
+            delete e->tile;
+        unlink(s, e);
+    }
+    else {
+        e = new Entry;
+        e->hash = hash;
+        s.entries.insert(hash, e);
+    }
+    e->tile = t;
+    e->frame = frame.load();
+    pushFront(s, e);
+    refresh(s, e);
+}
+
+void TileCache::remove(quint64 hash)
+{
+    Shard &s = shard(hash);
+    QMutexLocker locker(&s.mutex);
+    Entry *e = s.entries.take(hash);
+    if (e)
+        release(s, e);
+}
+
+void TileCache::updateCost(quint64 hash)
+{
+    Shard &s = shard(hash);
+    QMutexLocker locker(&s.mutex);
+    Entry *e = s.entries.value(hash);
+    if (e)
+        refresh(s, e);
+}
+
+void TileCache::beginFrame()
+{
+    frame.ref();
+}
+
+void TileCache::trim()
+{
+    qint64 shardLimit = limit / ShardCount;
+    int current = frame.load();
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard &s = shards[i];
+        QMutexLocker locker(&s.mutex);
+        // тайлы текущего кадра находятся в начале списка, на них вытеснение останавливается
+        while (s.bytes > shardLimit && s.tail && s.tail->frame != current) {
+            Entry *e = s.tail;
+            s.entries.remove(e->hash);
+            release(s, e);
+            evictions.ref();
+        }
+    }
+}
+
+void TileCache::clear()
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard &s = shards[i];
+        QMutexLocker locker(&s.mutex);
+        while (s.head) {
+            Entry *e = s.head;
+            s.entries.remove(e->hash);
+            release(s, e);
+        }
+    }
+}
+
+qint64 TileCache::budget() const
+{
+    return limit;
+}
+
+void TileCache::setBudget(qint64 bytes)
+{
+    limit = qMax<qint64>(bytes, 0);
+}
+
+TileCache::Stats TileCache::stats() const
+{
+    Stats st;
+    st.hits      = hits.load();
+    st.misses    = misses.load();
+    st.evictions = evictions.load();
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard &s = shards[i];
+        QMutexLocker locker(&s.mutex);
+        st.count += s.entries.size();
+        st.bytes += s.bytes;
+        for (int j = 0; j < StageCount; ++j)
+            st.stageBytes[j] += s.stageBytes[j];
+    }
+    return st;
+}
+
+TileCache::Shard &TileCache::shard(quint64 hash) const
+{
+    return shards[shardIndex(hash)];
+}
+
+void TileCache::unlink(Shard &s, Entry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else if (s.head == e)
+        s.head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else if (s.tail == e)
+        s.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+void TileCache::pushFront(Shard &s, Entry *e)
+{
+    e->prev = NULL;
+    e->next = s.head;
+    if (s.head)
+        s.head->prev = e;
+    s.head = e;
+    if (!s.tail)
+        s.tail = e;
+}
+
+void TileCache::refresh(Shard &s, Entry *e)
+{
+    qint64 stage[StageCount];
+    Tile *t = e->tile;
+
+    stage[SourceStage] = 0;
+    if (t) {
+        foreach (QImage *img, t->source)
+            stage[SourceStage] += imageBytes(img);
+    }
+    stage[OriginStage]    = t ? imageBytes(t->origin) : 0;
+    stage[ColorizedStage] = t ? imageBytes(t->colorized, t->origin) : 0;
+    stage[ScaledStage]    = t ? imageBytes(t->scaled, t->colorized) : 0;
+    stage[RotatedStage]   = t ? imageBytes(t->rotated, t->scaled) : 0;
+
+    qint64 total = 0;
+    for (int i = 0; i < StageCount; ++i) {
+        s.stageBytes[i] += stage[i] - e->stageBytes[i];
+        e->stageBytes[i] = stage[i];
+        total += stage[i];
+    }
+    s.bytes += total - e->bytes;
+    e->bytes = total;
+}
+
+void TileCache::release(Shard &s, Entry *e)
+{
+    unlink(s, e);
+    for (int i = 0; i < StageCount; ++i)
+        s.stageBytes[i] -= e->stageBytes[i];
+    s.bytes -= e->bytes;
+    delete e->tile;
+    delete e;
+}
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
@@ -0,0 +1,190 @@
+#ifndef MAPTILECACHE_H
+#define MAPTILECACHE_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QVariantMap>
+
+#include "core/mapdefs.h"
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+class Tile;
+
+/**
+ * @brief The TileCache class кэш подложки с ограничением по памяти
+ * Кэш разбит на сегменты (по хэшу ключа), у каждого сегмента свой мьютекс,
+ * хэш и двусвязный список LRU. Поиск, обновление истории и вытеснение - O(1).
+ * Кэш владеет тайлами и удаляет их при вытеснении.
+ */
+class TileCache
+{
+public:
+    //! стадии изображения тайла
+    enum Stage {
+        SourceStage = 0,    // исходники загрузчиков
+        OriginStage,        // оригинал
+        ColorizedStage,     // перекрашенный
+        ScaledStage,        // отмасштабированный
+        RotatedStage,       // повернутый
+
+        StageCount
+    };
+
+    //! статистика кэша
+    struct Stats {
+        Stats() : hits(0), misses(0), evictions(0), count(0), bytes(0) {
+            for (int i = 0; i < StageCount; ++i)
+                stageBytes[i] = 0;
+        }
+        int hits;                           // попадания
+        int misses;                         // промахи
+        int evictions;                      // вытесненные тайлы
+        int count;                          // количество тайлов
+        qint64 bytes;                       // занятая память
+        qint64 stageBytes[StageCount];      // занятая память по стадиям
+
+        QVariantMap toVariant() const;
+    };
+
+    static const int ShardCount = 16;                                  // количество сегментов
+    static const qint64 DefaultBudget = qint64(TILECACHEBUDGET) << 20; // бюджет по умолчанию
+
+    explicit TileCache(qint64 budget = DefaultBudget);
+    ~TileCache();
+
+    /**
+     * @brief value поиск тайла без изменения истории и статистики
+     * @param hash ключ-хэш тайла
+     * @return тайл или NULL
+     */
+    Tile *value(quint64 hash) const;
+
+    /**
+     * @brief touch поиск тайла с обновлением истории и статистики попаданий
+     * @param hash ключ-хэш тайла
+     * @return тайл или NULL
+     */
+    Tile *touch(quint64 hash);
+
+    /**
+     * @brief insert добавить тайл в кэш (кэш становится владельцем)
+     * @param hash ключ-хэш тайла
+     * @param t тайл
+     */
+    void insert(quint64 hash, Tile *t);
+
+    /**
+     * @brief remove удалить тайл из кэша
+     * @param hash ключ-хэш тайла
+     */
+    void remove(quint64 hash);
+
+    /**
+     * @brief updateCost пересчитать занимаемую тайлом память
+     * @param hash ключ-хэш тайла
+     */
+    void updateCost(quint64 hash);
+
+    /**
+     * @brief forEach выполнить функцию для всех тайлов и пересчитать память
+     * @param f функция (Tile *)
+     */
+    template <typename Func>
+    void forEach(Func f);
+
+    /**
+     * @brief beginFrame начать новый кадр. Тайлы, затронутые в текущем кадре, не вытесняются
+     */
+    void beginFrame();
+
+    /**
+     * @brief trim вытеснить давно неиспользуемые тайлы до укладывания в бюджет
+     * Вызывать только когда нет потоков, работающих с тайлами
+     */
+    void trim();
+
+    /**
+     * @brief clear удалить все тайлы
+     */
+    void clear();
+
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        Entry() : hash(0), tile(NULL), prev(NULL), next(NULL), frame(0), bytes(0) {
+            for (int i = 0; i < StageCount; ++i)
+                stageBytes[i] = 0;
+        }
+        quint64 hash;
+        Tile *tile;
+        Entry *prev;
+        Entry *next;
+        int frame;
+        qint64 bytes;
+        qint64 stageBytes[StageCount];
+    };
+
+    struct Shard {
+        Shard() : head(NULL), tail(NULL), bytes(0) {
+            for (int i = 0; i < StageCount; ++i)
+                stageBytes[i] = 0;
+        }
+        mutable QMutex mutex;
+        QHash<quint64, Entry*> entries;
+        Entry *head;                        // последний использованный
+        Entry *tail;                        // давно не используемый
+        qint64 bytes;
+        qint64 stageBytes[StageCount];
+    };
+
+    Shard &shard(quint64 hash) const;
+
+    void unlink(Shard &s, Entry *e);
+    void pushFront(Shard &s, Entry *e);
+    void refresh(Shard &s, Entry *e);
+    void release(Shard &s, Entry *e);
+
+    mutable Shard shards[ShardCount];
+    qint64 limit;
+    QAtomicInt frame;
+
+    QAtomicInt hits;
+    QAtomicInt misses;
+    QAtomicInt evictions;
+
+    Q_DISABLE_COPY(TileCache)
+};
+
+// -------------------------------------------------------
+
+template <typename Func>
+void TileCache::forEach(Func f)
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard &s = shards[i];
+        QMutexLocker locker(&s.mutex);
+        for (Entry *e = s.head; e; e = e->next) {
+            f(e->tile);
+            refresh(s, e);
+        }
+    }
+}
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
+
+#endif // MAPTILECACHE_H
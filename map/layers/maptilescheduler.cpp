@@ -0,0 +1,407 @@
+
+#include <QDateTime>
+
+#include <limits>
+
+#include <db/databasecontroller.h>
+
+#include "loaders/maptileloader.h"
+#include "layers/maptilescheduler.h"
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+QVariantMap TileScheduler::PrefetchStats::toVariant() const
+{
+    QVariantMap v;
+    v["fetched"] = fetched;
+    v["hits"]    = hits;
+    v["pending"] = pending;
+    v["hitRate"] = fetched > 0 ? qreal(hits) / fetched : 0.;
+    return v;
+}
+
+// -------------------------------------------------------
+
+TileScheduler::TileScheduler()
+    : dc(NULL), zoom(0), limit(DefaultLoaderLimit), prefetchFetched(0), prefetchHits(0)
+{
+}
+
+TileScheduler::~TileScheduler()
+{
+}
+
+void TileScheduler::setDatabase(dc::DatabaseController *db)
+{
+    dc = db;
+}
+
+int TileScheduler::loaderLimit() const
+{
+    return limit;
+}
+
+void TileScheduler::setLoaderLimit(int l)
+{
+    limit = qMax(l, 1);
+    for (QHash<int, LoaderQueue>::iterator it = queues.begin(); it != queues.end(); ++it)
+        pump(it.value());
+}
+
+void TileScheduler::setView(const QRect &rect, int z)
+{
+    if (view == rect && zoom == z)
+        return;
+
+    view = rect;
+    zoom = z;
+    cancelStale();
+}
+
+bool TileScheduler::isVisible(const TileKey &key) const
+{
+    if (view.isNull())
+        return true;
+    if (key.z > zoom)
+        return false;
+
+    int shift = zoom - key.z;
+    if (shift >= 31)
+        return true;
+    QRect r(QPoint(view.left() >> shift, view.top() >> shift), QPoint(view.right() >> shift, view.bottom() >> shift));
+    return r.contains(key.x, key.y);
+}
+
+// -------------------------------------------------------
+
+bool TileScheduler::isDbPending(const TileKey &key, bool prefetch) const
+{
+    QHash<quint64, uint>::const_iterator it = dbKeys.find(key.hash());
+    if (it == dbKeys.end())
+        return false;
+    // упреждающий запрос не мешает обычному: тот уйдет с более высоким приоритетом
+    return prefetch || !dbRequests.value(it.value()).prefetch;
+}
+
+uint TileScheduler::requestDb(const QList<TileKey> &keys, const QString &name, const QVariant &params, int priority,
+                              QObject *receiver, const QByteArray &callback, bool cancelable, bool prefetch)
+{
+    if (!dc)
+        return 0;
+
+    uint number = dc->postRequest(name, params, priority, receiver, callback);
+    if (number == 0)
+        return 0;
+
+    DbRequest r;
+    r.keys = keys;
+    r.cancelable = cancelable;
+    r.prefetch = prefetch;
+    dbRequests.insert(number, r);
+    foreach (const TileKey &key, keys)
+        dbKeys.insert(key.hash(), number);
+    return number;
+}
+
+bool TileScheduler::dbFinished(uint number)
+{
+    QHash<uint, DbRequest>::iterator it = dbRequests.find(number);
+    if (it == dbRequests.end())
+        return false;
+
+    DbRequest r = it.value();
+    dbRequests.erase(it);
+    foreach (const TileKey &key, r.keys) {
+        quint64 hash = key.hash();
+        if (dbKeys.value(hash) == number)
+            dbKeys.remove(hash);
+    }
+    return r.prefetch;
+}
+
+// -------------------------------------------------------
+
+bool TileScheduler::isLoaderPending(const TileKey &key) const
+{
+    return loaderKeys.contains(key.hash());
+}
+
+void TileScheduler::enqueue(MapTileLoader *loader, const TileKey &key, bool cancelable, bool prefetch)
+{
+    if (!loader)
+        return;
+
+    LoaderQueue &q = queues[key.type];
+    q.loader = loader;
+
+    quint64 hash = key.hash();
+    if (loaderKeys.contains(hash)) {
+        // тайл стал нужен на экране
+        if (!prefetch)
+            promote(q, key, cancelable);
+        return;
+    }
+
+    q.pending.append(Request(key, cancelable, prefetch));
+    loaderKeys.insert(hash);
+    pump(q);
+}
+
+bool TileScheduler::loaderFinished(const TileKey &key)
+{
+    quint64 hash = key.hash();
+    loaderKeys.remove(hash);
+
+    QHash<int, LoaderQueue>::iterator it = queues.find(key.type);
+    if (it == queues.end())
+        return false;
+
+    LoaderQueue &q = it.value();
+    bool prefetch = false;
+    QHash<quint64, Request>::iterator ait = q.active.find(hash);
+    if (ait != q.active.end()) {
+        prefetch = ait.value().prefetch;
+        q.active.erase(ait);
+    }
+    else {
+        for (int i = 0; i < q.pending.size(); ++i)
+            if (q.pending.at(i).key == key) {
+                prefetch = q.pending.takeAt(i).prefetch;
+                break;
+            }
+    }
+    pump(q);
+    return prefetch;
+}
+
+void TileScheduler::cancelType(int type)
+{
+    LoaderQueue q = queues.take(type);
+    foreach (const Request &r, q.pending)
+        loaderKeys.remove(r.key.hash());
+    foreach (const Request &r, q.active)
+        cancelActive(q, r);
+}
+
+void TileScheduler::cancelPrefetch()
+{
+    if (dc) {
+        foreach (uint number, dbRequests.keys())
+            if (dbRequests.value(number).prefetch && dc->cancelRequest(number))
+                dbFinished(number);
+    }
+
+    for (QHash<int, LoaderQueue>::iterator it = queues.begin(); it != queues.end(); ++it) {
+        LoaderQueue &q = it.value();
+        for (QMutableListIterator<Request> pit(q.pending); pit.hasNext(); ) {
+            const Request &r = pit.next();
+            if (r.prefetch) {
+                loaderKeys.remove(r.key.hash());
+                pit.remove();
+            }
+        }
+        foreach (const Request &r, q.active.values())
+            if (r.prefetch)
+                cancelActive(q, r);
+
+        pump(q);
+    }
+}
+
+void TileScheduler::clear()
+{
+    foreach (int type, queues.keys())
+        cancelType(type);
+    loaderKeys.clear();
+
+    if (dc) {
+        foreach (uint number, dbRequests.keys())
+            dc->cancelRequest(number);
+    }
+    dbRequests.clear();
+    dbKeys.clear();
+}
+
+// -------------------------------------------------------
+
+void TileScheduler::markPrefetched(const TileKey &key)
+{
+    quint64 hash = TileKey(key.x, key.y, key.z).hash();
+    if (prefetched.contains(hash))
+        return;
+
+    // не показанные тайлы давно устарели, считаем их промахами
+    if (prefetched.size() >= PrefetchTrackLimit)
+        prefetched.clear();
+    prefetched.insert(hash);
+    ++prefetchFetched;
+}
+
+void TileScheduler::touchPrefetched(const TileKey &key)
+{
+    if (!prefetched.isEmpty() && prefetched.remove(TileKey(key.x, key.y, key.z).hash()))
+        ++prefetchHits;
+}
+
+TileScheduler::PrefetchStats TileScheduler::prefetchStats() const
+{
+    PrefetchStats st;
+    st.fetched = prefetchFetched;
+    st.hits    = prefetchHits;
+    foreach (const DbRequest &r, dbRequests)
+        if (r.prefetch)
+            st.pending += r.keys.size();
+    foreach (const LoaderQueue &q, queues) {
+        foreach (const Request &r, q.pending)
+            st.pending += r.prefetch;
+        foreach (const Request &r, q.active)
+            st.pending += r.prefetch;
+    }
+    return st;
+}
+
+// -------------------------------------------------------
+
+void TileScheduler::pump(LoaderQueue &q)
+{
+    if (q.loader.isNull()) {
+        foreach (const Request &r, q.pending)
+            loaderKeys.remove(r.key.hash());
+        foreach (const Request &r, q.active)
+            loaderKeys.remove(r.key.hash());
+        q.pending.clear();
+        q.active.clear();
+        return;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    // загрузчик так и не ответил, освобождаем место
+    foreach (const Request &r, q.active.values())
+        if (now - r.start > RequestTimeout)
+            cancelActive(q, r);
+
+    int prefetchActive = 0;
+    foreach (const Request &r, q.active)
+        prefetchActive += r.prefetch;
+
+    QPointF center = QRectF(view).center();
+    while (q.active.size() < limit && !q.pending.isEmpty()) {
+        // ближайший к центру области видимости тайл
+        int best = -1;
+        qreal bestDist = -1;
+        for (int i = 0; i < q.pending.size(); ++i) {
+            if (q.pending.at(i).prefetch)
+                continue;
+            const TileKey &key = q.pending.at(i).key;
+            qreal dist = 0;
+            if (!view.isNull()) {
+                if (key.z > zoom || !isVisible(key))
+                    dist = std::numeric_limits<qreal>::max();
+                else {
+                    int side = 1 << (zoom - key.z);
+                    QPointF d = QPointF(key.x + .5, key.y + .5) * side - center;
+                    dist = d.x() * d.x() + d.y() * d.y();
+                }
+            }
+            if (bestDist < 0 || dist < bestDist) {
+                bestDist = dist;
+                best = i;
+            }
+        }
+
+        // видимых тайлов нет, отдаем упреждающие в порядке поступления
+        if (best < 0) {
+            if (prefetchActive >= PrefetchLimit)
+                break;
+            for (int i = 0; i < q.pending.size() && best < 0; ++i)
+                if (q.pending.at(i).prefetch)
+                    best = i;
+            if (best < 0)
+                break;
+            ++prefetchActive;
+        }
+
+        Request r = q.pending.takeAt(best);
+        r.start = now;
+        q.active.insert(r.key.hash(), r);
+        q.loader->getTile(r.key.x, r.key.y, r.key.z);
+    }
+}
+
+void TileScheduler::cancelStale()
+{
+    // запросы в бд, еще не взятые в обработку
+    if (dc) {
+        foreach (uint number, dbRequests.keys()) {
+            const DbRequest &r = dbRequests[number];
+            if (!r.cancelable || r.prefetch)
+                continue;
+
+            bool visible = false;
+            foreach (const TileKey &key, r.keys)
+                if ((visible = isVisible(key)))
+                    break;
+            if (!visible && dc->cancelRequest(number))
+                dbFinished(number);
+        }
+    }
+
+    // запросы к загрузчикам
+    for (QHash<int, LoaderQueue>::iterator it = queues.begin(); it != queues.end(); ++it) {
+        LoaderQueue &q = it.value();
+        for (QMutableListIterator<Request> pit(q.pending); pit.hasNext(); ) {
+            const Request &r = pit.next();
+            if (r.cancelable && !r.prefetch && !isVisible(r.key)) {
+                loaderKeys.remove(r.key.hash());
+                pit.remove();
+            }
+        }
+        foreach (const Request &r, q.active.values())
+            if (r.cancelable && !r.prefetch && !isVisible(r.key))
+                cancelActive(q, r);
+
+        pump(q);
+    }
+}
+
+void TileScheduler::promote(LoaderQueue &q, const TileKey &key, bool cancelable)
+{
+    QHash<quint64, Request>::iterator it = q.active.find(key.hash());
+    if (it != q.active.end()) {
+        it.value().prefetch = false;
+        it.value().cancelable = cancelable;
+        return;
+    }
+
+    for (int i = 0; i < q.pending.size(); ++i) {
+        Request &r = q.pending[i];
+        if (r.key == key) {
+            if (!r.prefetch)
+                return;
+            r.prefetch = false;
+            r.cancelable = cancelable;
+            break;
+        }
+    }
+    pump(q);
+}
+
+void TileScheduler::cancelActive(LoaderQueue &q, const Request &r)
+{
+    quint64 hash = r.key.hash();
+    q.active.remove(hash);
+    loaderKeys.remove(hash);
+    if (!q.loader.isNull())
+        q.loader->cancelTile(r.key.x, r.key.y, r.key.z);
+}
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
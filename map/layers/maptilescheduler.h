@@ -0,0 +1,209 @@
+#ifndef MAPTILESCHEDULER_H
+#define MAPTILESCHEDULER_H
+
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QRect>
+#include <QPointer>
+#include <QVariant>
+
+#include "core/mapdefs.h"
+
+namespace dc {
+    class DatabaseController;
+}
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+class MapTileLoader;
+
+/**
+ * @brief The TileScheduler class планировщик запросов тайлов в бд и к загрузчикам
+ * Отслеживает запросы "в полете" (без повторов), выдает запросы загрузчикам
+ * от центра области видимости с ограничением количества одновременных запросов
+ * и отменяет запросы тайлов, ушедших из области видимости.
+ * Упреждающие запросы (prefetch) выдаются только при отсутствии видимых,
+ * занимают не более PrefetchLimit мест загрузчика и отменяются отдельно.
+ * Ключи запросов содержат тип тайла. Работает в потоке слоя подложки.
+ */
+class TileScheduler
+{
+public:
+    static const int DefaultLoaderLimit = 6;    // одновременных запросов на загрузчик
+    static const int RequestTimeout = 30000;    // время ожидания ответа загрузчика (мс)
+    static const int PrefetchLimit = 2;         // одновременных упреждающих запросов на загрузчик
+    static const int PrefetchTrackLimit = 1024; // отслеживаемых упреждающих тайлов
+
+    //! статистика упреждающей загрузки
+    struct PrefetchStats {
+        PrefetchStats() : fetched(0), hits(0), pending(0) {}
+        int fetched;                            // получено тайлов
+        int hits;                               // из них показано
+        int pending;                            // запросов в очередях
+
+        QVariantMap toVariant() const;
+    };
+
+    TileScheduler();
+    ~TileScheduler();
+
+    void setDatabase(dc::DatabaseController *db);
+
+    int loaderLimit() const;
+    void setLoaderLimit(int limit);
+
+    /**
+     * @brief setView установить область видимости и отменить устаревшие запросы
+     * @param rect область видимости в индексах тайлов
+     * @param zoom масштаб области
+     */
+    void setView(const QRect &rect, int zoom);
+
+    /**
+     * @brief isVisible попадает ли тайл (или его дочерние тайлы) в область видимости
+     * @param key ключ тайла
+     */
+    bool isVisible(const TileKey &key) const;
+
+    // ---------------------------------------------------
+
+    /**
+     * @brief isDbPending есть ли запрос тайла в бд
+     * @param key ключ тайла с типом
+     * @param prefetch учитывать упреждающие запросы
+     */
+    bool isDbPending(const TileKey &key, bool prefetch = false) const;
+
+    /**
+     * @brief requestDb поставить запрос в очередь бд
+     * @param keys ключи тайлов с типами, закрываемые запросом
+     * @param name имя обработчика
+     * @param params параметры запроса
+     * @param priority приоритет запроса
+     * @param receiver объект получатель результата
+     * @param callback метод обратного вызова
+     * @param cancelable запрос можно отменить при уходе тайлов из области видимости
+     * @param prefetch упреждающий запрос
+     * @return регистрационный номер запроса
+     */
+    uint requestDb(const QList<TileKey> &keys, const QString &name, const QVariant &params, int priority,
+                   QObject *receiver, const QByteArray &callback, bool cancelable = true, bool prefetch = false);
+
+    /**
+     * @brief dbFinished пришел ответ на запрос в бд
+     * @param number регистрационный номер запроса
+     * @return запрос был упреждающим
+     */
+    bool dbFinished(uint number);
+
+    // ---------------------------------------------------
+
+    /**
+     * @brief isLoaderPending есть ли запрос тайла к загрузчику (в очереди или в полете)
+     * @param key ключ тайла с типом
+     */
+    bool isLoaderPending(const TileKey &key) const;
+
+    /**
+     * @brief enqueue поставить тайл в очередь загрузчика
+     * @param loader загрузчик
+     * @param key ключ тайла с типом
+     * @param cancelable запрос можно отменить при уходе тайла из области видимости
+     * @param prefetch упреждающий запрос. Обычный запрос того же тайла снимает этот признак
+     */
+    void enqueue(MapTileLoader *loader, const TileKey &key, bool cancelable = true, bool prefetch = false);
+
+    /**
+     * @brief loaderFinished загрузчик ответил (тайл или ошибка)
+     * @param key ключ тайла с типом
+     * @return запрос был упреждающим
+     */
+    bool loaderFinished(const TileKey &key);
+
+    /**
+     * @brief cancelType отменить все запросы загрузчика
+     * @param type тип загрузчика
+     */
+    void cancelType(int type);
+
+    /**
+     * @brief cancelPrefetch отменить все упреждающие запросы
+     */
+    void cancelPrefetch();
+
+    /**
+     * @brief clear отменить все запросы
+     */
+    void clear();
+
+    // ---------------------------------------------------
+
+    /**
+     * @brief markPrefetched тайл получен по упреждающему запросу
+     * @param key ключ тайла
+     */
+    void markPrefetched(const TileKey &key);
+
+    /**
+     * @brief touchPrefetched тайл показан на экране (учет попаданий)
+     * @param key ключ тайла
+     */
+    void touchPrefetched(const TileKey &key);
+
+    PrefetchStats prefetchStats() const;
+
+private:
+    struct Request {
+        Request(const TileKey &k = TileKey(), bool c = true, bool p = false) : key(k), cancelable(c), prefetch(p), start(0) {}
+        TileKey key;
+        bool cancelable;
+        bool prefetch;
+        qint64 start;
+    };
+
+    struct LoaderQueue {
+        QPointer<MapTileLoader> loader;
+        QList<Request> pending;                 // ожидают отправки
+        QHash<quint64, Request> active;         // отправлены загрузчику
+    };
+
+    struct DbRequest {
+        QList<TileKey> keys;
+        bool cancelable;
+        bool prefetch;
+    };
+
+    void pump(LoaderQueue &q);
+    void promote(LoaderQueue &q, const TileKey &key, bool cancelable);
+    void cancelStale();
+    void cancelActive(LoaderQueue &q, const Request &r);
+
+    dc::DatabaseController *dc;
+    QRect view;
+    int zoom;
+    int limit;
+
+    QHash<quint64, uint> dbKeys;                // ключ - номер запроса в бд
+    QHash<uint, DbRequest> dbRequests;          // номер запроса - ключи
+    QHash<int, LoaderQueue> queues;             // очереди загрузчиков
+    QSet<quint64> loaderKeys;                   // ключи в очередях и в полете
+
+    QSet<quint64> prefetched;                   // полученные упреждающие тайлы (без типа)
+    int prefetchFetched;
+    int prefetchHits;
+
+    Q_DISABLE_COPY(TileScheduler)
+};
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
+
+#endif // MAPTILESCHEDULER_H
@@ -11,6 +11,10 @@
 #include <QFile>
 #include <QDateTime>
 #include <QString>
+#include <QSet>
+#include <QSharedPointer>
+#include <QtConcurrentRun>
+#include <QFutureWatcher>
 
 #include <functional>
 
@@ -20,6 +24,7 @@
 #include "coord/mapcoords.h"
 #include "sql/mapsql.h"
 #include "loaders/maptileloader.h"
+#include "loaders/maptilepack.h"
 #include "layers/maplayertile.h"
 
 // --------------------------------------------------
@@ -34,6 +39,46 @@ QString strTrimmed(const QString &str) {
     return str.trimmed();
 }
 
+// срок годности тайла из заголовка Expires (0 - не задан)
+int replyExpires(QNetworkReply *reply)
+{
+    if (!reply->hasRawHeader("Expires"))
+        return 0;
+    QDateTime dt = QLocale("en").toDateTime(reply->rawHeader("Expires").constData(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
+    dt.setTimeSpec(Qt::UTC);
+    return dt.toTime_t();
+}
+
+// срок годности тайла после ответа 304: Expires, Cache-Control: max-age или NotModifiedTtl
+// (0 в бд - бессрочный тайл, поэтому без заголовков срок не обнуляется)
+int notModifiedExpires(QNetworkReply *reply)
+{
+    int expires = replyExpires(reply);
+    if (expires > 0)
+        return expires;
+
+    uint now = QDateTime::currentDateTimeUtc().toTime_t();
+    foreach (QByteArray directive, reply->rawHeader("Cache-Control").split(',')) {
+        directive = directive.trimmed();
+        if (directive.startsWith("max-age=")) {
+            bool ok;
+            int age = directive.mid(8).toInt(&ok);
+            if (ok && age >= 0)
+                return now + age;
+        }
+    }
+    return now + MapTileLoaderHttp::NotModifiedTtl;
+}
+
+// свойства запроса относятся к тайлу (составные тайлы запоминают исходный ключ в parent_*)
+bool isTileRequest(const QVariantMap &properties, int x, int y, int z)
+{
+    bool composite = properties.contains("parent_x");
+    return properties.value(composite ? "parent_x" : "x").toInt() == x &&
+            properties.value(composite ? "parent_y" : "y").toInt() == y &&
+            properties.value(composite ? "parent_z" : "z").toInt() == z;
+}
+
 }
 
 // --------------------------------------------------
@@ -75,6 +120,14 @@ MapTileLoader::~MapTileLoader()
     }
 }
 
+void MapTileLoader::cancelTile(int, int, int)
+{
+}
+
+void MapTileLoader::setTileValidators(int, int, int, const QByteArray &, const QByteArray &)
+{
+}
+
 QString MapTileLoader::fileformat() const
 {
     return d_ptr->fileFormat;
@@ -97,7 +150,7 @@ bool MapTileLoader::isEnabled()
 class MapTileLoaderHttpPrivate : public MapTileLoaderPrivate
 {
 public:
-    MapTileLoaderHttpPrivate() : manager(NULL), proxyEnabled(false) {}
+    MapTileLoaderHttpPrivate() : manager(NULL), proxyEnabled(false), hostLimit(MapTileLoaderHttp::DefaultHostLimit) {}
     ~MapTileLoaderHttpPrivate()
     {
         if (manager) {
@@ -106,11 +159,47 @@ public:
         }
     }
 
+    // запрос, ожидающий места в пуле соединений сервера
+    struct PendingRequest {
+        QNetworkRequest request;
+        QVariantMap properties;
+    };
+
+    // валидаторы сохраненного тайла
+    struct Validators {
+        QByteArray etag;
+        QByteArray lastModified;
+    };
+
+    static const int ValidatorsLimit = 4096;            // отслеживаемых валидаторов
+
+    void issue(QObject *receiver, const PendingRequest &r);
+
     QNetworkAccessManager *manager;
     QNetworkProxy proxy;
     bool proxyEnabled;
+
+    int hostLimit;
+    QHash<QString, int> hostActive;                     // сервер - запросов в полете
+    QHash<QString, QList<PendingRequest> > hostPending; // сервер - ожидающие запросы
+    QHash<quint64, Validators> validators;              // TileKey::hash - валидаторы для условного запроса
 };
 
+void MapTileLoaderHttpPrivate::issue(QObject *receiver, const PendingRequest &r)
+{
+    QNetworkReply *reply = manager->get(r.request);
+    for (QMapIterator<QString, QVariant> it(r.properties); it.hasNext(); ) {
+        it.next();
+        reply->setProperty(it.key().toLatin1().constData(), it.value());
+    }
+
+    QString host = r.request.url().host();
+    reply->setProperty("host", host);
+    ++hostActive[host];
+
+    QObject::connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), receiver, SLOT(getError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
+}
+
 // ----------------------------------------------------
 MapTileLoaderHttp::MapTileLoaderHttp()
     : MapTileLoader(*new MapTileLoaderHttpPrivate)
@@ -139,6 +228,9 @@ void MapTileLoaderHttp::init(MapLayerTile *)
         delete d->manager;
     d->manager = new QNetworkAccessManager;
 
+    // место в пуле освобождается до обработки ответа
+    connect(d->manager, SIGNAL(finished(QNetworkReply*)),
+            this, SLOT(requestFinished(QNetworkReply*)));
     connect(d->manager, SIGNAL(finished(QNetworkReply*)),
             this, SLOT(replyFinished(QNetworkReply*)));
 }
@@ -150,6 +242,121 @@ void MapTileLoaderHttp::done()
         delete d->manager;
         d->manager = NULL;
     }
+    d->hostActive.clear();
+    d->hostPending.clear();
+    d->validators.clear();
+}
+
+void MapTileLoaderHttp::cancelTile(int x, int y, int z)
+{
+    Q_D(MapTileLoaderHttp);
+    if (!d->manager)
+        return;
+
+    // ожидающие запросы снимаются без ответа
+    for (QHash<QString, QList<MapTileLoaderHttpPrivate::PendingRequest> >::iterator it = d->hostPending.begin(); it != d->hostPending.end(); ) {
+        QList<MapTileLoaderHttpPrivate::PendingRequest> &list = it.value();
+        for (int i = list.size() - 1; i >= 0; --i)
+            if (isTileRequest(list.at(i).properties, x, y, z))
+                list.removeAt(i);
+        if (list.isEmpty())
+            it = d->hostPending.erase(it);
+        else
+            ++it;
+    }
+
+    foreach (QNetworkReply *reply, d->manager->findChildren<QNetworkReply*>()) {
+        if (reply->isFinished())
+            continue;
+        // составные тайлы запоминают исходный ключ в parent_*
+        bool composite = reply->property("parent_x").isValid();
+        if (reply->property(composite ? "parent_x" : "x").toInt() == x &&
+                reply->property(composite ? "parent_y" : "y").toInt() == y &&
+                reply->property(composite ? "parent_z" : "z").toInt() == z)
+            reply->abort();
+    }
+}
+
+void MapTileLoaderHttp::setTileValidators(int x, int y, int z, const QByteArray &etag, const QByteArray &lastModified)
+{
+    Q_D(MapTileLoaderHttp);
+    if (etag.isEmpty() && lastModified.isEmpty())
+        return;
+
+    if (d->validators.size() >= MapTileLoaderHttpPrivate::ValidatorsLimit)
+        d->validators.clear();
+    MapTileLoaderHttpPrivate::Validators &v = d->validators[TileKey(x, y, z, type()).hash()];
+    v.etag = etag;
+    v.lastModified = lastModified;
+}
+
+int MapTileLoaderHttp::hostLimit() const
+{
+    Q_D(const MapTileLoaderHttp);
+    return d->hostLimit;
+}
+
+void MapTileLoaderHttp::setHostLimit(int limit)
+{
+    Q_D(MapTileLoaderHttp);
+    d->hostLimit = qMax(1, limit);
+}
+
+void MapTileLoaderHttp::sendRequest(QNetworkRequest request, const QVariantMap &properties)
+{
+    Q_D(MapTileLoaderHttp);
+    if (!d->manager)
+        return;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    // несколько запросов в одном соединении, если сервер поддерживает HTTP/2
+    request.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif
+
+    // устаревший тайл проверяется условным запросом, при ответе 304 изображение не передается
+    if (!properties.contains("parent_x")) {
+        quint64 hash = TileKey(properties.value("x").toInt(), properties.value("y").toInt(),
+                               properties.value("z").toInt(), properties.value("type").toInt()).hash();
+        QHash<quint64, MapTileLoaderHttpPrivate::Validators>::iterator it = d->validators.find(hash);
+        if (it != d->validators.end()) {
+            if (!it->etag.isEmpty())
+                request.setRawHeader("If-None-Match", it->etag);
+            if (!it->lastModified.isEmpty())
+                request.setRawHeader("If-Modified-Since", it->lastModified);
+            d->validators.erase(it);
+        }
+    }
+
+    MapTileLoaderHttpPrivate::PendingRequest r;
+    r.request = request;
+    r.properties = properties;
+
+    QString host = request.url().host();
+    if (d->hostActive.value(host) >= d->hostLimit) {
+        d->hostPending[host].append(r);
+        return;
+    }
+    d->issue(this, r);
+}
+
+void MapTileLoaderHttp::requestFinished(QNetworkReply *reply)
+{
+    Q_D(MapTileLoaderHttp);
+    QVariant host = reply ? reply->property("host") : QVariant();
+    if (!host.isValid())
+        return;
+
+    QString h = host.toString();
+    if (--d->hostActive[h] <= 0)
+        d->hostActive.remove(h);
+
+    QHash<QString, QList<MapTileLoaderHttpPrivate::PendingRequest> >::iterator it = d->hostPending.find(h);
+    if (it == d->hostPending.end() || !d->manager)
+        return;
+    MapTileLoaderHttpPrivate::PendingRequest r = it.value().takeFirst();
+    if (it.value().isEmpty())
+        d->hostPending.erase(it);
+    d->issue(this, r);
 }
 
 void MapTileLoaderHttp::setProxyEnabled(bool e)
@@ -198,6 +405,9 @@ void MapTileLoaderHttp::getError(QNetworkReply::NetworkError err)
     QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
     if (!reply)
         return;
+    // запрос отменен планировщиком
+    if (err == QNetworkReply::OperationCanceledError)
+        return;
 
     int x = reply->property("x").toInt();
     int y = reply->property("y").toInt();
@@ -221,21 +431,33 @@ void MapTileLoaderHttp::replyFinished(QNetworkReply *reply)
     if (!reply)
         return;
 
-    if (reply->error() != QNetworkReply::NoError)
+    if (reply->error() != QNetworkReply::NoError) {
+        reply->deleteLater();
         return;
+    }
+
+    int x = reply->property("x").toInt();
+    int y = reply->property("y").toInt();
+    int z = reply->property("z").toInt();
+    int type = reply->property("type").toInt();
+    int expires = replyExpires(reply);
+
+    // сохраненный тайл актуален - продлевается только срок годности
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+        emit tileNotModified(x, y, z, type, notModifiedExpires(reply));
+        reply->deleteLater();
+        return;
+    }
 
     QImage img;
     img.loadFromData(reply->readAll());
 
-    int expires = 0;
-    if (reply->hasRawHeader("Expires"))
-    {
-        QDateTime dt = QLocale("en").toDateTime(reply->rawHeader("Expires").constData(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
-        dt.setTimeSpec(Qt::UTC);
-        expires = dt.toTime_t();
-    }
+    QByteArray etag = reply->rawHeader("ETag");
+    QByteArray lastModified = reply->rawHeader("Last-Modified");
+    if (!img.isNull() && (!etag.isEmpty() || !lastModified.isEmpty()))
+        emit tileValidators(x, y, z, type, etag, lastModified);
 
-    emit imageReady(img, reply->property("x").toInt(), reply->property("y").toInt(), reply->property("z").toInt(), reply->property("type").toInt(), expires);
+    emit imageReady(img, x, y, z, type, expires);
     reply->deleteLater();
 }
 
@@ -358,14 +580,13 @@ void MapTileLoaderHttpTempl::getTile(int x, int y, int z)
     QUrl url(address);
     QNetworkRequest request(url);
     request.setRawHeader("User-Agent", "noop");
-    QNetworkReply *reply = d->manager->get(request);
 
-    reply->setProperty("x", x);
-    reply->setProperty("y", y);
-    reply->setProperty("z", z);
-    reply->setProperty("type", type());
-
-    connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(getError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
+    QVariantMap properties;
+    properties["x"] = x;
+    properties["y"] = y;
+    properties["z"] = z;
+    properties["type"] = type();
+    sendRequest(request, properties);
 }
 
 QString MapTileLoaderHttpTempl::description() const
@@ -706,17 +927,15 @@ void MapTileLoaderYandex::getTile(int x, int y, int z)
             address.replace(it.key(), it.value()->value(), Qt::CaseInsensitive);
         }
 
-        QNetworkReply *fReply = d->manager->get(QNetworkRequest(QUrl(address)));
-
-        fReply->setProperty("x", key.fKey.x);
-        fReply->setProperty("y", key.fKey.y);
-        fReply->setProperty("z", key.fKey.z);
-        fReply->setProperty("parent_x", x);
-        fReply->setProperty("parent_y", y);
-        fReply->setProperty("parent_z", z);
-        fReply->setProperty("type", type());
-
-        connect(fReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(getError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
+        QVariantMap properties;
+        properties["x"] = key.fKey.x;
+        properties["y"] = key.fKey.y;
+        properties["z"] = key.fKey.z;
+        properties["parent_x"] = x;
+        properties["parent_y"] = y;
+        properties["parent_z"] = z;
+        properties["type"] = type();
+        sendRequest(QNetworkRequest(QUrl(address)), properties);
     }
 
     if (!key.sFull) {
@@ -735,17 +954,15 @@ void MapTileLoaderYandex::getTile(int x, int y, int z)
             address.replace(it.key(), it.value()->value(), Qt::CaseInsensitive);
         }
 
-        QNetworkReply *sReply = d->manager->get(QNetworkRequest(QUrl(address)));
-
-        sReply->setProperty("x", key.sKey.x);
-        sReply->setProperty("y", key.sKey.y);
-        sReply->setProperty("z", key.sKey.z);
-        sReply->setProperty("parent_x", x);
-        sReply->setProperty("parent_y", y);
-        sReply->setProperty("parent_z", z);
-        sReply->setProperty("type", type());
-
-        connect(sReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(getError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
+        QVariantMap properties;
+        properties["x"] = key.sKey.x;
+        properties["y"] = key.sKey.y;
+        properties["z"] = key.sKey.z;
+        properties["parent_x"] = x;
+        properties["parent_y"] = y;
+        properties["parent_z"] = z;
+        properties["type"] = type();
+        sendRequest(QNetworkRequest(QUrl(address)), properties);
     }
 
 //    if (key.sFull && key.fFull) {
@@ -755,6 +972,13 @@ void MapTileLoaderYandex::getTile(int x, int y, int z)
 }
 
 
+void MapTileLoaderYandex::cancelTile(int x, int y, int z)
+{
+    Q_D(MapTileLoaderYandex);
+    d->cache.remove(TileKey(x, y, z));
+    MapTileLoaderHttp::cancelTile(x, y, z);
+}
+
 QString MapTileLoaderYandex::description() const
 {
     Q_D(const MapTileLoaderYandex);
@@ -785,19 +1009,15 @@ void MapTileLoaderYandex::replyFinished(QNetworkReply *reply)
     if (!reply)
         return;
 
-    if (reply->error() != QNetworkReply::NoError)
+    if (reply->error() != QNetworkReply::NoError) {
+        reply->deleteLater();
         return;
+    }
 
     QImage img;
     img.loadFromData(reply->readAll());
 
-    int expires = 0;
-    if (reply->hasRawHeader("Expires"))
-    {
-        QDateTime dt = QLocale("en").toDateTime(reply->rawHeader("Expires").constData(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
-        dt.setTimeSpec(Qt::UTC);
-        expires = dt.toTime_t();
-    }
+    int expires = replyExpires(reply);
 
     TileKey tmpKey(reply->property("parent_x").toInt(), reply->property("parent_y").toInt(), reply->property("parent_z").toInt());
     TileKey key(reply->property("x").toInt(), reply->property("y").toInt(), reply->property("z").toInt());
@@ -914,14 +1134,13 @@ void MapTileLoaderWMS::getTile(int x, int y, int z)
     QUrl url(address);
     QNetworkRequest request(url);
     request.setRawHeader("User-Agent", "noop");
-    QNetworkReply *reply = d->manager->get(request);
-
-    reply->setProperty("x", x);
-    reply->setProperty("y", y);
-    reply->setProperty("z", z);
-    reply->setProperty("type", type());
 
-    connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(getError(QNetworkReply::NetworkError)), Qt::QueuedConnection);
+    QVariantMap properties;
+    properties["x"] = x;
+    properties["y"] = y;
+    properties["z"] = z;
+    properties["type"] = type();
+    sendRequest(request, properties);
 }
 
 QString MapTileLoaderWMS::description() const
@@ -981,25 +1200,7 @@ bool MapTileLoaderWMS::parseUrl(QString const &url)
 
 void MapTileLoaderWMS::replyFinished(QNetworkReply *reply)
 {
-    if (!reply)
-        return;
-
-    if (reply->error() != QNetworkReply::NoError)
-        return;
-
-    QImage img;
-    img.loadFromData(reply->readAll());
-
-    int expires = 0;
-    if (reply->hasRawHeader("Expires"))
-    {
-        QDateTime dt = QLocale("en").toDateTime(reply->rawHeader("Expires").constData(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
-        dt.setTimeSpec(Qt::UTC);
-        expires = dt.toTime_t();
-    }
-
-    emit imageReady(img, reply->property("x").toInt(), reply->property("y").toInt(), reply->property("z").toInt(), reply->property("type").toInt(), expires);
-    reply->deleteLater();
+    MapTileLoaderHttp::replyFinished(reply);
 }
 
 // ----------------------------------------------------
@@ -1035,7 +1236,7 @@ public:
 
 public:
     QHash<QString, QImage> icons;
-    QHash<QString, TileWeather> tileWeather;
+    QHash<quint64, TileWeather> tileWeather;     // ключ - TileKey::hash
 
 private:
     MapTileLoaderYandexWeather *q_ptr;
@@ -1044,7 +1245,7 @@ public:
     void tileBounds(int x, int y, int z, QPointF &tl, QPointF &br);
     QImage trimEmptyLines(const QImage &sourceImage);
     void generateTiles();
-    void generateTile(const QString &quadKey);
+    void generateTile(quint64 quadKey);
 
 };
 
@@ -1093,11 +1294,11 @@ QImage MapTileLoaderYandexWeatherPrivate::trimEmptyLines(const QImage &sourceIma
 
 void MapTileLoaderYandexWeatherPrivate::generateTiles()
 {
-    foreach (const QString &quadKey, tileWeather.keys())
+    foreach (quint64 quadKey, tileWeather.keys())
         generateTile(quadKey);
 }
 
-void MapTileLoaderYandexWeatherPrivate::generateTile(const QString &quadKey)
+void MapTileLoaderYandexWeatherPrivate::generateTile(quint64 quadKey)
 {
     TileWeather tile = tileWeather.take(quadKey);
     bool iconsReady = true;
@@ -1251,7 +1452,7 @@ void MapTileLoaderYandexWeather::replyFinished(QNetworkReply *reply)
             int x = reply->property("x").toInt();
             int y = reply->property("y").toInt();
             int z = reply->property("z").toInt();
-            QString quadKey = minigis::TileSystem::tileToQuadKey(x, y, z);
+            quint64 quadKey = minigis::TileKey(x, y, z).hash();
 
             TileWeather tileWeather;
             tileWeather.x = x;
@@ -1398,7 +1599,6 @@ void MapTileLoaderCheckFillDataBase::getTile(int x, int y, int z)
         return;
 
     QVariantMap v;
-    v["quad"] = minigis::TileSystem::tileToQuadKey(x, y, z);
     v["x"] = x;
     v["y"] = y;
     v["z"] = z;
@@ -1445,27 +1645,144 @@ void MapTileLoaderCheckFillDataBase::onDb_QuadIncome(uint /*query*/, QVariant re
         img = img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
 
 
-    QString quadKey = res.value("quad").toString();
-
-    QStringList quads = res.value("quads").toStringList();
+    // потомки - относительно исходной плитки
+    QVariantList tiles = res.value("tiles").toList();
     QPainter painter(&img);
     painter.setRenderHints(QPainter::Antialiasing);
     painter.setBrush(Qt::NoBrush);
-    foreach (QString quad, quads) {
-        QPoint tPos;
-        int tZoom;
-        minigis::TileSystem::quadKeyToTile(quad, tPos, tZoom);
+    foreach (const QVariant &t, tiles) {
+        QVariantMap v = t.toMap();
+        int tZoom = v.value("z").toInt();
         int tSize = TileSize >> tZoom;
-        QRect r = QRect(tPos * tSize, QSize(tSize, tSize));
+        QRect r = QRect(QPoint(v.value("x").toInt(), v.value("y").toInt()) * tSize, QSize(tSize, tSize));
         painter.setPen(d->colors.at(tZoom));
         painter.drawRect(r);
     }
     painter.end();
 
-    QPoint pos;
-    int zoom;
-    minigis::TileSystem::quadKeyToTile(quadKey, pos, zoom);
-    emit imageReady(img, pos.x(), pos.y(), zoom, type(), 0);
+    emit imageReady(img, res.value("x").toInt(), res.value("y").toInt(), res.value("z").toInt(), type(), 0);
+}
+
+// ----------------------------------------------------
+// ----------------------------------------------------
+// ----------------------------------------------------
+
+class MapTileLoaderPackPrivate : public MapTileLoaderPrivate
+{
+public:
+    // декодирование изображения в пуле потоков
+    static QImage decode(QSharedPointer<TilePack> pack, int x, int y, int z);
+
+    QSharedPointer<TilePack> pack;          // пакет разделяется с задачами декодирования
+    QString desc;
+    quint8 type;
+    bool isNight;
+    QSet<quint64> requests;                 // ожидающие ответа тайлы
+};
+
+// ----------------------------------------------------
+
+QImage MapTileLoaderPackPrivate::decode(QSharedPointer<TilePack> pack, int x, int y, int z)
+{
+    QImage img;
+    QByteArray data = pack->tile(x, y, z);
+    if (!data.isEmpty())
+        img.loadFromData(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    return img;
+}
+
+// ----------------------------------------------------
+
+MapTileLoaderPack::MapTileLoaderPack(QString const &fileName, QString const &desc, quint8 type, bool isNight)
+    :MapTileLoader(*new MapTileLoaderPackPrivate)
+{
+    setObjectName("MapTileLoaderPack");
+    Q_D(MapTileLoaderPack);
+    d->desc = desc;
+    d->type = type;
+    d->isNight = isNight;
+    d->pack = QSharedPointer<TilePack>(new TilePack);
+
+    QString error;
+    if (!d->pack->open(fileName, &error))
+        qWarning() << error;
+    d->fileFormat = d->pack->isOpen() ? d->pack->format() : QString("PNG");
+}
+
+MapTileLoaderPack::~MapTileLoaderPack()
+{
+}
+
+void MapTileLoaderPack::init(MapLayerTile *)
+{
+}
+
+void MapTileLoaderPack::done()
+{
+    Q_D(MapTileLoaderPack);
+    d->requests.clear();
+}
+
+quint8 MapTileLoaderPack::type() const
+{
+    Q_D(const MapTileLoaderPack);
+    return d->type;
+}
+
+void MapTileLoaderPack::getTile(int x, int y, int z)
+{
+    Q_D(MapTileLoaderPack);
+
+    // промах индекса - сразу ошибка, без задачи декодирования
+    if (!d->pack->isOpen() || !d->pack->contains(x, y, z)) {
+        QMetaObject::invokeMethod(this, "errorKey", Qt::QueuedConnection, Q_ARG(int, x), Q_ARG(int, y), Q_ARG(int, z), Q_ARG(int, type()));
+        return;
+    }
+
+    quint64 hash = TileKey(x, y, z).hash();
+    if (d->requests.contains(hash))
+        return;
+    d->requests.insert(hash);
+
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, x, y, z, hash]() {
+        Q_D(MapTileLoaderPack);
+        watcher->deleteLater();
+        // отмененный запрос остается без ответа
+        if (!d->requests.remove(hash))
+            return;
+
+        QImage img = watcher->result();
+        if (img.isNull())
+            emit errorKey(x, y, z, type());
+        else
+            emit imageReady(img, x, y, z, type(), 0);
+    });
+    watcher->setFuture(QtConcurrent::run(&MapTileLoaderPackPrivate::decode, d->pack, x, y, z));
+}
+
+void MapTileLoaderPack::cancelTile(int x, int y, int z)
+{
+    Q_D(MapTileLoaderPack);
+    d->requests.remove(TileKey(x, y, z).hash());
+}
+
+QString MapTileLoaderPack::description() const
+{
+    Q_D(const MapTileLoaderPack);
+    return d->desc;
+}
+
+bool MapTileLoaderPack::nightModeAvalible() const
+{
+    Q_D(const MapTileLoaderPack);
+    return d->isNight;
+}
+
+bool MapTileLoaderPack::isOpen() const
+{
+    Q_D(const MapTileLoaderPack);
+    return d->pack->isOpen();
 }
 
 // ----------------------------------------------------
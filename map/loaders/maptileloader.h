@@ -26,10 +26,14 @@ public:
     enum {Type = 0};
     virtual quint8 type() const = 0;
     virtual void getTile(int x, int y, int z) = 0;
+    // cancelTile отменить запрос тайла (ответа на отмененный запрос не будет)
+    virtual void cancelTile(int x, int y, int z);
     virtual QString description() const = 0;
     virtual QString fileformat() const;
     virtual bool isTemporaryTiles() const = 0;
     virtual bool nightModeAvalible() const = 0;
+    // setTileValidators валидаторы сохраненного тайла для условного запроса (используются следующим getTile)
+    virtual void setTileValidators(int x, int y, int z, const QByteArray &etag, const QByteArray &lastModified);
 
     void setEnabled(bool);
     bool isEnabled();
@@ -41,6 +45,10 @@ public Q_SLOTS:
 Q_SIGNALS:
     void imageReady(QImage, int, int, int, int, int);
     void errorKey(int, int, int, int);
+    // тайл не изменился (ответ 304), новый срок годности
+    void tileNotModified(int, int, int, int, int);
+    // валидаторы полученного тайла (ETag, Last-Modified), приходят перед imageReady
+    void tileValidators(int, int, int, int, QByteArray, QByteArray);
 
 protected:
     MapTileLoader(MapTileLoaderPrivate &);
@@ -61,6 +69,17 @@ public:
     explicit MapTileLoaderHttp();
     virtual ~MapTileLoaderHttp();    
 
+    virtual void cancelTile(int x, int y, int z);
+    virtual void setTileValidators(int x, int y, int z, const QByteArray &etag, const QByteArray &lastModified);
+
+    // одновременных запросов к одному серверу (остальные ждут в очереди загрузчика)
+    static const int DefaultHostLimit = 6;
+    int hostLimit() const;
+    void setHostLimit(int limit);
+
+    // срок годности (с) тайла, подтвержденного ответом 304 без Expires и max-age
+    static const int NotModifiedTtl = 24 * 60 * 60;
+
 public Q_SLOTS:
     virtual void init(MapLayerTile *);
     virtual void done();
@@ -72,9 +91,19 @@ protected Q_SLOTS:
     void getError(QNetworkReply::NetworkError);
     void replyFinished(QNetworkReply*);
 
+private Q_SLOTS:
+    void requestFinished(QNetworkReply*);
+
 protected:
     MapTileLoaderHttp(MapTileLoaderHttpPrivate &);
 
+    /**
+     * @brief sendRequest отправить запрос (HTTP/2 там, где сервер его поддерживает)
+     * Свойства переносятся в ответ. Для одиночных тайлов (без parent_*) с сохраненными
+     * валидаторами запрос условный (If-None-Match / If-Modified-Since).
+     */
+    void sendRequest(QNetworkRequest request, const QVariantMap &properties);
+
     Q_DISABLE_COPY(MapTileLoaderHttp)
     Q_DECLARE_PRIVATE(MapTileLoaderHttp)
 };
@@ -119,6 +148,7 @@ public:
     virtual ~MapTileLoaderYandex();
 
     virtual void getTile(int x, int y, int z);
+    virtual void cancelTile(int x, int y, int z);
     virtual QString description() const;
     virtual quint8 type() const;
     virtual bool isTemporaryTiles() const;
@@ -220,6 +250,36 @@ protected:
 
 // ---------------------------------
 
+// загрузчик тайлов из пакета только для чтения (TilePack), отображаемого в память.
+// изображения декодируются в пуле потоков, в бд не сохраняются
+class MapTileLoaderPackPrivate;
+class MapTileLoaderPack: public MapTileLoader
+{
+    Q_OBJECT
+public:
+    explicit MapTileLoaderPack(QString const &fileName, QString const &desc, quint8 type, bool isNight);
+    virtual ~MapTileLoaderPack();
+
+    virtual void init(MapLayerTile *);
+    virtual void done();
+
+    enum {IsTmp = 1};
+    virtual quint8 type() const;
+    virtual void getTile(int x, int y, int z);
+    virtual void cancelTile(int x, int y, int z);
+    virtual QString description() const;
+    virtual bool isTemporaryTiles() const {return IsTmp;}
+    virtual bool nightModeAvalible() const;
+
+    bool isOpen() const;
+
+protected:
+    Q_DISABLE_COPY(MapTileLoaderPack)
+    Q_DECLARE_PRIVATE(MapTileLoaderPack)
+};
+
+// ---------------------------------
+
 
 } //minigis
 
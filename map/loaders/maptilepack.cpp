@@ -0,0 +1,270 @@
+
+#include <QDebug>
+#include <QHash>
+#include <QVector>
+#include <QSaveFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+#include "coord/mapcoords.h"
+#include "loaders/maptilepack.h"
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+namespace {
+
+bool entryLess(const TilePack::IndexEntry &a, const TilePack::IndexEntry &b)
+{
+    return a.key < b.key;
+}
+
+bool setError(QString *errorString, const QString &error)
+{
+    if (errorString)
+        *errorString = error;
+    return false;
+}
+
+}
+
+// -------------------------------------------------------
+
+TilePack::TilePack()
+    : data(NULL), header(NULL), index(NULL)
+{
+}
+
+TilePack::~TilePack()
+{
+    close();
+}
+
+bool TilePack::open(const QString &fileName, QString *errorString)
+{
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return setError(errorString, "Unable to open tile pack " + fileName + ": " + file.errorString());
+
+    qint64 size = file.size();
+    if (size < qint64(sizeof(Header))) {
+        close();
+        return setError(errorString, "Tile pack is too small " + fileName);
+    }
+
+    data = file.map(0, size);
+    if (!data) {
+        close();
+        return setError(errorString, "Unable to map tile pack " + fileName + ": " + file.errorString());
+    }
+
+    header = reinterpret_cast<const Header *>(data);
+    quint64 count = qFromLittleEndian(header->count);
+    quint64 indexOffset = qFromLittleEndian(header->indexOffset);
+    if (qFromLittleEndian(header->magic) != Magic || qFromLittleEndian(header->version) != Version ||
+            indexOffset % sizeof(quint64) != 0 || indexOffset > quint64(size) ||
+            count > (quint64(size) - indexOffset) / sizeof(IndexEntry)) {
+        close();
+        return setError(errorString, "Invalid tile pack " + fileName);
+    }
+    index = reinterpret_cast<const IndexEntry *>(data + indexOffset);
+    return true;
+}
+
+void TilePack::close()
+{
+    if (data)
+        file.unmap(data);
+    data = NULL;
+    header = NULL;
+    index = NULL;
+    if (file.isOpen())
+        file.close();
+}
+
+bool TilePack::isOpen() const
+{
+    return header != NULL;
+}
+
+QString TilePack::fileName() const
+{
+    return file.fileName();
+}
+
+QString TilePack::format() const
+{
+    if (!header)
+        return QString();
+    return QString::fromLatin1(header->format, qstrnlen(header->format, sizeof(header->format)));
+}
+
+quint64 TilePack::count() const
+{
+    return header ? qFromLittleEndian(header->count) : 0;
+}
+
+QByteArray TilePack::tile(int x, int y, int z) const
+{
+    const IndexEntry *e = find(key(x, y, z));
+    if (!e)
+        return QByteArray();
+
+    quint64 offset = qFromLittleEndian(e->offset);
+    quint32 size = qFromLittleEndian(e->size);
+    if (offset + size > quint64(file.size()))
+        return QByteArray();
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(data + offset), size);
+}
+
+bool TilePack::contains(int x, int y, int z) const
+{
+    return find(key(x, y, z)) != NULL;
+}
+
+quint64 TilePack::key(int x, int y, int z)
+{
+    // цифры quadkey по 2 бита, масштаб (до 29) в старших битах
+    return (quint64(z) << 58) | mortonEncode(x, y);
+}
+
+const TilePack::IndexEntry *TilePack::find(quint64 k) const
+{
+    if (!index)
+        return NULL;
+
+    // двоичный поиск по индексу
+    quint64 lo = 0;
+    quint64 hi = qFromLittleEndian(header->count);
+    while (lo < hi) {
+        quint64 mid = lo + ((hi - lo) >> 1);
+        quint64 midKey = qFromLittleEndian(index[mid].key);
+        if (midKey < k)
+            lo = mid + 1;
+        else if (midKey > k)
+            hi = mid;
+        else
+            return index + mid;
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------
+
+bool TilePack::exportDatabase(const QString &dbName, const QString &packName, int type, const QString &format, QString *errorString)
+{
+    static int npp = 0;
+    QString connection = QString("TilePackExport-%1").arg(++npp);
+
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(dbName);
+        if (!db.open())
+            setError(errorString, "Unable to open tile database " + dbName + ": " + db.lastError().text());
+        else {
+            QSaveFile out(packName);
+            if (!out.open(QIODevice::WriteOnly))
+                setError(errorString, "Unable to create tile pack " + packName + ": " + out.errorString());
+            else {
+                Header h;
+                memset(&h, 0, sizeof(h));
+                h.magic = qToLittleEndian(Magic);
+                h.version = qToLittleEndian(Version);
+                QByteArray fmt = format.toLatin1().left(sizeof(h.format));
+                memcpy(h.format, fmt.constData(), fmt.size());
+                out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+                // изображения пишутся по мере чтения, одинаковые - один раз
+                QHash<QString, QPair<quint64, quint32> > blobs;
+                QVector<IndexEntry> entries;
+                quint64 offset = sizeof(h);
+
+                QSqlQuery query(db);
+                query.setForwardOnly(true);
+                query.prepare("SELECT t.nx, t.ny, t.zoom, t.tile, b.tile FROM Tiles t "
+                              "JOIN TileBlob b ON b.id = t.tile WHERE t.type = :TYPE; ");
+                query.bindValue(":TYPE", type);
+                if (!query.exec())
+                    setError(errorString, "Unable to read tiles: " + query.lastError().text());
+                else {
+                    ok = true;
+                    while (ok && query.next()) {
+                        QString blobId = query.value(3).toString();
+                        QHash<QString, QPair<quint64, quint32> >::const_iterator it = blobs.constFind(blobId);
+                        if (it == blobs.constEnd()) {
+                            QByteArray blob = query.value(4).toByteArray();
+                            if (blob.isEmpty())
+                                continue;
+                            if (out.write(blob) != blob.size()) {
+                                ok = setError(errorString, "Unable to write tile pack: " + out.errorString());
+                                break;
+                            }
+                            it = blobs.insert(blobId, qMakePair(offset, quint32(blob.size())));
+                            offset += blob.size();
+                        }
+
+                        IndexEntry e;
+                        e.key = key(query.value(0).toInt(), query.value(1).toInt(), query.value(2).toInt());
+                        e.offset = it.value().first;
+                        e.size = it.value().second;
+                        e.reserved = 0;
+                        entries.append(e);
+                    }
+                }
+
+                if (ok) {
+                    std::sort(entries.begin(), entries.end(), entryLess);
+                    // повторы ключей невозможны (UNIQUE в Tiles), но индекс должен быть строгим
+                    entries.erase(std::unique(entries.begin(), entries.end(),
+                                              [](const IndexEntry &a, const IndexEntry &b) { return a.key == b.key; }),
+                                  entries.end());
+
+                    // выравнивание индекса
+                    static const char zeros[sizeof(quint64)] = {};
+                    int pad = int((sizeof(quint64) - offset % sizeof(quint64)) % sizeof(quint64));
+                    out.write(zeros, pad);
+                    offset += pad;
+
+                    for (int i = 0; i < entries.size(); ++i) {
+                        IndexEntry &e = entries[i];
+                        e.key = qToLittleEndian(e.key);
+                        e.offset = qToLittleEndian(e.offset);
+                        e.size = qToLittleEndian(e.size);
+                    }
+                    qint64 indexSize = qint64(entries.size()) * sizeof(IndexEntry);
+                    if (out.write(reinterpret_cast<const char *>(entries.constData()), indexSize) != indexSize)
+                        ok = setError(errorString, "Unable to write tile pack index: " + out.errorString());
+
+                    h.count = qToLittleEndian(quint64(entries.size()));
+                    h.indexOffset = qToLittleEndian(offset);
+                    if (ok && (!out.seek(0) || out.write(reinterpret_cast<const char *>(&h), sizeof(h)) != sizeof(h)))
+                        ok = setError(errorString, "Unable to write tile pack header: " + out.errorString());
+                    if (ok && !out.commit())
+                        ok = setError(errorString, "Unable to save tile pack " + packName + ": " + out.errorString());
+                }
+                if (!ok)
+                    out.cancelWriting();
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return ok;
+}
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
@@ -0,0 +1,100 @@
+#ifndef MAPTILEPACK_H
+#define MAPTILEPACK_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+
+// -------------------------------------------------------
+
+namespace minigis {
+
+// -------------------------------------------------------
+
+/**
+ * @brief The TilePack class пакет тайлов только для чтения, отображаемый в память
+ * Формат файла (little endian):
+ *  заголовок   - Header
+ *  изображения - PNG/JPEG подряд (одинаковые изображения хранятся один раз)
+ *  индекс      - IndexEntry[count], отсортирован по ключу (масштаб + quadkey)
+ * Поиск тайла - двоичный поиск по индексу, данные изображения отдаются без копирования.
+ * Методы чтения можно вызывать из нескольких потоков одновременно.
+ */
+class TilePack
+{
+public:
+    static const quint32 Magic = 0x4b50544d;        // "MTPK"
+    static const quint32 Version = 1;
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        char    format[8];                          // формат изображений (PNG, JPG)
+        quint64 count;                              // количество тайлов
+        quint64 indexOffset;                        // смещение индекса от начала файла
+    };
+
+    struct IndexEntry {
+        quint64 key;                                // ключ тайла (см. key())
+        quint64 offset;                             // смещение изображения от начала файла
+        quint32 size;                               // размер изображения
+        quint32 reserved;
+    };
+
+    TilePack();
+    ~TilePack();
+
+    /**
+     * @brief open открыть и отобразить в память файл пакета
+     * @param fileName имя файла
+     * @param errorString описание ошибки
+     */
+    bool open(const QString &fileName, QString *errorString = 0);
+    void close();
+    bool isOpen() const;
+
+    QString fileName() const;
+    QString format() const;
+    quint64 count() const;
+
+    /**
+     * @brief tile данные изображения тайла без копирования
+     * Данные действительны, пока пакет открыт. Пустой массив, если тайла нет.
+     */
+    QByteArray tile(int x, int y, int z) const;
+    bool contains(int x, int y, int z) const;
+
+    /**
+     * @brief key ключ тайла в индексе: масштаб в старших битах, ниже цифры quadkey
+     */
+    static quint64 key(int x, int y, int z);
+
+    /**
+     * @brief exportDatabase собрать пакет из бд тайлов (таблицы Tiles/TileBlob)
+     * @param dbName файл бд SQLite
+     * @param packName файл пакета
+     * @param type тип тайлов (загрузчик)
+     * @param format формат изображений для заголовка
+     * @param errorString описание ошибки
+     */
+    static bool exportDatabase(const QString &dbName, const QString &packName, int type,
+                               const QString &format = QString("PNG"), QString *errorString = 0);
+
+private:
+    const IndexEntry *find(quint64 key) const;
+
+    QFile file;
+    uchar *data;
+    const Header *header;
+    const IndexEntry *index;
+
+    Q_DISABLE_COPY(TilePack)
+};
+
+// -------------------------------------------------------
+
+} // namespace minigis
+
+// -------------------------------------------------------
+
+#endif // MAPTILEPACK_H
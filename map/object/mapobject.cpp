@@ -461,6 +461,14 @@ MapDrawer *MapObject::drawer() const
 
 // -------------------------------------------------------
 
+void MapObject::setDrawer(MapDrawer *drawer)
+{
+    Q_D(MapObject);
+    d->drawer = drawer;
+}
+
+// -------------------------------------------------------
+
 bool MapObject::selected() const
 {
     return d_ptr->selected;
@@ -845,14 +853,20 @@ void MapObject::setLayer(MapLayerWithObjects *layer)
 
 void MapObject::setSelected(bool flag)
 {
+    if (d_ptr->selected == flag)
+        return;
     d_ptr->selected = flag;
+    emit selectedChanged(flag);
 }
 
 // -------------------------------------------------------
 
 void MapObject::setHighlighted(Highlighting flag)
 {
+    if (d_ptr->highlighted == flag)
+        return;
     d_ptr->highlighted = flag;
+    emit highlightedChanged(flag);
 }
 
 // -------------------------------------------------------
@@ -89,6 +89,7 @@ public:
 
     Q_INVOKABLE MapLayerWithObjects *layer() const;
     MapDrawer *drawer() const;
+    void setDrawer(MapDrawer *drawer);
 
     Q_INVOKABLE bool selected() const;
     Q_INVOKABLE Highlighting highlighted() const;
@@ -116,6 +117,9 @@ Q_SIGNALS:
 
     void attributeChanged(int key, QVariant attr);
 
+    void selectedChanged(bool flag);
+    void highlightedChanged(Highlighting flag);
+
     void aniNotify(MapObject *);
 
 public Q_SLOTS:
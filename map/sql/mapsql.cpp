@@ -3,13 +3,16 @@
 #include <QStringList>
 #include <QDateTime>
 #include <QPointer>
-#include <QUuid>
-#include <QCryptographicHash>
-#include <QDateTime>
+#include <QSet>
+#include <QtEndian>
+#include <QPair>
+
+#include <cstring>
 
 #include <db/databasecontroller.h>
 
 //#include "core/maphmatrix.h"
+#include "core/mapdefs.h"
 #include "coord/mapcoords.h"
 #include "sql/mapsql.h"
 
@@ -27,9 +30,124 @@ class TilesDBPrivate
 public:
     TilesDBPrivate() : dc(NULL) {}
 
+    static const int KnownBlobsLimit = 1 << 18; // отслеживаемых сохраненных изображений
+
     dc::DatabaseController *dc;
+    QSet<QString> knownBlobs;                   // изображения, заведомо лежащие в TileBlob (только поток записи)
 };
 
+// -----------------------------------------------------------------------------
+// некриптографическая свертка изображения (xxHash64)
+static inline quint64 xxRotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 xxRead64(const uchar *p)
+{
+    quint64 v;
+    memcpy(&v, p, sizeof(v));
+    return qFromLittleEndian(v);
+}
+
+static inline quint32 xxRead32(const uchar *p)
+{
+    quint32 v;
+    memcpy(&v, p, sizeof(v));
+    return qFromLittleEndian(v);
+}
+
+static quint64 xxHash64(const QByteArray &data, quint64 seed = 0)
+{
+    static const quint64 P1 = Q_UINT64_C(11400714785074694791);
+    static const quint64 P2 = Q_UINT64_C(14029467366897019727);
+    static const quint64 P3 = Q_UINT64_C(1609587929392839161);
+    static const quint64 P4 = Q_UINT64_C(9650029242287828579);
+    static const quint64 P5 = Q_UINT64_C(2870177450012600261);
+
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    const uchar *end = p + data.size();
+    quint64 h;
+
+    if (data.size() >= 32) {
+        quint64 v1 = seed + P1 + P2;
+        quint64 v2 = seed + P2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - P1;
+        for (const uchar *limit = end - 32; p <= limit; p += 32) {
+            v1 = xxRotl(v1 + xxRead64(p)      * P2, 31) * P1;
+            v2 = xxRotl(v2 + xxRead64(p + 8)  * P2, 31) * P1;
+            v3 = xxRotl(v3 + xxRead64(p + 16) * P2, 31) * P1;
+            v4 = xxRotl(v4 + xxRead64(p + 24) * P2, 31) * P1;
+        }
+        h = xxRotl(v1, 1) + xxRotl(v2, 7) + xxRotl(v3, 12) + xxRotl(v4, 18);
+        const quint64 lanes[] = { v1, v2, v3, v4 };
+        for (int i = 0; i < 4; ++i)
+            h = (h ^ (xxRotl(lanes[i] * P2, 31) * P1)) * P1 + P4;
+    }
+    else
+        h = seed + P5;
+
+    h += quint64(data.size());
+    for (; p + 8 <= end; p += 8)
+        h = xxRotl(h ^ (xxRotl(xxRead64(p) * P2, 31) * P1), 27) * P1 + P4;
+    if (p + 4 <= end) {
+        h = xxRotl(h ^ (quint64(xxRead32(p)) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        h = xxRotl(h ^ (*p * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ключ изображения: свертка и размер (размер снижает вероятность коллизий)
+static QString blobKey(const QByteArray &blob)
+{
+    return QString("%1:%2").arg(xxHash64(blob), 16, 16, QChar('0')).arg(blob.size());
+}
+
+// количество строк в многострочных вставках и ключей в списках выборки: степени двойки (мало вариантов текста для кэша запросов)
+static const int InsertChunk = 64;
+
+static int insertChunk(int count)
+{
+    int chunk = InsertChunk;
+    while (chunk > count)
+        chunk >>= 1;
+    return chunk;
+}
+
+// заполнение целочисленного quadkey в бд прежних версий
+static void migrateQuadKeys(dc::DatabaseController *db)
+{
+    QVariantMap data;
+    dc::QueryResult res;
+    db->execQuery("ALTER TABLE Tiles ADD COLUMN qkey INTEGER;", data, res);
+
+    QList<QPair<qint64, qint64> > keys;
+    db->execQueryEach("SELECT rowid, nx, ny, zoom FROM Tiles;", data, [&keys](const QSqlQuery &q) {
+        minigis::TileKey key(q.value(1).toInt(), q.value(2).toInt(), q.value(3).toInt());
+        // плитка вне своего уровня ключа не получает (qkey остается NULL)
+        if (!key.isValid())
+            return;
+        keys.append(qMakePair(q.value(0).toLongLong(), qint64(key.quadOrder())));
+    });
+
+    db->transaction();
+    for (int i = 0; i < keys.size(); ++i) {
+        data[":K"] = keys.at(i).second;
+        data[":R"] = keys.at(i).first;
+        db->execQuery("UPDATE Tiles SET qkey = :K WHERE rowid = :R;", data, res);
+    }
+    db->commit();
+}
+
 // -----------------------------------------------------------------------------
 TilesDB::TilesDB(QObject *parent)
     :QObject(parent), d_ptr(new TilesDBPrivate)
@@ -61,8 +179,10 @@ void TilesDB::setDc(dc::DatabaseController *dc)
     dc->registerHandler("create",   handle, "createTables");
 
     dc->registerHandler("insTiles", handle, "insertTiles");
-    dc->registerHandler("selTiles", handle, "loadTiles");
-    dc->registerHandler("selQuad" , handle, "loadQuadTile");
+    // чтение тайлов в режиме пула идет параллельно записи
+    dc->registerHandler("selTiles", handle, "loadTiles", true);
+    dc->registerHandler("selTilesBatch", handle, "loadTilesBatch", true);
+    dc->registerHandler("selQuad" , handle, "loadQuadTile", true);
     dc->registerHandler("remTiles", handle, "removeTiles");
 }
 
@@ -105,7 +225,7 @@ void TilesDB::createTables(QVariant, QVariant &result, QVariant &errors)
                              "  CREATE TABLE IF NOT Exists TileBlob \n"
                              "  ( \n"
                              "      id TEXT PRIMARY KEY, /* идентификатор листа */ \n"
-                             "      hash TEXT, /* Sha1 хэшсвёртка изображения для поиска дубликатов */ \n"
+                             "      hash TEXT, /* свёртка изображения для поиска дубликатов (xxHash64:размер, ранее Sha1) */ \n"
                              "      tile BLOB, /* собственно изображение */ \n"
                              "      UNIQUE (hash) \n"
                              "  );")
@@ -119,22 +239,42 @@ void TilesDB::createTables(QVariant, QVariant &result, QVariant &errors)
     d_ptr->dc->execQuery(_ru(
                              "  CREATE TABLE IF NOT Exists Tiles \n"
                              "  ( \n"
-                             "      id TEXT PRIMARY KEY, /* ид плитки */ \n"
+                             "      id TEXT PRIMARY KEY, /* ид плитки (TileKey::hash) */ \n"
                              "      nx INTEGER, /* координаты плитки по X */ \n"
                              "      ny INTEGER,  /* координаты плитки по Y */ \n"
                              "      zoom INTEGER, /* масштаб или уровень зума */ \n"
                              "      type INTEGER, /* тип плитки */ \n"
-                             "      quadkey TEXT, /* идентификатор листа */ \n"
+                             "      qkey INTEGER, /* целочисленный quadkey в порядке обхода дерева (TileKey::quadOrder) */ \n"
                              "      inserttime INTEGER, /* время записи листа */ \n"
                              "      expires INTEGER, /* срок годности листа */ \n"
                              "      tile TEXT, /* ид изображения */ \n"
+                             "      etag TEXT, /* валидаторы HTTP-ответа для условного запроса после истечения срока */ \n"
+                             "      lastmodified TEXT, \n"
                              "      FOREIGN KEY (tile) REFERENCES TileBlob(id) ON UPDATE CASCADE ON DELETE CASCADE, \n"
                              "      UNIQUE (nx, ny, zoom, type) /* тип, зум, X, Y - обеспечат уникальность плиток */ \n"
                              "  );")
                          , data, res);
 
+    // бд прежних версий: текстовый quadkey заменяется целочисленным, добавляются валидаторы
+    QSet<QString> columns;
+    d_ptr->dc->execQuery(_ru("PRAGMA table_info(Tiles);"), data, res);
+    foreach (const QVariantMap &column, res)
+        columns.insert(column.value("name").toString());
+    if (!columns.contains("qkey"))
+        migrateQuadKeys(d_ptr->dc);
+    if (!columns.contains("etag"))
+        d_ptr->dc->execQuery(_ru("ALTER TABLE Tiles ADD COLUMN etag TEXT;"), data, res);
+    if (!columns.contains("lastmodified"))
+        d_ptr->dc->execQuery(_ru("ALTER TABLE Tiles ADD COLUMN lastmodified TEXT;"), data, res);
+
     d_ptr->dc->execQuery(_ru(
-                             "CREATE INDEX IF NOT EXISTS Tiles_tile_index ON Tiles(quadkey);"
+                             "DROP INDEX IF EXISTS Tiles_tile_index;"
+                             )
+                         , data, res);
+
+    // потомки плитки - диапазон qkey
+    d_ptr->dc->execQuery(_ru(
+                             "CREATE INDEX IF NOT EXISTS Tiles_qkey_index ON Tiles(type, qkey);"
                              )
                          , data, res);
 
@@ -160,62 +300,224 @@ void TilesDB::insertTiles(QVariant params, QVariant &result, QVariant &errors)
         return;
     }
 
-    d_ptr->dc->transaction();
+    Q_D(TilesDB);
+    bool ok = d->dc->transaction();
 
     dc::QueryResult res;
-    dc::QueryResult tiles = params.value<dc::QueryResult>();
+    dc::QueryResult rows = params.value<dc::QueryResult>();
     uint dt = QDateTime::currentDateTime().toTime_t();
 
+    // тайлы, подтвержденные ответом 304: изображение не перезаписывается, продлевается срок годности
+    // (без нового срока остается прежний: 0 означал бы бессрочный тайл)
+    dc::QueryResult tiles;
+    foreach (const QVariantMap &tile, rows) {
+        if (!tile.value("notModified").toBool()) {
+            tiles.append(tile);
+            continue;
+        }
+        QVariantMap data;
+        data[":DT"  ] = dt;
+        data[":EXP" ] = tile.value("expires");
+        data[":X"   ] = tile.value("x");
+        data[":Y"   ] = tile.value("y");
+        data[":Z"   ] = tile.value("z");
+        data[":TYPE"] = tile.value("type");
+        ok = d->dc->execQuery(
+                    "UPDATE Tiles SET inserttime = :DT, expires = COALESCE(NULLIF(:EXP, 0), expires) "
+                    "WHERE nx = :X AND ny = :Y AND zoom = :Z AND type = :TYPE; ",
+                    data, res) && ok;
+    }
+
+    // изображения: ключ - свертка, без повторов и уже сохраненных
+    QList<QString> tileIds;
+    QList<QString> blobIds;
+    QList<QByteArray> blobs;
+    QSet<QString> batchBlobs;
     foreach (const QVariantMap &tile, tiles) {
-        QString key = QUuid::createUuid().toString();
-        int x = tile.value("x").toInt();
-        int y = tile.value("y").toInt();
-        int z = tile.value("z").toInt();
-        QString q = minigis::TileSystem::tileToQuadKey(x, y, z);
         QByteArray blob = tile.value("tile").toByteArray();
-        QString hash(QCryptographicHash::hash(blob, QCryptographicHash::Sha1).toHex());
+        QString id = blobKey(blob);
+        tileIds.append(id);
+        if (d->knownBlobs.contains(id) || batchBlobs.contains(id))
+            continue;
+        batchBlobs.insert(id);
+        blobIds.append(id);
+        blobs.append(blob);
+    }
 
+    for (int i = 0; i < blobIds.size(); ) {
+        int chunk = insertChunk(blobIds.size() - i);
+        QStringList values;
         QVariantMap data;
+        for (int j = 0; j < chunk; ++j, ++i) {
+            QString n = QString::number(j);
+            values.append(QString("(:I%1, :I%1, :T%1)").arg(n));
+            data[":I" + n] = blobIds.at(i);
+            data[":T" + n] = blobs.at(i);
+        }
+        // id = hash: повторное изображение не вставляется
+        ok = d->dc->execQuery(
+                    "INSERT OR IGNORE INTO TileBlob (id, hash, tile) VALUES " + values.join(", ") + "; ",
+                    data, res) && ok;
+    }
 
-        data[":HASH"] = hash;
-        d_ptr->dc->execQuery("SELECT id FROM TileBlob WHERE hash = :HASH; ", data, res);
-
-        bool tileExist = !res.isEmpty();
-        QString tileid = tileExist ? res.first().value("id").toString() : key;
-
-        if (!tileExist) {
-            data.clear();
-            data[":I"] = tileid;
-            data[":T"] = blob;
-            data[":H"] = hash;
-            d_ptr->dc->execQuery(
-                        "INSERT INTO TileBlob (id, hash, tile) VALUES (:I, :H, :T); ",
-                        data, res);
+    for (int i = 0; i < tiles.size(); ) {
+        int chunk = insertChunk(tiles.size() - i);
+        QStringList values;
+        QVariantMap data;
+        data[":DT"] = dt;
+        for (int j = 0; j < chunk; ++j, ++i) {
+            const QVariantMap &tile = tiles.at(i);
+            int x = tile.value("x").toInt();
+            int y = tile.value("y").toInt();
+            int z = tile.value("z").toInt();
+            minigis::TileKey key(x, y, z, tile.value("type").toInt());
+
+            QString n = QString::number(j);
+            values.append(QString("(:I%1, :X%1, :Y%1, :Z%1, :TYPE%1, :Q%1, :DT, :EXP%1, :TILE%1, :ET%1, :LM%1)").arg(n));
+            // плитка однозначно задается quadkey и типом
+            data[":I"    + n] = QString::number(key.hash());
+            data[":X"    + n] = x;
+            data[":Y"    + n] = y;
+            data[":Z"    + n] = z;
+            data[":Q"    + n] = qint64(key.quadOrder());
+            data[":TYPE" + n] = key.type;
+            data[":EXP"  + n] = tile.value("expires");
+            data[":TILE" + n] = tileIds.at(i);
+            data[":ET"   + n] = QString::fromLatin1(tile.value("etag").toByteArray());
+            data[":LM"   + n] = QString::fromLatin1(tile.value("modified").toByteArray());
         }
+        ok = d->dc->execQuery(
+                    "INSERT OR REPLACE INTO Tiles (id, nx, ny, zoom, type, qkey, inserttime, expires, tile, etag, lastmodified) "
+                    "VALUES " + values.join(", ") + "; ",
+                    data, res) && ok;
+    }
 
-        data.clear();
-        data[":I"   ] = key;
-        data[":X"   ] = x;
-        data[":Y"   ] = y;
-        data[":Z"   ] = z;
-        data[":Q"   ] = q;
-        data[":TYPE"] = tile.value("type");
-        data[":EXP" ] = tile.value("expires");
-        data[":DT"  ] = dt;
-        data[":TILE"] = tileid;
+    // при ошибке изображения пачки не считаются сохраненными, иначе следующие пачки
+    // запишут плитки со ссылками на отсутствующие в TileBlob изображения
+    if (!ok || !d->dc->commit()) {
+        if (!ok)
+            d->dc->rollback();
+        qWarning() << "Failed to save tiles" << rows.size();
+        errors = false;
+        return;
+    }
 
-        d_ptr->dc->execQuery(
-                    "INSERT OR REPLACE INTO Tiles (id, nx, ny, zoom, type, quadkey, inserttime, expires, tile) "
-                    "VALUES (:I, :X, :Y, :Z, :TYPE, :Q, :DT, :EXP, :TILE); ",
-                    data, res);
+    if (d->knownBlobs.size() + blobIds.size() > TilesDBPrivate::KnownBlobsLimit)
+        d->knownBlobs.clear();
+    foreach (const QString &id, blobIds)
+        d->knownBlobs.insert(id);
 
+    result.setValue(rows);
+    errors.clear();
+}
 
-    }
+// -----------------------------------------------------------------------------
+// найденная плитка
+struct FoundTile
+{
+    QVariant id;
+    QVariant tile;
+    QVariant expires;
+    QVariant etag;
+    QVariant modified;
+};
 
-    d_ptr->dc->commit();
+// выборка плиток пачкой: на уровень масштаба - запросы списком quadkey (порциями InsertChunk),
+// для промахов (общих для соседних плиток) поднимаемся к родителям до maxShift уровней
+static dc::QueryResult selectTiles(dc::DatabaseController *db, QList<minigis::TileKey> keys, int maxShift)
+{
+    using minigis::TileKey;
 
-    result.setValue(tiles);
-    errors.clear();
+    dc::QueryResult res;
+    QSet<quint64> answered;
+
+    for (int shift = 0; shift <= maxShift && !keys.isEmpty(); ++shift) {
+        QMap<int, QList<TileKey> > levels;
+        foreach (const TileKey &key, keys)
+            levels[key.z].append(key);
+
+        QList<TileKey> misses;
+        for (QMapIterator<int, QList<TileKey> > it(levels); it.hasNext(); ) {
+            it.next();
+            const QList<TileKey> &level = it.value();
+
+            // типы и quadkey уровня без повторов (qkey однозначно задает x, y, z)
+            QSet<int> types;
+            QSet<qint64> qkeys;
+            foreach (const TileKey &key, level) {
+                types.insert(key.type);
+                qkeys.insert(qint64(key.quadOrder()));
+            }
+
+            QVariantMap typeData;
+            QStringList typeBinds;
+            foreach (int type, types) {
+                QString name = QString(":T%1").arg(typeBinds.size());
+                typeBinds.append(name);
+                typeData[name] = type;
+            }
+
+            // запрошенные плитки - списком qkey по индексу (type, qkey): видимая область и
+            // кольцо упреждающей загрузки не тянут за собой изображения всего пути между ними
+            int z = it.key();
+            QHash<quint64, FoundTile> found;
+            QList<qint64> qkeyList = qkeys.toList();
+            for (int i = 0; i < qkeyList.size(); ) {
+                int chunk = insertChunk(qkeyList.size() - i);
+                QVariantMap data = typeData;
+                QStringList binds;
+                for (int j = 0; j < chunk; ++j, ++i) {
+                    QString name = QString(":Q%1").arg(j);
+                    binds.append(name);
+                    data[name] = qkeyList.at(i);
+                }
+
+                // строки читаются по номеру столбца, без промежуточных QVariantMap
+                db->execQueryEach(QString(
+                    "SELECT t.nx, t.ny, t.type, t.id, b.tile, t.expires, t.etag, t.lastmodified FROM Tiles AS t "
+                    "INNER JOIN TileBlob AS b ON t.tile = b.id "
+                    "WHERE t.type IN (%1) AND t.qkey IN (%2); "
+                    ).arg(typeBinds.join(", ")).arg(binds.join(", "))
+                    , data, [&found, z](const QSqlQuery &q) {
+                    FoundTile &t = found[TileKey(q.value(0).toInt(), q.value(1).toInt(), z, q.value(2).toInt()).hash()];
+                    t.id       = q.value(3);
+                    t.tile     = q.value(4);
+                    t.expires  = q.value(5);
+                    t.etag     = q.value(6);
+                    t.modified = q.value(7);
+                });
+            }
+
+            foreach (const TileKey &key, level) {
+                quint64 hash = key.hash();
+                if (answered.contains(hash))
+                    continue;
+                answered.insert(hash);
+
+                // отсутствующие плитки возвращаются без изображения
+                QVariantMap v;
+                QHash<quint64, FoundTile>::const_iterator f = found.constFind(hash);
+                if (f != found.constEnd()) {
+                    v["id"] = f->id;
+                    v["tile"] = f->tile;
+                    v["expires"] = f->expires;
+                    v["etag"] = f->etag;
+                    v["modified"] = f->modified;
+                }
+                v["x"] = key.x;
+                v["y"] = key.y;
+                v["z"] = key.z;
+                v["type"] = key.type;
+                v["shift"] = shift;
+                res.append(v);
+
+                if (v.value("tile").toByteArray().isNull() && key.z > 0)
+                    misses.append(TileKey(key.x >> 1, key.y >> 1, key.z - 1, key.type));
+            }
+        }
+        keys = misses;
+    }
+    return res;
 }
 
 // -----------------------------------------------------------------------------
@@ -227,67 +529,40 @@ void TilesDB::loadTiles(QVariant params, QVariant &result, QVariant &errors)
         return;
     }
 
-    d_ptr->dc->transaction();
-
-    dc::QueryResult res;
-
-    dc::QueryResult tmpRes;
-    QVariantMap data;
-
     QVariantMap p = params.value<QVariantMap>();
-    int maxShift = p.value("level").toInt();
-    int shift = 0;
-
-    QStringList types = p.value("type").toStringList();
-    while (shift <= maxShift) {
-
-        int x = p.value("x").toInt() >> shift;
-        int y = p.value("y").toInt() >> shift;
-        int z = p.value("z").toInt() - shift;
-
-        data[":X"] = x;
-        data[":Y"] = y;
-        data[":Z"] = z;
-
-        QString typesSum = types.join(",");
-        d_ptr->dc->execQuery(QString(
-            "SELECT t.id, b.tile, t.type, t.expires FROM Tiles AS t "
-            "INNER JOIN TileBlob AS b ON t.tile = b.id "
-            "WHERE t.nx = :X AND t.ny = :Y AND t.zoom = :Z AND t.type in (%1); "
-            ).arg(typesSum)
-            , data, tmpRes);
-
-        QVariantMap xyz;
-        xyz["x"] = x;
-        xyz["y"] = y;
-        xyz["z"] = z;
-        for (QMutableListIterator<QVariantMap> it(tmpRes); it.hasNext(); ) {
-            QVariantMap &v = it.next();
-            v.unite(xyz);
-            types.removeAll(v.value("type").toString());
-        }
-        foreach (QString const &t, types) {
-            QVariantMap v = xyz;
-            v["type"] = t;
-            tmpRes.append(v);
-        }
+    int x = p.value("x").toInt();
+    int y = p.value("y").toInt();
+    int z = p.value("z").toInt();
 
-        types.clear();
-        for (QListIterator<QVariantMap> it(tmpRes); it.hasNext(); ) {
-            QVariantMap v = it.next();
-            res.append(v);
+    QList<minigis::TileKey> keys;
+    foreach (const QString &type, p.value("type").toStringList())
+        keys.append(minigis::TileKey(x, y, z, type.toInt()));
 
-            QByteArray b = v.value("tile").toByteArray();
-            if (b.isNull())
-                types.append(v.value("type").toString());
-        }
+    d_ptr->dc->transaction();
+    dc::QueryResult res = selectTiles(d_ptr->dc, keys, p.value("level").toInt());
+    d_ptr->dc->commit();
 
-        if (types.isEmpty())
-            break;
+    result.setValue(res);
+    errors.clear();
+}
+
+// -----------------------------------------------------------------------------
+void TilesDB::loadTilesBatch(QVariant params, QVariant &result, QVariant &errors)
+{
+    if (params.isNull() || !params.canConvert<QVariantMap>()) {
+        errors = false;
+        return;
+    }
 
-        ++shift;
+    QVariantMap p = params.value<QVariantMap>();
+    QList<minigis::TileKey> keys;
+    foreach (const QVariant &k, p.value("keys").toList()) {
+        QVariantMap v = k.toMap();
+        keys.append(minigis::TileKey(v.value("x").toInt(), v.value("y").toInt(), v.value("z").toInt(), v.value("type").toInt()));
     }
 
+    d_ptr->dc->transaction();
+    dc::QueryResult res = selectTiles(d_ptr->dc, keys, p.value("level").toInt());
     d_ptr->dc->commit();
 
     result.setValue(res);
@@ -323,32 +598,39 @@ void TilesDB::loadQuadTile(QVariant params, QVariant &result, QVariant &errors)
 
     data.clear();
 
-    QString quad = p.value("quad").toString();
-    int minsize = quad.size();
-    data[":KEY"  ] = quad + "%";
-    data[":TYPE" ] = p.value("type");
-    data[":MIN"  ] = minsize;
-    data[":MAX"  ] = minsize + 6;
-    data[":SS"   ] = minsize + 1;
-    d_ptr->dc->execQuery(
-                "SELECT substr(quadkey, :SS) as key "
+    // плитка и потомки до 6 уровней ниже - один диапазон qkey
+    int x = p.value("x").toInt();
+    int y = p.value("y").toInt();
+    int z = p.value("z").toInt();
+    minigis::TileKey key(x, y, z);
+    data[":LO"  ] = qint64(key.quadOrder());
+    data[":HI"  ] = qint64(key.quadOrderLast());
+    data[":TYPE"] = p.value("type");
+    data[":MAX" ] = z + 6;
+    QVariantList tiles;
+    d_ptr->dc->execQueryEach(
+                "SELECT nx, ny, zoom "
                 "FROM Tiles "
-                "WHERE type = :TYPE AND quadkey LIKE :KEY "
-                "    AND length(quadkey) BETWEEN :MIN AND :MAX "
-                "ORDER BY length(quadkey);"
-                , data, res);
+                "WHERE type = :TYPE AND qkey BETWEEN :LO AND :HI AND zoom <= :MAX "
+                "ORDER BY zoom;"
+                , data, [&tiles, x, y, z](const QSqlQuery &q) {
+        // положение внутри исходной плитки
+        int dz = q.value(2).toInt() - z;
+        QVariantMap v;
+        v["x"] = q.value(0).toInt() - (x << dz);
+        v["y"] = q.value(1).toInt() - (y << dz);
+        v["z"] = dz;
+        tiles.append(v);
+    });
 
     d_ptr->dc->commit();
 
-    QStringList list;
-    for (QListIterator<QVariantMap> it(res); it.hasNext();) {
-        QVariantMap v = it.next();
-        list.append(v["key"].toString());
-    }
     QVariantMap vm;
     vm["tile" ] = tile;
-    vm["quads"] = list;
-    vm["quad" ] = quad;
+    vm["tiles"] = tiles;
+    vm["x"    ] = x;
+    vm["y"    ] = y;
+    vm["z"    ] = z;
     result.setValue(vm);
     errors.clear();
 }
@@ -1135,9 +1417,14 @@ void SearchesDB::loadHistory(QVariant params, QVariant &result, QVariant &errors
     QVariantMap data;
     data[":LIMIT" ] = vm.value("limit");
     data[":OFFSET"] = vm.value("offset");
-    d_ptr->dc->execQuery("SELECT request, inserttime FROM History "
-                         "ORDER BY inserttime DESC LIMIT :LIMIT OFFSET :OFFSET ",
-                         data, res);
+    d_ptr->dc->execQueryEach("SELECT request, inserttime FROM History "
+                             "ORDER BY inserttime DESC LIMIT :LIMIT OFFSET :OFFSET ",
+                             data, [&res](const QSqlQuery &q) {
+        QVariantMap v;
+        v["request"   ] = q.value(0);
+        v["inserttime"] = q.value(1);
+        res.append(v);
+    });
 
     result.setValue(res);
     errors.clear();
@@ -1190,8 +1477,15 @@ void SearchesDB::removeFavorite(QVariant params, QVariant &result, QVariant &err
          return;
      }
 
+     // один подготовленный запрос вместо подстановки идентификаторов в текст
      dc::QueryResult res;
-     d_ptr->dc->execQuery(QString("DELETE FROM Favorite WHERE id IN (%1); ").arg(QString("\'%1\'").arg(keys.join("\', \'"))), QVariantMap(), res);
+     QVariantMap data;
+     d_ptr->dc->transaction();
+     foreach (const QString &key, keys) {
+         data[":ID"] = key;
+         d_ptr->dc->execQuery("DELETE FROM Favorite WHERE id = :ID; ", data, res);
+     }
+     d_ptr->dc->commit();
      result.setValue(res);
      errors.clear();
 }
@@ -1209,9 +1503,16 @@ void SearchesDB::loadFavorites(QVariant params, QVariant &result, QVariant &erro
     QVariantMap data;
     data[":LIMIT" ] = vm.value("limit");
     data[":OFFSET"] = vm.value("offset");
-    d_ptr->dc->execQuery("SELECT id, title, description, x, y, x1, y1, x2, y2, inserttime FROM Favorite "
-                         "ORDER BY inserttime DESC LIMIT :LIMIT OFFSET :OFFSET ",
-                         data, res);
+    static const char *columns[] = { "id", "title", "description", "x", "y", "x1", "y1", "x2", "y2", "inserttime" };
+    static const int columnCount = sizeof(columns) / sizeof(columns[0]);
+    d_ptr->dc->execQueryEach("SELECT id, title, description, x, y, x1, y1, x2, y2, inserttime FROM Favorite "
+                             "ORDER BY inserttime DESC LIMIT :LIMIT OFFSET :OFFSET ",
+                             data, [&res](const QSqlQuery &q) {
+        QVariantMap v;
+        for (int i = 0; i < columnCount; ++i)
+            v[columns[i]] = q.value(i);
+        res.append(v);
+    });
 
     result.setValue(res);
     errors.clear();
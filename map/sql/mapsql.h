@@ -40,7 +40,9 @@ private slots:
     void insertTiles(QVariant params, QVariant &result, QVariant &errors);
     //! загрузить список плиток
     void loadTiles(QVariant params, QVariant &result, QVariant &errors);
-    //! загрузить список quadkey и плитку с минимальным quadkey
+    //! загрузить плитки пачкой (ключи x, y, z, type), с подъемом к родителям для промахов
+    void loadTilesBatch(QVariant params, QVariant &result, QVariant &errors);
+    //! загрузить плитку и положение ее потомков (до 6 уровней ниже)
     void loadQuadTile(QVariant params, QVariant &result, QVariant &errors);
     //! удалить перечень плиток у себя из БД
     void removeTiles(QVariant params, QVariant &result, QVariant &errors);
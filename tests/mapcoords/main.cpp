@@ -0,0 +1,576 @@
+#include <QCoreApplication>
+#include <QPointF>
+#include <QTextStream>
+#include <QVector>
+#include <QtMath>
+
+#include <map/coord/mapcoords.h>
+
+// проверка пакетных и поточечных преобразований координат
+// по формулам исходной (поточечной) реализации
+
+using namespace minigis;
+
+// -------------------------------------------------------
+
+namespace reference {
+
+// исходные формулы без изменений (ГОСТ Р 51794-2008), координаты отдельными числами
+
+void geoToRect(double b, double l, double h, double alpha, double a, double &x, double &y, double &z)
+{
+    double e = 2 * alpha - alpha * alpha;
+
+    double sinx = qSin(b);
+    double cosx = qCos(b);
+
+    double n = a / sqrt(1 - e * sinx * sinx);
+
+    x = (n + h) * cosx * qCos(l);
+    y = (n + h) * cosx * qSin(l);
+    z = ((1 - e) * n + h) * sinx;
+}
+
+void rectToGeo(double x, double y, double z, double alpha, double a, double &b, double &l, double &h)
+{
+    double end = 0.0001;
+    double d = sqrt(x * x + y * y);
+
+    double e = 2 * alpha - alpha * alpha;
+
+    if (qFuzzyIsNull(d)) {
+        if (qFuzzyIsNull(z))
+            b = 0;
+        else
+            b = z > 0 ? M_PI_2 : -M_PI_2;
+
+        l = 0;
+        double sinx = qSin(b);
+        h = z * sinx - a * sqrt(1 - e * sinx * sinx);
+    }
+    else {
+        double la = asin(y / d);
+        if (qFuzzyIsNull(y)) {
+            if (x > 0)
+                l = 0;
+            else
+                l = M_PI;
+        }
+        else if (y > 0) {
+            if (x > 0)
+                l = la;
+            else
+                l = M_PI - la;
+        }
+        else {
+            if (x > 0)
+                l = 2 * M_PI - la;
+            else
+                l = M_PI + la;
+        }
+
+        if (qFuzzyIsNull(z)) {
+            b = 0;
+            h = d - a;
+        }
+        else {
+            double r, c, p;
+            r = sqrt(x * x + y * y + z * z);
+            c = asin(z / r);
+            p = e * a / (2 * r);
+            double s1 = 0, s2 = 0, i_b = 0, i_d = 0;
+            end = secToRad(end);
+            do {
+                s1 = s2;
+                i_b = c + s1;
+                double sin_i = qSin(i_b);
+                s2 = asin(p * qSin(2 * i_b) / sqrt(1 - e * sin_i * sin_i));
+                i_d = qAbs(s2 - s1);
+            } while (i_d > end || qFuzzyCompare(i_d, end));
+            b = i_b;
+
+            double sinx = qSin(b);
+            h = d * qCos(b) + z * sinx - a * sqrt(1 - e * sinx * sinx);
+        }
+    }
+}
+
+void transformRect(double &x0, double &y0, double &z0, Coord dr, Coord ang, double m)
+{
+    double x = (1 + m) * x0 +   ang.z * y0 -   ang.y * z0 + dr.x;
+    double y =  -ang.z * x0 + (1 + m) * y0 +   ang.x * z0 + dr.y;
+    double z =   ang.y * x0 -   ang.x * y0 + (1 + m) * z0 + dr.z;
+    x0 = x;
+    y0 = y;
+    z0 = z;
+}
+
+// поправки Молоденского, ang в секундах
+void transformGeo(double &b, double &l, double &h, Coord dr, Coord ang, double m,
+                  double aa, double alpha_a, double ab, double alpha_b)
+{
+    double dB, dL, dH;
+    double p, da, de2, a, e2, N, M;
+
+    double ea = 2 * alpha_a - alpha_a * alpha_a;
+    double eb = 2 * alpha_b - alpha_b * alpha_b;
+
+    da = ab - aa;
+    de2 = eb - ea;
+    a = (ab + aa) / 2;
+    e2 = (eb + ea) / 2;
+
+    double sinx = qSin(b);
+    double cosx = qCos(b);
+    double siny = qSin(l);
+    double cosy = qCos(l);
+
+    double W = sqrt(1 - e2 * sinx * sinx);
+    M = a * (1 - e2) / (W * W * W);
+    N = a / W;
+    p = 206264.806;
+
+    dB = p / (M + h) * (N / a * e2 * sinx * cosx * da
+                        + (N * N / (a * a) + 1) * N * sinx * cosx * de2 / 2
+                        - (dr.x * cosy + dr.y * siny) * sinx + dr.z * cosx)
+            - ang.x * siny * (1 + e2 * qCos(2 * b)) + ang.y * cosy * (1 + e2 * qCos(2 * b))
+            - p * m * e2 * sinx * cosx;
+
+    dL = p / ((N + h) * cosx) * (-dr.x * siny + dr.y * cosy)
+            + tan(b) * (1 - e2) * (ang.x * cosy + ang.y * siny) - ang.z;
+
+    dH = -a / N * da + N * sinx * sinx * de2 / 2 + (dr.x * cosy + dr.y * siny)
+            * cosx + dr.z * sinx
+            - N * e2 * sinx * cosx * (ang.x / p * siny - ang.y / p * cosy)
+            + (a * a / N + h) * m;
+
+    b = b + secToRad(dB);
+    l = l + secToRad(dL);
+    h = h + dH;
+}
+
+// Гаусс-Крюгер в зоне n (любой, в том числе отрицательной)
+QPointF SKtoFlatZone(double b, double lon, int n)
+{
+    double Y = radToDeg(lon);
+    double l = (Y - (3 + 6 * (n - 1))) / 57.29577951;
+
+    double sinx  = qSin(b);
+    double sinx2 = sinx  * sinx;
+    double sinx4 = sinx2 * sinx2;
+    double sinx6 = sinx2 * sinx4;
+
+    double x = 6367558.4968 * b - qSin(2 * b) *
+        (16002.89   + 66.9607    * sinx2 + 0.3515   * sinx4
+         - l * l *
+        (1594561.25 + 5336.535   * sinx2 + 26.790   * sinx4 + 0.149  * sinx6
+         + l * l *
+        (672483.4   - 811219.9   * sinx2 + 5420.0   * sinx4 - 10.6   * sinx6
+         + l * l *
+        (278194     - 830174     * sinx2 + 572434   * sinx4 - 16010  * sinx6
+         + l * l *
+        (109500     - 574700     * sinx2 + 863700   * sinx4 - 398600 * sinx6)))));
+
+    double y = (5 + 10 * n) * 1e+5 + l * qCos(b) *
+        (6378245    + 21346.1415 * sinx2 + 107.1590 * sinx4 + 0.5977 * sinx6
+         + l * l *
+        (1070204.16 - 2136826.66 * sinx2 + 17.98    * sinx4 - 11.99  * sinx6
+         + l * l *
+        (270806     - 1523417    * sinx2 + 1327645  * sinx4 - 21701  * sinx6
+         + l * l *
+        (79690      - 866190     * sinx2 + 1730360  * sinx4 - 945460 * sinx6))));
+
+    return QPointF(x, y);
+}
+
+QPointF SKfromFlatZone(QPointF flat, int zone)
+{
+    double B, L;
+    double b0, dB;
+    double l, n, beta, z;
+    n = zone;
+    beta = double(flat.x()) / 6367558.4968;
+
+    double sinBeta  = qSin(beta);
+    double sinBeta2 = sinBeta * sinBeta;
+
+    b0 = beta + qSin(2 * beta) * (0.00252588685 - 0.0000149186 * sinBeta2 + 0.00000011904 * sinBeta2 * sinBeta2);
+
+    z = (double(flat.y()) - (10 * n + 5) * 1e+5) / (6378245 * qCos(b0));
+    double z2 = z * z;
+
+    double sinb  = qSin(b0);
+    double sinb2 = sinb  * sinb;
+    double sinb4 = sinb2 * sinb2;
+    double sinb6 = sinb2 * sinb4;
+
+    dB = - z2 * qSin(2 * b0) *
+         (0.251684631 - 0.003369263 * sinb2 + 0.000011276  * sinb4
+         - z2 *
+         (0.10500614  - 0.04559916  * sinb2 + 0.00228901   * sinb4 - 0.00002987  * sinb6
+         - z2 *
+         (0.042858    - 0.025318    * sinb2 + 0.014346     * sinb4 - 0.001264    * sinb6
+         - z2 *
+         (0.01672     - 0.0063      * sinb2 * 0.01188      * sinb4 - 0.00328     * sinb6))));
+
+    l = z *
+         (1          - 0.0033467108 * sinb2 - 0.0000056002 * sinb4 - 0.0000000187 * sinb6
+         - z2 *
+         (0.16778975 + 0.16273586   * sinb2 - 0.0005349    * sinb4 - 0.00000846   * sinb6
+         - z2 *
+         (0.0420025  + 0.1487407    * sinb2 + 0.005942     * sinb4 - 0.000015     * sinb6
+         - z2 *
+         (0.01225    + 0.09477      * sinb2 + 0.03282      * sinb4 - 0.00034      * sinb6
+         - z2 *
+         (0.0038     + 0.0524       * sinb2 + 0.0482       * sinb4 + 0.0032       * sinb6)))));
+
+    B = b0 + dB;
+    L = 6 * (n - 0.5) / 57.29577951 + l;
+    return QPointF(B, L);
+}
+
+// номера зон
+int zoneFromGeo(double lon)
+{
+    return int((6 + lon) / 6);
+}
+
+int zoneFromFlat(double y)
+{
+    return int(y * 1e-6);
+}
+
+// zone <= 0 - по долготе точки
+QPointF SKtoFlat(double b, double lon, int zone)
+{
+    return SKtoFlatZone(b, lon, zone > 0 ? zone : zoneFromGeo(radToDeg(lon)));
+}
+
+// zone <= 0 - по плоской ординате
+QPointF SKfromFlat(QPointF flat, int zone)
+{
+    return SKfromFlatZone(flat, zone > 0 ? zone : zoneFromFlat(flat.y()));
+}
+
+// сферический Меркатор
+const double EarthRadius = 6378137.;
+const double OriginDeg = M_PI * EarthRadius / 180.;
+
+QPointF latLonToMeters(const QPointF &latLon)
+{
+    qreal my = qLn(qTan(degToRad(90 + latLon.x()) * 0.5));
+    return QPointF(my * EarthRadius, latLon.y() * OriginDeg);
+}
+
+QPointF metersToLatLon(const QPointF &xy)
+{
+    qreal lon = xy.y() / OriginDeg;
+    qreal lat = xy.x() / OriginDeg;
+
+    lat = radToDeg(2 * qAtan(qExp(degToRad(lat))) - M_PI_2);
+    return QPointF(lat, lon);
+}
+
+} // namespace reference
+
+// -------------------------------------------------------
+
+namespace {
+
+QTextStream err(stderr);
+
+// сравнение с исходными формулами: допуск - погрешность округления
+struct Check
+{
+    QString set;
+    int failed;
+    qint64 checked;
+
+    void compare(const char *what, int i, double expected, double value)
+    {
+        ++checked;
+        if (qAbs(expected - value) <= 1e-12 * qMax(1., qAbs(expected)))
+            return;
+        if (++failed <= 10)
+            err << set << ": " << what << " [" << i << "] expected " << QString::number(expected, 'g', 17)
+                << ", got " << QString::number(value, 'g', 17) << endl;
+    }
+
+    void compare(const char *what, int i, const QPointF &expected, const QPointF &value)
+    {
+        compare(what, i, expected.x(), value.x());
+        compare(what, i, expected.y(), value.y());
+    }
+};
+
+// геодезические координаты (град): широта, долгота
+void check(Check &c, const QVector<QPointF> &geo)
+{
+    const int n = geo.size();
+    QVector<double> b(n), l(n), h(n);
+    for (int i = 0; i < n; ++i) {
+        b[i] = degToRad(geo.at(i).x());
+        l[i] = degToRad(geo.at(i).y());
+        h[i] = (i % 7) * 250.;
+    }
+
+    // геодезические - прямоугольные и обратно (Красовский)
+    QVector<double> x(n), y(n), z(n);
+    CoordinateSystem::geoToRect(b.constData(), l.constData(), h.constData(), x.data(), y.data(), z.data(),
+                                n, ParamsKrass::alpha, ParamsKrass::a);
+    for (int i = 0; i < n; ++i) {
+        double rx, ry, rz;
+        reference::geoToRect(b[i], l[i], h[i], ParamsKrass::alpha, ParamsKrass::a, rx, ry, rz);
+        Coord s = CoordinateSystem::geoToRect(Coord(b[i], l[i], h[i]), ParamsKrass::alpha, ParamsKrass::a);
+        c.compare("geoToRect x", i, rx, x[i]);
+        c.compare("geoToRect y", i, ry, y[i]);
+        c.compare("geoToRect z", i, rz, z[i]);
+        c.compare("geoToRect scalar x", i, rx, s.x);
+        c.compare("geoToRect scalar y", i, ry, s.y);
+        c.compare("geoToRect scalar z", i, rz, s.z);
+    }
+
+    QVector<double> rb(n), rl(n), rh(n);
+    CoordinateSystem::rectToGeo(x.constData(), y.constData(), z.constData(), rb.data(), rl.data(), rh.data(),
+                                n, ParamsKrass::alpha, ParamsKrass::a);
+    for (int i = 0; i < n; ++i) {
+        double eb, el, eh;
+        reference::rectToGeo(x[i], y[i], z[i], ParamsKrass::alpha, ParamsKrass::a, eb, el, eh);
+        c.compare("rectToGeo b", i, eb, rb[i]);
+        c.compare("rectToGeo l", i, el, rl[i]);
+        c.compare("rectToGeo h", i, eh, rh[i]);
+    }
+
+    // прямоугольные СК-42 - ПЗ-90.02 (на месте)
+    QVector<double> tx = x, ty = y, tz = z;
+    CoordinateSystem::transformRect(tx.data(), ty.data(), tz.data(), n,
+                                    TeSK42toPZ9002::dr, TeSK42toPZ9002::dAngRad, TeSK42toPZ9002::m);
+    for (int i = 0; i < n; ++i) {
+        double ex = x[i], ey = y[i], ez = z[i];
+        reference::transformRect(ex, ey, ez, TeSK42toPZ9002::dr, TeSK42toPZ9002::dAngRad, TeSK42toPZ9002::m);
+        c.compare("transformRect x", i, ex, tx[i]);
+        c.compare("transformRect y", i, ey, ty[i]);
+        c.compare("transformRect z", i, ez, tz[i]);
+    }
+
+    // геодезические СК-42 - ПЗ-90.02, Молоденский (на месте)
+    QVector<double> mb = b, ml = l, mh = h;
+    CoordinateSystem::transformGeo(mb.data(), ml.data(), mh.data(), n,
+                                   TeSK42toPZ9002::dr, TeSK42toPZ9002::dAngSec, TeSK42toPZ9002::m,
+                                   ParamsKrass::a, ParamsKrass::alpha, ParamsPz::a, ParamsPz::alpha);
+    for (int i = 0; i < n; ++i) {
+        double eb = b[i], el = l[i], eh = h[i];
+        reference::transformGeo(eb, el, eh, TeSK42toPZ9002::dr, TeSK42toPZ9002::dAngSec, TeSK42toPZ9002::m,
+                                ParamsKrass::a, ParamsKrass::alpha, ParamsPz::a, ParamsPz::alpha);
+        Coord s = CoordinateSystem::transformGeo(Coord(b[i], l[i], h[i]),
+                                                 TeSK42toPZ9002::dr, TeSK42toPZ9002::dAngSec, TeSK42toPZ9002::m,
+                                                 ParamsKrass::a, ParamsKrass::alpha, ParamsPz::a, ParamsPz::alpha);
+        c.compare("transformGeo b", i, eb, mb[i]);
+        c.compare("transformGeo l", i, el, ml[i]);
+        c.compare("transformGeo h", i, eh, mh[i]);
+        c.compare("transformGeo scalar b", i, eb, s.x);
+        c.compare("transformGeo scalar l", i, el, s.y);
+        c.compare("transformGeo scalar h", i, eh, s.z);
+    }
+
+    // Гаусс-Крюгер: зона по точке и заданная зона
+    for (int zone = 0; zone <= 7; zone += 7) {
+        QVector<double> fx(n), fy(n);
+        CoordinateSystem::SKtoFlat(b.constData(), l.constData(), fx.data(), fy.data(), n, zone);
+        for (int i = 0; i < n; ++i) {
+            QPointF e = reference::SKtoFlat(b[i], l[i], zone);
+            QPointF s = zone ? CoordinateSystem::SKtoFlat(Coord(b[i], l[i]), zone) : CoordinateSystem::SKtoFlat(Coord(b[i], l[i]));
+            c.compare("SKtoFlat", i, e, QPointF(fx[i], fy[i]));
+            c.compare("SKtoFlat scalar", i, e, s);
+        }
+
+        QVector<double> gb(n), gl(n);
+        CoordinateSystem::SKfromFlat(fx.constData(), fy.constData(), gb.data(), gl.data(), n, zone);
+        for (int i = 0; i < n; ++i) {
+            QPointF flat(fx[i], fy[i]);
+            QPointF e = reference::SKfromFlat(flat, zone);
+            QPointF s = zone ? CoordinateSystem::SKfromFlat(flat, zone) : CoordinateSystem::SKfromFlat(flat);
+            c.compare("SKfromFlat", i, e, QPointF(gb[i], gl[i]));
+            c.compare("SKfromFlat scalar", i, e, s);
+        }
+    }
+
+    // пакеты точек CoordTranform (SK-42 и мировые - на месте)
+    QVector<QPointF> sk(n);
+    CoordTranform::geoToSK42(geo.constData(), sk.data(), n);
+    QVector<QPointF> back = sk;
+    CoordTranform::sk42ToGeo(back.constData(), back.data(), n);
+    QVector<QPointF> world = geo;
+    CoordTranform::geoToWorld(world.constData(), world.data(), n);
+    QVector<QPointF> latLon(n);
+    CoordTranform::worldToGeo(world.constData(), latLon.data(), n);
+    for (int i = 0; i < n; ++i) {
+        QPointF e = reference::SKtoFlat(degToRad(geo.at(i).x()), degToRad(geo.at(i).y()), 0);
+        c.compare("geoToSK42", i, e, sk.at(i));
+        c.compare("geoToSK42 scalar", i, e, CoordTranform::geoToSK42(geo.at(i)));
+
+        e = radToDeg(reference::SKfromFlat(sk.at(i), 0));
+        c.compare("sk42ToGeo", i, e, back.at(i));
+        c.compare("sk42ToGeo scalar", i, e, CoordTranform::sk42ToGeo(sk.at(i)));
+
+        e = reference::latLonToMeters(geo.at(i));
+        c.compare("geoToWorld", i, e, world.at(i));
+        c.compare("geoToWorld scalar", i, e, CoordTranform::geoToWorld(geo.at(i)));
+
+        e = reference::metersToLatLon(world.at(i));
+        c.compare("worldToGeo", i, e, latLon.at(i));
+        c.compare("worldToGeo scalar", i, e, CoordTranform::worldToGeo(world.at(i)));
+    }
+}
+
+// зоны Гаусса-Крюгера: таблица постоянных, номера зон на границах (в том числе отрицательные),
+// преобразования в заданной зоне
+void checkZones(Check &c)
+{
+    const GaussKruger &gk = GaussKruger::inst();
+
+    // таблица и зоны вне ее - по исходным формулам постоянных
+    for (int n = GaussKruger::ZoneMin - 2; n <= GaussKruger::ZoneMax + 2; ++n) {
+        GaussKrugerZone z = gk.zone(n);
+        c.compare("zone meridian deg", n, 3 + 6 * (n - 1), z.meridianDeg);
+        c.compare("zone meridian rad", n, 6 * (n - 0.5) / 57.29577951, z.meridianRad);
+        c.compare("zone false easting", n, (5 + 10 * n) * 1e+5, z.falseEasting);
+    }
+
+    // номера зон на границах по долготе и по плоской ординате
+    QVector<QPointF> geo, flat;
+    for (int k = -32; k <= 32; ++k) {
+        geo << QPointF(55, 6 * k - 1e-9) << QPointF(55, 6 * k) << QPointF(55, 6 * k + 1e-9);
+        flat << QPointF(6e+6, k * 1e+6 - 1e-3) << QPointF(6e+6, k * 1e+6) << QPointF(6e+6, k * 1e+6 + 1e-3)
+             << QPointF(6e+6, k * 1e+6 + 5e+5);
+    }
+    QVector<int> zones(geo.size());
+    GaussKruger::zonesFromGeo(geo.constData(), zones.data(), geo.size());
+    for (int i = 0; i < geo.size(); ++i) {
+        double lon = geo.at(i).y();
+        c.compare("zoneFromGeo", i, reference::zoneFromGeo(lon), GaussKruger::zoneFromGeo(lon));
+        c.compare("zonesFromGeo", i, reference::zoneFromGeo(lon), zones.at(i));
+        c.compare("zoneSK42FromGeo", i, reference::zoneFromGeo(lon), CoordTranform::zoneSK42FromGeo(geo.at(i)));
+        QPointF world = reference::latLonToMeters(geo.at(i));
+        c.compare("zoneSK42FromWorld", i, reference::zoneFromGeo(world.y() / reference::OriginDeg),
+                  CoordTranform::zoneSK42FromWorld(world));
+    }
+    zones.resize(flat.size());
+    GaussKruger::zonesFromFlat(flat.constData(), zones.data(), flat.size());
+    for (int i = 0; i < flat.size(); ++i) {
+        double y = flat.at(i).y();
+        c.compare("zoneFromFlat", i, reference::zoneFromFlat(y), GaussKruger::zoneFromFlat(y));
+        c.compare("zonesFromFlat", i, reference::zoneFromFlat(y), zones.at(i));
+        c.compare("zoneSK42FromSK42", i, reference::zoneFromFlat(y), CoordTranform::zoneSK42FromSK42(flat.at(i)));
+    }
+
+    // заданная зона: точки по обе стороны осевого меридиана и за границами зоны
+    const double lats[] = { -60, -1e-9, 0, 1e-9, 45, 70 };
+    const double offsets[] = { -4, -3 - 1e-9, -3, -1e-9, 0, 1e-9, 3, 3 + 1e-9, 4 };
+    const int fixed[] = { -33, -32, -5, -1, 0, 1, 7, 30, 60, 64, 65 };
+    for (uint f = 0; f < sizeof(fixed) / sizeof(fixed[0]); ++f) {
+        int n = fixed[f];
+        QVector<QPointF> pts;
+        for (uint i = 0; i < sizeof(lats) / sizeof(lats[0]); ++i)
+            for (uint j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j)
+                pts << QPointF(lats[i], 3 + 6 * (n - 1) + offsets[j]);
+
+        // контекст зоны: любая зона, в том числе отрицательная
+        GaussKrugerZone z = gk.zone(n);
+        for (int i = 0; i < pts.size(); ++i) {
+            double b = degToRad(pts.at(i).x());
+            double l = degToRad(pts.at(i).y());
+            QPointF e = reference::SKtoFlatZone(b, l, n);
+            double x, y;
+            GaussKruger::toFlat(b, l, z, x, y);
+            c.compare("GaussKruger::toFlat", i, e, QPointF(x, y));
+            c.compare("SKtoFlat zone scalar", i, e, CoordinateSystem::SKtoFlat(Coord(b, l), n));
+
+            QPointF eb = reference::SKfromFlatZone(e, n);
+            GaussKruger::fromFlat(e.x(), e.y(), z, b, l);
+            c.compare("GaussKruger::fromFlat", i, eb, QPointF(b, l));
+            c.compare("SKfromFlat zone scalar", i, eb, CoordinateSystem::SKfromFlat(e, n));
+        }
+
+        // CoordTransformer: зона задается только положительной, иначе - по каждой точке;
+        // поточечные функции CoordTranform с зоной - любая зона как есть
+        int zone = qMax(0, n);
+        QVector<QPointF> world(pts.size());
+        for (int i = 0; i < pts.size(); ++i)
+            world[i] = reference::latLonToMeters(pts.at(i));
+
+        CoordTransformer geoToSK(CoordTransformer::Geo, CoordTransformer::SK42, n);
+        CoordTransformer worldToSK(CoordTransformer::World, CoordTransformer::SK42, n);
+        CoordTransformer skToGeo(CoordTransformer::SK42, CoordTransformer::Geo, n);
+        CoordTransformer skToWorld(CoordTransformer::SK42, CoordTransformer::World, n);
+        c.compare("CoordTransformer zone", n, zone, geoToSK.zone());
+
+        QVector<QPointF> sk(pts.size()), fromWorld(pts.size()), back(pts.size()), backWorld(pts.size());
+        geoToSK.map(pts.constData(), sk.data(), pts.size());
+        worldToSK.map(world.constData(), fromWorld.data(), pts.size());
+        skToGeo.map(sk.constData(), back.data(), pts.size());
+        skToWorld.map(sk.constData(), backWorld.data(), pts.size());
+        for (int i = 0; i < pts.size(); ++i) {
+            QPointF e = reference::SKtoFlat(degToRad(pts.at(i).x()), degToRad(pts.at(i).y()), zone);
+            c.compare("fixed geoToSK42", i, e, sk.at(i));
+            c.compare("fixed geoToSK42 point", i, e, geoToSK.map(pts.at(i)));
+            c.compare("fixed geoToSK42 scalar", i, reference::SKtoFlatZone(degToRad(pts.at(i).x()), degToRad(pts.at(i).y()), n),
+                      CoordTranform::geoToSK42(pts.at(i), n));
+
+            QPointF latLon = reference::metersToLatLon(world.at(i));
+            e = reference::SKtoFlat(degToRad(latLon.x()), degToRad(latLon.y()), zone);
+            c.compare("fixed worldToSK42", i, e, fromWorld.at(i));
+            c.compare("fixed worldToSK42 scalar", i, reference::SKtoFlatZone(degToRad(latLon.x()), degToRad(latLon.y()), n),
+                      CoordTranform::worldToSK42(world.at(i), n));
+
+            e = radToDeg(reference::SKfromFlat(sk.at(i), zone));
+            c.compare("fixed sk42ToGeo", i, e, back.at(i));
+            c.compare("fixed sk42ToGeo scalar", i, radToDeg(reference::SKfromFlatZone(sk.at(i), n)),
+                      CoordTranform::sk42ToGeo(sk.at(i), n));
+
+            e = reference::latLonToMeters(e);
+            c.compare("fixed sk42ToWorld", i, e, backWorld.at(i));
+            c.compare("fixed sk42ToWorld scalar", i, reference::latLonToMeters(radToDeg(reference::SKfromFlatZone(sk.at(i), n))),
+                      CoordTranform::sk42ToWorld(sk.at(i), n));
+        }
+    }
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // границы и осевые меридианы зон, экватор и высокие широты
+    QVector<QPointF> edges;
+    const double lats[] = { -80, -45, -1e-9, 0, 1e-9, 30, 55.75, 80 };
+    for (uint i = 0; i < sizeof(lats) / sizeof(lats[0]); ++i)
+        for (int k = -2; k <= 30; ++k) {
+            edges << QPointF(lats[i], 6 * k - 1e-9) << QPointF(lats[i], 6 * k)
+                  << QPointF(lats[i], 6 * k + 1e-9) << QPointF(lats[i], 6 * k + 3);
+        }
+
+    // большой пакет - расчет в нескольких потоках
+    QVector<QPointF> bulk;
+    qsrand(22);
+    for (int i = 0; i < 100000; ++i)
+        bulk << QPointF(qrand() * 160. / RAND_MAX - 80, qrand() * 200. / RAND_MAX - 20);
+
+    Check c1 = { "zone edges", 0, 0 };
+    check(c1, edges);
+    Check c2 = { "bulk", 0, 0 };
+    check(c2, bulk);
+    Check c3 = { "gauss-kruger zones", 0, 0 };
+    checkZones(c3);
+
+    QTextStream out(stdout);
+    out << c1.set << ": " << c1.checked << " values, " << c1.failed << " failed" << endl;
+    out << c2.set << ": " << c2.checked << " values, " << c2.failed << " failed" << endl;
+    out << c3.set << ": " << c3.checked << " values, " << c3.failed << " failed" << endl;
+    return c1.failed || c2.failed || c3.failed ? 1 : 0;
+}
+
+// -------------------------------------------------------
@@ -0,0 +1,90 @@
+#ifndef LOADERSPY_H
+#define LOADERSPY_H
+
+#include <QObject>
+#include <QImage>
+#include <QPoint>
+#include <QVariant>
+
+// -------------------------------------------------------
+
+// сигналы загрузчика тайлов и ответы бд
+class LoaderSpy : public QObject
+{
+    Q_OBJECT
+public:
+    struct Event
+    {
+        QPoint tile;       //!< x, y
+        int z;
+        int expires;
+        QByteArray etag;
+    };
+
+    QList<Event> images;
+    QList<Event> notModified;
+    QList<Event> validators;
+    QList<Event> errors;
+    int dbReplies;
+
+    LoaderSpy() : dbReplies(0) {}
+
+    void clear()
+    {
+        images.clear();
+        notModified.clear();
+        validators.clear();
+        errors.clear();
+    }
+
+    static bool contains(const QList<Event> &list, int x, int y, int z)
+    {
+        foreach (const Event &e, list)
+            if (e.tile == QPoint(x, y) && e.z == z)
+                return true;
+        return false;
+    }
+
+public slots:
+    void imageReady(QImage img, int x, int y, int z, int, int expires)
+    {
+        if (!img.isNull())
+            images.append(event(x, y, z, expires));
+    }
+
+    void tileNotModified(int x, int y, int z, int, int expires)
+    {
+        notModified.append(event(x, y, z, expires));
+    }
+
+    void tileValidators(int x, int y, int z, int, QByteArray etag, QByteArray)
+    {
+        Event e = event(x, y, z, 0);
+        e.etag = etag;
+        validators.append(e);
+    }
+
+    void errorKey(int x, int y, int z, int)
+    {
+        errors.append(event(x, y, z, 0));
+    }
+
+    void dbFinished(uint, QVariant, QVariant)
+    {
+        ++dbReplies;
+    }
+
+private:
+    static Event event(int x, int y, int z, int expires)
+    {
+        Event e;
+        e.tile = QPoint(x, y);
+        e.z = z;
+        e.expires = expires;
+        return e;
+    }
+};
+
+// -------------------------------------------------------
+
+#endif // LOADERSPY_H
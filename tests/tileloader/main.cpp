@@ -0,0 +1,299 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <functional>
+
+#include <db/databasecontroller.h>
+#include <map/loaders/maptileloader.h>
+#include <map/sql/mapsql.h>
+
+#include "loaderspy.h"
+#include "stubserver.h"
+
+// проверка http-загрузчика тайлов на локальном сервере:
+// условные запросы (ETag, 304) с продлением срока в Tiles, очередь запросов к серверу, отмена
+
+using namespace minigis;
+
+// -------------------------------------------------------
+
+namespace {
+
+const int TileType = 200;
+
+QTextStream out(stdout);
+int failed = 0;
+
+#define CHECK(cond)                                                        \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            ++failed;                                                      \
+            out << "FAIL " << __LINE__ << ": " << #cond << endl;           \
+        }                                                                  \
+    } while (0)
+
+// ожидание условия с обработкой событий
+bool waitFor(const std::function<bool()> &cond, int msecs = 5000)
+{
+    QElapsedTimer t;
+    t.start();
+    while (!cond() && t.elapsed() < msecs)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    return cond();
+}
+
+// пауза с обработкой событий (ответов, которых быть не должно)
+void idle(int msecs)
+{
+    waitFor([]() { return false; }, msecs);
+}
+
+MapTileLoaderHttp *createLoader(StubServer &server, LoaderSpy &spy)
+{
+    QString url = QString("http://127.0.0.1:%1/{z}/{x}/{y}.png").arg(server.serverPort());
+    MapTileLoaderHttp *loader = new MapTileLoaderHttpTempl(url, "stub", "png", TileType, false, false);
+    loader->init(NULL);
+    QObject::connect(loader, SIGNAL(imageReady(QImage,int,int,int,int,int)), &spy, SLOT(imageReady(QImage,int,int,int,int,int)));
+    QObject::connect(loader, SIGNAL(tileNotModified(int,int,int,int,int)), &spy, SLOT(tileNotModified(int,int,int,int,int)));
+    QObject::connect(loader, SIGNAL(tileValidators(int,int,int,int,QByteArray,QByteArray)), &spy, SLOT(tileValidators(int,int,int,int,QByteArray,QByteArray)));
+    QObject::connect(loader, SIGNAL(errorKey(int,int,int,int)), &spy, SLOT(errorKey(int,int,int,int)));
+    return loader;
+}
+
+// строки на сохранение, как у MapLayerTile
+void saveTiles(dc::DatabaseController &db, LoaderSpy &spy, const dc::QueryResult &rows)
+{
+    int replies = spy.dbReplies;
+    db.postRequest("insTiles", QVariant::fromValue<dc::QueryResult>(rows), dc::NormalPriority, &spy, "dbFinished");
+    CHECK(waitFor([&]() { return spy.dbReplies > replies; }));
+}
+
+// сохраненная строка Tiles и изображение
+struct StoredTile
+{
+    qint64 rowid;
+    qint64 expires;
+    QString blob;
+    qint64 blobRowid;
+    int blobs;
+};
+
+StoredTile stored(QSqlDatabase &check, int x, int y, int z)
+{
+    StoredTile t = { -1, -1, QString(), -1, 0 };
+    QSqlQuery q(check);
+    q.prepare("SELECT t.rowid, t.expires, t.tile, b.rowid FROM Tiles AS t INNER JOIN TileBlob AS b ON t.tile = b.id "
+              "WHERE t.nx = :X AND t.ny = :Y AND t.zoom = :Z AND t.type = :TYPE;");
+    q.bindValue(":X", x);
+    q.bindValue(":Y", y);
+    q.bindValue(":Z", z);
+    q.bindValue(":TYPE", TileType);
+    if (q.exec() && q.next()) {
+        t.rowid = q.value(0).toLongLong();
+        t.expires = q.value(1).toLongLong();
+        t.blob = q.value(2).toString();
+        t.blobRowid = q.value(3).toLongLong();
+    }
+    if (q.exec("SELECT COUNT(*) FROM TileBlob;") && q.next())
+        t.blobs = q.value(0).toInt();
+    return t;
+}
+
+// -------------------------------------------------------
+
+// 200 с ETag, затем 304: срок в Tiles продлевается, изображение не перезаписывается
+void testRevalidation(StubServer &server, dc::DatabaseController &db, QSqlDatabase &check)
+{
+    LoaderSpy spy;
+    MapTileLoaderHttp *loader = createLoader(server, spy);
+    uint now = QDateTime::currentDateTimeUtc().toTime_t();
+
+    server.reset();
+    server.etag = "\"v1\"";
+    server.expires = now + 60;
+    loader->getTile(1, 2, 3);
+    CHECK(waitFor([&]() { return LoaderSpy::contains(spy.images, 1, 2, 3); }));
+    CHECK(spy.validators.size() == 1 && spy.validators.value(0).etag == server.etag);
+    CHECK(spy.images.value(0).expires == int(server.expires));
+
+    QVariantMap row;
+    row["x"] = 1;
+    row["y"] = 2;
+    row["z"] = 3;
+    row["type"] = TileType;
+    row["tile"] = server.png;
+    row["expires"] = spy.images.value(0).expires;
+    row["etag"] = spy.validators.value(0).etag;
+    saveTiles(db, spy, dc::QueryResult() << row);
+    StoredTile before = stored(check, 1, 2, 3);
+    CHECK(before.rowid >= 0 && before.expires == server.expires);
+
+    // срок истек: запрос с валидатором, ответ 304 с новым Expires
+    server.notModifiedExpires = now + 3600;
+    loader->setTileValidators(1, 2, 3, server.etag, QByteArray());
+    loader->getTile(1, 2, 3);
+    CHECK(waitFor([&]() { return LoaderSpy::contains(spy.notModified, 1, 2, 3); }));
+    CHECK(server.ifNoneMatch.value(1) == server.etag);
+    CHECK(server.notModified == 1);
+    CHECK(spy.images.size() == 1);
+    CHECK(spy.notModified.value(0).expires == int(server.notModifiedExpires));
+
+    QVariantMap update;
+    update["x"] = 1;
+    update["y"] = 2;
+    update["z"] = 3;
+    update["type"] = TileType;
+    update["expires"] = spy.notModified.value(0).expires;
+    update["notModified"] = true;
+    saveTiles(db, spy, dc::QueryResult() << update);
+    StoredTile after = stored(check, 1, 2, 3);
+    CHECK(after.expires == server.notModifiedExpires);
+    CHECK(after.expires > before.expires);
+    CHECK(after.rowid == before.rowid);
+    CHECK(after.blob == before.blob);
+    CHECK(after.blobRowid == before.blobRowid);
+    CHECK(after.blobs == before.blobs);
+
+    // 304 без Expires: срок по умолчанию, а не 0 (бессрочный)
+    server.notModifiedExpires = 0;
+    loader->setTileValidators(1, 2, 3, server.etag, QByteArray());
+    loader->getTile(1, 2, 3);
+    CHECK(waitFor([&]() { return spy.notModified.size() == 2; }));
+    int defaultExpires = spy.notModified.value(1).expires;
+    CHECK(defaultExpires >= int(now + MapTileLoaderHttp::NotModifiedTtl));
+
+    update["expires"] = defaultExpires;
+    saveTiles(db, spy, dc::QueryResult() << update);
+    CHECK(stored(check, 1, 2, 3).expires == defaultExpires);
+
+    // строка 304 без срока оставляет прежний
+    update["expires"] = 0;
+    saveTiles(db, spy, dc::QueryResult() << update);
+    StoredTile kept = stored(check, 1, 2, 3);
+    CHECK(kept.expires == defaultExpires);
+    CHECK(kept.blobs == before.blobs);
+
+    loader->done();
+    delete loader;
+}
+
+// не больше hostLimit запросов к серверу одновременно, остальные ждут и уходят по мере ответов
+void testHostQueue(StubServer &server)
+{
+    LoaderSpy spy;
+    MapTileLoaderHttp *loader = createLoader(server, spy);
+    loader->setHostLimit(2);
+
+    server.reset();
+    server.etag.clear();
+    server.delay = 100;
+    for (int x = 0; x < 6; ++x)
+        loader->getTile(x, 0, 4);
+    CHECK(waitFor([&]() { return spy.images.size() == 6; }));
+    CHECK(server.paths.size() == 6);
+    CHECK(server.maxOutstanding == 2);
+    CHECK(spy.errors.isEmpty());
+
+    server.delay = 0;
+    loader->done();
+    delete loader;
+}
+
+// отмена: ожидающий запрос не отправляется, отправленный прерывается, ответов на них нет
+void testCancel(StubServer &server)
+{
+    LoaderSpy spy;
+    MapTileLoaderHttp *loader = createLoader(server, spy);
+    loader->setHostLimit(1);
+
+    server.reset();
+    server.delay = 100;
+    loader->getTile(10, 0, 5);
+    loader->getTile(11, 0, 5);
+    loader->getTile(12, 0, 5);
+    loader->cancelTile(11, 0, 5);
+    CHECK(waitFor([&]() { return spy.images.size() == 2; }));
+    CHECK(LoaderSpy::contains(spy.images, 10, 0, 5));
+    CHECK(LoaderSpy::contains(spy.images, 12, 0, 5));
+    CHECK(!server.paths.contains("/5/11/0.png"));
+
+    loader->getTile(13, 0, 5);
+    CHECK(waitFor([&]() { return server.paths.contains("/5/13/0.png"); }));
+    loader->cancelTile(13, 0, 5);
+    idle(300);
+    CHECK(!LoaderSpy::contains(spy.images, 13, 0, 5));
+    CHECK(spy.errors.isEmpty());
+
+    // после отмены очередь сервера свободна
+    loader->getTile(14, 0, 5);
+    CHECK(waitFor([&]() { return LoaderSpy::contains(spy.images, 14, 0, 5); }));
+
+    server.delay = 0;
+    loader->done();
+    delete loader;
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    StubServer server;
+    if (!server.listen(QHostAddress::LocalHost)) {
+        out << "stub server: " << server.errorString() << endl;
+        return 1;
+    }
+    QImage img(256, 256, QImage::Format_ARGB32);
+    img.fill(Qt::darkGreen);
+    QBuffer buffer(&server.png);
+    buffer.open(QIODevice::WriteOnly);
+    img.save(&buffer, "PNG");
+
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/tiles.sqlite";
+    dc::DatabaseController *db = new dc::DatabaseController;
+    QVariantMap connData;
+    connData["name"] = fileName;
+    QString error;
+    if (!db->init("QSQLITE", connData, &error)) {
+        out << "database: " << error << endl;
+        return 1;
+    }
+    TilesDB *tileDB = new TilesDB;
+    tileDB->setDc(db);
+    {
+        LoaderSpy spy;
+        db->postRequest("create", QVariant(), dc::RealTimePriority, &spy, "dbFinished");
+        CHECK(waitFor([&]() { return spy.dbReplies > 0; }));
+    }
+
+    {
+        QSqlDatabase check = QSqlDatabase::addDatabase("QSQLITE", "check");
+        check.setDatabaseName(fileName);
+        CHECK(check.open());
+
+        testRevalidation(server, *db, check);
+        testHostQueue(server);
+        testCancel(server);
+
+        check.close();
+    }
+    QSqlDatabase::removeDatabase("check");
+
+    delete db;
+    delete tileDB;
+
+    out << (failed ? "FAILED " : "OK ") << failed << endl;
+    return failed ? 1 : 0;
+}
+
+// -------------------------------------------------------
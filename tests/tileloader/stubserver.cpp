@@ -0,0 +1,105 @@
+#include <QDateTime>
+#include <QLocale>
+#include <QPointer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "stubserver.h"
+
+// -------------------------------------------------------
+
+namespace {
+
+QByteArray httpDate(uint t)
+{
+    return QLocale("en").toString(QDateTime::fromTime_t(t).toUTC(), "ddd, dd MMM yyyy HH:mm:ss 'GMT'").toLatin1();
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+StubServer::StubServer(QObject *parent)
+    : QTcpServer(parent), expires(0), notModifiedExpires(0), delay(0)
+{
+    reset();
+}
+
+void StubServer::reset()
+{
+    paths.clear();
+    ifNoneMatch.clear();
+    outstanding = 0;
+    maxOutstanding = 0;
+    notModified = 0;
+}
+
+void StubServer::incomingConnection(qintptr handle)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    socket->setSocketDescriptor(handle);
+    connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { buffers.remove(socket); });
+    connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+}
+
+void StubServer::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket)
+        return;
+
+    // в одном соединении запросы идут друг за другом (keep-alive), тела у GET нет
+    QByteArray &buffer = buffers[socket];
+    buffer += socket->readAll();
+    int end;
+    while ((end = buffer.indexOf("\r\n\r\n")) >= 0) {
+        QList<QByteArray> lines = buffer.left(end).split('\n');
+        buffer.remove(0, end + 4);
+
+        QList<QByteArray> request = lines.value(0).trimmed().split(' ');
+        paths.append(QString::fromLatin1(request.value(1)));
+        QByteArray match;
+        for (int i = 1; i < lines.size(); ++i) {
+            QByteArray line = lines.at(i).trimmed();
+            if (line.toLower().startsWith("if-none-match:"))
+                match = line.mid(14).trimmed();
+        }
+        ifNoneMatch.append(match);
+
+        maxOutstanding = qMax(maxOutstanding, ++outstanding);
+        QPointer<QTcpSocket> guard(socket);
+        QTimer::singleShot(delay, this, [this, guard, match]() {
+            --outstanding;
+            if (guard)
+                respond(guard, match);
+        });
+    }
+}
+
+void StubServer::respond(QTcpSocket *socket, const QByteArray &match)
+{
+    QByteArray head;
+    QByteArray body;
+    if (!etag.isEmpty() && match == etag) {
+        ++notModified;
+        head = "HTTP/1.1 304 Not Modified\r\n";
+        head += "ETag: " + etag + "\r\n";
+        if (notModifiedExpires)
+            head += "Expires: " + httpDate(notModifiedExpires) + "\r\n";
+    }
+    else {
+        body = png;
+        head = "HTTP/1.1 200 OK\r\n";
+        head += "Content-Type: image/png\r\n";
+        if (!etag.isEmpty())
+            head += "ETag: " + etag + "\r\n";
+        if (expires)
+            head += "Expires: " + httpDate(expires) + "\r\n";
+    }
+    head += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    head += "Connection: keep-alive\r\n\r\n";
+    socket->write(head + body);
+}
+
+// -------------------------------------------------------
@@ -0,0 +1,48 @@
+#ifndef STUBSERVER_H
+#define STUBSERVER_H
+
+#include <QTcpServer>
+#include <QStringList>
+#include <QHash>
+
+class QTcpSocket;
+
+// -------------------------------------------------------
+
+// HTTP-сервер тайлов для проверки загрузчика: любой путь - png,
+// ETag и условные запросы (304), ответы с задержкой для проверки очереди сервера
+class StubServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit StubServer(QObject *parent = 0);
+
+    QByteArray png;              //!< тело ответа 200
+    QByteArray etag;             //!< ETag ответа 200 (пустой - без ETag)
+    uint expires;                //!< Expires ответа 200 (0 - без заголовка)
+    uint notModifiedExpires;     //!< Expires ответа 304 (0 - без заголовка)
+    int delay;                   //!< задержка ответа (мс)
+
+    QStringList paths;           //!< пути полученных запросов
+    QList<QByteArray> ifNoneMatch; //!< If-None-Match полученных запросов
+    int outstanding;             //!< запросы без ответа
+    int maxOutstanding;          //!< максимум запросов без ответа
+    int notModified;             //!< отправлено ответов 304
+
+    void reset();
+
+protected:
+    void incomingConnection(qintptr handle);
+
+private slots:
+    void readRequest();
+
+private:
+    void respond(QTcpSocket *socket, const QByteArray &match);
+
+    QHash<QTcpSocket*, QByteArray> buffers;
+};
+
+// -------------------------------------------------------
+
+#endif // STUBSERVER_H
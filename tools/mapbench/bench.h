@@ -0,0 +1,36 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+namespace minigis {
+class MapObject;
+class MapDrawer;
+}
+
+// -------------------------------------------------------
+
+// вывод результата замера: количество операций и время на операцию
+void benchReport(const QString &name, qint64 ops, qint64 nsecs);
+
+// -------------------------------------------------------
+
+// отрезки длиной 500 м со случайным началом в квадрате 2000 км (Меркатор)
+QList<minigis::MapObject *> benchLines(int n, minigis::MapDrawer *drawer);
+
+// -------------------------------------------------------
+
+// сценарии замеров, возвращают код завершения программы
+int benchStatements(const QStringList &args);
+int benchRTreeBuild(const QStringList &args);
+int benchRTreeQuery(const QStringList &args);
+int benchRTreeKernel(const QStringList &args);
+int benchRTreeMoves(const QStringList &args);
+int benchArrows(const QStringList &args);
+int benchTileDecode(const QStringList &args);
+
+// -------------------------------------------------------
+
+#endif // BENCH_H
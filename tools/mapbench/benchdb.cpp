@@ -0,0 +1,198 @@
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSqlQuery>
+#include <QTextStream>
+
+#include <db/databasecontroller.h>
+
+#include "bench.h"
+#include "benchdb.h"
+
+// -------------------------------------------------------
+
+namespace {
+
+const char *PointQuery = "SELECT v FROM Bench WHERE id = :I;";
+const char *RangeQuery = "SELECT id, v FROM Bench WHERE id BETWEEN :I0 AND :I1;";
+const int RangeRows = 256;
+
+void append(QVariantList &out, const QString &name, qint64 ops, qint64 nsecs)
+{
+    QVariantMap v;
+    v["name"] = name;
+    v["ops"] = ops;
+    v["nsecs"] = nsecs;
+    out.append(v);
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+StatementBench::StatementBench(dc::DatabaseController *db)
+    : QObject(), db(db)
+{
+}
+
+void StatementBench::run(QVariant params, QVariant &result, QVariant &errors)
+{
+    int rows = qMax(RangeRows, params.toInt());
+    QVariantMap data;
+    dc::QueryResult res;
+
+    db->execQuery("CREATE TABLE Bench (id INTEGER PRIMARY KEY, v INTEGER);", data, res);
+    db->transaction();
+    for (int i = 0; i < rows; ++i) {
+        data[":I"] = i;
+        data[":V"] = i * 7;
+        db->execQuery("INSERT INTO Bench (id, v) VALUES (:I, :V);", data, res);
+    }
+    db->commit();
+
+    QVariantList out;
+    qint64 check = 0;
+    QElapsedTimer t;
+
+    // точечные запросы: подготовка на каждый вызов (прежний execQuery) и из кэша
+    t.start();
+    for (int i = 0; i < rows; ++i) {
+        QSqlQuery q(*db->database());
+        q.setForwardOnly(true);
+        q.prepare(PointQuery);
+        q.bindValue(":I", i);
+        q.exec();
+        while (q.next())
+            check += q.value(0).toLongLong();
+    }
+    append(out, "point: prepare each", rows, t.nsecsElapsed());
+
+    data.clear();
+    t.start();
+    for (int i = 0; i < rows; ++i) {
+        data[":I"] = i;
+        db->execQuery(PointQuery, data, res);
+        check += res.first().value("v").toLongLong();
+    }
+    append(out, "point: cached, QueryResult", rows, t.nsecsElapsed());
+
+    dc::QueryRows r;
+    t.start();
+    for (int i = 0; i < rows; ++i) {
+        data[":I"] = i;
+        db->execQuery(PointQuery, data, r);
+        check += r.first().at(0).toLongLong();
+    }
+    append(out, "point: cached, QueryRows", rows, t.nsecsElapsed());
+
+    t.start();
+    for (int i = 0; i < rows; ++i) {
+        data[":I"] = i;
+        db->execQueryEach(PointQuery, data, [&check](const QSqlQuery &q) {
+            check += q.value(0).toLongLong();
+        });
+    }
+    append(out, "point: cached, each", rows, t.nsecsElapsed());
+
+    // выборки диапазонов: разбор результата
+    int ranges = rows / RangeRows;
+    data.clear();
+    t.start();
+    for (int i = 0; i < ranges; ++i) {
+        data[":I0"] = i * RangeRows;
+        data[":I1"] = (i + 1) * RangeRows - 1;
+        db->execQuery(RangeQuery, data, res);
+        foreach (const QVariantMap &row, res)
+            check += row.value("v").toLongLong();
+    }
+    append(out, "range: QueryResult (rows)", ranges * RangeRows, t.nsecsElapsed());
+
+    t.start();
+    for (int i = 0; i < ranges; ++i) {
+        data[":I0"] = i * RangeRows;
+        data[":I1"] = (i + 1) * RangeRows - 1;
+        db->execQuery(RangeQuery, data, r);
+        foreach (const dc::QueryRow &row, r)
+            check += row.at(1).toLongLong();
+    }
+    append(out, "range: QueryRows (rows)", ranges * RangeRows, t.nsecsElapsed());
+
+    t.start();
+    for (int i = 0; i < ranges; ++i) {
+        data[":I0"] = i * RangeRows;
+        data[":I1"] = (i + 1) * RangeRows - 1;
+        db->execQueryEach(RangeQuery, data, [&check](const QSqlQuery &q) {
+            check += q.value(1).toLongLong();
+        });
+    }
+    append(out, "range: each (rows)", ranges * RangeRows, t.nsecsElapsed());
+
+    // вытеснение: внутри execQueryEach выполняются запросы с разным текстом (вдвое больше кэша),
+    // выполняемый запрос при этом не должен удаляться
+    int inner = 0;
+    data[":I0"] = 0;
+    data[":I1"] = RangeRows - 1;
+    t.start();
+    db->execQueryEach(RangeQuery, data, [this, &check, &inner](const QSqlQuery &q) {
+        for (int k = 0; k < 2 * dc::DatabaseController::StatementCacheSize; ++k, ++inner) {
+            QVariantMap d;
+            d[":I"] = q.value(0);
+            dc::QueryRows rr;
+            db->execQuery(QString("SELECT v + %1 FROM Bench WHERE id = :I;").arg(k), d, rr);
+            check += rr.first().at(0).toLongLong();
+        }
+    });
+    append(out, "eviction inside each", inner, t.nsecsElapsed());
+
+    QVariantMap v;
+    v["check"] = check;
+    out.append(v);
+    result = out;
+    errors.clear();
+}
+
+// -------------------------------------------------------
+
+void BenchReceiver::done(uint /*query*/, QVariant result, QVariant /*errors*/)
+{
+    this->result = result;
+    emit finished();
+}
+
+// -------------------------------------------------------
+
+int benchStatements(const QStringList &args)
+{
+    QTextStream err(stderr);
+    int rows = args.isEmpty() ? 20000 : args.first().toInt();
+
+    dc::DatabaseController db;
+    QVariantMap connData;
+    connData["name"] = ":memory:";
+    QString error;
+    if (!db.init("QSQLITE", connData, &error)) {
+        err << error << endl;
+        return 2;
+    }
+
+    StatementBench *bench = new StatementBench(&db);
+    db.registerHandler("bench", bench, "run");
+
+    BenchReceiver receiver;
+    QEventLoop loop;
+    QObject::connect(&receiver, SIGNAL(finished()), &loop, SLOT(quit()));
+    db.postRequest("bench", rows, dc::NormalPriority, &receiver, "done");
+    loop.exec();
+
+    foreach (const QVariant &r, receiver.result.toList()) {
+        QVariantMap v = r.toMap();
+        if (v.contains("name"))
+            benchReport(v.value("name").toString(), v.value("ops").toLongLong(), v.value("nsecs").toLongLong());
+    }
+
+    db.unregisterHandler(bench);
+    db.done();
+    delete bench;
+    return receiver.result.toList().size() > 1 ? 0 : 2;
+}
+
+// -------------------------------------------------------
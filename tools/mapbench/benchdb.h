@@ -0,0 +1,46 @@
+#ifndef BENCHDB_H
+#define BENCHDB_H
+
+#include <QObject>
+#include <QVariant>
+
+namespace dc {
+class DatabaseController;
+}
+
+// -------------------------------------------------------
+
+// замеры в потоке бд (обработчик DatabaseController)
+class StatementBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StatementBench(dc::DatabaseController *db);
+
+private slots:
+    // params - количество строк таблицы, result - список замеров (name, ops, nsecs)
+    void run(QVariant params, QVariant &result, QVariant &errors);
+
+private:
+    dc::DatabaseController *db;
+};
+
+// -------------------------------------------------------
+
+// ожидание ответа бд
+class BenchReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    QVariant result;
+
+signals:
+    void finished();
+
+private slots:
+    void done(uint query, QVariant result, QVariant errors);
+};
+
+// -------------------------------------------------------
+
+#endif // BENCHDB_H
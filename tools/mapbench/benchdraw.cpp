@@ -0,0 +1,114 @@
+#include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QSvgRenderer>
+#include <QTextStream>
+
+#include <map/object/mapobject.h>
+#include <map/coord/mapcamera.h>
+#include <map/drawer/mapdrawerline.h>
+#include <map/drawer/mapdrawercommon.h>
+
+#include "bench.h"
+
+using namespace minigis;
+
+// -------------------------------------------------------
+
+namespace {
+
+const QSize Screen(1920, 1080);
+const qreal View = 10000; // сторона области с линиями (м), целиком на экране
+
+// кадр: все объекты в порядке списка, как MapLayerObjects
+qint64 frame(const QList<MapObject *> &objects, const MapCamera &camera, QImage &image)
+{
+    QElapsedTimer t;
+    t.start();
+    image.fill(Qt::white);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    QRectF rgn(QPointF(), Screen);
+    foreach (MapObject *mo, objects)
+        mo->drawer()->paint(mo, &painter, rgn, &camera);
+    painter.end();
+    return t.nsecsElapsed();
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+int benchArrows(const QStringList &args)
+{
+    int n = args.value(0, "10000").toInt();
+    int frames = args.value(1, "10").toInt();
+    QTextStream out(stdout);
+
+    QList<uint> types = ArrowType::keys();
+    if (types.isEmpty()) {
+        out << "no arrow types" << endl;
+        return 2;
+    }
+
+    MapCamera camera;
+    camera.setScreenSize(Screen);
+    camera.setScale(qMin(Screen.width(), Screen.height()) / (View * 1.2));
+    camera.moveTo(QPointF(View / 2, View / 2));
+
+    // линии в области экрана, несколько цветов и все типы окончаний
+    qsrand(5);
+    QList<MapObject *> objects;
+    for (int i = 0; i < n; ++i) {
+        MapObject *mo = new MapObject;
+        mo->setClassCode("{00000000-0001-409d-9621-f4899f6a4c6e}");
+        QPointF p(qrand() * View / RAND_MAX, qrand() * View / RAND_MAX);
+        mo->setMetric(Metric(MetricItem() << p << p + QPointF(qrand() % 400 - 200, qrand() % 400 - 200), Mercator));
+        mo->setAttribute(attrPenColor, QColor(Qt::GlobalColor(Qt::black + i % 8)));
+        mo->setAttribute(attrStartArrow, types.at(i % types.size()));
+        mo->setAttribute(attrEndArrow, types.at((i / types.size()) % types.size()));
+        objects.append(mo);
+    }
+
+    QImage image(Screen, QImage::Format_ARGB32_Premultiplied);
+
+    // первый кадр разбирает svg всех сочетаний (тип, цвет), следующие берут стрелки из кэша
+    {
+        MapDrawerLine drawer;
+        foreach (MapObject *mo, objects)
+            mo->setDrawer(&drawer);
+
+        benchReport("frame: cold cache", 1, frame(objects, camera, image));
+        qint64 nsecs = 0;
+        for (int i = 0; i < frames; ++i)
+            nsecs += frame(objects, camera, image);
+        benchReport("frame: cached arrows", frames, nsecs);
+    }
+
+    // прежняя отрисовка: разбор шаблона svg на каждую стрелку каждого кадра (только стрелки)
+    QElapsedTimer t;
+    t.start();
+    QPainter painter(&image);
+    int arrows = 0;
+    foreach (MapObject *mo, objects) {
+        for (int end = 0; end < 2; ++end) {
+            uint type = mo->attribute(end ? attrEndArrow : attrStartArrow).toUInt();
+            QByteArray copy = ArrowType::templateSVG();
+            copy.replace("%color%", mo->attribute(attrPenColor).value<QColor>().name().toUtf8());
+            copy.replace("%metric%", ArrowType::metric(type));
+            copy.replace("%width%", "0");
+            QSvgRenderer svg(copy);
+            QPointF p = camera.toScreen(mo->metric().toMercator().first().at(end));
+            svg.render(&painter, "object", QRectF(p, QSizeF(10, 10)));
+            ++arrows;
+        }
+    }
+    painter.end();
+    benchReport("arrows: svg per paint", arrows, t.nsecsElapsed());
+
+    qDeleteAll(objects);
+    return 0;
+}
+
+// -------------------------------------------------------
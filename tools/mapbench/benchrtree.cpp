@@ -0,0 +1,341 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QTransform>
+#include <QVector>
+#include <QtMath>
+
+#include <map/object/mapobject.h>
+#include <map/drawer/mapdrawerline.h>
+#include <map/layers/maprtree.h>
+#include <map/layers/maprtreekernel.h>
+
+#include "bench.h"
+
+using namespace minigis;
+
+// -------------------------------------------------------
+
+namespace {
+
+const char *LineClass = "{00000000-0001-409d-9621-f4899f6a4c6e}"; // "Перо", открытая линия
+const qreal Side = 2e6;        // сторона области с объектами (Меркатор, м)
+const qreal LineLength = 500;  // длина отрезка (м)
+const qreal Window = 10000;    // сторона окна поиска (м)
+
+inline qreal randomValue(qreal max)
+{
+    return qrand() * max / RAND_MAX;
+}
+
+QRectF randomWindow(qreal size)
+{
+    return QRectF(randomValue(Side - size), randomValue(Side - size), size, size);
+}
+
+// отрезок с началом в точке p
+Metric segment(const QPointF &p)
+{
+    qreal a = randomValue(2 * M_PI);
+    return Metric(MetricItem() << p << p + QPointF(qCos(a), qSin(a)) * LineLength, Mercator);
+}
+
+// проверка границ элементов узлов без векторных инструкций (та же проверка, что у скалярной реализации)
+int overlapReference(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                     qreal l, qreal t, qreal r, qreal b, int *result)
+{
+    int found = 0;
+    for (int i = 0; i < n; ++i)
+        if (minx[i] <= r && maxx[i] >= l && miny[i] <= b && maxy[i] >= t)
+            result[found++] = i;
+    return found;
+}
+
+int chooseReference(const qreal *minx, const qreal *miny, const qreal *maxx, const qreal *maxy, int n,
+                    qreal l, qreal t, qreal r, qreal b)
+{
+    int best = 0;
+    qreal bestValue = 0;
+    for (int i = 0; i < n; ++i) {
+        qreal w = qMax(maxx[i], r) - qMin(minx[i], l);
+        qreal h = qMax(maxy[i], b) - qMin(miny[i], t);
+        qreal v = w * h - (maxx[i] - minx[i]) * (maxy[i] - miny[i]);
+        if (!i || v < bestValue) {
+            best = i;
+            bestValue = v;
+        }
+        if (bestValue <= 0)
+            break;
+    }
+    return best;
+}
+
+// запросы окнами к дереву, возвращает количество найденных объектов
+qint64 queryWindows(const MapRTree &tree, const QVector<QRectF> &windows, const QString &name)
+{
+    qint64 found = 0;
+    QElapsedTimer t;
+    t.start();
+    foreach (const QRectF &r, windows)
+        found += tree.find(r).size();
+    benchReport(name, windows.size(), t.nsecsElapsed());
+    return found;
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+QList<MapObject *> benchLines(int n, MapDrawer *drawer)
+{
+    QList<MapObject *> objects;
+    objects.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        MapObject *mo = new MapObject;
+        mo->setClassCode(LineClass);
+        mo->setDrawer(drawer);
+        mo->setMetric(segment(QPointF(randomValue(Side), randomValue(Side))));
+        objects.append(mo);
+    }
+    return objects;
+}
+
+// -------------------------------------------------------
+
+int benchRTreeBuild(const QStringList &args)
+{
+    int n = args.value(0, "200000").toInt();
+    int queries = args.value(1, "10000").toInt();
+    QTextStream out(stdout);
+
+    qsrand(1);
+    MapDrawerLine drawer;
+    QList<MapObject *> objects = benchLines(n, &drawer);
+
+    // вставка по одному (chooseLeaf/splitNode) и пакетное построение (STR)
+    MapRTree incremental;
+    QElapsedTimer t;
+    t.start();
+    foreach (MapObject *mo, objects)
+        incremental.insert(mo);
+    benchReport("build: incremental", n, t.nsecsElapsed());
+
+    MapRTree bulk;
+    t.start();
+    bulk.build(objects);
+    benchReport("build: STR", n, t.nsecsElapsed());
+
+    // перекрытие узлов и заполнение листьев (qDebug)
+    out << "incremental:" << endl;
+    incremental.numFeature();
+    out << "STR:" << endl;
+    bulk.numFeature();
+
+    QVector<QRectF> windows;
+    QVector<QRectF> points;
+    for (int i = 0; i < queries; ++i) {
+        windows.append(randomWindow(Window));
+        points.append(randomWindow(1));
+    }
+
+    qint64 a = queryWindows(incremental, windows, "find window: incremental");
+    qint64 b = queryWindows(bulk, windows, "find window: STR");
+    queryWindows(incremental, points, "find point: incremental");
+    queryWindows(bulk, points, "find point: STR");
+    if (a != b)
+        out << "MISMATCH: incremental " << a << ", STR " << b << endl;
+
+    incremental.clear();
+    bulk.clear();
+    qDeleteAll(objects);
+    return a == b ? 0 : 2;
+}
+
+// -------------------------------------------------------
+
+int benchRTreeQuery(const QStringList &args)
+{
+    int n = args.value(0, "1000000").toInt();
+    int queries = args.value(1, "10000").toInt();
+    QTextStream out(stdout);
+
+    qsrand(2);
+    MapDrawerLine drawer;
+    QList<MapObject *> objects = benchLines(n, &drawer);
+
+    MapRTree tree;
+    QElapsedTimer t;
+    t.start();
+    tree.build(objects);
+    benchReport("build: STR", n, t.nsecsElapsed());
+
+    // окна разного размера: точка, окно экрана крупного и мелкого масштаба
+    qint64 found = 0;
+    for (qreal size = 1; size <= Window * 10; size *= 100) {
+        QVector<QRectF> windows;
+        for (int i = 0; i < queries; ++i)
+            windows.append(randomWindow(size));
+        found += queryWindows(tree, windows, QString("find rect %1 m").arg(size));
+    }
+
+    // тот же поиск многоугольником (повернутое окно)
+    QElapsedTimer tp;
+    tp.start();
+    for (int i = 0; i < queries; ++i) {
+        QRectF r = randomWindow(Window);
+        QPolygonF p = QTransform().translate(r.center().x(), r.center().y()).rotate(30)
+                .translate(-r.center().x(), -r.center().y()).map(QPolygonF(r));
+        found += tree.find(p).size();
+    }
+    benchReport(QString("find polygon %1 m").arg(Window), queries, tp.nsecsElapsed());
+
+    tp.start();
+    for (int i = 0; i < queries; ++i)
+        found += tree.nearest(randomWindow(0).topLeft(), 10).size();
+    benchReport("nearest k=10", queries, tp.nsecsElapsed());
+
+    out << "found: " << found << endl;
+    tree.clear();
+    qDeleteAll(objects);
+    return 0;
+}
+
+// -------------------------------------------------------
+
+int benchRTreeKernel(const QStringList &args)
+{
+    static const int Cap = 26;
+    int nodes = args.value(0, "100000").toInt();
+    int rounds = args.value(1, "20").toInt();
+    QTextStream out(stdout);
+
+    // блоки элементов узлов, как в хранилище дерева
+    qsrand(3);
+    QVector<qreal> minx(nodes * Cap), miny(nodes * Cap), maxx(nodes * Cap), maxy(nodes * Cap);
+    for (int i = 0; i < nodes * Cap; ++i) {
+        QRectF r = randomWindow(Window);
+        minx[i] = r.left();
+        miny[i] = r.top();
+        maxx[i] = r.right();
+        maxy[i] = r.bottom();
+    }
+    QVector<QRectF> windows;
+    for (int i = 0; i < rounds; ++i)
+        windows.append(randomWindow(Window * 20));
+
+    const qreal *x0 = minx.constData();
+    const qreal *y0 = miny.constData();
+    const qreal *x1 = maxx.constData();
+    const qreal *y1 = maxy.constData();
+
+    out << "kernel: " << boxKernelName() << endl;
+    int result[Cap];
+    qint64 ops = qint64(nodes) * rounds;
+    qint64 found[2] = { 0, 0 };
+    QElapsedTimer t;
+
+    t.start();
+    foreach (const QRectF &w, windows)
+        for (int node = 0; node < nodes; ++node) {
+            int s = node * Cap;
+            found[0] += overlapReference(x0 + s, y0 + s, x1 + s, y1 + s, Cap,
+                                         w.left(), w.top(), w.right(), w.bottom(), result);
+        }
+    benchReport("overlap: scalar", ops, t.nsecsElapsed());
+
+    t.start();
+    foreach (const QRectF &w, windows)
+        for (int node = 0; node < nodes; ++node) {
+            int s = node * Cap;
+            found[1] += boxOverlap(x0 + s, y0 + s, x1 + s, y1 + s, Cap,
+                                   w.left(), w.top(), w.right(), w.bottom(), result);
+        }
+    benchReport(QString("overlap: %1").arg(boxKernelName()), ops, t.nsecsElapsed());
+
+    qint64 chosen[2] = { 0, 0 };
+    t.start();
+    foreach (const QRectF &w, windows)
+        for (int node = 0; node < nodes; ++node) {
+            int s = node * Cap;
+            chosen[0] += chooseReference(x0 + s, y0 + s, x1 + s, y1 + s, Cap,
+                                         w.left(), w.top(), w.right(), w.bottom());
+        }
+    benchReport("choose: scalar", ops, t.nsecsElapsed());
+
+    t.start();
+    foreach (const QRectF &w, windows)
+        for (int node = 0; node < nodes; ++node) {
+            int s = node * Cap;
+            chosen[1] += boxChoose(x0 + s, y0 + s, x1 + s, y1 + s, Cap,
+                                   w.left(), w.top(), w.right(), w.bottom());
+        }
+    benchReport(QString("choose: %1").arg(boxKernelName()), ops, t.nsecsElapsed());
+
+    if (found[0] != found[1] || chosen[0] != chosen[1]) {
+        out << "MISMATCH: overlap " << found[0] << "/" << found[1]
+            << ", choose " << chosen[0] << "/" << chosen[1] << endl;
+        return 2;
+    }
+    return 0;
+}
+
+// -------------------------------------------------------
+
+int benchRTreeMoves(const QStringList &args)
+{
+    int n = args.value(0, "500000").toInt();
+    int moves = args.value(1, "10000").toInt();
+    int batch = args.value(2, "100").toInt(); // перемещений между возвратами в цикл событий
+    QTextStream out(stdout);
+
+    qsrand(4);
+    MapDrawerLine drawer;
+    QList<MapObject *> objects = benchLines(n, &drawer);
+
+    MapRTree tree;
+    tree.build(objects);
+
+    // смещения как у треков телеметрии: десятки метров, изредка - прыжок через область
+    QVector<int> index(moves);
+    QVector<QPointF> shift(moves);
+    for (int i = 0; i < moves; ++i) {
+        index[i] = qrand() % n;
+        shift[i] = (i % 50) ? QPointF(randomValue(100) - 50, randomValue(100) - 50)
+                            : QPointF(randomValue(Side) - Side / 2, randomValue(Side) - Side / 2);
+    }
+
+    for (int concurrent = 0; concurrent < 2; ++concurrent) {
+        tree.setConcurrent(concurrent);
+        QCoreApplication::processEvents();
+
+        qint64 metric = 0;
+        QElapsedTimer t;
+        QElapsedTimer total;
+        total.start();
+        for (int i = 0; i < moves; ++i) {
+            MapObject *mo = objects.at(index.at(i));
+            t.start();
+            MetricItem line = mo->metric().toMercator().first().translated(shift.at(i));
+            mo->setMetric(Metric(line, Mercator));
+            metric += t.nsecsElapsed();
+
+            tree.movedObj(mo);
+            // публикация снимка при возврате в цикл событий
+            if (concurrent && (i + 1) % batch == 0)
+                QCoreApplication::processEvents();
+        }
+        qint64 nsecs = total.nsecsElapsed();
+        QString mode = concurrent ? "moves: concurrent" : "moves";
+        benchReport(mode, moves, nsecs - metric);
+        benchReport(mode + " + metric", moves, nsecs);
+        out << qSetFieldWidth(32) << left << mode << qSetFieldWidth(0)
+            << QString::number(moves * 1e9 / qMax<qint64>(1, nsecs), 'f', 0) << " moves/s" << endl;
+    }
+
+    int count = tree.count();
+    tree.clear();
+    qDeleteAll(objects);
+    return count == n ? 0 : 2;
+}
+
+// -------------------------------------------------------
@@ -0,0 +1,167 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+
+#include <common/Runtime.h>
+#include <map/coord/mapcamera.h>
+#include <map/layers/maplayertile.h>
+#include <map/layers/maplayertile_p.h>
+
+#include "bench.h"
+
+using namespace minigis;
+
+// -------------------------------------------------------
+
+namespace {
+
+const QSize Screen(1920, 1080);
+const int TileType = 1;
+const int TileZoom = 4;    // 16 x 16 = 256 тайлов, все в области видимости
+
+// слой подложки с доступом к приватной части: ответы бд подаются в нее напрямую
+class BenchTileLayer : public MapLayerTile
+{
+public:
+    MapLayerTilePrivate *priv() const { return static_cast<MapLayerTilePrivate *>(d_ptr); }
+};
+
+// строки ответа selTilesBatch: png 256x256 с шумом (декодирование не вырождается)
+dc::QueryResult encodedRows(int n)
+{
+    dc::QueryResult rows;
+    QImage img(256, 256, QImage::Format_RGB32);
+    int side = 1 << TileZoom;
+    for (int i = 0; i < n; ++i) {
+        for (int y = 0; y < img.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+            for (int x = 0; x < img.width(); ++x)
+                line[x] = qRgb(x + i, y, qrand() & 0x3f);
+        }
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        img.save(&buffer, "PNG");
+
+        QVariantMap row;
+        row["x"] = i % side;
+        row["y"] = (i / side) % side;
+        row["z"] = TileZoom;
+        row["type"] = TileType;
+        row["tile"] = png;
+        row["expires"] = 0;
+        row["shift"] = 0;
+        row["id"] = QString::number(i);
+        rows.append(row);
+    }
+    return rows;
+}
+
+// кадр слоя: экран, заполненный тайлами
+void frame(QImage &screen, const QImage &tile)
+{
+    QPainter painter(&screen);
+    painter.fillRect(screen.rect(), Qt::white);
+    for (int y = 0; y < Screen.height(); y += tile.height())
+        for (int x = 0; x < Screen.width(); x += tile.width())
+            painter.drawImage(x, y, tile);
+}
+
+void frameReport(const QString &name, QVector<qint64> frames, qint64 readyNsecs)
+{
+    QTextStream out(stdout);
+    std::sort(frames.begin(), frames.end());
+    int n = frames.size();
+    out << qSetFieldWidth(32) << left << name << qSetFieldWidth(0)
+        << n << " frames, p50 " << QString::number(frames.value(n / 2) / 1e6, 'f', 2)
+        << " ms, p99 " << QString::number(frames.value(n * 99 / 100) / 1e6, 'f', 2)
+        << " ms, max " << QString::number(n ? frames.last() / 1e6 : 0., 'f', 2)
+        << " ms, tiles ready " << QString::number(readyNsecs / 1e6, 'f', 1) << " ms" << endl;
+}
+
+// ответы бд приходят по одному на кадр, между кадрами - обработка событий слоя;
+// время кадра - от начала кадра до начала следующего (включая работу слоя в цикле событий)
+int run(const QString &name, const dc::QueryResult &rows, int batch, int tail, bool pool)
+{
+    // камера, как у слоя в кадре: по ней слой считает области перерисовки пришедших тайлов
+    MapCamera camera;
+    camera.setScreenSize(Screen);
+
+    BenchTileLayer layer;
+    MapLayerTilePrivate *d = layer.priv();
+    d->camera = &camera;
+    d->types << TileType;
+    d->zoom = TileZoom;
+    d->visionTileRect = QRect(0, 0, 1 << TileZoom, 1 << TileZoom);
+
+    int ready = 0;
+    QObject::connect(d, &MapLayerTilePrivate::tileIncome, [&ready]() { ++ready; });
+
+    QImage screen(Screen, QImage::Format_ARGB32_Premultiplied);
+    QImage tile(256, 256, QImage::Format_ARGB32_Premultiplied);
+    tile.fill(Qt::darkGreen);
+
+    QVector<qint64> frames;
+    QElapsedTimer total;
+    QElapsedTimer t;
+    qint64 readyNsecs = 0;
+    uint query = 0;
+    int next = 0;
+    total.start();
+    t.start();
+    while ((ready < rows.size() || tail-- > 0) && total.elapsed() < 60000) {
+        if (next < rows.size()) {
+            dc::QueryResult part = rows.mid(next, batch);
+            next += batch;
+            ++query;
+            if (pool)
+                QMetaObject::invokeMethod(d, "onDb_TileIncome", Qt::DirectConnection, Q_ARG(uint, query),
+                                          Q_ARG(QVariant, QVariant::fromValue<dc::QueryResult>(part)), Q_ARG(QVariant, QVariant()));
+            else
+                // прежний путь: декодирование в потоке слоя внутри onDb_TileIncome
+                d->tilesDecoded(query, MapLayerTilePrivate::decodeTiles(part));
+        }
+        QCoreApplication::processEvents();
+        frame(screen, tile);
+        frames.append(t.nsecsElapsed());
+        t.restart();
+        if (ready >= rows.size() && !readyNsecs)
+            readyNsecs = total.nsecsElapsed();
+    }
+
+    frameReport(name, frames, readyNsecs);
+    if (ready < rows.size()) {
+        QTextStream(stdout) << name << ": " << ready << " of " << rows.size() << " tiles decoded" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+// -------------------------------------------------------
+
+int benchTileDecode(const QStringList &args)
+{
+    int n = args.value(0, "256").toInt();
+    int batch = qMax(1, args.value(1, "32").toInt());
+    int tail = args.value(2, "30").toInt();
+
+    // слой открывает бд подложки в каталоге share
+    Runtime::mkPath(Runtime::getSharePath());
+
+    qsrand(5);
+    dc::QueryResult rows = encodedRows(n);
+
+    int res = run("tile-decode: sync", rows, batch, tail, false);
+    res |= run("tile-decode: pool", rows, batch, tail, true);
+    return res;
+}
+
+// -------------------------------------------------------
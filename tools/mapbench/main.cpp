@@ -0,0 +1,66 @@
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QScopedPointer>
+#include <QStringList>
+#include <QTextStream>
+
+#include "bench.h"
+
+// замеры производительности
+// mapbench <сценарий> [параметры]
+
+// -------------------------------------------------------
+
+typedef int (*BenchFunc)(const QStringList &);
+
+struct BenchScenario
+{
+    const char *name;
+    BenchFunc func;
+    bool gui;          // нужен QGuiApplication (отрисовка; без экрана - -platform offscreen)
+    const char *help;
+};
+
+static const BenchScenario scenarios[] = {
+    { "statements", benchStatements, false, "[rows] - кэш подготовленных запросов DatabaseController" },
+    { "rtree-build", benchRTreeBuild, false, "[objects] [queries] - вставка по одному и STR: перекрытие узлов, поиск" },
+    { "rtree-query", benchRTreeQuery, false, "[objects] [queries] - поиск окном, многоугольником и ближайших на 1M объектов" },
+    { "rtree-kernel", benchRTreeKernel, false, "[nodes] [rounds] - проверка границ узлов: скалярная и векторная" },
+    { "rtree-moves", benchRTreeMoves, false, "[objects] [moves] [batch] - перемещения объектов в дереве на 500k объектов" },
+    { "arrows", benchArrows, true, "[lines] [frames] - время кадра с линиями со стрелками" },
+    { "tile-decode", benchTileDecode, true, "[tiles] [batch] [frames] - разброс времени кадра при поступлении тайлов из бд: пул и синхронно" },
+};
+
+// -------------------------------------------------------
+
+void benchReport(const QString &name, qint64 ops, qint64 nsecs)
+{
+    QTextStream out(stdout);
+    out << qSetFieldWidth(32) << left << name << qSetFieldWidth(0)
+        << ops << " ops, " << QString::number(nsecs / 1e6, 'f', 1) << " ms, "
+        << QString::number(ops ? nsecs / 1e3 / ops : 0., 'f', 3) << " us/op" << endl;
+}
+
+// -------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    QTextStream err(stderr);
+
+    const BenchScenario *scenario = NULL;
+    for (uint i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+        if (argc > 1 && qstrcmp(argv[1], scenarios[i].name) == 0)
+            scenario = &scenarios[i];
+
+    QScopedPointer<QCoreApplication> app(scenario && scenario->gui ? new QGuiApplication(argc, argv)
+                                                                   : new QCoreApplication(argc, argv));
+    if (scenario)
+        return scenario->func(app->arguments().mid(2));
+
+    err << "usage: mapbench <scenario> [args]" << endl;
+    for (uint i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+        err << "  " << scenarios[i].name << " " << QString::fromUtf8(scenarios[i].help) << endl;
+    return 1;
+}
+
+// -------------------------------------------------------
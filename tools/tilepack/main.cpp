@@ -0,0 +1,42 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include <map/loaders/maptilepack.h>
+
+// сборка пакета тайлов (TilePack) из бд тайлов
+// tilepack <tiles.sqlite> <out.pack> <type> [format]
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QStringList args = app.arguments();
+    if (args.size() < 4) {
+        err << "usage: tilepack <tiles.sqlite> <out.pack> <type> [format]" << endl;
+        return 1;
+    }
+
+    bool ok = false;
+    int type = args.at(3).toInt(&ok);
+    if (!ok) {
+        err << "invalid tile type " << args.at(3) << endl;
+        return 1;
+    }
+    QString format = args.size() > 4 ? args.at(4).toUpper() : QString("PNG");
+
+    QString error;
+    if (!minigis::TilePack::exportDatabase(args.at(1), args.at(2), type, format, &error)) {
+        err << error << endl;
+        return 2;
+    }
+
+    minigis::TilePack pack;
+    if (!pack.open(args.at(2), &error)) {
+        err << error << endl;
+        return 2;
+    }
+    QTextStream(stdout) << "tiles: " << pack.count() << endl;
+    return 0;
+}